@@ -1,428 +1,2761 @@
 #include "Assembler.h"
-#include <cctype>
+#include "AssemblerObject.h"
+#include "CharacterClass.h"
+#include "Expression.h"
+#include "IncludeCache.h"
+#include "InstructionEncoder.h"
+#include "Keywords.h"
+#include "NumericLiteral.h"
+#include "SourceScanner.h"
+#include "SymbolTable.h"
+#include "ThreadPool.h"
+#include "TokenStream.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <unordered_set>
+
+// Rough sizes used to preallocate the per-call arena.
+static constexpr size_t ArenaBytesPerSourceByte = 4;
+static constexpr size_t MinArenaSize = 4096;
+
+// How much source is split into lines at a time.
+static constexpr size_t LineChunkSize = 16 * 1024;
+
+static constexpr uint32_t AddressSpaceSize = 0x10000;
+
+// Macros that expand into themselves would otherwise never stop expanding.
+static constexpr uint32_t MaxMacroNestingDepth = 64;
+
+// Registers the optimizer tracks, as bit 1 << Register.
+static constexpr uint16_t AllRegisterBits = 1 << static_cast<uint8_t>(Register::A) | 1 << static_cast<uint8_t>(Register::B) |
+	1 << static_cast<uint8_t>(Register::C) | 1 << static_cast<uint8_t>(Register::D) | 1 << static_cast<uint8_t>(Register::E) |
+	1 << static_cast<uint8_t>(Register::H) | 1 << static_cast<uint8_t>(Register::L);
+
+// Appends the contents of the string literal that starts at operand[i], and moves i past its end.
+// NOTE: the tokenizer already made sure every string literal is terminated.
+template<typename String>
+static bool AppendStringLiteral(std::string_view operand, size_t& i, String& string)
+{
+	for (i++; operand[i] != '"'; i++)
+	{
+		char c = operand[i];
+		if (c == '\\')
+		{
+			int16_t escaped = GetEscapedCharacter(operand[++i]);
+			if (escaped < 0)
+				return false;
+			c = static_cast<char>(escaped);
+		}
+		string.push_back(c);
+	}
+	i++;
+	return true;
+}
+
+// Decodes an operand made of nothing but string literals.
+static bool DecodeStringLiterals(std::string_view operand, std::string& string)
+{
+	for (size_t i = 0; i < operand.size();)
+	{
+		if (IsBlank(operand[i]))
+			i++;
+		else if (operand[i] != '"' || !AppendStringLiteral(operand, i, string))
+			return false;
+	}
+	return true;
+}
+
+// Gets the directive that a line or its first token starts with.
+static Directive GetDirective(std::string_view line)
+{
+	if (line.empty() || line.front() != '.')
+		return Directive::None;
+
+	size_t end = 1;
+	while (end < line.size() && IsIdentifierContinue(line[end]))
+		end++;
+	return DirectiveTable.Find(line.substr(1, end - 1));
+}
 
-constexpr bool IsLineEnding(char c) noexcept
+static bool IsConditionalDirective(Directive directive)
 {
-	return c == '\n' || c == '\r';
+	return directive == Directive::If || directive == Directive::Elif || directive == Directive::Else || directive == Directive::EndIf;
 }
 
-constexpr bool IsBinaryDigit(char c) noexcept
+// Skips the raw lines of an inactive branch, without splitting or tokenizing them, up to the next line that starts
+// with a conditional directive. offset must be after the content of the last line that was assembled.
+static size_t SkipInactiveLines(std::string_view source, size_t offset, size_t& lineNumber)
 {
-	return c == '0' || c == '1';
+	// Both .elif and .else start with .el.
+	static constexpr std::string_view ConditionalPrefixes[] = { ".if", ".el", ".endif" };
+	while ((offset = SourceScanner::FindLine(source, offset, ConditionalPrefixes, lineNumber)) < source.size())
+	{
+		// Other directives may start with the same prefixes.
+		size_t lineEnd = std::min(source.find_first_of("\r\n", offset), source.size());
+		if (IsConditionalDirective(GetDirective(source.substr(offset, lineEnd - offset))))
+			break;
+		offset = lineEnd;
+	}
+	return offset;
 }
 
-constexpr bool IsDecimalDigit(char c) noexcept
+// Private and protected labels are keyed by their name and the file they're defined in, see InsertScopedLabel().
+static std::string_view GetLabelName(std::string_view key)
 {
-	return '0' <= c && c <= '9';
+	return key.substr(0, key.find('\0'));
 }
 
-constexpr bool IsHexadecimalDigit(char c) noexcept
+static std::filesystem::path ResolveIncludePath(const std::filesystem::path& directory, const std::filesystem::path& path)
 {
-	return IsDecimalDigit(c) || ('A' <= c && c <= 'F') || ('a' <= c && c <= 'f');
+	return (path.is_absolute() || directory.empty() ? path : directory / path).lexically_normal();
 }
 
-constexpr bool IsAlpha(char c) noexcept
+// Marks size bytes from address as written, see AssemblerImage::writtenBits. Returns false, and marks nothing,
+// if any of them already is.
+static bool MarkWritten(std::span<uint64_t, AssemblerImage::Size / 64> writtenBits, uint32_t address, size_t size)
 {
-	return ('A' <= c && c <= 'Z') || ('a' <= c && c <= 'z');
+	for (uint32_t i = address; i < address + size; i++)
+		if ((writtenBits[i / 64] >> (i % 64)) & 1)
+			return false;
+
+	for (uint32_t i = address; i < address + size; i++)
+		writtenBits[i / 64] |= uint64_t(1) << (i % 64);
+	return true;
 }
 
-constexpr bool IsAlphanumeric(char c) noexcept
+// Copies bytes to address, and marks them as written. Returns false, and writes nothing, if any of them already is.
+static bool WriteImage(AssemblerImage& image, uint32_t address, std::span<const uint8_t> bytes)
 {
-	return IsDecimalDigit(c) || ('A' <= c && c <= 'Z') || ('a' <= c && c <= 'z');
+	if (!MarkWritten(image.writtenBits, address, bytes.size()))
+		return false;
+	std::copy(bytes.begin(), bytes.end(), image.memory.begin() + address);
+	return true;
 }
 
-struct Assembler::Line : std::string_view
+// Passes allocations through to upstream, and counts them for the phase that made them, see AssemblerStats.
+class AllocationCounter : public std::pmr::memory_resource
 {
-	size_t number = 0;
+public:
+	AllocationCounter(std::pmr::memory_resource* upstream, AssemblerStats& stats)
+		: upstream(upstream), stats(stats) {}
+
+	// Allocations before this is set, like the ones that set up a Context, are preprocessing.
+	void SetPhase(const AssemblerPhase* phase) noexcept { this->phase = phase; }
+private:
+	void* do_allocate(size_t bytes, size_t alignment) override
+	{
+		AssemblerPhase currentPhase = AssemblerPhase_Preprocess;
+		if (phase)
+			currentPhase = *phase;
+		stats.allocatedBytes[currentPhase] += bytes;
+		stats.allocations[currentPhase]++;
+		return upstream->allocate(bytes, alignment);
+	}
+
+	void do_deallocate(void* pointer, size_t bytes, size_t alignment) override
+	{
+		upstream->deallocate(pointer, bytes, alignment);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+		return this == &other;
+	}
+private:
+	std::pmr::memory_resource* upstream;
+	AssemblerStats& stats;
+	const AssemblerPhase* phase = nullptr;
 };
 
-struct Assembler::TokenizedLine : std::vector<std::string_view>
+// Included files, by resolved path.
+using PreloadedFiles = std::unordered_map<std::string, std::shared_ptr<const IncludeCache::Entry>>;
+
+// Loads and tokenizes every file that is reachable through .include directives with constant paths, concurrently.
+// Each file's includes are submitted as soon as it is tokenized, so the whole graph is loaded in parallel.
+struct IncludePreloader
 {
-	size_t number = 0;
+	ThreadPool& threadPool;
+	std::mutex mutex;
+	PreloadedFiles files;
+
+	IncludePreloader(ThreadPool& threadPool)
+		: threadPool(threadPool) {}
+
+	// Only the lines that start with .include are split and tokenized.
+	void Preload(const std::filesystem::path& directory, std::string_view source)
+	{
+		static constexpr std::string_view IncludePrefix[] = { ".include" };
+		std::pmr::vector<SourceLine> lines;
+		TokenStream tokenStream;
+		size_t lineNumber = 1;
+		for (size_t offset = 0; (offset = SourceScanner::FindLine(source, offset, IncludePrefix, lineNumber)) < source.size();)
+		{
+			size_t lineEnd = std::min(source.find_first_of("\r\n", offset), source.size());
+			if (GetDirective(source.substr(offset, lineEnd - offset)) == Directive::Include)
+				SourceScanner::SplitLines(source.substr(offset, lineEnd - offset), lines, lineNumber);
+			offset = lineEnd;
+		}
+
+		for (const SourceLine& line : lines)
+			if (tokenStream.Append(line) != AssemblerReturnCode_Success)
+				tokenStream.lines.pop_back();
+		Preload(directory, tokenStream);
+	}
+
+	void Preload(const std::filesystem::path& directory, const TokenStream& tokenStream)
+	{
+		std::string path;
+		for (const TokenizedLine& line : tokenStream.lines)
+		{
+			std::span<const std::string_view> tokens = tokenStream.GetTokens(line);
+			if (line.isLabel || tokens.front().front() != '.' || DirectiveTable.Find(tokens.front().substr(1)) != Directive::Include)
+				continue;
+
+			for (std::string_view operand : tokens.subspan(1))
+			{
+				// Paths computed from defines are only known while assembling, so those files are loaded then.
+				path.clear();
+				if (!DecodeStringLiterals(operand, path))
+					continue;
+
+				std::filesystem::path resolvedPath = ResolveIncludePath(directory, path);
+				std::string key = resolvedPath.string();
+				{
+					std::scoped_lock lock(mutex);
+					if (!files.try_emplace(key).second)
+						continue;
+				}
+
+				threadPool.Submit([this, key = std::move(key), resolvedPath = std::move(resolvedPath)]()
+				{
+					std::shared_ptr<const IncludeCache::Entry> entry = IncludeCache::Get(resolvedPath);
+					if (!entry)
+						return;
+
+					{
+						std::scoped_lock lock(mutex);
+						files[key] = entry;
+					}
+					Preload(entry->path.parent_path(), entry->tokenStream);
+				});
+			}
+		}
+	}
 };
 
-AssemblerOutput Assembler::Assemble(std::string_view source)
+// Everything that carries over from one line to the next.
+// Lines are assembled in order, and bytes are emitted as soon as their line is assembled.
+// Expressions that reference symbols which aren't defined yet are compiled once into bytecode and
+// recorded as fixups. Each fixup waits on the first undefined symbol it needs, and is re-evaluated
+// as soon as that symbol is defined.
+// Macro bodies are tokenized once, when they are defined, and every invocation splices those tokens
+// with its arguments instead of tokenizing the body again.
+// Lines of inactive conditional branches are skipped by looking at nothing but their directive name, see SkipLine().
+// When assembling an object, labels of the relocatable section are never evaluated, so every operand that
+// uses them stays a fixup, and FinishObject() turns whatever fixups are left into relocations.
+struct Assembler::Context : private Expression::SymbolResolver
 {
-	if (source.empty())
-		return AssemblerReturnCode_EffectivelyEmptySource;
+public:
+	using SectionSink = AssemblerStream::SectionSink;
 
-	enum class LabelVisibility : uint8_t
+	static constexpr uint32_t NoIndex = ~uint32_t(0);
+
+	enum class SymbolKind : uint8_t
 	{
-		// Only accessible in this file. This is the default.
-		Private,
-		// Accessible in any file that includes this file.
-		Protected,
-		// Accessible in any file that includes this file or any file that
-		// includes a file that includes a file ... that includes this file.
-		Public
+		// Referenced, but not defined yet.
+		Undefined,
+		Label,
+		Define,
 	};
 
-	struct Label
+	// A label or a .define. Both share one namespace, except for private and protected labels, which only
+	// share it with the labels that are visible in the same files, see firstScopedLabel.
+	struct Symbol
 	{
-		std::string_view name;
-		size_t lineNumber = 0;
+		SymbolKind kind = SymbolKind::Undefined;
 		LabelVisibility visibility = LabelVisibility::Private;
+		// Whether value is known. Always true for labels, except those of a relocatable section, whose value is their offset.
+		bool isEvaluated = false;
+		// Set while evaluating a define, to catch defines that depend on themselves.
+		bool isEvaluating = false;
+		bool isString = false;
+		size_t lineNumber = 0;
+		// The file it was defined in, see fileParents.
+		uint32_t file = 0;
+		// A label's address, or a define's memoised value.
+		int32_t value = 0;
+		// The bytecode of a define whose value wasn't constant when it was defined, see defineBytecode.
+		uint32_t bytecodeOffset = 0;
+		uint32_t bytecodeSize = 0;
+		// The decoded value of a string define.
+		std::string_view string;
+		// The first fixup waiting on this symbol, see Fixup::nextFixup.
+		uint32_t firstFixup = NoIndex;
+		// Private and protected labels are symbols of their own, see InsertScopedLabel(), listed by the symbol
+		// of their name. Uses of the name resolve to the one that is visible where they're evaluated, if any.
+		uint32_t firstScopedLabel = NoIndex;
+		uint32_t nextScopedLabel = NoIndex;
+		// Only tracked if recordOperands is set, see EmittedOperand.
+		// The first operand that uses this symbol, see OperandUse::nextUse.
+		uint32_t firstUse = NoIndex;
+		// Whether anything other than an EmittedOperand uses this symbol, like .origin, another define,
+		// or an operand that came from a macro or an included file.
+		bool isUsedOutsideOperands = false;
 	};
 
-	std::vector<Label> labels;
-	std::vector<TokenizedLine> tokenizedLines;
+	// An operand that couldn't be evaluated yet when it was emitted.
+	struct Fixup
 	{
-		// Separate source code into lines while ignoring preceding whitespace, traling whitespace, and comments.
-		std::vector<Line> lines;
-		{
-			size_t lastSourceIndex = source.size() - 1;
+		uint32_t sectionIndex = 0;
+		uint32_t offset = 0;
+		uint8_t size = 0;
+		size_t lineNumber = 0;
+		// The operand's bytecode, see fixupBytecode.
+		uint32_t bytecodeOffset = 0;
+		uint32_t bytecodeSize = 0;
+		// The file it was emitted in, which decides which labels it may use.
+		uint32_t file = 0;
+		// The next fixup waiting on the same symbol, or the next free fixup.
+		uint32_t nextFixup = NoIndex;
+	};
 
-			// Get number of characters in line endings.
-			size_t lineEndingCharCount = 1;
-			{
-				size_t i = 0;
-				char c = source.front();
-				// Find the end of the first line.
-				while (!IsLineEnding(c) && i < lastSourceIndex)
-					c = source[++i];
-
-				if (i >= lastSourceIndex)
-					return AssemblerReturnCode_EffectivelyEmptySource;
-
-				// Check if the line ending is CRLF.
-				if (c == '\r' && source[i + 1] == '\n')
-					lineEndingCharCount++;
-			}
+	// A .byte or .word operand, or an instruction, of the source itself, i.e. not of a macro or an included file.
+	// Lets a changed operand, define, or label be re-emitted on its own, without assembling everything again.
+	struct EmittedOperand
+	{
+		uint32_t address = 0;
+		uint32_t size = 0;
+		size_t lineNumber = 0;
+		// Which operand of its line it is.
+		uint32_t operandIndex = 0;
+		// 1 for .byte, 2 for .word, and 0 for an instruction, which is encoded again as a whole.
+		uint8_t operandSize = 0;
+	};
 
-			size_t lineEndingsEncountered = 0;
-			size_t lineBegin = 0;
-			while (true)
-			{
-				// Get first index of a non-whitespace character.
-				size_t i = lineBegin;
-				char c = source[i];
-				while (std::isspace(c) && i < lastSourceIndex)
-				{
-					if (IsLineEnding(c))
-						lineEndingsEncountered++;
-					c = source[++i];
-				}
+	struct OperandUse
+	{
+		uint32_t emittedOperandIndex = 0;
+		// The next use of the same symbol.
+		uint32_t nextUse = NoIndex;
+	};
 
-				// If there's no more source code, stop looking.
-				if (i >= lastSourceIndex)
-					break;
+	struct Section : AssemblerProgramSection
+	{
+		// How many bytes were emitted, which assembly doesn't hold when they're written to an image instead.
+		uint32_t size = 0;
+		uint32_t pendingFixups = 0;
+		bool isClosed = false;
+		bool isFlushed = false;
+		// Only the section before the first .origin of an object is, see AssemblerObject.
+		bool isRelocatable = false;
+	};
 
-				// If the line is not only a comment...
-				if (c != ';')
-				{
-					// Cache the beginning of the line.
-					lineBegin = i;
+	// A macro's body, stored as a template of lines, tokens, and fragments.
+	// The lines of every macro are stored in macroLines, and so on.
+	struct Macro
+	{
+		uint32_t firstParameter = 0;
+		uint32_t parameterCount = 0;
+		uint32_t firstLine = 0;
+		uint32_t lineCount = 0;
+		size_t lineNumber = 0;
+	};
 
-					// Find the end of the line.
-					while (c != ';' && !IsLineEnding(c) && i < lastSourceIndex)
-						c = source[++i];
+	struct MacroLine
+	{
+		uint32_t firstToken = 0;
+		uint32_t tokenCount = 0;
+		// Label definitions are stored as a single token.
+		bool isLabel = false;
+	};
 
-					// Remove trailing whitespace.
-					size_t lineEnd = i;
-					while (lineEnd > lineBegin && std::isblank(source[--lineEnd]));
+	struct MacroToken
+	{
+		uint32_t firstFragment = 0;
+		uint32_t fragmentCount = 0;
+	};
 
-					// Add the line to the list of lines.
-					size_t lineNumber = lineEndingsEncountered / lineEndingCharCount + 1;
-					//if (lineEndingCharCount == 2)
-					//	assert(lineEndingsEncountered % 2 == 0);
-					lines.emplace_back(std::string_view(source.begin() + lineBegin, source.begin() + (lineEnd + 1)), lineNumber);
+	// Either a parameter slot, or text that is copied as is.
+	struct MacroFragment
+	{
+		std::string_view text;
+		uint32_t parameter = NoIndex;
+	};
 
-					if (IsLineEnding(c))
-						lineEndingsEncountered++;
+	// An instruction that waits for the rest of its block before it's emitted, so that the optimizer can see it, see passes.
+	struct PendingInstruction
+	{
+		const InstructionInfo* info = nullptr;
+		// Interned, since the tokens of a macro expansion don't outlive it.
+		std::string_view immediate;
+		size_t lineNumber = 0;
+		uint32_t sourceLineNumber = 0;
+		uint32_t file = 0;
+		// Whether it was written as mvr r, r, which InstructionEncoder turns into nop.
+		bool isSelfMove = false;
+		bool isDeleted = false;
+	};
 
-					// If there's no more source code, stop looking.
-					if (i >= lastSourceIndex)
-						break;
-				}
+	// Charges the time until it's destroyed to a phase, instead of the phase it interrupted, see stats.
+	struct PhaseScope
+	{
+		Context& context;
+		AssemblerPhase outerPhase;
 
-				// Get the first possible beginning of the next line.
-				if (c == ';')
-				{
-					do c = source[++i];
-					while (!IsLineEnding(c) && i < lastSourceIndex);
+		PhaseScope(Context& context, AssemblerPhase phase)
+			: context(context), outerPhase(context.SwitchPhase(phase)) {}
+		~PhaseScope() { context.SwitchPhase(outerPhase); }
+	};
 
-					// If there's no more source code, stop looking.
-					if (i >= lastSourceIndex)
-						break;
+	// An .if block that is being assembled.
+	struct Conditional
+	{
+		// Whether one of its branches was assembled already, in which case every other branch is skipped.
+		bool isBranchTaken = false;
+		bool hasElse = false;
+		size_t lineNumber = 0;
+	};
 
-					lineEndingsEncountered++;
-				}
-				lineBegin = i + 1;
-			}
+	// Holds the text of expanded tokens that mix parameters with other text, like "[$a]".
+	// Blocks never move their text, so views of it stay valid while invocations nest, and they are
+	// reused after each invocation instead of being freed.
+	struct ExpansionText
+	{
+		static constexpr size_t BlockSize = 4096;
 
-			if (lines.empty())
-				return AssemblerReturnCode_EffectivelyEmptySource;
-		}
+		std::pmr::vector<std::pmr::string> blocks;
+		size_t blockIndex = 0;
 
-		// Tokenize each line and find all label definitions.
-		for (const Line& line : lines)
+		ExpansionText(std::pmr::memory_resource* resource)
+			: blocks(resource) {}
+
+		char* Allocate(size_t size)
 		{
-			// If the line could be a label definition...
-			if (line.ends_with(':'))
+			while (true)
 			{
-				size_t lastSpace = line.find_last_of(" \t");
-				std::string_view labelName = line.substr(lastSpace + 1, line.size() - (lastSpace + 2));
-				if (!labelName.empty() && IsLabel(labelName))
-				{
-					// Check if the label doesn't yet exist...
-					for (const Label& label : labels)
-						if (label.name == labelName)
-							return { AssemblerReturnCode_DuplicateLabelDefinition, line.number };
-
-					// Get label visibility.
-					LabelVisibility visibility = LabelVisibility::Private;
-					if (lastSpace != std::string_view::npos)
-					{
-						std::string_view labelVisibility = line.substr(0, lastSpace);
-						if (labelVisibility == "public")
-							visibility = LabelVisibility::Public;
-						else if (labelVisibility == "protected")
-							visibility = LabelVisibility::Protected;
-						else if (labelVisibility != "private")
-							return { AssemblerReturnCode_InvalidLabelDefinition, line.number };
-					}
+				if (blockIndex == blocks.size())
+					blocks.emplace_back().reserve(std::max(size, BlockSize));
 
-					// Label definition is valid, so add it to the list of labels.
-					labels.emplace_back(labelName, line.number, visibility);
+				std::pmr::string& block = blocks[blockIndex];
+				if (block.capacity() - block.size() >= size)
+				{
+					size_t offset = block.size();
+					block.append(size, '\0');
+					return block.data() + offset;
 				}
-				else
-					return { AssemblerReturnCode_InvalidLabelDefinition, line.number };
+				blockIndex++;
 			}
-			else // The line could be a directive, an instruction, or a syntax error.
-			{
-				auto& tokenizedLine = tokenizedLines.emplace_back();
-				tokenizedLine.number = line.number;
+		}
 
-				size_t i = 0;
-				char c = line.front();
+		void Reset() noexcept
+		{
+			for (std::pmr::string& block : blocks)
+				block.clear();
+			blockIndex = 0;
+		}
+	};
+public:
+	// If internNames is true, symbol names are copied, so the source they came from doesn't need to stay alive.
+	Context(std::pmr::memory_resource* resource, const std::filesystem::path& sourcePath = {}, SectionSink sectionSink = {}, bool internNames = false)
+		: lines(resource), tokenStream(resource), emittedOperands(resource), symbols(resource), fixups(resource), operandUses(resource), fixupBytecode(resource),
+		defineBytecode(resource), stringBuffer(resource), sections(resource), macros(resource), macroParameters(resource), macroLines(resource),
+		macroTokens(resource), macroFragments(resource), expansionTokens(resource), expansionText(resource), conditionals(resource), pendingInstructions(resource),
+		includeStack(resource), includedFiles(resource), fileParents(1, NoIndex, resource), outputFiles(1, 0, resource),
+		outputFileIndices(resource), nameArena(resource), sectionSink(std::move(sectionSink)), internNames(internNames)
+	{
+		if (!sourcePath.empty())
+		{
+			std::error_code error;
+			this->sourcePath = std::filesystem::weakly_canonical(sourcePath, error);
+		}
+	}
 
-				// Find the end of the first token.
-				while (!std::isspace(c) && ++i < line.size())
-					c = line[i];
+	// Tokenizes line and assembles it, unless it's skipped.
+	AssemblerReturnCode ProcessLine(const SourceLine& line);
+	AssemblerReturnCode ProcessTokenizedLine(const TokenizedLine& line, std::span<const std::string_view> tokens);
+	// Whether line is in an inactive conditional branch, and should be skipped without being tokenized.
+	// Only the directive name at the start of line is looked at, so line may be raw text or a line's first token.
+	// NOTE: lines must be passed in order, since nested .if blocks are counted.
+	bool SkipLine(std::string_view line);
+	bool IsSkipping() const noexcept { return isSkipping; }
+	bool IsRecordingMacro() const noexcept { return recordingMacro != NoIndex; }
+	bool IsMacro(std::string_view name) const noexcept { return macros.Find(name) != SymbolTable<Macro>::InvalidIndex; }
+	uint32_t GetCurrentAddress() const noexcept;
+	AssemblerOutput Finish();
+	// Like Finish(), but moves everything into object, see isObject.
+	AssemblerReturnCode FinishObject(AssemblerObject& object);
+
+	// Lists every label with an address, in order of address.
+	void GetSymbols(std::vector<AssemblerSymbol>& outputSymbols) const;
+
+	// Evaluates a data operand on its own, against the symbols as they are after Finish(), and appends its bytes.
+	// Unless emittedOperandIndex is NoIndex, the symbols it uses are recorded as used by that operand.
+	AssemblerReturnCode EvaluateData(std::string_view operand, uint8_t size, uint32_t emittedOperandIndex, std::vector<uint8_t>& bytes);
+	// Like EvaluateData(), for the tokens of an instruction.
+	AssemblerReturnCode EvaluateInstruction(std::span<const std::string_view> tokens, uint32_t emittedOperandIndex, std::vector<uint8_t>& bytes);
+	// Gives a numeric define of the source itself a new value after Finish(), if nothing but EmittedOperands
+	// use it, and gets its first OperandUse. Returns false if it can't.
+	bool Redefine(std::string_view name, std::string_view operand, size_t lineNumber, uint32_t& firstUse);
+	// Like Redefine(), for the label of the source defined by line, which is removed, or defined at address.
+	bool RemoveLabel(std::string_view line, size_t lineNumber, uint32_t& firstUse);
+	bool AddLabel(std::string_view line, size_t lineNumber, uint32_t address, uint32_t& firstUse);
+	const OperandUse& GetOperandUse(uint32_t useIndex) const noexcept { return operandUses[useIndex]; }
+private:
+	static AssemblerReturnCode ParseLabel(std::string_view line, std::string_view& name, LabelVisibility& visibility);
+	AssemblerReturnCode DefineLabel(std::string_view line);
+	// Defines a label of currentFile at address, unless one that would be visible with it is defined already.
+	// Gets the symbol of its name, and the label itself, which is a symbol of its own unless it's public.
+	AssemblerReturnCode InsertLabel(std::string_view name, LabelVisibility visibility, uint32_t address, uint32_t& symbolIndex, uint32_t& labelIndex);
+	AssemblerReturnCode Define(std::string_view name, std::string_view operand);
+	AssemblerReturnCode ProcessStatement(std::span<const std::string_view> tokens);
+	AssemblerReturnCode EmitInstruction(const InstructionInfo& instruction, std::string_view immediate);
+	// Optimizes the pending instructions, and emits those that are left.
+	AssemblerReturnCode FlushInstructions();
+	void OptimizeInstructions();
+	// Deletes instruction, unless its immediate would fail or can't be evaluated yet, which only emitting it reports.
+	bool DeleteInstruction(PendingInstruction& instruction, AssemblerPass pass);
+	AssemblerReturnCode Include(const std::filesystem::path& path);
+	AssemblerReturnCode ProcessConditional(Directive directive, std::span<const std::string_view> operands);
+
+	AssemblerReturnCode BeginMacro(std::span<const std::string_view> operands);
+	AssemblerReturnCode RecordMacroLine(const TokenizedLine& line, std::span<const std::string_view> tokens);
+	void RecordMacroToken(std::string_view token);
+	AssemblerReturnCode InvokeMacro(uint32_t macroIndex, std::span<const std::string_view> arguments);
+	// The arguments are stored in expansionTokens, since they may be tokens of an enclosing invocation.
+	AssemblerReturnCode ExpandMacro(uint32_t macroIndex, size_t argumentOffset, size_t argumentCount, uint32_t depth);
+	std::string_view ExpandMacroToken(const MacroToken& token, size_t argumentOffset);
+	AssemblerReturnCode EmitData(std::string_view operand, uint8_t size);
+	AssemblerReturnCode EmitValue(int64_t value, uint8_t size);
+	AssemblerReturnCode EmitBytes(std::span<const uint8_t> bytes);
+	void AddOperandUse(uint32_t symbolIndex, uint32_t emittedOperandIndex);
+
+	// Evaluates an operand that must be known right away, like the operand of .origin.
+	AssemblerReturnCode EvaluateOperand(std::string_view operand, int32_t& value);
+
+	// Whether operand is a concatenation of string literals and string defines, e.g. "abc" Name "def".
+	bool IsStringOperand(std::string_view operand) const;
+	AssemblerReturnCode DecodeStringOperand(std::string_view operand, std::pmr::string& string) const;
+
+	// Patches the fixup if its operand can be evaluated, or makes it wait on the symbol it's blocked by.
+	AssemblerReturnCode ResolveFixup(uint32_t fixupIndex);
+	// Retries every fixup that was waiting on symbolIndex, after it was defined.
+	AssemblerReturnCode ResolveFixups(uint32_t symbolIndex);
+	void FreeFixup(uint32_t fixupIndex);
+
+	void OpenSection(uint16_t origin);
+	void CloseSection();
+	void FlushSection(Section& section);
+	Section& GetCurrentSection();
+	uint32_t InsertSymbol(std::string_view name);
+	// Adds a private or protected label defined in file, and lists it by the symbol of its name, symbolIndex.
+	uint32_t InsertScopedLabel(uint32_t symbolIndex, uint32_t file);
+	std::string_view Intern(std::string_view string);
+	// Whether a label's visibility lets file use it.
+	bool IsAccessible(const Symbol& label, uint32_t file) const noexcept;
+	// Whether a private or protected label defined in file would be visible in a file that label is visible in.
+	bool IsVisibleWith(const Symbol& label, LabelVisibility visibility, uint32_t file) const noexcept;
+	// The private or protected label named like symbolIndex that file can use, or else symbolIndex itself.
+	uint32_t FindVisibleLabel(uint32_t symbolIndex, uint32_t file) const noexcept;
+
+	bool Resolve(std::string_view name, int32_t& value, uint32_t& symbolIndex, AssemblerReturnCode& returnCode) override;
+	AssemblerReturnCode Evaluate(uint32_t symbolIndex, int32_t& value, uint32_t& blockingSymbolIndex) override;
+public:
+	// Scratch space for callers that split their source into lines in pieces.
+	std::pmr::vector<SourceLine> lines;
+	TokenStream tokenStream;
+	// The line currently being assembled, or the line an error was found on.
+	size_t lineNumber = 0;
+	// Like lineNumber, but the line in the file it's in, instead of the line of the outermost .include, for the line maps.
+	uint32_t sourceLineNumber = 0;
+	// Files that were loaded ahead of time, see IncludePreloader.
+	PreloadedFiles preloadedFiles;
+	// Whether to record every EmittedOperand, and which symbols each one uses.
+	bool recordOperands = false;
+	std::pmr::vector<EmittedOperand> emittedOperands;
+	// Whether an object is being assembled, in which case the code before the first .origin is relocatable.
+	bool isObject = false;
+	// If not nullptr, every byte is written here instead of to its section, see Assembler::AssembleImage().
+	AssemblerImage* image = nullptr;
+	// Which bytes the sections wrote to when there is no image, since sections may not overlap either way.
+	// The linker places relocatable sections, and checks them itself.
+	std::array<uint64_t, AssemblerImage::Size / 64> writtenBits{};
+	// The optimizer's passes. If any are set, instructions are held back until their block ends, see PendingInstruction.
+	AssemblerPasses passes = 0;
+	// If not nullptr, the time of each phase is added to it, see PhaseScope.
+	AssemblerStats* stats = nullptr;
+	AssemblerPhase currentPhase = AssemblerPhase_Preprocess;
+	std::chrono::steady_clock::time_point phaseStart;
+public:
+	// Charges the time since the last switch to the current phase, and returns it.
+	AssemblerPhase SwitchPhase(AssemblerPhase phase)
+	{
+		AssemblerPhase outerPhase = currentPhase;
+		if (stats)
+		{
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			stats->nanoseconds[currentPhase] += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - phaseStart).count());
+			phaseStart = now;
+		}
+		currentPhase = phase;
+		return outerPhase;
+	}
 
-				tokenizedLine.push_back(line.substr(0, i));
+	// Relative include paths are relative to this directory.
+	std::filesystem::path GetIncludeDirectory() const
+	{
+		return includeStack.empty() ? sourcePath.parent_path() : includeStack.back()->path.parent_path();
+	}
 
-				// Find the rest of the tokens.
-				while (i < line.size())
-				{
-					// Find the start of the current token.
-					do c = line[++i];
-					while (std::isspace(c) && i < line.size());
+	// Adds every file that was included so far, once.
+	void GetDependencies(std::vector<AssemblerDependency>& dependencies) const
+	{
+		std::unordered_set<const IncludeCache::Entry*> addedEntries;
+		for (const std::shared_ptr<const IncludeCache::Entry>& entry : includedFiles)
+			if (addedEntries.insert(entry.get()).second)
+				dependencies.push_back({ entry->path, entry->contentHash });
+	}
+private:
+	SymbolTable<Symbol> symbols;
+	std::pmr::vector<Fixup> fixups;
+	uint32_t freeFixup = NoIndex;
+	uint32_t unresolvedFixups = 0;
+	std::pmr::vector<OperandUse> operandUses;
+	// The operand that symbols being resolved are used by, or NoIndex if they're used by something else.
+	uint32_t emittingOperand = NoIndex;
+	// How many macro invocations are being expanded.
+	uint32_t expandingMacros = 0;
+	// Bytecode of unresolved fixups. Reset whenever every fixup is resolved.
+	std::pmr::vector<uint8_t> fixupBytecode;
+	std::pmr::vector<uint8_t> defineBytecode;
+	// Scratch space for decoding strings.
+	std::pmr::string stringBuffer;
+	std::pmr::vector<Section> sections;
+	uint32_t currentSection = NoIndex;
+	SymbolTable<Macro> macros;
+	std::pmr::vector<std::string_view> macroParameters;
+	std::pmr::vector<MacroLine> macroLines;
+	std::pmr::vector<MacroToken> macroTokens;
+	std::pmr::vector<MacroFragment> macroFragments;
+	// The macro whose body is being recorded, if any.
+	uint32_t recordingMacro = NoIndex;
+	// The tokens of every line being expanded, innermost invocation last.
+	std::pmr::vector<std::string_view> expansionTokens;
+	ExpansionText expansionText;
+	// The .if blocks being assembled, innermost last.
+	std::pmr::vector<Conditional> conditionals;
+	// The instructions since the last label or directive, in order, while optimizing.
+	std::pmr::vector<PendingInstruction> pendingInstructions;
+	std::array<AssemblerPassStats, AssemblerPass_Count> passStats{};
+	// The first conditional of the file or macro invocation being assembled, which may not end any before it.
+	uint32_t firstConditional = 0;
+	// Whether lines are skipped until the next branch of the innermost conditional.
+	bool isSkipping = false;
+	// How many .if blocks are open inside of the lines being skipped.
+	uint32_t skippedDepth = 0;
+	std::filesystem::path sourcePath;
+	// The files being included, innermost last.
+	std::pmr::vector<const IncludeCache::Entry*> includeStack;
+	// Every file included so far, which symbol names may refer to.
+	std::pmr::vector<std::shared_ptr<const IncludeCache::Entry>> includedFiles;
+	// The file that included each file. Every .include is a new file, and the source being assembled is file 0.
+	std::pmr::vector<uint32_t> fileParents;
+	// Files that were included more than once are one file in AssemblerOutput::files. The index of each file of
+	// fileParents in it, and the index of each entry that was included in it.
+	std::pmr::vector<uint32_t> outputFiles;
+	std::pmr::unordered_map<const IncludeCache::Entry*, uint32_t> outputFileIndices;
+	uint32_t currentFile = 0;
+	// The file whose expression is being evaluated.
+	uint32_t evaluatingFile = 0;
+	std::pmr::monotonic_buffer_resource nameArena;
+	SectionSink sectionSink;
+	bool internNames = false;
+};
 
-					size_t operandStart = i;
+AssemblerReturnCode Assembler::Context::ProcessLine(const SourceLine& line)
+{
+	lineNumber = line.number;
+	if (SkipLine(line))
+		return AssemblerReturnCode_Success;
 
-					// Find the end of the current token, accounting for string literals.
-					bool inQuote = c == '"';
-					bool isEscaped = false;
-					while ((inQuote || c != ',') && ++i < line.size())
-					{
-						char oldC = c;
-						c = line[i];
-
-						if (inQuote)
-						{
-							if (c == '"' && !isEscaped)
-								inQuote = false;
-							else
-								isEscaped = c == '\\' && !isEscaped;
-						}
-						else if (c == '"')
-							inQuote = true;
-					}
+	{
+		PhaseScope phaseScope(*this, AssemblerPhase_Tokenize);
+		if (AssemblerReturnCode returnCode = tokenStream.Append(line); returnCode != AssemblerReturnCode_Success)
+			return returnCode;
+	}
+
+	const TokenizedLine& tokenizedLine = tokenStream.lines.back();
+	return ProcessTokenizedLine(tokenizedLine, tokenStream.GetTokens(tokenizedLine));
+}
 
-					if (inQuote || isEscaped)
-						return { AssemblerReturnCode_InvalidStringLiteral, line.number };
+AssemblerReturnCode Assembler::Context::ProcessTokenizedLine(const TokenizedLine& line, std::span<const std::string_view> tokens)
+{
+	sourceLineNumber = static_cast<uint32_t>(line.number);
+	if (recordingMacro != NoIndex)
+		return RecordMacroLine(line, tokens);
+	if (SkipLine(tokens.front()))
+		return AssemblerReturnCode_Success;
 
-					//// Find the end of the current token.
-					//while (c != ',' && ++i < line.size())
-					//	c = line[i];
+	if (line.isLabel)
+		return DefineLabel(tokens.front());
 
-					size_t operandLength = i - operandStart;
-					if (operandLength == 0)
-						return { AssemblerReturnCode_InvalidOperand, line.number };
+	// The line could be a directive, an instruction, a macro invocation, or a syntax error.
+	if (tokens.front().front() != '.')
+		if (uint32_t macroIndex = macros.Find(tokens.front()); macroIndex != SymbolTable<Macro>::InvalidIndex)
+			return InvokeMacro(macroIndex, tokens.subspan(1));
 
-					tokenizedLine.push_back(line.substr(operandStart, operandLength));
-				}
-			}
-		}
+	return ProcessStatement(tokens);
+}
+
+bool Assembler::Context::SkipLine(std::string_view line)
+{
+	if (!isSkipping)
+		return false;
+
+	// Only branches of the innermost conditional end the skipped lines; nested blocks are skipped whole.
+	switch (GetDirective(line))
+	{
+		case Directive::If:
+			skippedDepth++;
+			return true;
+		case Directive::Elif:
+		case Directive::Else:
+			return skippedDepth != 0;
+		case Directive::EndIf:
+			if (skippedDepth == 0)
+				return false;
+			skippedDepth--;
+			return true;
+		default:
+			return true;
 	}
+}
 
-	std::vector<AssemblerProgramSection> sections;
+AssemblerReturnCode Assembler::Context::ParseLabel(std::string_view line, std::string_view& name, LabelVisibility& visibility)
+{
+	size_t lastSpace = line.size() - 1;
+	while (lastSpace != std::string_view::npos && !IsBlank(line[lastSpace]))
+		lastSpace--;
+
+	name = line.substr(lastSpace + 1, line.size() - (lastSpace + 2));
+	if (name.empty() || !IsLabel(name))
+		return AssemblerReturnCode_InvalidLabelDefinition;
 
-	// Preprocess
-	for (const TokenizedLine& tokenizedLine : tokenizedLines)
+	// Get label visibility.
+	visibility = LabelVisibility::Private;
+	if (lastSpace != std::string_view::npos)
 	{
-		std::string_view token0 = tokenizedLine.front();
-		if (token0.front() == '.')
-		{
-			// directives: include, byte, word, macro, endmacro, define, if, elif, else, endif, origin
-			std::string_view directive = token0.substr(1, token0.size() - 1);
-			if (directive == "include")
-			{
+		std::string_view labelVisibility = line.substr(0, lastSpace);
+		if (labelVisibility == "public")
+			visibility = LabelVisibility::Public;
+		else if (labelVisibility == "protected")
+			visibility = LabelVisibility::Protected;
+		else if (labelVisibility != "private")
+			return AssemblerReturnCode_InvalidLabelDefinition;
+	}
+	return AssemblerReturnCode_Success;
+}
 
-			}
-			else if (directive == "byte")
-			{
+AssemblerReturnCode Assembler::Context::DefineLabel(std::string_view line)
+{
+	// Code may jump to a label, so it ends the block the optimizer sees, and its address is only known after.
+	if (AssemblerReturnCode returnCode = FlushInstructions(); returnCode != AssemblerReturnCode_Success)
+		return returnCode;
+
+	std::string_view labelName;
+	LabelVisibility visibility = LabelVisibility::Private;
+	if (AssemblerReturnCode returnCode = ParseLabel(line, labelName, visibility); returnCode != AssemblerReturnCode_Success)
+		return returnCode;
+
+	uint32_t symbolIndex = NoIndex;
+	uint32_t labelIndex = NoIndex;
+	if (AssemblerReturnCode returnCode = InsertLabel(labelName, visibility, GetCurrentAddress(), symbolIndex, labelIndex); returnCode != AssemblerReturnCode_Success)
+		return returnCode;
+
+	// The address of a relocatable label is only known once linked, so whatever waits on it keeps waiting.
+	if (isObject && GetCurrentSection().isRelocatable)
+		return AssemblerReturnCode_Success;
+
+	// What waits on a scoped label waits on its name, since it might have resolved to another label.
+	symbols[labelIndex].value.isEvaluated = true;
+	return ResolveFixups(symbolIndex);
+}
 
-			}
-			else if (directive == "word")
-			{
+AssemblerReturnCode Assembler::Context::InsertLabel(std::string_view name, LabelVisibility visibility, uint32_t address, uint32_t& symbolIndex,
+	uint32_t& labelIndex)
+{
+	// Private and protected labels only conflict with the labels visible in the same files.
+	symbolIndex = InsertSymbol(name);
+	const Symbol& symbol = symbols[symbolIndex].value;
+	if (symbol.kind != SymbolKind::Undefined)
+		return AssemblerReturnCode_DuplicateLabelDefinition;
+	for (uint32_t scopedIndex = symbol.firstScopedLabel; scopedIndex != NoIndex; scopedIndex = symbols[scopedIndex].value.nextScopedLabel)
+		if (visibility == LabelVisibility::Public || IsVisibleWith(symbols[scopedIndex].value, visibility, currentFile))
+			return AssemblerReturnCode_DuplicateLabelDefinition;
+
+	if (address >= AddressSpaceSize)
+		return AssemblerReturnCode_AddressOverflow;
+
+	labelIndex = visibility == LabelVisibility::Public ? symbolIndex : InsertScopedLabel(symbolIndex, currentFile);
+	Symbol& label = symbols[labelIndex].value;
+	label.kind = SymbolKind::Label;
+	label.lineNumber = lineNumber;
+	label.file = currentFile;
+	label.visibility = visibility;
+	label.value = static_cast<int32_t>(address);
+	return AssemblerReturnCode_Success;
+}
 
-			}
-			else if (directive == "macro")
-			{
+AssemblerReturnCode Assembler::Context::Define(std::string_view name, std::string_view operand)
+{
+	if (!IsLabel(name))
+		return AssemblerReturnCode_InvalidOperand;
 
-			}
-			else if (directive == "endmacro")
-			{
+	uint32_t symbolIndex = InsertSymbol(name);
+	if (symbols[symbolIndex].value.kind != SymbolKind::Undefined || symbols[symbolIndex].value.firstScopedLabel != NoIndex)
+		return AssemblerReturnCode_DuplicateDefine;
 
-			}
-			else if (directive == "define")
-			{
+	if (IsStringOperand(operand))
+	{
+		stringBuffer.clear();
+		if (AssemblerReturnCode returnCode = DecodeStringOperand(operand, stringBuffer); returnCode != AssemblerReturnCode_Success)
+			return returnCode;
 
-			}
-			else if (directive == "if")
-			{
+		Symbol& define = symbols[symbolIndex].value;
+		define.isString = true;
+		define.string = Intern(stringBuffer);
+	}
+	else
+	{
+		// Compiling may insert symbols, so the define is only looked up again afterwards.
+		uint32_t bytecodeOffset = static_cast<uint32_t>(defineBytecode.size());
+		Expression::CompileResult result = Expression::Compile(operand, *this, defineBytecode);
+		if (result.returnCode != AssemblerReturnCode_Success)
+			return result.returnCode;
+
+		Symbol& define = symbols[symbolIndex].value;
+		define.isEvaluated = result.isConstant;
+		define.value = result.value;
+		define.bytecodeOffset = bytecodeOffset;
+		define.bytecodeSize = static_cast<uint32_t>(defineBytecode.size() - bytecodeOffset);
+	}
 
-			}
-			else if (directive == "elif")
+	Symbol& define = symbols[symbolIndex].value;
+	define.kind = SymbolKind::Define;
+	define.lineNumber = lineNumber;
+	define.file = currentFile;
+	return ResolveFixups(symbolIndex);
+}
+
+AssemblerReturnCode Assembler::Context::ProcessStatement(std::span<const std::string_view> tokens)
+{
+	std::string_view token0 = tokens.front();
+	std::span<const std::string_view> operands = tokens.subspan(1);
+	if (token0.front() == '.')
+	{
+		// Directives may emit bytes, move to another section, or include code, so they end the block the optimizer sees.
+		if (AssemblerReturnCode returnCode = FlushInstructions(); returnCode != AssemblerReturnCode_Success)
+			return returnCode;
+
+		std::string_view directiveName = token0.substr(1, token0.size() - 1);
+		switch (DirectiveTable.Find(directiveName))
+		{
+			case Directive::Include:
 			{
+				if (operands.empty())
+					return AssemblerReturnCode_InvalidOperandCount;
 
+				for (std::string_view operand : operands)
+				{
+					if (!IsStringOperand(operand))
+						return AssemblerReturnCode_InvalidOperand;
+
+					stringBuffer.clear();
+					if (AssemblerReturnCode returnCode = DecodeStringOperand(operand, stringBuffer); returnCode != AssemblerReturnCode_Success)
+						return returnCode;
+					if (AssemblerReturnCode returnCode = Include(std::filesystem::path(stringBuffer.begin(), stringBuffer.end())); returnCode != AssemblerReturnCode_Success)
+						return returnCode;
+				}
+				break;
 			}
-			else if (directive == "else")
+			case Directive::Byte:
+			case Directive::Word:
 			{
+				if (operands.empty())
+					return AssemblerReturnCode_InvalidOperandCount;
 
+				PhaseScope phaseScope(*this, AssemblerPhase_Encode);
+				uint8_t size = DirectiveTable.Find(directiveName) == Directive::Byte ? 1 : 2;
+				for (size_t i = 0; i < operands.size(); i++)
+				{
+					// Operands that came from a macro or an included file can't be re-emitted from the source's lines.
+					bool isRecorded = recordOperands && currentFile == 0 && expandingMacros == 0;
+					uint32_t address = GetCurrentAddress();
+					emittingOperand = isRecorded ? static_cast<uint32_t>(emittedOperands.size()) : NoIndex;
+					AssemblerReturnCode returnCode = EmitData(operands[i], size);
+					emittingOperand = NoIndex;
+					if (returnCode != AssemblerReturnCode_Success)
+						return returnCode;
+
+					if (isRecorded)
+						emittedOperands.push_back({ address, GetCurrentAddress() - address, lineNumber, static_cast<uint32_t>(i), size });
+				}
+				break;
 			}
-			else if (directive == "endif")
+			case Directive::Macro:
+				return BeginMacro(operands);
+			case Directive::EndMacro:
+				// Only valid while recording a macro, which RecordMacroLine handles.
+				return AssemblerReturnCode_InvalidMacroDefinition;
+			case Directive::Define:
 			{
-
+				if (operands.size() != 2)
+					return AssemblerReturnCode_InvalidOperandCount;
+				return Define(operands[0], operands[1]);
 			}
-			else if (directive == "origin")
+			case Directive::If:
+			case Directive::Elif:
+			case Directive::Else:
+			case Directive::EndIf:
+				return ProcessConditional(DirectiveTable.Find(directiveName), operands);
+			case Directive::Origin:
 			{
+				if (operands.size() != 1)
+					return AssemblerReturnCode_InvalidOperandCount;
+
+				int32_t origin = 0;
+				if (AssemblerReturnCode returnCode = EvaluateOperand(operands.front(), origin); returnCode != AssemblerReturnCode_Success)
+					return returnCode;
+				if (origin < 0 || origin >= static_cast<int32_t>(AddressSpaceSize))
+					return AssemblerReturnCode_OperandOutOfRange;
 
+				OpenSection(static_cast<uint16_t>(origin));
+				break;
 			}
+			case Directive::None:
+				return AssemblerReturnCode_InvalidDirective;
 		}
+		return AssemblerReturnCode_Success;
 	}
 
-	// Anything that expects an integer requires a constexpr evaluation, i.e. using 23 in
-	// place of "17 + 6". This includes multiple numbers represented in any supported base,
-	// which are binary, decimal, and hexadecimal.
-
-
+	PhaseScope phaseScope(*this, AssemblerPhase_Encode);
+	Mnemonic mnemonic = MnemonicTable.Find(token0);
+	EncodedInstruction instruction;
+	if (AssemblerReturnCode returnCode = InstructionEncoder::Encode(mnemonic, operands, instruction); returnCode != AssemblerReturnCode_Success)
+		return returnCode;
+	if (passes == 0)
+	{
+		// Like data operands, instructions of the source itself are recorded, to be encoded again on their own.
+		bool isRecorded = recordOperands && currentFile == 0 && expandingMacros == 0;
+		uint32_t address = GetCurrentAddress();
+		emittingOperand = isRecorded ? static_cast<uint32_t>(emittedOperands.size()) : NoIndex;
+		AssemblerReturnCode returnCode = EmitInstruction(*instruction.info, instruction.immediate);
+		emittingOperand = NoIndex;
+		if (returnCode == AssemblerReturnCode_Success && isRecorded)
+			emittedOperands.push_back({ address, GetCurrentAddress() - address, lineNumber, 0, 0 });
+		return returnCode;
+	}
 
-	return { AssemblerReturnCode_Success, 0, std::move(sections) };
+	bool isSelfMove = mnemonic == Mnemonic::Mvr && instruction.info->mnemonic == Mnemonic::Nop;
+	pendingInstructions.push_back({ instruction.info, Intern(instruction.immediate), lineNumber, sourceLineNumber, currentFile, isSelfMove });
+	return AssemblerReturnCode_Success;
 }
 
-bool Assembler::IsLabel(std::string_view text)
+AssemblerReturnCode Assembler::Context::EmitInstruction(const InstructionInfo& instruction, std::string_view immediate)
 {
-	// Evaluate this regex: "^[_a-zA-Z][._a-zA-Z0-9]*$"
-
-	// If the first character is not valid, text is not a label.
-	if (!IsAlpha(text.front()) && text.front() != '_')
-		return false;
-
-	// Check the rest of the characters.
-	for (size_t j = 1; j < text.size(); j++)
-		if (char c = text[j]; !IsAlphanumeric(c) && c != '.' && c != '_')
-			return false;
+	if (AssemblerReturnCode returnCode = EmitBytes({ instruction.opcode.data(), instruction.opcodeSize }); returnCode != AssemblerReturnCode_Success)
+		return returnCode;
+
+	// Immediates are integers, so strings aren't allowed, even of a single character.
+	if (instruction.immediateSize == 0)
+		return AssemblerReturnCode_Success;
+	if (IsStringOperand(immediate))
+		return AssemblerReturnCode_InvalidOperand;
+	return EmitData(immediate, instruction.immediateSize);
+}
 
-	return true;
+AssemblerReturnCode Assembler::Context::FlushInstructions()
+{
+	if (pendingInstructions.empty())
+		return AssemblerReturnCode_Success;
+
+	PhaseScope phaseScope(*this, AssemblerPhase_Encode);
+	OptimizeInstructions();
+
+	// Each instruction is emitted as if it were assembled on its own line, in its own file.
+	size_t outerLineNumber = lineNumber;
+	uint32_t outerSourceLineNumber = sourceLineNumber;
+	uint32_t outerFile = currentFile;
+	AssemblerReturnCode returnCode = AssemblerReturnCode_Success;
+	for (const PendingInstruction& instruction : pendingInstructions)
+	{
+		if (instruction.isDeleted)
+			continue;
+
+		lineNumber = instruction.lineNumber;
+		sourceLineNumber = instruction.sourceLineNumber;
+		currentFile = instruction.file;
+		evaluatingFile = currentFile;
+		if (returnCode = EmitInstruction(*instruction.info, instruction.immediate); returnCode != AssemblerReturnCode_Success)
+			break;
+	}
+	pendingInstructions.clear();
+
+	// The line of an instruction that failed is the line of the error.
+	if (returnCode == AssemblerReturnCode_Success)
+		lineNumber = outerLineNumber;
+	sourceLineNumber = outerSourceLineNumber;
+	currentFile = outerFile;
+	evaluatingFile = currentFile;
+	return returnCode;
 }
 
-bool Assembler::IsBinary(std::string_view text, std::string_view& tidiedNumber)
+// Gets the registers that instruction reads and writes, as bits 1 << Register.
+static void GetRegisterEffects(const InstructionInfo& instruction, uint16_t& registersRead, uint16_t& registersWritten)
 {
-	// Evaluate this regex: "^(?:(?:0[bB]|%)[01]+|[01]+[bB])$"
+	auto getBits = [](const OperandInfo& operand) -> uint16_t
+	{
+		if (operand.kind == OperandKind::R8)
+			return static_cast<uint16_t>(1 << static_cast<uint8_t>(operand.reg));
+		if (operand.kind != OperandKind::R16)
+			return 0;
+
+		// [bc] is made of b and c, and so on.
+		uint8_t high = static_cast<uint8_t>(Register::B) + 2 * (static_cast<uint8_t>(operand.reg) - static_cast<uint8_t>(Register::BC));
+		return static_cast<uint16_t>(3 << high);
+	};
 
-	if (std::tolower(text.back()) == 'b')
+	constexpr uint16_t A = 1 << static_cast<uint8_t>(Register::A);
+	const std::array<OperandInfo, 2>& operands = instruction.operands;
+	registersRead = 0;
+	registersWritten = 0;
+	switch (instruction.mnemonic)
 	{
-		if (text.size() < 2)
-			return false;
-		for (size_t i = 0; i < text.size() - 1; i++)
-			if (char c = text[i]; !IsBinaryDigit(c))
-				return false;
-		tidiedNumber = text.substr(0, text.size() - 1);
-		return true;
+		case Mnemonic::Ldi:
+			registersWritten = getBits(operands[0]);
+			break;
+		case Mnemonic::Mvr:
+			registersRead = getBits(operands[1]);
+			registersWritten = getBits(operands[0]);
+			break;
+		case Mnemonic::Sto:
+			registersRead = getBits(operands[0]) | getBits(operands[1]);
+			break;
+		case Mnemonic::Rcl:
+			registersRead = getBits(operands[0]);
+			registersWritten = getBits(operands[1]);
+			break;
+		case Mnemonic::Add:
+		case Mnemonic::Adc:
+		case Mnemonic::Sub:
+		case Mnemonic::Sbc:
+		case Mnemonic::And:
+		case Mnemonic::Xor:
+		case Mnemonic::Or:
+			registersRead = A | getBits(operands[0]);
+			registersWritten = A;
+			break;
+		case Mnemonic::Cmp:
+			registersRead = A | getBits(operands[0]);
+			break;
+		case Mnemonic::Cpl:
+		case Mnemonic::Neg:
+			registersRead = A;
+			registersWritten = A;
+			break;
+		default:
+			break;
 	}
-	else if (text.front() == '%')
+}
+
+void Assembler::Context::OptimizeInstructions()
+{
+	auto isRunning = [this](AssemblerPass pass) { return (passes >> pass & 1) != 0; };
+
+	// Only labels lead into a block, so nothing after the first instruction that never falls through can run.
+	bool isReachable = true;
+	for (PendingInstruction& instruction : pendingInstructions)
 	{
-		if (text.size() < 2)
-			return false;
-		for (size_t i = 1; i < text.size(); i++)
-			if (char c = text[i]; !IsBinaryDigit(c))
-				return false;
-		tidiedNumber = text.substr(1, text.size() - 1);
-		return true;
+		const InstructionInfo& info = *instruction.info;
+		if (!isReachable && isRunning(AssemblerPass_UnreachableCode))
+			DeleteInstruction(instruction, AssemblerPass_UnreachableCode);
+		else if (instruction.isSelfMove && isRunning(AssemblerPass_SelfMoves))
+			DeleteInstruction(instruction, AssemblerPass_SelfMoves);
+
+		bool isUnconditionalBranch = (info.mnemonic == Mnemonic::Jmp || info.mnemonic == Mnemonic::Ret) && info.operands[0].kind != OperandKind::Cond;
+		if (info.mnemonic == Mnemonic::Halt || isUnconditionalBranch)
+			isReachable = false;
 	}
-	else if (text.front() == '0')
+
+	// Whatever comes after the block, and whatever a branch leads to, may read any register or flag, so
+	// everything is live there. Going backwards, a write is dead if nothing reads it before the next write.
+	uint16_t liveRegisters = AllRegisterBits;
+	Flags liveFlags = Flags_All;
+	for (size_t i = pendingInstructions.size(); i-- > 0;)
 	{
-		if (text.size() < 3 && std::tolower(text[1]) != 'b')
-			return false;
-		for (size_t i = 2; i < text.size(); i++)
-			if (char c = text[i]; !IsBinaryDigit(c))
-				return false;
-		tidiedNumber = text.substr(2, text.size() - 2);
-		return true;
+		PendingInstruction& instruction = pendingInstructions[i];
+		if (instruction.isDeleted)
+			continue;
+
+		const InstructionInfo& info = *instruction.info;
+		uint16_t registersRead = 0;
+		uint16_t registersWritten = 0;
+		GetRegisterEffects(info, registersRead, registersWritten);
+		if (info.mnemonic == Mnemonic::Ldi && (registersWritten & liveRegisters) == 0 && isRunning(AssemblerPass_DeadLoads)
+			&& DeleteInstruction(instruction, AssemblerPass_DeadLoads))
+			continue;
+		if (info.mnemonic == Mnemonic::Cmp && (info.flagsWritten & liveFlags) == 0 && isRunning(AssemblerPass_DeadCompares)
+			&& DeleteInstruction(instruction, AssemblerPass_DeadCompares))
+			continue;
+
+		if (info.mnemonic == Mnemonic::Jmp || info.mnemonic == Mnemonic::Call || info.mnemonic == Mnemonic::Ret || info.mnemonic == Mnemonic::Halt)
+		{
+			liveRegisters = AllRegisterBits;
+			liveFlags = Flags_All;
+			continue;
+		}
+		liveRegisters = static_cast<uint16_t>((liveRegisters & ~registersWritten) | registersRead);
+		liveFlags = static_cast<Flags>((liveFlags & ~info.flagsWritten) | info.flagsRead);
 	}
-	return false;
 }
 
-bool Assembler::IsDecimal(std::string_view text, std::string_view& tidiedNumber)
+bool Assembler::Context::DeleteInstruction(PendingInstruction& instruction, AssemblerPass pass)
 {
-	// Evaluate this regex: "^[0-9]+$"
+	// Optimizing must not turn a program that fails into one that doesn't, so an immediate that isn't a constant
+	// that fits, like one that uses a symbol that is never defined, keeps its instruction.
+	const InstructionInfo& info = *instruction.info;
+	if (info.immediateSize != 0)
+	{
+		if (IsStringOperand(instruction.immediate))
+			return false;
 
-	for (char c : text)
-		if (!IsDecimalDigit(c))
+		size_t bytecodeOffset = fixupBytecode.size();
+		evaluatingFile = instruction.file;
+		Expression::CompileResult result = Expression::Compile(instruction.immediate, *this, fixupBytecode);
+		evaluatingFile = currentFile;
+		fixupBytecode.resize(bytecodeOffset);
+		if (result.returnCode != AssemblerReturnCode_Success || !result.isConstant || !NumericLiteral::FitsOperandSize(result.value, info.immediateSize))
 			return false;
-	tidiedNumber = text;
+	}
+
+	instruction.isDeleted = true;
+	AssemblerPassStats& stats = passStats[pass];
+	stats.instructions++;
+	stats.bytes += info.length;
+	stats.cycles += info.cycles;
 	return true;
 }
 
-bool Assembler::IsHexadecimal(std::string_view text, std::string_view& tidiedNumber)
+AssemblerReturnCode Assembler::Context::ProcessConditional(Directive directive, std::span<const std::string_view> operands)
 {
-	// Evaluate this regex: "^(?:(?:0[xX]|\$)[0-9a-fA-F]+|[0-9a-fA-F]+[hH])$"
+	bool hasCondition = directive == Directive::If || directive == Directive::Elif;
+	if (operands.size() != (hasCondition ? 1 : 0))
+		return AssemblerReturnCode_InvalidOperandCount;
 
-	if (std::tolower(text.back()) == 'h')
+	if (directive == Directive::If)
 	{
-		if (text.size() < 2)
-			return false;
-		for (size_t i = 0; i < text.size() - 1; i++)
-			if (char c = text[i]; !IsHexadecimalDigit(c))
-				return false;
-		tidiedNumber = text.substr(0, text.size() - 1);
-		return true;
+		// Conditions must be known right away, like the operand of .origin.
+		int32_t condition = 0;
+		if (AssemblerReturnCode returnCode = EvaluateOperand(operands.front(), condition); returnCode != AssemblerReturnCode_Success)
+			return returnCode;
+
+		conditionals.push_back({ condition != 0, false, lineNumber });
+		isSkipping = condition == 0;
+		return AssemblerReturnCode_Success;
 	}
-	else if (text.front() == '$')
+
+	if (conditionals.size() <= firstConditional || (directive != Directive::EndIf && conditionals.back().hasElse))
+		return AssemblerReturnCode_UnmatchedConditional;
+
+	switch (directive)
 	{
-		if (text.size() < 2)
-			return false;
-		for (size_t i = 1; i < text.size(); i++)
-			if (char c = text[i]; !IsHexadecimalDigit(c))
-				return false;
-		tidiedNumber = text.substr(1, text.size() - 1);
-		return true;
+		case Directive::Elif:
+		{
+			// Once a branch was assembled, the conditions of the others aren't even evaluated.
+			if (conditionals.back().isBranchTaken)
+			{
+				isSkipping = true;
+				break;
+			}
+
+			int32_t condition = 0;
+			if (AssemblerReturnCode returnCode = EvaluateOperand(operands.front(), condition); returnCode != AssemblerReturnCode_Success)
+				return returnCode;
+
+			conditionals.back().isBranchTaken = condition != 0;
+			isSkipping = condition == 0;
+			break;
+		}
+		case Directive::Else:
+		{
+			Conditional& conditional = conditionals.back();
+			conditional.hasElse = true;
+			isSkipping = conditional.isBranchTaken;
+			conditional.isBranchTaken = true;
+			break;
+		}
+		default:
+			conditionals.pop_back();
+			isSkipping = false;
+			break;
 	}
-	else if (text.front() == '0')
+
+	return AssemblerReturnCode_Success;
+}
+
+AssemblerReturnCode Assembler::Context::Include(const std::filesystem::path& path)
+{
+	std::filesystem::path resolvedPath = ResolveIncludePath(GetIncludeDirectory(), path);
+	std::shared_ptr<const IncludeCache::Entry> entry;
+	if (auto it = preloadedFiles.find(resolvedPath.string()); it != preloadedFiles.end())
+		entry = it->second;
+	if (!entry)
 	{
-		if (text.size() < 3 && std::tolower(text[1]) != 'x')
-			return false;
-		for (size_t i = 2; i < text.size(); i++)
-			if (char c = text[i]; !IsHexadecimalDigit(c))
-				return false;
-		tidiedNumber = text.substr(2, text.size() - 2);
-		return true;
+		PhaseScope phaseScope(*this, AssemblerPhase_Tokenize);
+		entry = IncludeCache::Get(resolvedPath);
 	}
-	return false;
+	if (!entry)
+		return AssemblerReturnCode_IncludeNotFound;
+	if (entry->returnCode != AssemblerReturnCode_Success)
+		return entry->returnCode;
+
+	if (entry->path == sourcePath)
+		return AssemblerReturnCode_CircularInclude;
+	for (const IncludeCache::Entry* includingEntry : includeStack)
+		if (includingEntry->path == entry->path)
+			return AssemblerReturnCode_CircularInclude;
+
+	// The cached tokens are processed as they are, without being tokenized again.
+	includeStack.push_back(entry.get());
+	includedFiles.push_back(entry);
+	uint32_t outerRecordingMacro = recordingMacro;
+	uint32_t outerFirstConditional = firstConditional;
+	firstConditional = static_cast<uint32_t>(conditionals.size());
+	uint32_t outerFile = currentFile;
+	uint32_t outerSourceLineNumber = sourceLineNumber;
+	currentFile = static_cast<uint32_t>(fileParents.size());
+	fileParents.push_back(outerFile);
+	evaluatingFile = currentFile;
+	outputFiles.push_back(outputFileIndices.try_emplace(entry.get(), static_cast<uint32_t>(outputFileIndices.size() + 1)).first->second);
+
+	AssemblerReturnCode returnCode = AssemblerReturnCode_Success;
+	const TokenStream& includedTokens = entry->tokenStream;
+	for (const TokenizedLine& line : includedTokens.lines)
+		if (returnCode = ProcessTokenizedLine(line, includedTokens.GetTokens(line)); returnCode != AssemblerReturnCode_Success)
+			break;
+
+	includeStack.pop_back();
+	currentFile = outerFile;
+	sourceLineNumber = outerSourceLineNumber;
+	evaluatingFile = currentFile;
+	if (returnCode == AssemblerReturnCode_Success && recordingMacro != outerRecordingMacro)
+		returnCode = AssemblerReturnCode_UnterminatedMacro;
+	// Conditionals can't span files.
+	if (returnCode == AssemblerReturnCode_Success && conditionals.size() != firstConditional)
+		returnCode = AssemblerReturnCode_UnterminatedConditional;
+	firstConditional = outerFirstConditional;
+	return returnCode;
 }
 
-uint8_t Assembler::GetBase(std::string_view text, std::string_view& tidiedNumber)
+AssemblerReturnCode Assembler::Context::BeginMacro(std::span<const std::string_view> operands)
 {
-	if (text.empty())
-		return 0;
-	if (IsBinary(text, tidiedNumber))
-		return 2;
-	if (IsDecimal(text, tidiedNumber))
-		return 10;
-	if (IsHexadecimal(text, tidiedNumber))
-		return 16;
-	return 0;
+	if (operands.empty())
+		return AssemblerReturnCode_InvalidOperandCount;
+
+	// Macros can't hide instructions.
+	std::string_view name = operands.front();
+	if (!IsLabel(name) || MnemonicTable.Find(name) != Mnemonic::None)
+		return AssemblerReturnCode_InvalidMacroDefinition;
+
+	Macro macro;
+	macro.firstParameter = static_cast<uint32_t>(macroParameters.size());
+	macro.parameterCount = static_cast<uint32_t>(operands.size() - 1);
+	macro.firstLine = static_cast<uint32_t>(macroLines.size());
+	macro.lineNumber = lineNumber;
+
+	for (std::string_view parameter : operands.subspan(1))
+	{
+		if (parameter.size() < 2 || parameter.front() != '$' || !IsLabel(parameter.substr(1)))
+			return AssemblerReturnCode_InvalidMacroDefinition;
+		for (uint32_t i = macro.firstParameter; i < macroParameters.size(); i++)
+			if (macroParameters[i] == parameter)
+				return AssemblerReturnCode_InvalidMacroDefinition;
+		macroParameters.push_back(Intern(parameter));
+	}
+
+	auto [macroIndex, inserted] = macros.Insert(name, macro);
+	if (!inserted)
+		return AssemblerReturnCode_DuplicateMacroDefinition;
+	if (internNames)
+		macros[macroIndex].name = Intern(name);
+
+	recordingMacro = macroIndex;
+	return AssemblerReturnCode_Success;
 }
+
+AssemblerReturnCode Assembler::Context::RecordMacroLine(const TokenizedLine& line, std::span<const std::string_view> tokens)
+{
+	if (!line.isLabel && tokens.front().front() == '.')
+	{
+		Directive directive = DirectiveTable.Find(tokens.front().substr(1));
+		if (directive == Directive::EndMacro)
+		{
+			if (tokens.size() != 1)
+				return AssemblerReturnCode_InvalidOperandCount;
+			recordingMacro = NoIndex;
+			return AssemblerReturnCode_Success;
+		}
+
+		// Macros can't be defined inside of other macros.
+		if (directive == Directive::Macro)
+			return AssemblerReturnCode_InvalidMacroDefinition;
+	}
+
+	MacroLine macroLine;
+	macroLine.firstToken = static_cast<uint32_t>(macroTokens.size());
+	macroLine.isLabel = line.isLabel;
+
+	// The line's tokens are copied at once, so the template doesn't depend on the source staying alive.
+	std::string_view lineText(tokens.front().data(), tokens.back().data() + tokens.back().size() - tokens.front().data());
+	std::string_view text = Intern(lineText);
+	for (std::string_view token : tokens)
+		RecordMacroToken(text.substr(token.data() - lineText.data(), token.size()));
+
+	macroLine.tokenCount = static_cast<uint32_t>(macroTokens.size() - macroLine.firstToken);
+	macroLines.push_back(macroLine);
+	macros[recordingMacro].value.lineCount++;
+	return AssemblerReturnCode_Success;
+}
+
+void Assembler::Context::RecordMacroToken(std::string_view token)
+{
+	const Macro& macro = macros[recordingMacro].value;
+	std::span<const std::string_view> parameters(macroParameters.data() + macro.firstParameter, macro.parameterCount);
+
+	MacroToken& macroToken = macroTokens.emplace_back();
+	macroToken.firstFragment = static_cast<uint32_t>(macroFragments.size());
+
+	// Split the token into text and parameters. Parameters take priority over hexadecimal literals like $a,
+	// and string literals are never substituted into.
+	size_t textStart = 0;
+	bool inQuote = false;
+	bool isEscaped = false;
+	for (size_t i = 0; i < token.size(); i++)
+	{
+		char c = token[i];
+		if (inQuote)
+		{
+			if (c == '"' && !isEscaped)
+				inQuote = false;
+			else
+				isEscaped = c == '\\' && !isEscaped;
+			continue;
+		}
+		if (c == '"')
+		{
+			inQuote = true;
+			continue;
+		}
+		if (c != '$')
+			continue;
+
+		size_t end = i + 1;
+		while (end < token.size() && IsIdentifierContinue(token[end]))
+			end++;
+
+		auto parameter = std::find(parameters.begin(), parameters.end(), token.substr(i, end - i));
+		if (parameter == parameters.end())
+			continue;
+
+		if (i != textStart)
+			macroFragments.push_back({ token.substr(textStart, i - textStart) });
+		macroFragments.push_back({ {}, static_cast<uint32_t>(parameter - parameters.begin()) });
+		textStart = end;
+		i = end - 1;
+	}
+	if (textStart != token.size())
+		macroFragments.push_back({ token.substr(textStart) });
+
+	macroToken.fragmentCount = static_cast<uint32_t>(macroFragments.size() - macroToken.firstFragment);
+}
+
+AssemblerReturnCode Assembler::Context::InvokeMacro(uint32_t macroIndex, std::span<const std::string_view> arguments)
+{
+	size_t argumentOffset = expansionTokens.size();
+	expansionTokens.insert(expansionTokens.end(), arguments.begin(), arguments.end());
+	expandingMacros++;
+	AssemblerReturnCode returnCode = ExpandMacro(macroIndex, argumentOffset, arguments.size(), 0);
+	expandingMacros--;
+	expansionTokens.resize(argumentOffset);
+
+	// Invocations in files included by a macro are nested inside of that macro's invocation.
+	if (argumentOffset == 0)
+		expansionText.Reset();
+	return returnCode;
+}
+
+AssemblerReturnCode Assembler::Context::ExpandMacro(uint32_t macroIndex, size_t argumentOffset, size_t argumentCount, uint32_t depth)
+{
+	if (depth == MaxMacroNestingDepth)
+		return AssemblerReturnCode_MacroNestingTooDeep;
+
+	const Macro& macro = macros[macroIndex].value;
+	if (argumentCount != macro.parameterCount)
+		return AssemblerReturnCode_InvalidOperandCount;
+
+	// Conditionals can't span invocations.
+	uint32_t outerFirstConditional = firstConditional;
+	firstConditional = static_cast<uint32_t>(conditionals.size());
+
+	// Macros can't be defined while expanding, so the template doesn't move.
+	for (const MacroLine& line : std::span(macroLines.data() + macro.firstLine, macro.lineCount))
+	{
+		// The rest of a skipped line isn't expanded.
+		std::span<const MacroToken> tokens(macroTokens.data() + line.firstToken, line.tokenCount);
+		std::string_view token0 = ExpandMacroToken(tokens.front(), argumentOffset);
+		if (SkipLine(token0))
+			continue;
+
+		size_t lineOffset = expansionTokens.size();
+		expansionTokens.push_back(token0);
+		for (const MacroToken& token : tokens.subspan(1))
+		{
+			std::string_view expandedToken = ExpandMacroToken(token, argumentOffset);
+			expansionTokens.push_back(expandedToken);
+		}
+
+		AssemblerReturnCode returnCode = AssemblerReturnCode_Success;
+		if (line.isLabel)
+			returnCode = DefineLabel(token0);
+		else if (uint32_t nestedMacroIndex = token0.front() != '.' ? macros.Find(token0) : SymbolTable<Macro>::InvalidIndex;
+			nestedMacroIndex != SymbolTable<Macro>::InvalidIndex)
+			returnCode = ExpandMacro(nestedMacroIndex, lineOffset + 1, line.tokenCount - 1, depth + 1);
+		else
+			returnCode = ProcessStatement({ expansionTokens.data() + lineOffset, line.tokenCount });
+
+		expansionTokens.resize(lineOffset);
+		if (returnCode != AssemblerReturnCode_Success)
+			return returnCode;
+	}
+
+	if (conditionals.size() != firstConditional)
+		return AssemblerReturnCode_UnterminatedConditional;
+	firstConditional = outerFirstConditional;
+	return AssemblerReturnCode_Success;
+}
+
+std::string_view Assembler::Context::ExpandMacroToken(const MacroToken& token, size_t argumentOffset)
+{
+	std::span<const MacroFragment> fragments(macroFragments.data() + token.firstFragment, token.fragmentCount);
+
+	// Most tokens are either plain text or a lone parameter, which are used as they are.
+	if (fragments.size() == 1)
+		return fragments.front().parameter == NoIndex ? fragments.front().text : expansionTokens[argumentOffset + fragments.front().parameter];
+
+	size_t size = 0;
+	for (const MacroFragment& fragment : fragments)
+		size += fragment.parameter == NoIndex ? fragment.text.size() : expansionTokens[argumentOffset + fragment.parameter].size();
+
+	char* text = expansionText.Allocate(size);
+	char* end = text;
+	for (const MacroFragment& fragment : fragments)
+	{
+		std::string_view fragmentText = fragment.parameter == NoIndex ? fragment.text : expansionTokens[argumentOffset + fragment.parameter];
+		end = std::copy(fragmentText.begin(), fragmentText.end(), end);
+	}
+	return { text, size };
+}
+
+AssemblerReturnCode Assembler::Context::EmitData(std::string_view operand, uint8_t size)
+{
+	if (IsStringOperand(operand))
+	{
+		// Strings are only allowed where bytes are expected.
+		if (size != 1)
+			return AssemblerReturnCode_InvalidStringLiteral;
+
+		stringBuffer.clear();
+		if (AssemblerReturnCode returnCode = DecodeStringOperand(operand, stringBuffer); returnCode != AssemblerReturnCode_Success)
+			return returnCode;
+		return EmitBytes({ reinterpret_cast<const uint8_t*>(stringBuffer.data()), stringBuffer.size() });
+	}
+
+	// Anything that expects an integer requires a constant expression, i.e. "17 + 6" is emitted as 23.
+	uint32_t bytecodeOffset = static_cast<uint32_t>(fixupBytecode.size());
+	Expression::CompileResult result = Expression::Compile(operand, *this, fixupBytecode);
+	if (result.returnCode != AssemblerReturnCode_Success)
+		return result.returnCode;
+	if (result.isConstant)
+		return EmitValue(result.value, size);
+
+	// The operand references symbols that aren't defined yet, so emit a placeholder and patch it later.
+	Section& section = GetCurrentSection();
+	uint32_t offset = section.size;
+	uint8_t placeholder[2]{};
+	if (AssemblerReturnCode returnCode = EmitBytes({ placeholder, size }); returnCode != AssemblerReturnCode_Success)
+		return returnCode;
+
+	uint32_t fixupIndex = freeFixup;
+	if (fixupIndex != NoIndex)
+		freeFixup = fixups[fixupIndex].nextFixup;
+	else
+	{
+		fixupIndex = static_cast<uint32_t>(fixups.size());
+		fixups.emplace_back();
+	}
+
+	fixups[fixupIndex] = { currentSection, offset, size, lineNumber, bytecodeOffset, static_cast<uint32_t>(fixupBytecode.size() - bytecodeOffset), currentFile };
+	section.pendingFixups++;
+	unresolvedFixups++;
+	return ResolveFixup(fixupIndex);
+}
+
+AssemblerReturnCode Assembler::Context::EmitValue(int64_t value, uint8_t size)
+{
+	if (!NumericLiteral::FitsOperandSize(value, size))
+		return AssemblerReturnCode_OperandOutOfRange;
+
+	// Words are little endian.
+	uint8_t bytes[2] = { static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8) };
+	return EmitBytes({ bytes, size });
+}
+
+AssemblerReturnCode Assembler::Context::EmitBytes(std::span<const uint8_t> bytes)
+{
+	Section& section = GetCurrentSection();
+	uint32_t address = section.origin + section.size;
+	if (address + bytes.size() > AddressSpaceSize)
+		return AssemblerReturnCode_AddressOverflow;
+
+	if (image)
+	{
+		if (!WriteImage(*image, address, bytes))
+			return AssemblerReturnCode_OverlappingSections;
+	}
+	else
+	{
+		if (!section.isRelocatable && !MarkWritten(writtenBits, address, bytes.size()))
+			return AssemblerReturnCode_OverlappingSections;
+		section.assembly.insert(section.assembly.end(), bytes.begin(), bytes.end());
+		section.lineMap.Add(address, static_cast<uint32_t>(bytes.size()), { outputFiles[currentFile], sourceLineNumber });
+	}
+	section.size += static_cast<uint32_t>(bytes.size());
+	return AssemblerReturnCode_Success;
+}
+
+AssemblerReturnCode Assembler::Context::EvaluateOperand(std::string_view operand, int32_t& value)
+{
+	size_t bytecodeOffset = fixupBytecode.size();
+	Expression::CompileResult result = Expression::Compile(operand, *this, fixupBytecode);
+	if (result.returnCode != AssemblerReturnCode_Success || result.isConstant)
+	{
+		value = result.value;
+		return result.returnCode;
+	}
+
+	// Something it references isn't defined yet.
+	fixupBytecode.resize(bytecodeOffset);
+	return AssemblerReturnCode_UndefinedSymbol;
+}
+
+bool Assembler::Context::IsStringOperand(std::string_view operand) const
+{
+	if (operand.front() == '"')
+		return true;
+
+	size_t end = 0;
+	while (end < operand.size() && IsIdentifierContinue(operand[end]))
+		end++;
+
+	uint32_t symbolIndex = symbols.Find(operand.substr(0, end));
+	return symbolIndex != SymbolTable<Symbol>::InvalidIndex && symbols[symbolIndex].value.isString;
+}
+
+AssemblerReturnCode Assembler::Context::DecodeStringOperand(std::string_view operand, std::pmr::string& string) const
+{
+	for (size_t i = 0; i < operand.size();)
+	{
+		if (IsBlank(operand[i]))
+		{
+			i++;
+			continue;
+		}
+
+		if (operand[i] != '"')
+		{
+			// Only string defines may be concatenated with string literals.
+			size_t end = i;
+			while (end < operand.size() && IsIdentifierContinue(operand[end]))
+				end++;
+
+			uint32_t symbolIndex = end != i ? symbols.Find(operand.substr(i, end - i)) : SymbolTable<Symbol>::InvalidIndex;
+			if (symbolIndex == SymbolTable<Symbol>::InvalidIndex || !symbols[symbolIndex].value.isString)
+				return AssemblerReturnCode_InvalidStringLiteral;
+
+			string.append(symbols[symbolIndex].value.string);
+			i = end;
+			continue;
+		}
+
+		if (!AppendStringLiteral(operand, i, string))
+			return AssemblerReturnCode_InvalidStringLiteral;
+	}
+
+	return AssemblerReturnCode_Success;
+}
+
+AssemblerReturnCode Assembler::Context::ResolveFixup(uint32_t fixupIndex)
+{
+	Fixup& fixup = fixups[fixupIndex];
+	evaluatingFile = fixup.file;
+	Expression::EvaluateResult result = Expression::Evaluate({ fixupBytecode.data() + fixup.bytecodeOffset, fixup.bytecodeSize }, *this);
+	evaluatingFile = currentFile;
+	if (result.returnCode == AssemblerReturnCode_UndefinedSymbol)
+	{
+		Symbol& symbol = symbols[result.blockingSymbolIndex].value;
+		fixup.nextFixup = symbol.firstFixup;
+		symbol.firstFixup = fixupIndex;
+		return AssemblerReturnCode_Success;
+	}
+
+	if (result.returnCode == AssemblerReturnCode_Success && !NumericLiteral::FitsOperandSize(result.value, fixup.size))
+		result.returnCode = AssemblerReturnCode_OperandOutOfRange;
+	if (result.returnCode != AssemblerReturnCode_Success)
+	{
+		lineNumber = fixup.lineNumber;
+		return result.returnCode;
+	}
+
+	// The placeholder's bytes are already marked as written, so they're simply replaced.
+	Section& section = sections[fixup.sectionIndex];
+	uint8_t* bytes = image ? image->memory.data() + section.origin : section.assembly.data();
+	bytes[fixup.offset] = static_cast<uint8_t>(result.value);
+	if (fixup.size == 2)
+		bytes[fixup.offset + 1] = static_cast<uint8_t>(result.value >> 8);
+
+	if (--section.pendingFixups == 0 && section.isClosed)
+		FlushSection(section);
+
+	FreeFixup(fixupIndex);
+	return AssemblerReturnCode_Success;
+}
+
+AssemblerReturnCode Assembler::Context::ResolveFixups(uint32_t symbolIndex)
+{
+	// Fixups that are still blocked by another symbol get added to that symbol's list instead.
+	uint32_t fixupIndex = symbols[symbolIndex].value.firstFixup;
+	symbols[symbolIndex].value.firstFixup = NoIndex;
+	while (fixupIndex != NoIndex)
+	{
+		uint32_t nextFixupIndex = fixups[fixupIndex].nextFixup;
+		if (AssemblerReturnCode returnCode = ResolveFixup(fixupIndex); returnCode != AssemblerReturnCode_Success)
+			return returnCode;
+		fixupIndex = nextFixupIndex;
+	}
+
+	return AssemblerReturnCode_Success;
+}
+
+void Assembler::Context::AddOperandUse(uint32_t symbolIndex, uint32_t emittedOperandIndex)
+{
+	// Operands that use a symbol more than once only need to be listed once.
+	Symbol& symbol = symbols[symbolIndex].value;
+	if (symbol.firstUse != NoIndex && operandUses[symbol.firstUse].emittedOperandIndex == emittedOperandIndex)
+		return;
+
+	operandUses.push_back({ emittedOperandIndex, symbol.firstUse });
+	symbol.firstUse = static_cast<uint32_t>(operandUses.size() - 1);
+}
+
+void Assembler::Context::FreeFixup(uint32_t fixupIndex)
+{
+	fixups[fixupIndex].nextFixup = freeFixup;
+	freeFixup = fixupIndex;
+
+	// Nothing refers to the bytecode anymore once every fixup is resolved.
+	if (--unresolvedFixups == 0)
+		fixupBytecode.clear();
+}
+
+void Assembler::Context::OpenSection(uint16_t origin)
+{
+	CloseSection();
+
+	Section& section = sections.emplace_back();
+	section.origin = origin;
+	currentSection = static_cast<uint32_t>(sections.size() - 1);
+}
+
+void Assembler::Context::CloseSection()
+{
+	if (currentSection == NoIndex)
+		return;
+
+	Section& section = sections[currentSection];
+	section.isClosed = true;
+	if (section.pendingFixups == 0)
+		FlushSection(section);
+	currentSection = NoIndex;
+}
+
+void Assembler::Context::FlushSection(Section& section)
+{
+	// Without a sink, every section is returned at the end instead.
+	if (!sectionSink || section.isFlushed)
+		return;
+
+	if (!section.assembly.empty())
+		sectionSink(std::move(static_cast<AssemblerProgramSection&>(section)));
+
+	// Release the section's memory; only its bookkeeping is kept.
+	section.assembly = {};
+	section.isFlushed = true;
+}
+
+Assembler::Context::Section& Assembler::Context::GetCurrentSection()
+{
+	// Code before the first .origin starts at address 0, or wherever the linker places it.
+	if (currentSection == NoIndex)
+	{
+		OpenSection(0);
+		sections[currentSection].isRelocatable = isObject;
+	}
+	return sections[currentSection];
+}
+
+uint32_t Assembler::Context::GetCurrentAddress() const noexcept
+{
+	if (currentSection == NoIndex)
+		return 0;
+
+	const Section& section = sections[currentSection];
+	return section.origin + section.size;
+}
+
+uint32_t Assembler::Context::InsertSymbol(std::string_view name)
+{
+	auto [index, inserted] = symbols.Insert(name);
+	if (inserted && internNames)
+		symbols[index].name = Intern(name);
+	return index;
+}
+
+uint32_t Assembler::Context::InsertScopedLabel(uint32_t symbolIndex, uint32_t file)
+{
+	// Keyed by the name, a null character, and the file, which never conflicts with a name.
+	std::string_view name = symbols[symbolIndex].name;
+	char* key = static_cast<char*>(nameArena.allocate(name.size() + 1 + sizeof(file), 1));
+	std::copy(name.begin(), name.end(), key);
+	key[name.size()] = '\0';
+	std::memcpy(key + name.size() + 1, &file, sizeof(file));
+
+	uint32_t labelIndex = symbols.Insert({ key, name.size() + 1 + sizeof(file) }).first;
+	symbols[labelIndex].value.nextScopedLabel = symbols[symbolIndex].value.firstScopedLabel;
+	symbols[symbolIndex].value.firstScopedLabel = labelIndex;
+	return labelIndex;
+}
+
+std::string_view Assembler::Context::Intern(std::string_view string)
+{
+	char* internedString = static_cast<char*>(nameArena.allocate(string.size(), 1));
+	std::copy(string.begin(), string.end(), internedString);
+	return { internedString, string.size() };
+}
+
+bool Assembler::Context::IsAccessible(const Symbol& label, uint32_t file) const noexcept
+{
+	if (label.file == file)
+		return true;
+
+	switch (label.visibility)
+	{
+		case LabelVisibility::Private:
+			return false;
+		case LabelVisibility::Protected:
+			return fileParents[label.file] == file;
+		case LabelVisibility::Public:
+			for (uint32_t parent = fileParents[label.file]; parent != NoIndex; parent = fileParents[parent])
+				if (parent == file)
+					return true;
+			return false;
+	}
+	return false;
+}
+
+bool Assembler::Context::IsVisibleWith(const Symbol& label, LabelVisibility visibility, uint32_t file) const noexcept
+{
+	uint32_t labelParent = label.visibility == LabelVisibility::Protected ? fileParents[label.file] : NoIndex;
+	uint32_t parent = visibility == LabelVisibility::Protected ? fileParents[file] : NoIndex;
+	return label.file == file || label.file == parent || labelParent == file || (labelParent != NoIndex && labelParent == parent);
+}
+
+uint32_t Assembler::Context::FindVisibleLabel(uint32_t symbolIndex, uint32_t file) const noexcept
+{
+	for (uint32_t labelIndex = symbols[symbolIndex].value.firstScopedLabel; labelIndex != NoIndex; labelIndex = symbols[labelIndex].value.nextScopedLabel)
+		if (IsAccessible(symbols[labelIndex].value, file))
+			return labelIndex;
+	return symbolIndex;
+}
+
+bool Assembler::Context::Resolve(std::string_view name, int32_t& value, uint32_t& symbolIndex, AssemblerReturnCode& returnCode)
+{
+	symbolIndex = InsertSymbol(name);
+	if (recordOperands)
+	{
+		if (emittingOperand != NoIndex)
+			AddOperandUse(symbolIndex, emittingOperand);
+		else
+			symbols[symbolIndex].value.isUsedOutsideOperands = true;
+	}
+
+	uint32_t blockingSymbolIndex = NoIndex;
+	returnCode = Evaluate(symbolIndex, value, blockingSymbolIndex);
+	if (returnCode == AssemblerReturnCode_Success)
+		return true;
+
+	// Symbols that can't be evaluated yet are evaluated later instead.
+	if (returnCode == AssemblerReturnCode_UndefinedSymbol)
+		returnCode = AssemblerReturnCode_Success;
+	return false;
+}
+
+AssemblerReturnCode Assembler::Context::Evaluate(uint32_t symbolIndex, int32_t& value, uint32_t& blockingSymbolIndex)
+{
+	symbolIndex = FindVisibleLabel(symbolIndex, evaluatingFile);
+	Symbol& symbol = symbols[symbolIndex].value;
+	if (symbol.kind == SymbolKind::Undefined)
+	{
+		blockingSymbolIndex = symbolIndex;
+		return AssemblerReturnCode_UndefinedSymbol;
+	}
+	if (symbol.isString)
+		return AssemblerReturnCode_InvalidExpression;
+	if (symbol.kind == SymbolKind::Label && !IsAccessible(symbol, evaluatingFile))
+		return AssemblerReturnCode_InaccessibleLabel;
+	if (symbol.kind == SymbolKind::Label && !symbol.isEvaluated)
+	{
+		blockingSymbolIndex = symbolIndex;
+		return AssemblerReturnCode_UndefinedSymbol;
+	}
+	if (symbol.isEvaluated)
+	{
+		value = symbol.value;
+		return AssemblerReturnCode_Success;
+	}
+	if (symbol.isEvaluating)
+		return AssemblerReturnCode_CircularDefine;
+
+	// Evaluating never inserts symbols, so symbol stays valid.
+	// A define can use whatever labels the file it was defined in can.
+	uint32_t outerEvaluatingFile = evaluatingFile;
+	evaluatingFile = symbol.file;
+	symbol.isEvaluating = true;
+	Expression::EvaluateResult result = Expression::Evaluate({ defineBytecode.data() + symbol.bytecodeOffset, symbol.bytecodeSize }, *this);
+	symbol.isEvaluating = false;
+	evaluatingFile = outerEvaluatingFile;
+
+	if (result.returnCode == AssemblerReturnCode_Success)
+	{
+		// Whatever a define depends on never changes once it's defined, so its value is memoised.
+		symbol.isEvaluated = true;
+		symbol.value = result.value;
+		value = result.value;
+	}
+	blockingSymbolIndex = result.blockingSymbolIndex;
+	return result.returnCode;
+}
+
+AssemblerOutput Assembler::Context::Finish()
+{
+	PhaseScope phaseScope(*this, AssemblerPhase_Encode);
+	if (AssemblerReturnCode returnCode = FlushInstructions(); returnCode != AssemblerReturnCode_Success)
+		return { returnCode, lineNumber };
+	if (recordingMacro != NoIndex)
+		return { AssemblerReturnCode_UnterminatedMacro, macros[recordingMacro].value.lineNumber };
+	if (!conditionals.empty())
+		return { AssemblerReturnCode_UnterminatedConditional, conditionals.back().lineNumber };
+
+	CloseSection();
+
+	// Every referenced symbol must have been defined by now. A name that only private or protected labels
+	// of other files define is defined, just not where it's used.
+	size_t undefinedLineNumber = 0;
+	AssemblerReturnCode undefinedReturnCode = AssemblerReturnCode_UndefinedSymbol;
+	for (const auto& [name, symbol] : symbols)
+	{
+		for (uint32_t fixupIndex = symbol.firstFixup; fixupIndex != NoIndex; fixupIndex = fixups[fixupIndex].nextFixup)
+		{
+			if (undefinedLineNumber == 0 || fixups[fixupIndex].lineNumber < undefinedLineNumber)
+			{
+				undefinedLineNumber = fixups[fixupIndex].lineNumber;
+				undefinedReturnCode = symbol.firstScopedLabel != NoIndex ? AssemblerReturnCode_InaccessibleLabel : AssemblerReturnCode_UndefinedSymbol;
+			}
+		}
+	}
+	if (undefinedLineNumber != 0)
+		return { undefinedReturnCode, undefinedLineNumber };
+
+	std::vector<AssemblerProgramSection> outputSections;
+	for (Section& section : sections)
+	{
+		if (sectionSink)
+			FlushSection(section);
+		else if (!section.assembly.empty())
+			outputSections.push_back(std::move(static_cast<AssemblerProgramSection&>(section)));
+	}
+	sections.clear();
+
+	AssemblerOutput output(AssemblerReturnCode_Success, 0, std::move(outputSections));
+	GetSymbols(output.symbols);
+	output.passStats = passStats;
+
+	output.files.resize(outputFileIndices.size() + 1);
+	output.files[0] = sourcePath;
+	for (const auto& [entry, fileIndex] : outputFileIndices)
+		output.files[fileIndex] = entry->path;
+	return output;
+}
+
+void Assembler::Context::GetSymbols(std::vector<AssemblerSymbol>& outputSymbols) const
+{
+	outputSymbols.clear();
+	for (const auto& [name, symbol] : symbols)
+		if (symbol.kind == SymbolKind::Label && symbol.value >= 0 && symbol.value < static_cast<int32_t>(AssemblerImage::Size))
+			outputSymbols.push_back({ std::string(GetLabelName(name)), static_cast<uint16_t>(symbol.value) });
+	std::ranges::stable_sort(outputSymbols, {}, &AssemblerSymbol::address);
+}
+
+AssemblerReturnCode Assembler::Context::FinishObject(AssemblerObject& object)
+{
+	PhaseScope phaseScope(*this, AssemblerPhase_Encode);
+	if (AssemblerReturnCode returnCode = FlushInstructions(); returnCode != AssemblerReturnCode_Success)
+		return returnCode;
+	if (recordingMacro != NoIndex)
+	{
+		lineNumber = macros[recordingMacro].value.lineNumber;
+		return AssemblerReturnCode_UnterminatedMacro;
+	}
+	if (!conditionals.empty())
+	{
+		lineNumber = conditionals.back().lineNumber;
+		return AssemblerReturnCode_UnterminatedConditional;
+	}
+
+	CloseSection();
+
+	// Empty sections are left out, unless labels point into them.
+	std::vector<uint32_t> objectSectionIndices(sections.size(), NoIndex);
+	for (uint32_t i = 0; i < sections.size(); i++)
+	{
+		Section& section = sections[i];
+		if (section.assembly.empty() && !section.isRelocatable)
+			continue;
+
+		objectSectionIndices[i] = static_cast<uint32_t>(object.sections.size());
+		AssemblerObject::Section& objectSection = object.sections.emplace_back();
+		objectSection.origin = section.origin;
+		objectSection.assembly = std::move(section.assembly);
+		objectSection.isRelocatable = section.isRelocatable;
+	}
+
+	// Only the symbols that are exported, or that the bytecode of relocations refers to, are added to the object,
+	// and every symbol is only looked at once it is added.
+	std::vector<uint32_t> objectSymbolIndices(symbols.Size(), NoIndex);
+	std::vector<uint32_t> addedSymbols;
+	auto addSymbol = [&](uint32_t symbolIndex)
+	{
+		if (objectSymbolIndices[symbolIndex] == NoIndex)
+		{
+			objectSymbolIndices[symbolIndex] = static_cast<uint32_t>(object.symbols.size());
+			object.symbols.emplace_back().name = GetLabelName(symbols[symbolIndex].name);
+			addedSymbols.push_back(symbolIndex);
+		}
+		return objectSymbolIndices[symbolIndex];
+	};
+
+	// Copies bytecode that is evaluated as file, and checks that file may use every label it refers to.
+	AssemblerReturnCode returnCode = AssemblerReturnCode_Success;
+	auto addBytecode = [&](std::span<const uint8_t> bytecode, uint32_t file, uint32_t& bytecodeOffset, uint32_t& bytecodeSize)
+	{
+		bytecodeOffset = static_cast<uint32_t>(object.bytecode.size());
+		bytecodeSize = static_cast<uint32_t>(bytecode.size());
+		object.bytecode.insert(object.bytecode.end(), bytecode.begin(), bytecode.end());
+		Expression::RemapSymbols({ object.bytecode.data() + bytecodeOffset, bytecodeSize }, [&](uint32_t symbolIndex)
+		{
+			symbolIndex = FindVisibleLabel(symbolIndex, file);
+			const Symbol& symbol = symbols[symbolIndex].value;
+			if ((symbol.kind == SymbolKind::Label && !IsAccessible(symbol, file)) || symbol.firstScopedLabel != NoIndex)
+				returnCode = AssemblerReturnCode_InaccessibleLabel;
+			return addSymbol(symbolIndex);
+		});
+	};
+
+	for (uint32_t symbolIndex = 0; symbolIndex < symbols.Size(); symbolIndex++)
+	{
+		// Labels are exported if any file that includes the source could use them.
+		const Symbol& symbol = symbols[symbolIndex].value;
+		if (symbol.kind == SymbolKind::Label && (symbol.visibility == LabelVisibility::Public || (symbol.file == 0 && symbol.visibility == LabelVisibility::Protected)))
+			object.symbols[addSymbol(symbolIndex)].isExported = true;
+	}
+
+	// Every fixup that is left waits on an undefined or relocatable symbol, and becomes a relocation.
+	for (uint32_t symbolIndex = 0; symbolIndex < symbols.Size(); symbolIndex++)
+	{
+		for (uint32_t fixupIndex = symbols[symbolIndex].value.firstFixup; fixupIndex != NoIndex; fixupIndex = fixups[fixupIndex].nextFixup)
+		{
+			const Fixup& fixup = fixups[fixupIndex];
+			AssemblerObject::Relocation& relocation = object.relocations.emplace_back();
+			relocation.section = objectSectionIndices[fixup.sectionIndex];
+			relocation.offset = fixup.offset;
+			relocation.size = fixup.size;
+			relocation.lineNumber = fixup.lineNumber;
+			addBytecode({ fixupBytecode.data() + fixup.bytecodeOffset, fixup.bytecodeSize }, fixup.file, relocation.bytecodeOffset, relocation.bytecodeSize);
+			if (returnCode != AssemblerReturnCode_Success)
+			{
+				lineNumber = fixup.lineNumber;
+				return returnCode;
+			}
+		}
+	}
+
+	// Adding a define's bytecode may add more symbols, which are looked at in turn.
+	for (size_t i = 0; i < addedSymbols.size(); i++)
+	{
+		uint32_t symbolIndex = addedSymbols[i];
+		Symbol& symbol = symbols[symbolIndex].value;
+		AssemblerObject::Symbol& objectSymbol = object.symbols[objectSymbolIndices[symbolIndex]];
+		switch (symbol.kind)
+		{
+			case SymbolKind::Undefined:
+				objectSymbol.kind = AssemblerObject::SymbolKind::Import;
+				break;
+			case SymbolKind::Label:
+				objectSymbol.value = symbol.value;
+				if (!symbol.isEvaluated)
+				{
+					// Only the first section is ever relocatable.
+					objectSymbol.kind = AssemblerObject::SymbolKind::Relocatable;
+					objectSymbol.section = objectSectionIndices[0];
+				}
+				break;
+			case SymbolKind::Define:
+			{
+				int32_t value = 0;
+				uint32_t blockingSymbolIndex = NoIndex;
+				evaluatingFile = symbol.file;
+				returnCode = Evaluate(symbolIndex, value, blockingSymbolIndex);
+				evaluatingFile = currentFile;
+				if (returnCode == AssemblerReturnCode_Success)
+				{
+					objectSymbol.value = value;
+					break;
+				}
+
+				// Evaluating may have added symbols, so neither symbol nor objectSymbol may be valid anymore.
+				const Symbol& define = symbols[symbolIndex].value;
+				if (returnCode == AssemblerReturnCode_UndefinedSymbol)
+				{
+					returnCode = AssemblerReturnCode_Success;
+					uint32_t bytecodeOffset = 0;
+					uint32_t bytecodeSize = 0;
+					addBytecode({ defineBytecode.data() + define.bytecodeOffset, define.bytecodeSize }, define.file, bytecodeOffset, bytecodeSize);
+
+					AssemblerObject::Symbol& expressionSymbol = object.symbols[objectSymbolIndices[symbolIndex]];
+					expressionSymbol.kind = AssemblerObject::SymbolKind::Expression;
+					expressionSymbol.bytecodeOffset = bytecodeOffset;
+					expressionSymbol.bytecodeSize = bytecodeSize;
+				}
+				if (returnCode != AssemblerReturnCode_Success)
+				{
+					lineNumber = define.lineNumber;
+					return returnCode;
+				}
+				break;
+			}
+		}
+	}
+
+	return AssemblerReturnCode_Success;
+}
+
+AssemblerReturnCode Assembler::Context::EvaluateData(std::string_view operand, uint8_t size, uint32_t emittedOperandIndex, std::vector<uint8_t>& bytes)
+{
+	if (IsStringOperand(operand))
+	{
+		if (size != 1)
+			return AssemblerReturnCode_InvalidStringLiteral;
+
+		stringBuffer.clear();
+		if (AssemblerReturnCode returnCode = DecodeStringOperand(operand, stringBuffer); returnCode != AssemblerReturnCode_Success)
+			return returnCode;
+		bytes.insert(bytes.end(), stringBuffer.begin(), stringBuffer.end());
+		return AssemblerReturnCode_Success;
+	}
+
+	// Every symbol is either defined by now or never will be, so nothing is left waiting.
+	// An operand that is evaluated again as it was already has its uses recorded.
+	size_t bytecodeOffset = fixupBytecode.size();
+	bool outerRecordOperands = recordOperands;
+	recordOperands = recordOperands && emittedOperandIndex != NoIndex;
+	emittingOperand = emittedOperandIndex;
+	Expression::CompileResult result = Expression::Compile(operand, *this, fixupBytecode);
+	emittingOperand = NoIndex;
+	recordOperands = outerRecordOperands;
+	if (result.returnCode == AssemblerReturnCode_Success && !result.isConstant)
+	{
+		Expression::EvaluateResult evaluateResult = Expression::Evaluate({ fixupBytecode.data() + bytecodeOffset, fixupBytecode.size() - bytecodeOffset }, *this);
+		result.returnCode = evaluateResult.returnCode;
+		result.value = evaluateResult.value;
+	}
+	fixupBytecode.resize(bytecodeOffset);
+
+	if (result.returnCode != AssemblerReturnCode_Success)
+		return result.returnCode;
+	if (!NumericLiteral::FitsOperandSize(result.value, size))
+		return AssemblerReturnCode_OperandOutOfRange;
+
+	bytes.push_back(static_cast<uint8_t>(result.value));
+	if (size == 2)
+		bytes.push_back(static_cast<uint8_t>(result.value >> 8));
+	return AssemblerReturnCode_Success;
+}
+
+bool Assembler::Context::Redefine(std::string_view name, std::string_view operand, size_t lineNumber, uint32_t& firstUse)
+{
+	// Without operand uses, there's no telling what else uses it.
+	uint32_t symbolIndex = symbols.Find(name);
+	if (!recordOperands || symbolIndex == SymbolTable<Symbol>::InvalidIndex)
+		return false;
+
+	const Symbol& define = symbols[symbolIndex].value;
+	if (define.kind != SymbolKind::Define || define.isString || define.isUsedOutsideOperands || define.file != 0 || define.lineNumber != lineNumber)
+		return false;
+	if (IsStringOperand(operand))
+		return false;
+
+	// Whatever the new value uses is now used by a define, like it would be when assembling everything again.
+	size_t bytecodeOffset = defineBytecode.size();
+	uint32_t symbolCount = static_cast<uint32_t>(symbols.Size());
+	Expression::CompileResult result = Expression::Compile(operand, *this, defineBytecode);
+	if (result.returnCode == AssemblerReturnCode_Success && !result.isConstant)
+	{
+		Expression::EvaluateResult evaluateResult = Expression::Evaluate({ defineBytecode.data() + bytecodeOffset, defineBytecode.size() - bytecodeOffset }, *this);
+		result.returnCode = evaluateResult.returnCode;
+		result.value = evaluateResult.value;
+	}
+	defineBytecode.resize(bytecodeOffset);
+
+	// A define that now uses itself is circular, which only assembling everything again reports.
+	Symbol& redefined = symbols[symbolIndex].value;
+	if (result.returnCode != AssemblerReturnCode_Success || redefined.isUsedOutsideOperands || symbols.Size() != symbolCount)
+		return false;
+
+	redefined.value = result.value;
+	redefined.isEvaluated = true;
+	firstUse = redefined.firstUse;
+	return true;
+}
+
+AssemblerReturnCode Assembler::Context::EvaluateInstruction(std::span<const std::string_view> tokens, uint32_t emittedOperandIndex,
+	std::vector<uint8_t>& bytes)
+{
+	EncodedInstruction instruction;
+	if (AssemblerReturnCode returnCode = InstructionEncoder::Encode(MnemonicTable.Find(tokens.front()), tokens.subspan(1), instruction); returnCode != AssemblerReturnCode_Success)
+		return returnCode;
+
+	const InstructionInfo& info = *instruction.info;
+	bytes.insert(bytes.end(), info.opcode.begin(), info.opcode.begin() + info.opcodeSize);
+	if (info.immediateSize == 0)
+		return AssemblerReturnCode_Success;
+	if (IsStringOperand(instruction.immediate))
+		return AssemblerReturnCode_InvalidOperand;
+	return EvaluateData(instruction.immediate, info.immediateSize, emittedOperandIndex, bytes);
+}
+
+bool Assembler::Context::RemoveLabel(std::string_view line, size_t lineNumber, uint32_t& firstUse)
+{
+	std::string_view name;
+	LabelVisibility visibility = LabelVisibility::Private;
+	if (!recordOperands || ParseLabel(line, name, visibility) != AssemblerReturnCode_Success)
+		return false;
+
+	uint32_t symbolIndex = symbols.Find(name);
+	if (symbolIndex == SymbolTable<Symbol>::InvalidIndex || symbols[symbolIndex].value.isUsedOutsideOperands)
+		return false;
+
+	// The source can only have one private or protected label of each name, which is unlinked from its name.
+	uint32_t* link = &symbols[symbolIndex].value.firstScopedLabel;
+	if (visibility != LabelVisibility::Public)
+		while (*link != NoIndex && symbols[*link].value.file != 0)
+			link = &symbols[*link].value.nextScopedLabel;
+
+	uint32_t labelIndex = visibility == LabelVisibility::Public ? symbolIndex : *link;
+	if (labelIndex == NoIndex)
+		return false;
+
+	Symbol& label = symbols[labelIndex].value;
+	if (label.kind != SymbolKind::Label || label.file != 0 || label.lineNumber != lineNumber || label.visibility != visibility)
+		return false;
+	if (visibility != LabelVisibility::Public)
+	{
+		*link = label.nextScopedLabel;
+		label.nextScopedLabel = NoIndex;
+	}
+
+	// Like a name that was only referenced, what uses it now fails to evaluate, unless another label is added.
+	label.kind = SymbolKind::Undefined;
+	label.visibility = LabelVisibility::Private;
+	label.isEvaluated = false;
+	label.value = 0;
+	firstUse = symbols[symbolIndex].value.firstUse;
+	return true;
+}
+
+bool Assembler::Context::AddLabel(std::string_view line, size_t lineNumber, uint32_t address, uint32_t& firstUse)
+{
+	std::string_view name;
+	LabelVisibility visibility = LabelVisibility::Private;
+	if (!recordOperands || ParseLabel(line, name, visibility) != AssemblerReturnCode_Success)
+		return false;
+
+	this->lineNumber = lineNumber;
+	uint32_t symbolIndex = NoIndex;
+	uint32_t labelIndex = NoIndex;
+	if (InsertLabel(name, visibility, address, symbolIndex, labelIndex) != AssemblerReturnCode_Success || symbols[symbolIndex].value.isUsedOutsideOperands)
+		return false;
+
+	symbols[labelIndex].value.isEvaluated = true;
+	firstUse = symbols[symbolIndex].value.firstUse;
+	return true;
+}
+
+AssemblerOutput Assembler::Assemble(std::string_view source, const std::filesystem::path& sourcePath, AssemblerPasses passes, AssemblerStats* stats,
+	std::pmr::memory_resource* resource)
+{
+	return AssembleSource(source, sourcePath, nullptr, nullptr, nullptr, nullptr, passes, stats, resource);
+}
+
+AssemblerOutput Assembler::Assemble(std::string_view source, const std::filesystem::path& sourcePath, ThreadPool& threadPool, AssemblerPasses passes,
+	AssemblerStats* stats, std::pmr::memory_resource* resource)
+{
+	return AssembleSource(source, sourcePath, &threadPool, nullptr, nullptr, nullptr, passes, stats, resource);
+}
+
+AssemblerOutput Assembler::AssembleObject(std::string_view source, AssemblerObject& object, const std::filesystem::path& sourcePath)
+{
+	object = {};
+	return AssembleSource(source, sourcePath, nullptr, &object);
+}
+
+AssemblerOutput Assembler::AssembleImage(std::string_view source, AssemblerImage& image, const std::filesystem::path& sourcePath,
+	AssemblerPasses passes, AssemblerStats* stats, std::pmr::memory_resource* resource)
+{
+	return AssembleSource(source, sourcePath, nullptr, nullptr, nullptr, &image, passes, stats, resource);
+}
+
+AssemblerOutput Assembler::AssembleSource(std::string_view source, const std::filesystem::path& sourcePath, ThreadPool* threadPool,
+	AssemblerObject* object, std::vector<AssemblerDependency>* dependencies, AssemblerImage* image, AssemblerPasses passes, AssemblerStats* stats,
+	std::pmr::memory_resource* resource)
+{
+	if (source.empty())
+		return AssemblerReturnCode_EffectivelyEmptySource;
+
+	// Everything below that only lives for this call is allocated from resource, or else from an arena, so that
+	// the number of heap allocations grows with the size of source, not its line count.
+	std::optional<std::pmr::monotonic_buffer_resource> arena;
+	if (!resource)
+		resource = &arena.emplace(std::max(source.size() * ArenaBytesPerSourceByte, MinArenaSize));
+
+	// Allocations are only counted when they're asked for, so that they cost nothing otherwise.
+	std::optional<AllocationCounter> allocationCounter;
+	if (stats)
+		resource = &allocationCounter.emplace(resource, *stats);
+
+	Context context(resource, sourcePath);
+	if (allocationCounter)
+		allocationCounter->SetPhase(&context.currentPhase);
+	context.isObject = object != nullptr;
+	context.image = image;
+	context.passes = passes;
+	context.stats = stats;
+	context.phaseStart = std::chrono::steady_clock::now();
+	// Whatever isn't in a phase of its own is preprocessing.
+	Context::PhaseScope phaseScope(context, AssemblerPhase_Preprocess);
+
+	// Every file is loaded and tokenized concurrently, then assembled in order from the warm cache.
+	// Files included by inactive branches are loaded too, since which branches are active isn't known yet.
+	if (threadPool)
+	{
+		Context::PhaseScope tokenizeScope(context, AssemblerPhase_Tokenize);
+		IncludePreloader preloader(*threadPool);
+		preloader.Preload(context.GetIncludeDirectory(), source);
+		threadPool->Wait();
+		context.preloadedFiles = std::move(preloader.files);
+	}
+
+	// Separate source code into lines while ignoring preceding whitespace, traling whitespace, and comments.
+	// Lines are split a chunk at a time, and only tokenized once they're known to be active, so that the
+	// lines of inactive branches are skipped as raw text instead.
+	std::pmr::vector<SourceLine>& lines = context.lines;
+	bool isEffectivelyEmpty = true;
+	size_t chunkSize = LineChunkSize;
+	size_t lineNumber = 1;
+	for (size_t offset = 0; offset < source.size();)
+	{
+		// Chunks end with a line ending, so that no line is split in two.
+		size_t chunkEnd = std::min(source.find_first_of("\r\n", std::min(offset + chunkSize, source.size())), source.size());
+		if (chunkEnd < source.size())
+			chunkEnd += source.compare(chunkEnd, 2, "\r\n") == 0 ? 2 : 1;
+
+		// The lines and tokens only ever hold one chunk's worth of source.
+		lines.clear();
+		context.tokenStream.Clear();
+		size_t nextLineNumber = 0;
+		{
+			Context::PhaseScope splitScope(context, AssemblerPhase_Split);
+			nextLineNumber = SourceScanner::SplitLines(source.substr(offset, chunkEnd - offset), lines, lineNumber);
+		}
+		offset = chunkEnd;
+		lineNumber = nextLineNumber;
+		chunkSize = LineChunkSize;
+
+		for (const SourceLine& line : lines)
+		{
+			isEffectivelyEmpty = false;
+			if (AssemblerReturnCode returnCode = context.ProcessLine(line); returnCode != AssemblerReturnCode_Success)
+				return { returnCode, context.lineNumber };
+
+			// The line that ends the inactive branch is likely followed by active lines, but it may be
+			// the start of another inactive one, so only that line is split at first.
+			if (context.IsSkipping())
+			{
+				Context::PhaseScope splitScope(context, AssemblerPhase_Split);
+				lineNumber = line.number;
+				offset = SkipInactiveLines(source, static_cast<size_t>(line.data() + line.size() - source.data()), lineNumber);
+				chunkSize = 0;
+				break;
+			}
+		}
+	}
+
+	if (isEffectivelyEmpty)
+		return AssemblerReturnCode_EffectivelyEmptySource;
+	if (dependencies)
+		context.GetDependencies(*dependencies);
+	if (object)
+	{
+		if (AssemblerReturnCode returnCode = context.FinishObject(*object); returnCode != AssemblerReturnCode_Success)
+		{
+			*object = {};
+			return { returnCode, context.lineNumber };
+		}
+		return AssemblerReturnCode_Success;
+	}
+	return context.Finish();
+}
+
+AssemblerStream::AssemblerStream(SectionSink sectionSink, const std::filesystem::path& sourcePath)
+	: context(std::make_unique<Assembler::Context>(std::pmr::get_default_resource(), sourcePath, std::move(sectionSink), true)) {}
+
+AssemblerStream::~AssemblerStream() = default;
+
+bool AssemblerStream::Feed(std::string_view chunk)
+{
+	if (returnCode != AssemblerReturnCode_Success)
+		return false;
+
+	// Only complete lines are assembled now. A CR at the very end might be the first half of a CRLF.
+	size_t completeSize = chunk.size();
+	while (completeSize > 0)
+	{
+		char c = chunk[completeSize - 1];
+		if (c == '\n' || (c == '\r' && completeSize != chunk.size()))
+			break;
+		completeSize--;
+	}
+
+	if (completeSize == 0)
+	{
+		partialLine.append(chunk);
+		return true;
+	}
+
+	std::string_view completeLines = chunk.substr(0, completeSize);
+	if (!partialLine.empty())
+	{
+		// Finish the line carried over from the last chunk with the start of this one.
+		size_t lineEnd = completeLines.find_first_of("\r\n");
+		lineEnd += (completeLines[lineEnd] == '\r' && lineEnd + 1 < completeLines.size() && completeLines[lineEnd + 1] == '\n') ? 2 : 1;
+		partialLine.append(completeLines.substr(0, lineEnd));
+		AssembleLines(partialLine);
+		completeLines.remove_prefix(lineEnd);
+	}
+
+	AssembleLines(completeLines);
+	partialLine.assign(chunk.substr(completeSize));
+	return returnCode == AssemblerReturnCode_Success;
+}
+
+AssemblerOutput AssemblerStream::Finish()
+{
+	if (!partialLine.empty())
+	{
+		AssembleLines(partialLine);
+		partialLine.clear();
+	}
+
+	if (returnCode != AssemblerReturnCode_Success)
+		return { returnCode, errorLineNumber };
+	return context->Finish();
+}
+
+void AssemblerStream::AssembleLines(std::string_view text)
+{
+	if (returnCode != AssemblerReturnCode_Success)
+		return;
+
+	// The lines and tokens only ever hold one chunk's worth of source, and keep their capacity between chunks.
+	context->lines.clear();
+	lineNumber = SourceScanner::SplitLines(text, context->lines, lineNumber);
+
+	for (const SourceLine& line : context->lines)
+	{
+		if (AssemblerReturnCode lineReturnCode = context->ProcessLine(line); lineReturnCode != AssemblerReturnCode_Success)
+		{
+			returnCode = lineReturnCode;
+			errorLineNumber = context->lineNumber;
+			break;
+		}
+	}
+
+	context->tokenStream.Clear();
+}
+
+AssemblerSession::AssemblerSession(const std::filesystem::path& sourcePath)
+	: sourcePath(sourcePath), output(AssemblerReturnCode_EffectivelyEmptySource), image(AddressSpaceSize) {}
+
+AssemblerSession::~AssemblerSession() = default;
+
+const AssemblerOutput& AssemblerSession::Assemble(std::string_view source)
+{
+	std::vector<AssemblerPatch> patches;
+	lines.clear();
+	context.reset();
+	return Edit(1, 0, source, patches);
+}
+
+const AssemblerOutput& AssemblerSession::Edit(size_t firstLineNumber, size_t lineCount, std::string_view text, std::vector<AssemblerPatch>& patches)
+{
+	// Edits past the last line append to it.
+	firstLineNumber = std::clamp<size_t>(firstLineNumber, 1, lines.size() + 1);
+	lineCount = std::min(lineCount, lines.size() + 1 - firstLineNumber);
+
+	// Only the new lines are tokenized.
+	std::vector<std::unique_ptr<Line>> newLines;
+	TokenizeLines(text, firstLineNumber, newLines);
+
+	auto firstLine = lines.begin() + static_cast<ptrdiff_t>(firstLineNumber - 1);
+	if (newLines.size() == lineCount)
+	{
+		// No line moved, so every operand that wasn't edited was emitted where it was before.
+		std::swap_ranges(newLines.begin(), newLines.end(), firstLine);
+		if (context && ReemitLines(firstLineNumber, newLines, patches))
+			return output;
+	}
+	else
+	{
+		firstLine = lines.erase(firstLine, firstLine + static_cast<ptrdiff_t>(lineCount));
+		lines.insert(firstLine, std::make_move_iterator(newLines.begin()), std::make_move_iterator(newLines.end()));
+	}
+
+	AssembleLines(patches);
+	return output;
+}
+
+void AssemblerSession::GetDependencies(std::vector<AssemblerDependency>& dependencies) const
+{
+	if (context)
+		context->GetDependencies(dependencies);
+}
+
+void AssemblerSession::TokenizeLines(std::string_view text, size_t firstLineNumber, std::vector<std::unique_ptr<Line>>& newLines)
+{
+	std::pmr::vector<SourceLine> sourceLines;
+	TokenStream tokenStream;
+
+	// SplitLines skips blank lines, so text is split into lines here, to keep every line's number.
+	size_t lineNumber = firstLineNumber;
+	for (size_t start = 0; start < text.size(); lineNumber++)
+	{
+		size_t end = std::min(text.find_first_of("\r\n", start), text.size());
+		std::unique_ptr<Line>& line = newLines.emplace_back(std::make_unique<Line>());
+		line->text.assign(text.substr(start, end - start));
+
+		start = end;
+		if (start < text.size())
+			start += text[start] == '\r' && start + 1 < text.size() && text[start + 1] == '\n' ? 2 : 1;
+
+		sourceLines.clear();
+		SourceScanner::SplitLines(line->text, sourceLines, lineNumber);
+		if (sourceLines.empty())
+			continue;
+
+		tokenStream.Clear();
+		if (line->returnCode = tokenStream.Append(sourceLines.front()); line->returnCode != AssemblerReturnCode_Success)
+			continue;
+
+		const TokenizedLine& tokenizedLine = tokenStream.lines.front();
+		std::span<const std::string_view> tokens = tokenStream.GetTokens(tokenizedLine);
+		line->tokens.assign(tokens.begin(), tokens.end());
+		line->isLabel = tokenizedLine.isLabel;
+	}
+}
+
+AssemblerSession::LineKind AssemblerSession::GetLineKind(const Line& line) const
+{
+	if (line.tokens.empty())
+		return LineKind::Empty;
+	if (line.isLabel)
+		return LineKind::Label;
+	if (line.tokens.front().front() != '.')
+		return context->IsMacro(line.tokens.front()) ? LineKind::Other : LineKind::Instruction;
+
+	switch (GetDirective(line.tokens.front()))
+	{
+		case Directive::Define:
+			return LineKind::Define;
+		case Directive::Byte:
+		case Directive::Word:
+			return LineKind::Data;
+		default:
+			return LineKind::Other;
+	}
+}
+
+bool AssemblerSession::ReemitLines(size_t firstLineNumber, std::span<const std::unique_ptr<Line>> oldLines, std::vector<AssemblerPatch>& patches)
+{
+	// A source that is effectively empty has no program to patch.
+	if (output.returnCode != AssemblerReturnCode_Success)
+		return false;
+
+	// Every define and label changes before any operand is re-emitted, so that each is evaluated once everything
+	// it uses has its new value. Labels are removed before any are added, so that a label may move to another line.
+	pendingWrites.clear();
+	pendingBytes.clear();
+	std::vector<uint32_t> firstUses;
+	bool hasLabelEdits = false;
+	for (size_t i = 0; i < oldLines.size(); i++)
+	{
+		size_t lineNumber = firstLineNumber + i;
+		const Line& oldLine = *oldLines[i];
+		const Line& newLine = *lines[lineNumber - 1];
+		if (newLine.returnCode != AssemblerReturnCode_Success)
+			return false;
+
+		// Edits that keep every token, like edits of comments, change nothing.
+		if (oldLine.isLabel == newLine.isLabel && std::ranges::equal(oldLine.tokens, newLine.tokens))
+			continue;
+
+		// Lines that were skipped, or that are part of a macro, aren't emitted where they are.
+		LineKind oldKind = GetLineKind(oldLine);
+		LineKind newKind = GetLineKind(newLine);
+		bool isLabelEdit = (oldKind == LineKind::Label || oldKind == LineKind::Empty) && (newKind == LineKind::Label || newKind == LineKind::Empty);
+		if (lineAddresses[lineNumber - 1] == NoAddress || (!isLabelEdit && (oldKind != newKind || oldKind == LineKind::Other)))
+			return false;
+
+		hasLabelEdits = hasLabelEdits || isLabelEdit;
+		if (oldKind == LineKind::Label)
+		{
+			uint32_t firstUse = Assembler::Context::NoIndex;
+			if (!context->RemoveLabel(oldLine.tokens.front(), lineNumber, firstUse))
+				return false;
+			firstUses.push_back(firstUse);
+		}
+	}
+
+	// Removing the last line that isn't empty makes the source effectively empty.
+	if (hasLabelEdits && std::ranges::all_of(lines, [](const std::unique_ptr<Line>& line) { return line->tokens.empty(); }))
+		return false;
+
+	for (size_t i = 0; i < oldLines.size(); i++)
+	{
+		size_t lineNumber = firstLineNumber + i;
+		const Line& oldLine = *oldLines[i];
+		const Line& newLine = *lines[lineNumber - 1];
+		if (oldLine.isLabel == newLine.isLabel && std::ranges::equal(oldLine.tokens, newLine.tokens))
+			continue;
+
+		uint32_t firstUse = Assembler::Context::NoIndex;
+		LineKind kind = GetLineKind(newLine);
+		if (kind == LineKind::Label)
+		{
+			if (!context->AddLabel(newLine.tokens.front(), lineNumber, lineAddresses[lineNumber - 1], firstUse))
+				return false;
+			firstUses.push_back(firstUse);
+		}
+		else if (kind == LineKind::Define)
+		{
+			if (oldLine.tokens.size() != 3 || newLine.tokens.size() != 3 || oldLine.tokens[1] != newLine.tokens[1])
+				return false;
+			if (!context->Redefine(newLine.tokens[1], newLine.tokens[2], lineNumber, firstUse))
+				return false;
+			firstUses.push_back(firstUse);
+		}
+	}
+
+	for (size_t i = 0; i < oldLines.size(); i++)
+	{
+		size_t lineNumber = firstLineNumber + i;
+		const Line& oldLine = *oldLines[i];
+		const Line& newLine = *lines[lineNumber - 1];
+		LineKind kind = GetLineKind(newLine);
+		if ((kind != LineKind::Data && kind != LineKind::Instruction) || std::ranges::equal(oldLine.tokens, newLine.tokens))
+			continue;
+
+		// An instruction is one EmittedOperand, and a data line is one for each of its operands.
+		size_t operandCount = kind == LineKind::Data ? newLine.tokens.size() - 1 : 1;
+		if (kind == LineKind::Data && oldLine.tokens.size() != newLine.tokens.size())
+			return false;
+
+		auto [first, last] = std::ranges::equal_range(context->emittedOperands, lineNumber, {}, &Assembler::Context::EmittedOperand::lineNumber);
+		if (static_cast<size_t>(last - first) != operandCount)
+			return false;
+
+		for (auto it = first; it != last; it++)
+		{
+			if (kind == LineKind::Data)
+				it->operandSize = GetDirective(newLine.tokens.front()) == Directive::Byte ? 1 : 2;
+			if (!ReemitOperand(static_cast<uint32_t>(it - context->emittedOperands.begin()), newLine.tokens, true))
+				return false;
+		}
+	}
+
+	for (uint32_t firstUse : firstUses)
+		if (!ReemitUses(firstUse))
+			return false;
+
+	// Every operand still fits, so nothing else moved. Later writes to the same operand are newer.
+	for (const PendingWrite& write : pendingWrites)
+		Patch(write.address, { pendingBytes.data() + write.offset, write.size }, patches);
+	if (hasLabelEdits)
+		context->GetSymbols(output.symbols);
+	return true;
+}
+
+bool AssemblerSession::ReemitUses(uint32_t firstUse)
+{
+	// The operand's own text didn't change, so neither did what it uses.
+	for (uint32_t useIndex = firstUse; useIndex != Assembler::Context::NoIndex; useIndex = context->GetOperandUse(useIndex).nextUse)
+	{
+		uint32_t emittedOperandIndex = context->GetOperandUse(useIndex).emittedOperandIndex;
+		if (!ReemitOperand(emittedOperandIndex, lines[context->emittedOperands[emittedOperandIndex].lineNumber - 1]->tokens, false))
+			return false;
+	}
+	return true;
+}
+
+bool AssemblerSession::ReemitOperand(uint32_t emittedOperandIndex, std::span<const std::string_view> tokens, bool recordUses)
+{
+	const Assembler::Context::EmittedOperand& emittedOperand = context->emittedOperands[emittedOperandIndex];
+	uint32_t useIndex = recordUses ? emittedOperandIndex : Assembler::Context::NoIndex;
+	size_t offset = pendingBytes.size();
+	AssemblerReturnCode returnCode = AssemblerReturnCode_InvalidOperandCount;
+	if (emittedOperand.operandSize == 0)
+		returnCode = context->EvaluateInstruction(tokens, useIndex, pendingBytes);
+	else if (tokens.size() > 1 + emittedOperand.operandIndex)
+		returnCode = context->EvaluateData(tokens[1 + emittedOperand.operandIndex], emittedOperand.operandSize, useIndex, pendingBytes);
+	if (returnCode != AssemblerReturnCode_Success || pendingBytes.size() - offset != emittedOperand.size)
+		return false;
+
+	pendingWrites.push_back({ emittedOperand.address, offset, emittedOperand.size });
+	return true;
+}
+
+void AssemblerSession::AssembleLines(std::vector<AssemblerPatch>& patches)
+{
+	// Edits free the lines they replace, which names of symbols may still point into.
+	context = std::make_unique<Assembler::Context>(std::pmr::get_default_resource(), sourcePath, Assembler::Context::SectionSink(), true);
+	context->recordOperands = true;
+
+	AssemblerReturnCode returnCode = AssemblerReturnCode_Success;
+	bool isEffectivelyEmpty = true;
+	lineAddresses.clear();
+	for (size_t i = 0; i < lines.size() && returnCode == AssemblerReturnCode_Success; i++)
+	{
+		const Line& line = *lines[i];
+		context->lineNumber = i + 1;
+		lineAddresses.push_back(context->IsSkipping() || context->IsRecordingMacro() ? NoAddress : context->GetCurrentAddress());
+		if (line.returnCode != AssemblerReturnCode_Success)
+			returnCode = line.returnCode;
+		else if (!line.tokens.empty())
+		{
+			TokenizedLine tokenizedLine{ 0, static_cast<uint32_t>(line.tokens.size()), i + 1, line.isLabel };
+			returnCode = context->ProcessTokenizedLine(tokenizedLine, line.tokens);
+			isEffectivelyEmpty = false;
+		}
+	}
+
+	AssemblerOutput newOutput = returnCode != AssemblerReturnCode_Success ? AssemblerOutput(returnCode, context->lineNumber) : context->Finish();
+	if (!newOutput)
+	{
+		// The image stays the last program that assembled, for the next edit to be compared with.
+		context.reset();
+		output = std::move(newOutput);
+		return;
+	}
+	if (isEffectivelyEmpty)
+		newOutput.returnCode = AssemblerReturnCode_EffectivelyEmptySource;
+
+	// Sections never overlap, so every byte of the image comes from one operand.
+	std::vector<uint8_t> newImage(AddressSpaceSize);
+	for (const AssemblerProgramSection& section : newOutput.sections)
+		std::copy(section.assembly.begin(), section.assembly.end(), newImage.begin() + section.origin);
+
+	for (uint32_t address = 0; address < AddressSpaceSize;)
+	{
+		if (image[address] == newImage[address])
+		{
+			address++;
+			continue;
+		}
+
+		AssemblerPatch& patch = patches.emplace_back();
+		patch.address = static_cast<uint16_t>(address);
+		for (; address < AddressSpaceSize && image[address] != newImage[address]; address++)
+			patch.bytes.push_back(newImage[address]);
+	}
+
+	image = std::move(newImage);
+	output = std::move(newOutput);
+}
+
+void AssemblerSession::Patch(uint32_t address, std::span<const uint8_t> bytes, std::vector<AssemblerPatch>& patches)
+{
+	for (size_t i = 0; i < bytes.size(); i++)
+	{
+		if (image[address + i] == bytes[i])
+			continue;
+
+		// Runs of changed bytes are merged into one patch.
+		if (patches.empty() || patches.back().address + patches.back().bytes.size() != address + i)
+			patches.emplace_back().address = static_cast<uint16_t>(address + i);
+		patches.back().bytes.push_back(bytes[i]);
+		image[address + i] = bytes[i];
+	}
+
+	// Sections don't overlap, so exactly one of them holds the bytes.
+	for (AssemblerProgramSection& section : output.sections)
+	{
+		if (address >= section.origin && address + bytes.size() <= section.origin + section.assembly.size())
+		{
+			std::copy(bytes.begin(), bytes.end(), section.assembly.begin() + (address - section.origin));
+			break;
+		}
+	}
+}
+
@@ -1,8 +1,21 @@
 #pragma once
 
+#include "AssemblerLineMap.h"
+#include "CharacterClass.h"
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <string>
 #include <string_view>
 #include <vector>
 
+class ThreadPool;
+struct AssemblerObject;
+
 using AssemblerReturnCode = uint16_t;
 enum AssemblerReturnCode_ : AssemblerReturnCode
 {
@@ -18,12 +31,114 @@ enum AssemblerReturnCode_ : AssemblerReturnCode
 	AssemblerReturnCode_InvalidDirective,
 	AssemblerReturnCode_InvalidOperand,
 	AssemblerReturnCode_InvalidStringLiteral,
+	AssemblerReturnCode_InvalidOperandCount,
+	AssemblerReturnCode_OperandOutOfRange,
+	AssemblerReturnCode_UndefinedSymbol,
+	AssemblerReturnCode_AddressOverflow,
+	AssemblerReturnCode_InvalidExpression,
+	AssemblerReturnCode_DivisionByZero,
+	AssemblerReturnCode_DuplicateDefine,
+	AssemblerReturnCode_CircularDefine,
+	AssemblerReturnCode_InvalidMacroDefinition,
+	AssemblerReturnCode_DuplicateMacroDefinition,
+	AssemblerReturnCode_UnterminatedMacro,
+	AssemblerReturnCode_MacroNestingTooDeep,
+	AssemblerReturnCode_IncludeNotFound,
+	AssemblerReturnCode_CircularInclude,
+	AssemblerReturnCode_InaccessibleLabel,
+	AssemblerReturnCode_UnmatchedConditional,
+	AssemblerReturnCode_UnterminatedConditional,
+	AssemblerReturnCode_InvalidObject,
+	AssemblerReturnCode_OverlappingSections,
+	AssemblerReturnCode_SourceNotFound,
+	AssemblerReturnCode_ServiceUnavailable,
+	AssemblerReturnCode_InvalidRequest,
+	AssemblerReturnCode_InvalidMnemonic,
+};
+
+enum class LabelVisibility : uint8_t
+{
+	// Only accessible in this file. This is the default.
+	// Private and protected labels only conflict with labels that are accessible in the same files.
+	Private,
+	// Accessible in any file that includes this file.
+	Protected,
+	// Accessible in any file that includes this file or any file that
+	// includes a file that includes a file ... that includes this file.
+	Public
 };
 
 struct AssemblerProgramSection
 {
 	uint16_t origin = 0;
 	std::vector<uint8_t> assembly;
+	// Which line each byte of assembly came from. Bytes of a macro come from the line that invoked it.
+	AssemblerLineMap lineMap;
+};
+
+// A label, and the address it was defined at.
+struct AssemblerSymbol
+{
+	std::string name;
+	uint16_t address = 0;
+};
+
+// Passes of the peephole optimizer, see Assembler::Assemble().
+using AssemblerPass = uint8_t;
+enum AssemblerPass_ : AssemblerPass
+{
+	// Deletes mvr r, r, which is assembled as a nop otherwise.
+	AssemblerPass_SelfMoves,
+	// Deletes ldi whose register is written again before anything reads it.
+	AssemblerPass_DeadLoads,
+	// Deletes cmp whose flags are all written again before anything reads them.
+	AssemblerPass_DeadCompares,
+	// Deletes the instructions after halt, or after jmp or ret without a condition, up to the next label.
+	AssemblerPass_UnreachableCode,
+
+	AssemblerPass_Count
+};
+
+// Bit n is set if AssemblerPass n runs.
+using AssemblerPasses = uint8_t;
+static constexpr AssemblerPasses AllAssemblerPasses = (1 << AssemblerPass_Count) - 1;
+
+// What a pass of the peephole optimizer deleted.
+struct AssemblerPassStats
+{
+	uint32_t instructions = 0;
+	uint32_t bytes = 0;
+	// Cycles of the deleted instructions, see InstructionSet.
+	uint32_t cycles = 0;
+};
+
+// The phases of assembling, see AssemblerStats.
+using AssemblerPhase = uint8_t;
+enum AssemblerPhase_ : AssemblerPhase
+{
+	// Splitting source into lines, and skipping the lines of inactive branches.
+	AssemblerPhase_Split,
+	// Tokenizing lines, and loading and tokenizing included files.
+	AssemblerPhase_Tokenize,
+	// Labels, defines, macros, conditionals, includes, and .origin.
+	AssemblerPhase_Preprocess,
+	// Instructions and data, resolving what refers to labels, and building the output.
+	AssemblerPhase_Encode,
+
+	AssemblerPhase_Count
+};
+
+// Where assembling spent its time. Every call that is given one adds to it, so one may be shared by several calls
+// that don't run at the same time.
+struct AssemblerStats
+{
+	// By phase. Time spent in a phase that another phase interrupted, like tokenizing an included file, only
+	// counts for the phase that interrupted it.
+	std::array<uint64_t, AssemblerPhase_Count> nanoseconds{};
+	// What was allocated from the memory resource that assembling works in, by phase, see Assembler::Assemble().
+	// The output is allocated elsewhere, and isn't counted.
+	std::array<uint64_t, AssemblerPhase_Count> allocatedBytes{};
+	std::array<uint64_t, AssemblerPhase_Count> allocations{};
 };
 
 struct AssemblerOutput
@@ -31,6 +146,13 @@ struct AssemblerOutput
 	AssemblerReturnCode returnCode = AssemblerReturnCode_Success;
 	size_t lineNumber = 0; // Only relevant if returnCode is not AssemblerReturnCode_Success.
 	std::vector<AssemblerProgramSection> sections; // Only relevant if returnCode is AssemblerReturnCode_Success.
+	// Every label, sorted by address, for disassemblers and debuggers. Only relevant if returnCode is AssemblerReturnCode_Success.
+	std::vector<AssemblerSymbol> symbols;
+	// The files that the line maps of sections refer to: the source, then every file it included, once each.
+	// Only relevant if returnCode is AssemblerReturnCode_Success.
+	std::vector<std::filesystem::path> files;
+	// What each AssemblerPass deleted, by pass. Only relevant if returnCode is AssemblerReturnCode_Success.
+	std::array<AssemblerPassStats, AssemblerPass_Count> passStats{};
 
 	constexpr AssemblerOutput() noexcept = default;
 	constexpr AssemblerOutput(AssemblerReturnCode returnCode, size_t lineNumber = 0, std::vector<AssemblerProgramSection>&& sections = {}) noexcept
@@ -42,22 +164,111 @@ struct AssemblerOutput
 	}
 };
 
+// The whole address space of a program, as the machine sees it, see Assembler::AssembleImage().
+// The memory is the caller's, so it can be handed to the machine, or be a mapped file, without copying it.
+struct AssemblerImage
+{
+	static constexpr size_t Size = 0x10000;
+
+	std::span<uint8_t, Size> memory;
+	// Bit i % 64 of writtenBits[i / 64] is set if byte i was written.
+	std::array<uint64_t, Size / 64> writtenBits{};
+
+	constexpr AssemblerImage(std::span<uint8_t, Size> memory) noexcept
+		: memory(memory) {}
+
+	constexpr bool IsWritten(uint16_t address) const noexcept
+	{
+		return (writtenBits[address / 64] >> (address % 64)) & 1;
+	}
+
+	// Forgets which bytes were written. The memory is left as it is.
+	constexpr void ClearWritten() noexcept
+	{
+		writtenBits = {};
+	}
+};
+
+// A file that assembling a source included, and the hash of the contents it was assembled with, see ContentHash.
+struct AssemblerDependency
+{
+	std::filesystem::path path; // Canonical
+	uint64_t contentHash = 0;
+};
+
 class Assembler
 {
 public:
-	// Assumes line endings are one of LF, CRLF, or CR, and are consistent.
-	// Otherwise, you could get errors and warnings reported on incorrect lines.
+	// Line endings may be any of LF, CRLF, or CR.
+	// Relative .include paths are relative to the directory of sourcePath, or the working directory if it's empty.
+	// Errors in included files are reported on the line of the outermost .include.
+	// Sections may not overlap, so emitting a byte that another section already emitted fails with
+	// AssemblerReturnCode_OverlappingSections.
 	// NOTE: the data source points to must stay alive for the duration of this function.
-	static AssemblerOutput Assemble(std::string_view source);
+	//
+	// Instructions are optimized by every pass in passes before they're emitted. Each run of instructions
+	// without a label or a directive between them is optimized on its own, assuming that anything after it may
+	// read any register or flag, and that code is only ever entered at labels. Labels after deleted instructions
+	// move back with the rest of the code. Optimizing never hides an error: an instruction whose immediate isn't a
+	// constant that fits, like one that uses an undefined symbol or a label defined further on, is kept.
+	//
+	// If stats isn't nullptr, the time each phase took, and what it allocated, is added to it. Timing reads the clock
+	// whenever the phase changes, which is a few times per line, so it slows assembling down noticeably.
+	//
+	// The scratch space that only lives for the call, like the tokens, symbols, macros, and fixups, is allocated from
+	// resource. Without one, an arena sized after source is made for the call. A caller that assembles over and over
+	// can pass a std::pmr::monotonic_buffer_resource over a buffer of its own, and release() it between calls, so that
+	// every call reuses the buffer for its scratch space. The bytes and line maps of sections are the output, which is
+	// built on the heap, and moved out without a copy. Included files are kept in the IncludeCache instead. Nothing in
+	// the output points into resource, so it may be released as soon as this returns.
+	static AssemblerOutput Assemble(std::string_view source, const std::filesystem::path& sourcePath = {}, AssemblerPasses passes = 0,
+		AssemblerStats* stats = nullptr, std::pmr::memory_resource* resource = nullptr);
+
+	// Like above, but every file reachable through .include directives with constant paths is loaded and
+	// tokenized concurrently on threadPool first. Only the final pass over the tokens, which defines symbols
+	// and resolves fixups, is serial.
+	// NOTE: waits for every task on threadPool, not only the ones this submits.
+	static AssemblerOutput Assemble(std::string_view source, const std::filesystem::path& sourcePath, ThreadPool& threadPool, AssemblerPasses passes = 0,
+		AssemblerStats* stats = nullptr, std::pmr::memory_resource* resource = nullptr);
+
+	// Like above, but assembles source into an object for the Linker instead, see AssemblerObject.
+	// Symbols that source never defines are imported instead of being errors. On success, the output has no sections.
+	static AssemblerOutput AssembleObject(std::string_view source, AssemblerObject& object, const std::filesystem::path& sourcePath = {});
+
+	// Like Assemble(), but writes every byte straight into image's memory instead, and marks it as written.
+	// Writing a byte that is already marked as written fails with AssemblerReturnCode_OverlappingSections, so
+	// several programs may be assembled into one image as long as they don't overlap. Bytes that aren't written
+	// are left as they are. On success, the output has no sections. On failure, image may be partly written.
+	static AssemblerOutput AssembleImage(std::string_view source, AssemblerImage& image, const std::filesystem::path& sourcePath = {},
+		AssemblerPasses passes = 0, AssemblerStats* stats = nullptr, std::pmr::memory_resource* resource = nullptr);
 private:
-	struct Line;
-	struct TokenizedLine;
+	friend class AssemblerStream;
+	friend class AssemblerSession;
+	friend class AssemblyCache;
+	friend class CompileTimeAssembler;
+
+	struct Context;
+
+	// If dependencies isn't nullptr, every file that was included is added to it, once.
+	static AssemblerOutput AssembleSource(std::string_view source, const std::filesystem::path& sourcePath, ThreadPool* threadPool,
+		AssemblerObject* object = nullptr, std::vector<AssemblerDependency>* dependencies = nullptr, AssemblerImage* image = nullptr,
+		AssemblerPasses passes = 0, AssemblerStats* stats = nullptr, std::pmr::memory_resource* resource = nullptr);
 private:
-	static bool IsLabel(std::string_view text);
-	static bool IsBinary(std::string_view text, std::string_view& tidiedNumber);
-	static bool IsDecimal(std::string_view text, std::string_view& tidiedNumber);
-	static bool IsHexadecimal(std::string_view text, std::string_view& tidiedNumber);
-	static uint8_t GetBase(std::string_view text, std::string_view& tidiedNumber);
+	static constexpr bool IsLabel(std::string_view text) noexcept
+	{
+		// Evaluate this regex: "^[_a-zA-Z][._a-zA-Z0-9]*$"
+
+		// If the first character is not valid, text is not a label.
+		if (text.empty() || !IsIdentifierStart(text.front()))
+			return false;
+
+		// Check the rest of the characters.
+		for (size_t j = 1; j < text.size(); j++)
+			if (!IsIdentifierContinue(text[j]))
+				return false;
+
+		return true;
+	}
 private:
 	Assembler() = delete;
 	Assembler(const Assembler&) = delete;
@@ -66,3 +277,147 @@ private:
 	Assembler& operator=(Assembler&&) = delete;
 	~Assembler() = delete;
 };
+
+// Assembles source that arrives in chunks, without ever holding all of it in memory.
+// Lines and string literals may be split across chunks. Each section is handed to the sink as soon as
+// all of its bytes are known, so peak memory is bounded by the chunk size, the symbol table, and the
+// sections still waiting on forward label references, not by the size of the source.
+class AssemblerStream
+{
+public:
+	using SectionSink = std::function<void(AssemblerProgramSection&& section)>;
+public:
+	// If sectionSink is empty, every section is returned by Finish() instead.
+	// sourcePath is used like in Assembler::Assemble().
+	AssemblerStream(SectionSink sectionSink = {}, const std::filesystem::path& sourcePath = {});
+	~AssemblerStream();
+
+	// Assembles every complete line in chunk, and keeps the rest for the next call.
+	// Returns false if assembly failed, in which case Finish() reports why.
+	// NOTE: the data chunk points to only needs to stay alive for the duration of this function.
+	bool Feed(std::string_view chunk);
+
+	// Assembles whatever is left and resolves every remaining label reference.
+	AssemblerOutput Finish();
+private:
+	void AssembleLines(std::string_view text);
+private:
+	AssemblerStream(const AssemblerStream&) = delete;
+	AssemblerStream(AssemblerStream&&) = delete;
+	AssemblerStream& operator=(const AssemblerStream&) = delete;
+	AssemblerStream& operator=(AssemblerStream&&) = delete;
+private:
+	std::unique_ptr<Assembler::Context> context;
+	std::string partialLine;
+	size_t lineNumber = 1;
+	AssemblerReturnCode returnCode = AssemblerReturnCode_Success;
+	size_t errorLineNumber = 0;
+};
+
+// Bytes of the program that changed, see AssemblerSession::Edit().
+struct AssemblerPatch
+{
+	uint16_t address = 0;
+	std::vector<uint8_t> bytes;
+};
+
+// Assembles a source that is edited over and over, like an editor's buffer, and reports what changed.
+// Every line's tokens are kept, so an edit only tokenizes the lines it replaces. The symbol table is kept too,
+// along with where each instruction and .byte and .word operand of the source was emitted, and which symbols
+// it used. An edit that keeps the number of lines only re-emits the operands it affects if it only:
+// - changes such operands or instructions, without changing how many bytes they take,
+// - changes the value of a numeric .define,
+// - or adds, removes, renames, or moves labels, between lines that emit nothing,
+// and nothing but those operands uses the defines and labels it changes.
+// Any other edit assembles the kept tokens again.
+// NOTE: labels at the same address may be listed in another order than assembling everything again lists them.
+class AssemblerSession
+{
+public:
+	// sourcePath is used like in Assembler::Assemble().
+	AssemblerSession(const std::filesystem::path& sourcePath = {});
+	~AssemblerSession();
+
+	// Replaces the whole source, and assembles it.
+	const AssemblerOutput& Assemble(std::string_view source);
+
+	// Replaces lineCount lines, starting at line firstLineNumber, with the lines of text, and assembles the result.
+	// Inserting lines uses a lineCount of 0, and removing them uses an empty text.
+	// Every byte whose value changed since the last successful assembly is added to patches, counting bytes that
+	// are no longer emitted as 0. If assembly fails, nothing is added, and the next edit is compared with the
+	// last program that did assemble.
+	const AssemblerOutput& Edit(size_t firstLineNumber, size_t lineCount, std::string_view text, std::vector<AssemblerPatch>& patches);
+
+	const AssemblerOutput& GetOutput() const noexcept { return output; }
+	size_t GetLineCount() const noexcept { return lines.size(); }
+	// Adds every file the last successful assembly included. Edits don't notice when those files change.
+	void GetDependencies(std::vector<AssemblerDependency>& dependencies) const;
+private:
+	static constexpr uint32_t NoAddress = ~uint32_t(0);
+
+	struct Line
+	{
+		std::string text;
+		// Views of text. Empty if the line is blank or only a comment.
+		std::vector<std::string_view> tokens;
+		bool isLabel = false;
+		AssemblerReturnCode returnCode = AssemblerReturnCode_Success;
+	};
+
+	// What kind of edit of a line can be re-emitted on its own, see ReemitLines().
+	enum class LineKind : uint8_t
+	{
+		Empty,
+		Label,
+		Define,
+		Data,
+		Instruction,
+		// Any other directive, or a macro invocation.
+		Other,
+	};
+
+	// Bytes to write to the program once every operand an edit affects is known to fit.
+	struct PendingWrite
+	{
+		uint32_t address = 0;
+		// Where the bytes are in pendingBytes.
+		size_t offset = 0;
+		size_t size = 0;
+	};
+private:
+	// Splits text into lines and tokenizes them.
+	void TokenizeLines(std::string_view text, size_t firstLineNumber, std::vector<std::unique_ptr<Line>>& newLines);
+
+	LineKind GetLineKind(const Line& line) const;
+	// Re-emits the operands that an edit which kept the number of lines changed, given the lines it replaced.
+	// Returns false if it can't, in which case the context is left in an unknown state.
+	bool ReemitLines(size_t firstLineNumber, std::span<const std::unique_ptr<Line>> oldLines, std::vector<AssemblerPatch>& patches);
+	// Re-emits every operand that uses a redefined define, or a label that was added or removed.
+	bool ReemitUses(uint32_t firstUse);
+	// Evaluates an operand or instruction again, given the tokens of its line, and adds its bytes to the pending writes.
+	// Returns false if its size changed.
+	bool ReemitOperand(uint32_t emittedOperandIndex, std::span<const std::string_view> tokens, bool recordUses);
+
+	void AssembleLines(std::vector<AssemblerPatch>& patches);
+	// Adds the bytes that differ from image to patches, and writes them to image and output.
+	void Patch(uint32_t address, std::span<const uint8_t> bytes, std::vector<AssemblerPatch>& patches);
+private:
+	AssemblerSession(const AssemblerSession&) = delete;
+	AssemblerSession(AssemblerSession&&) = delete;
+	AssemblerSession& operator=(const AssemblerSession&) = delete;
+	AssemblerSession& operator=(AssemblerSession&&) = delete;
+private:
+	std::filesystem::path sourcePath;
+	// Each line is allocated on its own, so that its tokens stay valid while lines are inserted and removed.
+	std::vector<std::unique_ptr<Line>> lines;
+	// The context of the last successful assembly, or nullptr if the last assembly failed.
+	std::unique_ptr<Assembler::Context> context;
+	AssemblerOutput output;
+	// The address each line was assembled at by the last successful assembly, or NoAddress if it was skipped
+	// or recorded into a macro.
+	std::vector<uint32_t> lineAddresses;
+	// The last successful program, with every byte that isn't emitted being 0.
+	std::vector<uint8_t> image;
+	std::vector<PendingWrite> pendingWrites;
+	std::vector<uint8_t> pendingBytes;
+};
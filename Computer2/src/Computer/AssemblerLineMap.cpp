@@ -0,0 +1,113 @@
+#include "AssemblerLineMap.h"
+#include <algorithm>
+
+static void WriteVarint(std::vector<uint8_t>& data, uint64_t value)
+{
+	for (; value >= 0x80; value >>= 7)
+		data.push_back(static_cast<uint8_t>(value | 0x80));
+	data.push_back(static_cast<uint8_t>(value));
+}
+
+// Reads rows from offset on, starting from the row before them.
+struct AssemblerLineMap::RowDecoder
+{
+	std::span<const uint8_t> data;
+	size_t offset = 0;
+	uint32_t address = 0;
+	AssemblerSourceLocation location;
+
+	// Moves to the next row. Returns false if data doesn't hold a whole valid one.
+	bool Next() noexcept
+	{
+		uint64_t addressDelta = 0;
+		uint64_t lineDelta = 0;
+		if (!ReadVarint(addressDelta) || !ReadVarint(lineDelta))
+			return false;
+
+		uint64_t file = location.file;
+		if ((addressDelta & 1) != 0 && !ReadVarint(file))
+			return false;
+
+		// Undo the zigzag encoding.
+		int64_t line = static_cast<int64_t>(location.line) + (static_cast<int64_t>(lineDelta >> 1) ^ -static_cast<int64_t>(lineDelta & 1));
+		uint64_t nextAddress = address + (addressDelta >> 1);
+		if (nextAddress > UINT32_MAX || file > UINT32_MAX || line < 0 || line > UINT32_MAX)
+			return false;
+
+		address = static_cast<uint32_t>(nextAddress);
+		location = { static_cast<uint32_t>(file), static_cast<uint32_t>(line) };
+		return true;
+	}
+
+	bool ReadVarint(uint64_t& value) noexcept
+	{
+		value = 0;
+		for (uint32_t shift = 0; shift < 64 && offset < data.size(); shift += 7)
+		{
+			uint8_t byte = data[offset++];
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+				return true;
+		}
+		return false;
+	}
+};
+
+void AssemblerLineMap::AddRow(uint32_t address, uint32_t size, AssemblerSourceLocation location)
+{
+	int64_t lineDelta = static_cast<int64_t>(location.line) - static_cast<int64_t>(lastLocation.line);
+	bool isNewFile = location.file != lastLocation.file;
+	WriteVarint(data, static_cast<uint64_t>(address - lastAddress) << 1 | (isNewFile ? 1 : 0));
+	WriteVarint(data, static_cast<uint64_t>(lineDelta) << 1 ^ static_cast<uint64_t>(lineDelta >> 63));
+	if (isNewFile)
+		WriteVarint(data, location.file);
+
+	if (rowCount++ % CheckpointInterval == 0)
+		checkpoints.push_back({ address, location, static_cast<uint32_t>(data.size()) });
+	lastAddress = address;
+	lastLocation = location;
+	endAddress = address + size;
+}
+
+bool AssemblerLineMap::Find(uint32_t address, AssemblerSourceLocation& location) const noexcept
+{
+	if (rowCount == 0 || address < checkpoints.front().address || address >= endAddress)
+		return false;
+
+	// The rows after the last checkpoint at or before address are decoded until one is past it.
+	const Checkpoint& checkpoint = *(std::ranges::upper_bound(checkpoints, address, {}, &Checkpoint::address) - 1);
+	RowDecoder decoder{ data, checkpoint.nextRowOffset, checkpoint.address, checkpoint.location };
+	location = checkpoint.location;
+	while (decoder.offset < data.size())
+	{
+		if (!decoder.Next() || decoder.address > address)
+			break;
+		location = decoder.location;
+	}
+	return true;
+}
+
+bool AssemblerLineMap::Load(std::span<const uint8_t> rows, uint32_t end)
+{
+	*this = {};
+	RowDecoder decoder{ rows, 0, 0, {} };
+	while (decoder.offset < rows.size())
+	{
+		// Rows must start after the one before them, and before the end.
+		uint32_t previousAddress = decoder.address;
+		if (!decoder.Next() || (rowCount != 0 && decoder.address <= previousAddress) || decoder.address >= end)
+		{
+			*this = {};
+			return false;
+		}
+
+		if (rowCount++ % CheckpointInterval == 0)
+			checkpoints.push_back({ decoder.address, decoder.location, static_cast<uint32_t>(decoder.offset) });
+		lastAddress = decoder.address;
+		lastLocation = decoder.location;
+	}
+
+	data.assign(rows.begin(), rows.end());
+	endAddress = rowCount != 0 ? end : 0;
+	return true;
+}
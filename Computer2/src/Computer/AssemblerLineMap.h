@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// The line of source that a byte was assembled from.
+struct AssemblerSourceLocation
+{
+	// Which of AssemblerOutput::files the line is in.
+	uint32_t file = 0;
+	uint32_t line = 0;
+
+	constexpr bool operator==(const AssemblerSourceLocation&) const noexcept = default;
+};
+
+// Maps the addresses of a section back to the source lines they were assembled from, so that profilers, tracers,
+// and debuggers can attribute what runs at an address to its line without assembling the source again.
+//
+// Consecutive bytes of the same line share a row, and each row is encoded as the difference from the row before
+// it, in LEB128: how many bytes the row before it took, shifted left once and with the low bit set if the file
+// changed, then the line difference, zigzag encoded, then the new file, if it changed. An instruction on the line
+// after the one before it takes 2 bytes. Every CheckpointInterval rows, the whole row is kept on the side as well,
+// so Find() binary searches those, then decodes at most CheckpointInterval rows.
+class AssemblerLineMap
+{
+public:
+	static constexpr uint32_t CheckpointInterval = 32;
+public:
+	// Maps size bytes at address to location. The bytes must follow the ones added before them.
+	void Add(uint32_t address, uint32_t size, AssemblerSourceLocation location)
+	{
+		// Bytes of the same line as the ones before them only extend the last row, e.g. an instruction's immediate.
+		if (rowCount != 0 && location == lastLocation && address == endAddress)
+			endAddress += size;
+		else if (size != 0)
+			AddRow(address, size, location);
+	}
+
+	// Gets the location of the byte at address. Returns false if the map has no such byte.
+	bool Find(uint32_t address, AssemblerSourceLocation& location) const noexcept;
+
+	bool IsEmpty() const noexcept { return rowCount == 0; }
+	// The encoded rows, which Load() takes, and the address after the last byte.
+	std::span<const uint8_t> GetData() const noexcept { return data; }
+	uint32_t GetEndAddress() const noexcept { return endAddress; }
+
+	// Replaces the map with rows that GetData() returned, e.g. from a file, whose bytes end at address end.
+	// Returns false, and leaves the map empty, if they aren't valid.
+	bool Load(std::span<const uint8_t> rows, uint32_t end);
+private:
+	struct Checkpoint
+	{
+		uint32_t address = 0;
+		AssemblerSourceLocation location;
+		// Where the row after it starts in data.
+		uint32_t nextRowOffset = 0;
+	};
+
+	struct RowDecoder;
+private:
+	void AddRow(uint32_t address, uint32_t size, AssemblerSourceLocation location);
+private:
+	std::vector<uint8_t> data;
+	std::vector<Checkpoint> checkpoints;
+	uint32_t rowCount = 0;
+	// The last row, which bytes of the same location are added to.
+	uint32_t lastAddress = 0;
+	AssemblerSourceLocation lastLocation;
+	uint32_t endAddress = 0;
+};
@@ -0,0 +1,235 @@
+#include "AssemblerObject.h"
+#include "Expression.h"
+#include <cstring>
+
+// The format is a magic number and a version, followed by the sections, the bytecode, the symbols, and the
+// relocations. Counts, sizes, offsets, and indices are stored as LEB128 varints, and values are zigzag encoded.
+static constexpr char Magic[4] = { 'C', '2', 'O', 'B' };
+static constexpr uint8_t Version = 1;
+
+static constexpr uint32_t AddressSpaceSize = 0x10000;
+
+static void WriteVarint(std::vector<uint8_t>& data, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		data.push_back(static_cast<uint8_t>(value | 0x80));
+		value >>= 7;
+	}
+	data.push_back(static_cast<uint8_t>(value));
+}
+
+// Reads from the front of data, and removes what it read. Never reads past its end.
+struct ObjectReader
+{
+	std::span<const uint8_t> data;
+	bool isValid = true;
+
+	uint8_t ReadByte()
+	{
+		if (data.empty())
+		{
+			isValid = false;
+			return 0;
+		}
+
+		uint8_t byte = data.front();
+		data = data.subspan(1);
+		return byte;
+	}
+
+	uint64_t ReadVarint()
+	{
+		uint64_t value = 0;
+		for (uint32_t shift = 0; shift < 64; shift += 7)
+		{
+			uint8_t byte = ReadByte();
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+				return value;
+		}
+
+		isValid = false;
+		return 0;
+	}
+
+	// Reads a varint that must be at most max.
+	uint32_t ReadIndex(uint64_t max)
+	{
+		uint64_t value = ReadVarint();
+		if (value > max)
+		{
+			isValid = false;
+			return 0;
+		}
+		return static_cast<uint32_t>(value);
+	}
+
+	std::span<const uint8_t> ReadBytes(size_t size)
+	{
+		if (data.size() < size)
+		{
+			isValid = false;
+			return {};
+		}
+
+		std::span<const uint8_t> bytes = data.first(size);
+		data = data.subspan(size);
+		return bytes;
+	}
+};
+
+void AssemblerObject::Serialize(std::vector<uint8_t>& data) const
+{
+	data.insert(data.end(), std::begin(Magic), std::end(Magic));
+	data.push_back(Version);
+
+	WriteVarint(data, sections.size());
+	for (const Section& section : sections)
+	{
+		data.push_back(section.isRelocatable ? 1 : 0);
+		WriteVarint(data, section.origin);
+		WriteVarint(data, section.assembly.size());
+		data.insert(data.end(), section.assembly.begin(), section.assembly.end());
+	}
+
+	WriteVarint(data, bytecode.size());
+	data.insert(data.end(), bytecode.begin(), bytecode.end());
+
+	WriteVarint(data, symbols.size());
+	for (const Symbol& symbol : symbols)
+	{
+		data.push_back(static_cast<uint8_t>(symbol.kind) | (symbol.isExported ? 0x80 : 0));
+		WriteVarint(data, symbol.name.size());
+		data.insert(data.end(), symbol.name.begin(), symbol.name.end());
+		switch (symbol.kind)
+		{
+			case SymbolKind::Absolute:
+				// Zigzag, so that small negative values stay small.
+				WriteVarint(data, (static_cast<uint32_t>(symbol.value) << 1) ^ static_cast<uint32_t>(symbol.value >> 31));
+				break;
+			case SymbolKind::Relocatable:
+				WriteVarint(data, symbol.section);
+				WriteVarint(data, static_cast<uint32_t>(symbol.value));
+				break;
+			case SymbolKind::Expression:
+				WriteVarint(data, symbol.bytecodeOffset);
+				WriteVarint(data, symbol.bytecodeSize);
+				break;
+			case SymbolKind::Import:
+				break;
+		}
+	}
+
+	WriteVarint(data, relocations.size());
+	for (const Relocation& relocation : relocations)
+	{
+		WriteVarint(data, relocation.section);
+		WriteVarint(data, relocation.offset);
+		data.push_back(relocation.size);
+		WriteVarint(data, relocation.lineNumber);
+		WriteVarint(data, relocation.bytecodeOffset);
+		WriteVarint(data, relocation.bytecodeSize);
+	}
+}
+
+bool AssemblerObject::Deserialize(std::span<const uint8_t> data)
+{
+	*this = {};
+	ObjectReader reader{ data };
+
+	std::span<const uint8_t> header = reader.ReadBytes(sizeof(Magic) + 1);
+	if (!reader.isValid || std::memcmp(header.data(), Magic, sizeof(Magic)) != 0 || header.back() != Version)
+		return false;
+
+	// Counts are checked against what's left of data, so that a corrupt count can't allocate a lot of memory.
+	sections.resize(reader.ReadIndex(reader.data.size()));
+	for (Section& section : sections)
+	{
+		section.isRelocatable = reader.ReadByte() != 0;
+		section.origin = static_cast<uint16_t>(reader.ReadIndex(AddressSpaceSize - 1));
+		std::span<const uint8_t> assembly = reader.ReadBytes(reader.ReadIndex(AddressSpaceSize - section.origin));
+		section.assembly.assign(assembly.begin(), assembly.end());
+	}
+
+	std::span<const uint8_t> objectBytecode = reader.ReadBytes(reader.ReadIndex(reader.data.size()));
+	bytecode.assign(objectBytecode.begin(), objectBytecode.end());
+
+	symbols.resize(reader.ReadIndex(reader.data.size()));
+	for (Symbol& symbol : symbols)
+	{
+		uint8_t kind = reader.ReadByte();
+		symbol.isExported = (kind & 0x80) != 0;
+		symbol.kind = static_cast<SymbolKind>(kind & 0x7F);
+		std::span<const uint8_t> name = reader.ReadBytes(reader.ReadIndex(reader.data.size()));
+		symbol.name.assign(name.begin(), name.end());
+		switch (symbol.kind)
+		{
+			case SymbolKind::Absolute:
+			{
+				uint32_t zigzag = reader.ReadIndex(UINT32_MAX);
+				symbol.value = static_cast<int32_t>((zigzag >> 1) ^ (0u - (zigzag & 1)));
+				break;
+			}
+			case SymbolKind::Relocatable:
+				symbol.section = reader.ReadIndex(sections.size() - 1);
+				if (sections.empty() || !sections[symbol.section].isRelocatable)
+					reader.isValid = false;
+				else
+					symbol.value = static_cast<int32_t>(reader.ReadIndex(sections[symbol.section].assembly.size()));
+				break;
+			case SymbolKind::Expression:
+				symbol.bytecodeOffset = reader.ReadIndex(bytecode.size());
+				symbol.bytecodeSize = reader.ReadIndex(bytecode.size() - symbol.bytecodeOffset);
+				break;
+			case SymbolKind::Import:
+				if (symbol.name.empty())
+					reader.isValid = false;
+				break;
+			default:
+				reader.isValid = false;
+				break;
+		}
+
+		// Only labels can be exported, and they need a name to be found by.
+		if (symbol.isExported && (symbol.name.empty() || (symbol.kind != SymbolKind::Absolute && symbol.kind != SymbolKind::Relocatable)))
+			reader.isValid = false;
+		if (!reader.isValid)
+			break;
+	}
+
+	relocations.resize(reader.isValid ? reader.ReadIndex(reader.data.size()) : 0);
+	for (Relocation& relocation : relocations)
+	{
+		relocation.section = reader.ReadIndex(sections.size() - 1);
+		relocation.offset = reader.ReadIndex(AddressSpaceSize);
+		relocation.size = reader.ReadByte();
+		relocation.lineNumber = reader.ReadVarint();
+		relocation.bytecodeOffset = reader.ReadIndex(bytecode.size());
+		relocation.bytecodeSize = reader.ReadIndex(bytecode.size() - relocation.bytecodeOffset);
+		if (sections.empty() || (relocation.size != 1 && relocation.size != 2) || relocation.offset + relocation.size > sections[relocation.section].assembly.size())
+			reader.isValid = false;
+		if (!reader.isValid)
+			break;
+	}
+
+	// The linker evaluates the bytecode as is, so it must be well formed.
+	uint32_t symbolCount = static_cast<uint32_t>(symbols.size());
+	auto isValidBytecode = [&](uint32_t offset, uint32_t size)
+	{
+		return Expression::IsValid({ bytecode.data() + offset, size }, symbolCount);
+	};
+	for (const Symbol& symbol : symbols)
+		if (reader.isValid && symbol.kind == SymbolKind::Expression && !isValidBytecode(symbol.bytecodeOffset, symbol.bytecodeSize))
+			reader.isValid = false;
+	for (const Relocation& relocation : relocations)
+		if (reader.isValid && !isValidBytecode(relocation.bytecodeOffset, relocation.bytecodeSize))
+			reader.isValid = false;
+
+	if (!reader.isValid || !reader.data.empty())
+	{
+		*this = {};
+		return false;
+	}
+	return true;
+}
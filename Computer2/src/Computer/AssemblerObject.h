@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Assembler.h"
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+// An assembled source whose final addresses aren't decided yet, to be combined with other objects by the Linker.
+//
+// The code before a source's first .origin is a relocatable section, which the linker places wherever it fits.
+// Sections after an .origin stay where they are. Labels in the relocatable section, and symbols that no object
+// defined yet, are only known once linked, so every operand that uses them is kept as a relocation, with the
+// bytecode of its expression, and is evaluated by the linker.
+struct AssemblerObject
+{
+	enum class SymbolKind : uint8_t
+	{
+		// A label in an absolute section, or a define whose value was known.
+		Absolute,
+		// A label in a relocatable section. value is its offset in that section.
+		Relocatable,
+		// A define whose value depends on relocatable labels or imports.
+		Expression,
+		// A symbol that another object must export.
+		Import,
+	};
+
+	struct Section : AssemblerProgramSection
+	{
+		// If true, origin is decided by the linker.
+		bool isRelocatable = false;
+	};
+
+	struct Symbol
+	{
+		std::string name;
+		SymbolKind kind = SymbolKind::Absolute;
+		// Whether other objects can import it, which only labels can be, following their LabelVisibility.
+		bool isExported = false;
+		int32_t value = 0;
+		uint32_t section = 0;
+		// Where an Expression symbol's bytecode is in bytecode.
+		uint32_t bytecodeOffset = 0;
+		uint32_t bytecodeSize = 0;
+	};
+
+	// An operand that is patched by the linker.
+	struct Relocation
+	{
+		uint32_t section = 0;
+		uint32_t offset = 0;
+		uint8_t size = 0;
+		size_t lineNumber = 0;
+		uint32_t bytecodeOffset = 0;
+		uint32_t bytecodeSize = 0;
+	};
+
+	std::vector<Section> sections;
+	// Every symbol that is exported, or that bytecode refers to.
+	std::vector<Symbol> symbols;
+	std::vector<Relocation> relocations;
+	// The bytecode of every relocation and Expression symbol, see Expression. Symbol indices refer to symbols.
+	std::vector<uint8_t> bytecode;
+
+	// Appends the object in its binary format.
+	void Serialize(std::vector<uint8_t>& data) const;
+	// Replaces the object with the one in data. Returns false, and leaves the object empty, if data isn't a valid object.
+	bool Deserialize(std::span<const uint8_t> data);
+};
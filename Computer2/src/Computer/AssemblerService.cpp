@@ -0,0 +1,638 @@
+#include "AssemblerService.h"
+#include "ContentHash.h"
+#include "SourceFile.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <memory_resource>
+#include <thread>
+#include <vector>
+
+#if SYSTEM_WINDOWS
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <WinSock2.h>
+	#include <afunix.h>
+	#pragma comment(lib, "Ws2_32.lib")
+
+	using Socket = SOCKET;
+	static constexpr Socket InvalidSocket = INVALID_SOCKET;
+#else
+	#include <sys/socket.h>
+	#include <sys/stat.h>
+	#include <sys/time.h>
+	#include <sys/un.h>
+	#include <unistd.h>
+
+	using Socket = int;
+	static constexpr Socket InvalidSocket = -1;
+#endif
+
+static constexpr char RequestMagic[4] = { 'C', '2', 'A', 'Q' };
+static constexpr char ResponseMagic[4] = { 'C', '2', 'A', 'R' };
+// How long a connection may take to send its request, so that a stalled client doesn't hold a worker forever.
+static constexpr uint32_t ReceiveTimeoutMilliseconds = 10'000;
+// The buffer each worker assembles sources without a path in, see AssemblerService::Assemble().
+static constexpr size_t WorkerArenaSize = 1 << 20;
+// How long Run() waits before accepting again after running out of something, like file descriptors.
+// The wait doubles every time accepting fails in a row, up to the maximum.
+static constexpr uint32_t MinAcceptBackOffMilliseconds = 10;
+static constexpr uint32_t MaxAcceptBackOffMilliseconds = 1'000;
+
+enum class AcceptError : uint8_t
+{
+	// Only the connection being accepted failed, so the next one can be accepted right away.
+	Retry,
+	// Something the process needs ran out, so accepting again right away would fail too.
+	BackOff,
+	// The listening socket itself is broken.
+	Fatal,
+};
+
+static bool InitializeSockets()
+{
+#if SYSTEM_WINDOWS
+	static bool isInitialized = []()
+	{
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	return isInitialized;
+#else
+	return true;
+#endif
+}
+
+// Classifies why accept() just failed.
+static AcceptError GetAcceptError()
+{
+#if SYSTEM_WINDOWS
+	switch (WSAGetLastError())
+	{
+		case WSAEINTR:
+		case WSAECONNRESET:
+		case WSAEWOULDBLOCK:
+			return AcceptError::Retry;
+		case WSAEMFILE:
+		case WSAENOBUFS:
+			return AcceptError::BackOff;
+		default:
+			return AcceptError::Fatal;
+	}
+#else
+	switch (errno)
+	{
+		case EINTR:
+		case ECONNABORTED:
+		case EAGAIN:
+		case EPROTO:
+		case EPERM:
+			return AcceptError::Retry;
+		case EMFILE:
+		case ENFILE:
+		case ENOBUFS:
+		case ENOMEM:
+			return AcceptError::BackOff;
+		default:
+			return AcceptError::Fatal;
+	}
+#endif
+}
+
+// Whether path is a socket file, rather than some other file that happens to be where the socket should be.
+static bool IsSocketFile(const std::filesystem::path& path)
+{
+#if SYSTEM_WINDOWS
+	WIN32_FIND_DATAW data;
+	HANDLE find = FindFirstFileW(path.c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE)
+		return false;
+	FindClose(find);
+	return (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0 && data.dwReserved0 == IO_REPARSE_TAG_AF_UNIX;
+#else
+	struct stat status;
+	return lstat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode);
+#endif
+}
+
+static void CloseSocket(Socket socket)
+{
+#if SYSTEM_WINDOWS
+	closesocket(socket);
+#else
+	close(socket);
+#endif
+}
+
+// Identifies the file at path, to tell it apart from a file that replaced it since.
+static bool GetFileId(const std::filesystem::path& path, uint64_t& volume, uint64_t& index)
+{
+#if SYSTEM_WINDOWS
+	HANDLE file = CreateFileW(path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+		FILE_FLAG_OPEN_REPARSE_POINT | FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	BY_HANDLE_FILE_INFORMATION information;
+	bool isFound = GetFileInformationByHandle(file, &information) != 0;
+	CloseHandle(file);
+	if (!isFound)
+		return false;
+	volume = information.dwVolumeSerialNumber;
+	index = static_cast<uint64_t>(information.nFileIndexHigh) << 32 | information.nFileIndexLow;
+	return true;
+#else
+	struct stat status;
+	if (lstat(path.c_str(), &status) != 0)
+		return false;
+	volume = static_cast<uint64_t>(status.st_dev);
+	index = static_cast<uint64_t>(status.st_ino);
+	return true;
+#endif
+}
+
+// Creates a socket, and fills in address with path. Returns InvalidSocket if path doesn't fit.
+static Socket CreateSocket(const std::filesystem::path& path, sockaddr_un& address)
+{
+	address = {};
+	address.sun_family = AF_UNIX;
+	std::string pathString = path.string();
+	if (pathString.size() >= sizeof(address.sun_path) || !InitializeSockets())
+		return InvalidSocket;
+
+	std::copy(pathString.begin(), pathString.end(), address.sun_path);
+	return socket(AF_UNIX, SOCK_STREAM, 0);
+}
+
+// Whether nothing listens on the socket file at path, which is what a service that didn't stop cleanly leaves behind.
+static bool IsStaleSocket(const std::filesystem::path& path)
+{
+	sockaddr_un address;
+	Socket socket = CreateSocket(path, address);
+	if (socket == InvalidSocket)
+		return false;
+
+	bool isRefused = connect(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0;
+#if SYSTEM_WINDOWS
+	isRefused = isRefused && WSAGetLastError() == WSAECONNREFUSED;
+#else
+	isRefused = isRefused && errno == ECONNREFUSED;
+#endif
+	CloseSocket(socket);
+	return isRefused;
+}
+
+static bool SendAll(Socket socket, std::string_view data)
+{
+#ifdef MSG_NOSIGNAL
+	// A client that went away must not kill the service with SIGPIPE.
+	constexpr int flags = MSG_NOSIGNAL;
+#else
+	constexpr int flags = 0;
+#endif
+
+	while (!data.empty())
+	{
+		int size = static_cast<int>(std::min<size_t>(data.size(), 1 << 20));
+		auto sent = send(socket, data.data(), size, flags);
+		if (sent <= 0)
+			return false;
+		data.remove_prefix(static_cast<size_t>(sent));
+	}
+	return true;
+}
+
+static bool ReceiveAll(Socket socket, char* data, size_t size)
+{
+	while (size != 0)
+	{
+		auto received = recv(socket, data, static_cast<int>(std::min<size_t>(size, 1 << 20)), 0);
+		if (received <= 0)
+			return false;
+		data += received;
+		size -= static_cast<size_t>(received);
+	}
+	return true;
+}
+
+static bool ReceiveInteger(Socket socket, uint64_t& value, size_t size)
+{
+	char bytes[8];
+	if (!ReceiveAll(socket, bytes, size))
+		return false;
+
+	value = 0;
+	for (size_t i = 0; i < size; i++)
+		value |= static_cast<uint64_t>(static_cast<uint8_t>(bytes[i])) << (i * 8);
+	return true;
+}
+
+static void WriteInteger(std::string& data, uint64_t value, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		data.push_back(static_cast<char>(value >> (i * 8)));
+}
+
+// Splits source into lines the same way AssemblerSession does, keeping blank lines.
+static void SplitLines(std::string_view source, std::vector<std::string_view>& lines)
+{
+	for (size_t start = 0; start < source.size();)
+	{
+		size_t end = std::min(source.find_first_of("\r\n", start), source.size());
+		lines.push_back(source.substr(start, end - start));
+
+		start = end;
+		if (start < source.size())
+			start += source[start] == '\r' && start + 1 < source.size() && source[start + 1] == '\n' ? 2 : 1;
+	}
+}
+
+AssemblerService::AssemblerService(const std::filesystem::path& socketPath, size_t threadCount)
+	: socketPath(socketPath), threadPool(threadCount), listener(static_cast<uintptr_t>(InvalidSocket)) {}
+
+AssemblerService::~AssemblerService()
+{
+	Stop();
+	threadPool.Wait();
+	if (static_cast<Socket>(listener) != InvalidSocket)
+	{
+		CloseSocket(static_cast<Socket>(listener));
+
+		// Only the socket file this service created is removed, not one that replaced it since.
+		uint64_t volume = 0;
+		uint64_t index = 0;
+		if (IsSocketFile(socketPath) && GetFileId(socketPath, volume, index) && volume == socketVolume && index == socketIndex)
+		{
+			std::error_code error;
+			std::filesystem::remove(socketPath, error);
+		}
+	}
+}
+
+bool AssemblerService::Start()
+{
+	sockaddr_un address;
+	Socket socket = CreateSocket(socketPath, address);
+	if (socket == InvalidSocket)
+		return false;
+
+	// A socket file left behind by a service that didn't stop cleanly would make binding fail.
+	// A socket that another service still listens on isn't taken over, and any other file is left alone too,
+	// so binding fails instead.
+	if (IsSocketFile(socketPath))
+	{
+		if (!IsStaleSocket(socketPath))
+		{
+			CloseSocket(socket);
+			return false;
+		}
+
+		std::error_code error;
+		std::filesystem::remove(socketPath, error);
+	}
+	if (bind(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(socket, SOMAXCONN) != 0)
+	{
+		CloseSocket(socket);
+		return false;
+	}
+
+	// If the socket file can't be identified, it's left behind, for the next service to replace.
+	socketVolume = 0;
+	socketIndex = 0;
+	GetFileId(socketPath, socketVolume, socketIndex);
+
+	listener = static_cast<uintptr_t>(socket);
+	isStopping = false;
+	return true;
+}
+
+void AssemblerService::Run()
+{
+	Socket listenerSocket = static_cast<Socket>(listener);
+	uint32_t backOffMilliseconds = 0;
+	while (listenerSocket != InvalidSocket && !isStopping)
+	{
+		Socket connection = accept(listenerSocket, nullptr, nullptr);
+		if (connection == InvalidSocket)
+		{
+			AcceptError error = GetAcceptError();
+			if (error == AcceptError::Fatal)
+				break;
+			if (error == AcceptError::BackOff)
+			{
+				backOffMilliseconds = std::clamp(backOffMilliseconds * 2, MinAcceptBackOffMilliseconds, MaxAcceptBackOffMilliseconds);
+				std::this_thread::sleep_for(std::chrono::milliseconds(backOffMilliseconds));
+			}
+			continue;
+		}
+		backOffMilliseconds = 0;
+		if (isStopping)
+		{
+			CloseSocket(connection);
+			break;
+		}
+
+		threadPool.Submit([this, connection]() { Serve(static_cast<uintptr_t>(connection)); });
+	}
+
+	threadPool.Wait();
+}
+
+void AssemblerService::Stop()
+{
+	if (isStopping.exchange(true) || static_cast<Socket>(listener) == InvalidSocket)
+		return;
+
+	// Wake Run() up from accepting, by connecting to it.
+	sockaddr_un address;
+	Socket socket = CreateSocket(socketPath, address);
+	if (socket == InvalidSocket)
+		return;
+	connect(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+	CloseSocket(socket);
+}
+
+AssemblerOutput AssemblerService::RequestFile(const std::filesystem::path& socketPath, const std::filesystem::path& sourcePath)
+{
+	std::error_code error;
+	std::string path = std::filesystem::absolute(sourcePath, error).string();
+
+	std::string request(RequestMagic, sizeof(RequestMagic));
+	WriteInteger(request, Version, 4);
+	WriteInteger(request, path.size(), 4);
+	request += path;
+	request.push_back(0);
+	return SendRequest(socketPath, request);
+}
+
+AssemblerOutput AssemblerService::Request(const std::filesystem::path& socketPath, std::string_view source, const std::filesystem::path& sourcePath)
+{
+	if (source.size() > MaxSourceSize)
+		return AssemblerReturnCode_InvalidRequest;
+
+	std::error_code error;
+	std::string path = sourcePath.empty() ? std::string() : std::filesystem::absolute(sourcePath, error).string();
+
+	std::string request(RequestMagic, sizeof(RequestMagic));
+	request.reserve(request.size() + 13 + path.size() + source.size());
+	WriteInteger(request, Version, 4);
+	WriteInteger(request, path.size(), 4);
+	request += path;
+	request.push_back(1);
+	WriteInteger(request, source.size(), 4);
+	request += source;
+	return SendRequest(socketPath, request);
+}
+
+AssemblerOutput AssemblerService::SendRequest(const std::filesystem::path& socketPath, const std::string& request)
+{
+	sockaddr_un address;
+	Socket socket = CreateSocket(socketPath, address);
+	if (socket == InvalidSocket)
+		return AssemblerReturnCode_ServiceUnavailable;
+	if (connect(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || !SendAll(socket, request))
+	{
+		CloseSocket(socket);
+		return AssemblerReturnCode_ServiceUnavailable;
+	}
+
+	// The service closes the connection once it responded.
+	AssemblerOutput output;
+	char magic[sizeof(ResponseMagic)];
+	uint64_t returnCode = 0;
+	uint64_t lineNumber = 0;
+	uint64_t sectionCount = 0;
+	bool isValid = ReceiveAll(socket, magic, sizeof(magic)) && std::equal(magic, magic + sizeof(magic), ResponseMagic) &&
+		ReceiveInteger(socket, returnCode, 2) && ReceiveInteger(socket, lineNumber, 8) && ReceiveInteger(socket, sectionCount, 4);
+	for (uint64_t i = 0; i < sectionCount && isValid; i++)
+	{
+		uint64_t origin = 0;
+		uint64_t size = 0;
+		isValid = ReceiveInteger(socket, origin, 2) && ReceiveInteger(socket, size, 4) && size <= 0x10000;
+		if (!isValid)
+			break;
+
+		AssemblerProgramSection& section = output.sections.emplace_back();
+		section.origin = static_cast<uint16_t>(origin);
+		section.assembly.resize(size);
+		isValid = ReceiveAll(socket, reinterpret_cast<char*>(section.assembly.data()), size);
+
+		uint64_t lineMapSize = 0;
+		isValid = isValid && ReceiveInteger(socket, lineMapSize, 4) && lineMapSize <= MaxSourceSize;
+		if (!isValid)
+			break;
+
+		std::vector<uint8_t> lineMap(lineMapSize);
+		isValid = ReceiveAll(socket, reinterpret_cast<char*>(lineMap.data()), lineMapSize) && section.lineMap.Load(lineMap, static_cast<uint32_t>(origin + size));
+	}
+
+	uint64_t symbolCount = 0;
+	isValid = isValid && ReceiveInteger(socket, symbolCount, 4);
+	for (uint64_t i = 0; i < symbolCount && isValid; i++)
+	{
+		uint64_t address = 0;
+		uint64_t nameSize = 0;
+		isValid = ReceiveInteger(socket, address, 2) && ReceiveInteger(socket, nameSize, 4) && nameSize <= MaxSourceSize;
+		if (!isValid)
+			break;
+
+		AssemblerSymbol& symbol = output.symbols.emplace_back();
+		symbol.address = static_cast<uint16_t>(address);
+		symbol.name.resize(nameSize);
+		isValid = ReceiveAll(socket, symbol.name.data(), nameSize);
+	}
+
+	uint64_t fileCount = 0;
+	isValid = isValid && ReceiveInteger(socket, fileCount, 4);
+	for (uint64_t i = 0; i < fileCount && isValid; i++)
+	{
+		uint64_t pathSize = 0;
+		isValid = ReceiveInteger(socket, pathSize, 4) && pathSize <= 0x10000;
+		if (!isValid)
+			break;
+
+		std::u8string path(pathSize, '\0');
+		isValid = ReceiveAll(socket, reinterpret_cast<char*>(path.data()), pathSize);
+		output.files.emplace_back(std::move(path));
+	}
+	CloseSocket(socket);
+
+	if (!isValid)
+		return AssemblerReturnCode_ServiceUnavailable;
+	output.returnCode = static_cast<AssemblerReturnCode>(returnCode);
+	output.lineNumber = static_cast<size_t>(lineNumber);
+	return output;
+}
+
+void AssemblerService::Serve(uintptr_t connection)
+{
+	Socket socket = static_cast<Socket>(connection);
+
+#if SYSTEM_WINDOWS
+	DWORD timeout = ReceiveTimeoutMilliseconds;
+#else
+	timeval timeout{ ReceiveTimeoutMilliseconds / 1000, (ReceiveTimeoutMilliseconds % 1000) * 1000 };
+#endif
+	setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+
+	// Connections that don't send a whole request, like the one Stop() makes, are closed without a response.
+	char magic[sizeof(RequestMagic)];
+	uint64_t version = 0;
+	uint64_t pathSize = 0;
+	std::string path;
+	char hasSource = 0;
+	uint64_t sourceSize = 0;
+	std::string source;
+	bool isValid = ReceiveAll(socket, magic, sizeof(magic)) && ReceiveInteger(socket, version, 4) && ReceiveInteger(socket, pathSize, 4) && pathSize <= 0x10000;
+	if (isValid)
+	{
+		path.resize(pathSize);
+		isValid = ReceiveAll(socket, path.data(), path.size()) && ReceiveAll(socket, &hasSource, 1);
+	}
+	if (isValid && hasSource)
+	{
+		isValid = ReceiveInteger(socket, sourceSize, 4) && sourceSize <= MaxSourceSize;
+		if (isValid)
+		{
+			source.resize(sourceSize);
+			isValid = ReceiveAll(socket, source.data(), source.size());
+		}
+	}
+	if (!isValid)
+	{
+		CloseSocket(socket);
+		return;
+	}
+
+	// Files are read rather than mapped, since one that is truncated while it's assembled mustn't crash the service.
+	AssemblerOutput output;
+	if (!std::equal(magic, magic + sizeof(magic), RequestMagic) || version != Version || (!hasSource && path.empty()))
+		output = AssemblerReturnCode_InvalidRequest;
+	else if (hasSource)
+		output = Assemble(source, path);
+	else if (SourceFile file(path, false); file)
+		output = Assemble(file.GetSource(), path);
+	else
+		output = AssemblerReturnCode_SourceNotFound;
+
+	std::string response(ResponseMagic, sizeof(ResponseMagic));
+	WriteInteger(response, output.returnCode, 2);
+	WriteInteger(response, output.lineNumber, 8);
+	WriteInteger(response, output.sections.size(), 4);
+	for (const AssemblerProgramSection& section : output.sections)
+	{
+		WriteInteger(response, section.origin, 2);
+		WriteInteger(response, section.assembly.size(), 4);
+		response.append(reinterpret_cast<const char*>(section.assembly.data()), section.assembly.size());
+		std::span<const uint8_t> lineMap = section.lineMap.GetData();
+		WriteInteger(response, lineMap.size(), 4);
+		response.append(reinterpret_cast<const char*>(lineMap.data()), lineMap.size());
+	}
+	WriteInteger(response, output.symbols.size(), 4);
+	for (const AssemblerSymbol& symbol : output.symbols)
+	{
+		WriteInteger(response, symbol.address, 2);
+		WriteInteger(response, symbol.name.size(), 4);
+		response.append(symbol.name);
+	}
+	WriteInteger(response, output.files.size(), 4);
+	for (const std::filesystem::path& file : output.files)
+	{
+		std::u8string path = file.u8string();
+		WriteInteger(response, path.size(), 4);
+		response.append(reinterpret_cast<const char*>(path.data()), path.size());
+	}
+	SendAll(socket, response);
+	CloseSocket(socket);
+}
+
+AssemblerOutput AssemblerService::Assemble(std::string_view source, const std::filesystem::path& sourcePath)
+{
+	// Sources without a path have nothing to be told apart by.
+	// Their working memory comes from a buffer that every request the worker serves reuses, so only sources that
+	// outgrow it allocate it from the heap.
+	if (sourcePath.empty())
+	{
+		thread_local std::vector<std::byte> arenaBuffer(WorkerArenaSize);
+		std::pmr::monotonic_buffer_resource arena(arenaBuffer.data(), arenaBuffer.size());
+		return Assembler::Assemble(source, {}, 0, nullptr, &arena);
+	}
+
+	std::shared_ptr<Session> session = GetSession(sourcePath);
+	std::scoped_lock lock(session->mutex);
+	AssemblerSession& assemblerSession = session->session;
+
+	// Edits don't notice when included files change, so a session whose includes changed is assembled again.
+	// Only the includes of the last successful assembly are known, so a session whose last assembly failed,
+	// maybe because of an include that has been fixed or created since, is assembled again too.
+	std::vector<AssemblerDependency> dependencies;
+	assemblerSession.GetDependencies(dependencies);
+	const AssemblerOutput& lastOutput = assemblerSession.GetOutput();
+	bool isStale = assemblerSession.GetLineCount() == 0 || (!lastOutput && lastOutput.returnCode != AssemblerReturnCode_EffectivelyEmptySource);
+	for (const AssemblerDependency& dependency : dependencies)
+	{
+		SourceFile file(dependency.path, false);
+		if (isStale || !file || ContentHash::Hash(file.GetSource()) != dependency.contentHash)
+		{
+			isStale = true;
+			break;
+		}
+	}
+
+	if (isStale)
+	{
+		assemblerSession.Assemble(source);
+		session->source.assign(source);
+	}
+	else if (source != session->source)
+	{
+		// Only the lines between the first and the last one that changed are replaced.
+		std::vector<std::string_view> oldLines;
+		std::vector<std::string_view> newLines;
+		SplitLines(session->source, oldLines);
+		SplitLines(source, newLines);
+
+		size_t commonSize = std::min(oldLines.size(), newLines.size());
+		size_t prefixSize = std::mismatch(oldLines.begin(), oldLines.begin() + commonSize, newLines.begin()).first - oldLines.begin();
+		size_t suffixSize = std::mismatch(oldLines.rbegin(), oldLines.rbegin() + (commonSize - prefixSize), newLines.rbegin()).first - oldLines.rbegin();
+
+		// Sources that only differ in their line endings have no lines to replace.
+		if (prefixSize != oldLines.size() || prefixSize != newLines.size())
+		{
+			// Every line gets a line ending, so that blank lines are kept.
+			std::string text;
+			for (size_t i = prefixSize; i < newLines.size() - suffixSize; i++)
+			{
+				text += newLines[i];
+				text += '\n';
+			}
+
+			std::vector<AssemblerPatch> patches;
+			assemblerSession.Edit(prefixSize + 1, oldLines.size() - suffixSize - prefixSize, text, patches);
+		}
+		session->source.assign(source);
+	}
+
+	return assemblerSession.GetOutput();
+}
+
+std::shared_ptr<AssemblerService::Session> AssemblerService::GetSession(const std::filesystem::path& sourcePath)
+{
+	std::error_code error;
+	std::string key = std::filesystem::weakly_canonical(sourcePath, error).string();
+
+	std::scoped_lock lock(sessionsMutex);
+	std::shared_ptr<Session>& session = sessions[key];
+	if (!session)
+		session = std::make_shared<Session>(sourcePath);
+	session->lastUsed = ++useCount;
+	std::shared_ptr<Session> usedSession = session;
+
+	// Sessions that are still in use stay alive until they aren't.
+	if (sessions.size() > MaxSessionCount)
+	{
+		auto leastRecentlyUsed = std::min_element(sessions.begin(), sessions.end(), [](const auto& lhs, const auto& rhs) { return lhs.second->lastUsed < rhs.second->lastUsed; });
+		sessions.erase(leastRecentlyUsed);
+	}
+	return usedSession;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Assembler.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// A long-running process that assembles sources for other processes over a local socket, so that they don't each
+// pay for starting up and for loading every include cold.
+//
+// Every connection carries one request, and is served on a thread pool. Requests for the same source are served in
+// order, and requests for different sources concurrently. Included files stay tokenized in the IncludeCache, and
+// each source keeps an AssemblerSession, so a source that changed since its last request only has the lines that
+// changed tokenized again, and edits of data operands and defines are patched in place instead of reassembled.
+// Sessions are reassembled whenever a file they include changes, and whenever their last assembly failed.
+//
+// A request is a header, the source's path, and optionally the source itself; without it, the service reads the
+// file at that path. The response is the AssemblerOutput. Every integer is little endian.
+class AssemblerService
+{
+public:
+	static constexpr uint32_t Version = 3;
+	// Sessions beyond this many are dropped, least recently used first.
+	static constexpr size_t MaxSessionCount = 256;
+	// Larger sources are rejected, rather than trusting any size a client sends.
+	static constexpr uint32_t MaxSourceSize = 256u << 20;
+public:
+	// threadCount is used like in ThreadPool.
+	AssemblerService(const std::filesystem::path& socketPath, size_t threadCount = 0);
+	// Stops, waits for every request being served, and removes the socket file, unless it was replaced since.
+	~AssemblerService();
+
+	// Creates the socket, replacing a socket file that is left at socketPath, which nothing listens on anymore.
+	// Returns false if it can't, if another service is listening there, or if any other kind of file is there.
+	bool Start();
+	// Serves connections until Stop() is called, or until accepting them fails for good.
+	// Accepting again after running out of file descriptors or memory waits a little longer every time.
+	void Run();
+	// May be called from any thread.
+	void Stop();
+
+	// Sends a request to the service listening on socketPath, and waits for its response.
+	// Relative paths are made absolute first, since the service's working directory may be another one.
+	// Returns AssemblerReturnCode_ServiceUnavailable if the service can't be reached.
+	static AssemblerOutput Request(const std::filesystem::path& socketPath, std::string_view source, const std::filesystem::path& sourcePath = {});
+	// Like above, but the service reads the source from sourcePath itself.
+	static AssemblerOutput RequestFile(const std::filesystem::path& socketPath, const std::filesystem::path& sourcePath);
+private:
+	struct Session
+	{
+		std::mutex mutex;
+		AssemblerSession session;
+		// The source it last assembled, to find which lines changed.
+		std::string source;
+		uint64_t lastUsed = 0;
+
+		Session(const std::filesystem::path& sourcePath)
+			: session(sourcePath) {}
+	};
+private:
+	void Serve(uintptr_t connection);
+	AssemblerOutput Assemble(std::string_view source, const std::filesystem::path& sourcePath);
+	std::shared_ptr<Session> GetSession(const std::filesystem::path& sourcePath);
+	static AssemblerOutput SendRequest(const std::filesystem::path& socketPath, const std::string& request);
+private:
+	AssemblerService(const AssemblerService&) = delete;
+	AssemblerService(AssemblerService&&) = delete;
+	AssemblerService& operator=(const AssemblerService&) = delete;
+	AssemblerService& operator=(AssemblerService&&) = delete;
+private:
+	std::filesystem::path socketPath;
+	ThreadPool threadPool;
+	// The listening socket, or an invalid one if the service isn't started.
+	uintptr_t listener;
+	// Identifies the socket file that Start() created, see GetFileId().
+	uint64_t socketVolume = 0;
+	uint64_t socketIndex = 0;
+	std::atomic<bool> isStopping = false;
+	std::mutex sessionsMutex;
+	std::unordered_map<std::string, std::shared_ptr<Session>> sessions;
+	uint64_t useCount = 0;
+};
@@ -0,0 +1,327 @@
+#include "AssemblyCache.h"
+#include "ContentHash.h"
+#include "SourceFile.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <random>
+
+// An entry is a header, its dependencies, its sections and their line maps, its symbols, the files its line maps
+// refer to, and a checksum of everything before it.
+// Every integer is little endian.
+static constexpr char Magic[4] = { 'C', '2', 'A', 'C' };
+static constexpr std::string_view EntryExtension = ".c2ac";
+static constexpr std::string_view TemporaryExtension = ".tmp";
+// The seed of the second hash of the source that entries store, which the key doesn't depend on.
+static constexpr uint64_t SourceHashSeed = 0x2D358DCCAA6C78A5ull;
+// Temporary files this old were left behind by a process that didn't finish writing them.
+static constexpr std::chrono::hours AbandonedTemporaryAge{ 1 };
+
+static void WriteInteger(std::string& data, uint64_t value, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		data.push_back(static_cast<char>(value >> (i * 8)));
+}
+
+// Reads from the front of data, and removes what it read. Never reads past its end.
+struct EntryReader
+{
+	std::string_view data;
+	bool isValid = true;
+
+	uint64_t ReadInteger(size_t size)
+	{
+		if (data.size() < size)
+		{
+			isValid = false;
+			return 0;
+		}
+
+		uint64_t value = 0;
+		for (size_t i = 0; i < size; i++)
+			value |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (i * 8);
+		data.remove_prefix(size);
+		return value;
+	}
+
+	std::string_view ReadBytes(size_t size)
+	{
+		if (data.size() < size)
+		{
+			isValid = false;
+			return {};
+		}
+
+		std::string_view bytes = data.substr(0, size);
+		data.remove_prefix(size);
+		return bytes;
+	}
+};
+
+AssemblyCache::AssemblyCache(const std::filesystem::path& directory, uint64_t maxSize)
+	: directory(directory), maxSize(maxSize)
+{
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+	isEnabled = std::filesystem::is_directory(directory, error);
+
+	std::random_device randomDevice;
+	temporaryNonce = (static_cast<uint64_t>(randomDevice()) << 32) | randomDevice();
+}
+
+AssemblerOutput AssemblyCache::Assemble(std::string_view source, const std::filesystem::path& sourcePath)
+{
+	return AssembleSource(source, sourcePath, nullptr);
+}
+
+AssemblerOutput AssemblyCache::Assemble(std::string_view source, const std::filesystem::path& sourcePath, ThreadPool& threadPool)
+{
+	return AssembleSource(source, sourcePath, &threadPool);
+}
+
+AssemblerOutput AssemblyCache::AssembleSource(std::string_view source, const std::filesystem::path& sourcePath, ThreadPool* threadPool)
+{
+	if (!isEnabled)
+		return Assembler::AssembleSource(source, sourcePath, threadPool);
+
+	uint64_t key = GetKey(source, sourcePath);
+	AssemblerOutput output;
+	if (Load(key, source, output))
+	{
+		hitCount++;
+		return output;
+	}
+
+	missCount++;
+	std::vector<AssemblerDependency> dependencies;
+	output = Assembler::AssembleSource(source, sourcePath, threadPool, nullptr, &dependencies);
+	if (output)
+		Store(key, source, dependencies, output);
+	return output;
+}
+
+void AssemblyCache::Trim()
+{
+	struct CachedFile
+	{
+		std::filesystem::path path;
+		std::filesystem::file_time_type lastWriteTime;
+		uint64_t size = 0;
+	};
+
+	// Other processes may add and remove files at any time, so every error is ignored.
+	std::error_code error;
+	std::vector<CachedFile> cachedFiles;
+	uint64_t cacheSize = 0;
+	std::filesystem::file_time_type now = std::filesystem::file_time_type::clock::now();
+	for (std::filesystem::directory_iterator it(directory, error), end; !error && it != end; it.increment(error))
+	{
+		const std::filesystem::path& path = it->path();
+		std::filesystem::file_time_type lastWriteTime = it->last_write_time(error);
+		uint64_t size = it->file_size(error);
+		if (error)
+		{
+			error.clear();
+			continue;
+		}
+
+		if (path.extension() == TemporaryExtension)
+		{
+			if (now - lastWriteTime > AbandonedTemporaryAge)
+				std::filesystem::remove(path, error);
+			error.clear();
+		}
+		else if (path.extension() == EntryExtension)
+		{
+			cachedFiles.push_back({ path, lastWriteTime, size });
+			cacheSize += size;
+		}
+	}
+
+	if (cacheSize <= maxSize)
+		return;
+
+	// Trimming to below the maximum size means it doesn't happen again on the very next store.
+	std::sort(cachedFiles.begin(), cachedFiles.end(), [](const CachedFile& lhs, const CachedFile& rhs) { return lhs.lastWriteTime < rhs.lastWriteTime; });
+	uint64_t targetSize = maxSize / 4 * 3;
+	for (const CachedFile& cachedFile : cachedFiles)
+	{
+		if (cacheSize <= targetSize)
+			break;
+		if (std::filesystem::remove(cachedFile.path, error))
+			cacheSize -= cachedFile.size;
+		error.clear();
+	}
+}
+
+uint64_t AssemblyCache::GetKey(std::string_view source, const std::filesystem::path& sourcePath) const
+{
+	// Relative includes are relative to the source's directory, and a source may not include itself,
+	// so the same text may assemble differently at another path.
+	std::string seedText = std::to_string(Version);
+	if (!sourcePath.empty())
+	{
+		std::error_code error;
+		seedText += '\0';
+		seedText += std::filesystem::weakly_canonical(sourcePath, error).generic_string();
+	}
+	return ContentHash::Hash(source, ContentHash::Hash(seedText));
+}
+
+std::filesystem::path AssemblyCache::GetEntryPath(uint64_t key) const
+{
+	char name[17];
+	for (size_t i = 0; i < 16; i++)
+		name[i] = "0123456789abcdef"[(key >> ((15 - i) * 4)) & 0xF];
+	name[16] = '\0';
+	return directory / (std::string(name) + std::string(EntryExtension));
+}
+
+bool AssemblyCache::Load(uint64_t key, std::string_view source, AssemblerOutput& output)
+{
+	std::filesystem::path entryPath = GetEntryPath(key);
+	SourceFile entryFile;
+	if (!entryFile.Open(entryPath))
+		return false;
+
+	// A damaged entry is a miss, and is replaced once the source is assembled again.
+	std::string_view entry = entryFile.GetSource();
+	if (entry.size() < sizeof(uint64_t))
+		return false;
+	std::string_view body = entry.substr(0, entry.size() - sizeof(uint64_t));
+	EntryReader checksumReader{ entry.substr(body.size()) };
+	if (checksumReader.ReadInteger(sizeof(uint64_t)) != ContentHash::Hash(body))
+		return false;
+
+	EntryReader reader{ body };
+	if (reader.ReadBytes(sizeof(Magic)) != std::string_view(Magic, sizeof(Magic)) || reader.ReadInteger(4) != Version)
+		return false;
+	// The key is only 64 bits, so the source must also have the same size and the same hash with another seed.
+	if (reader.ReadInteger(8) != key || reader.ReadInteger(8) != source.size() || reader.ReadInteger(8) != ContentHash::Hash(source, SourceHashSeed))
+		return false;
+
+	// Every included file must still have the contents the entry was assembled with.
+	uint64_t dependencyCount = reader.ReadInteger(4);
+	for (uint64_t i = 0; i < dependencyCount && reader.isValid; i++)
+	{
+		uint64_t contentHash = reader.ReadInteger(8);
+		std::string_view path = reader.ReadBytes(reader.ReadInteger(4));
+		if (!reader.isValid)
+			return false;
+
+		// Included files are read rather than mapped, so that one being truncated by an editor can't raise SIGBUS.
+		SourceFile dependency(std::filesystem::path(std::u8string_view(reinterpret_cast<const char8_t*>(path.data()), path.size())), false);
+		if (!dependency || ContentHash::Hash(dependency.GetSource()) != contentHash)
+			return false;
+	}
+
+	// Every section takes at least 10 bytes, which bounds how many there can be.
+	std::vector<AssemblerProgramSection> sections(std::min<uint64_t>(reader.ReadInteger(4), reader.data.size() / 10));
+	for (AssemblerProgramSection& section : sections)
+	{
+		section.origin = static_cast<uint16_t>(reader.ReadInteger(2));
+		std::string_view assembly = reader.ReadBytes(reader.ReadInteger(4));
+		section.assembly.assign(assembly.begin(), assembly.end());
+		std::string_view lineMap = reader.ReadBytes(reader.ReadInteger(4));
+		if (!section.lineMap.Load({ reinterpret_cast<const uint8_t*>(lineMap.data()), lineMap.size() }, section.origin + static_cast<uint32_t>(assembly.size())))
+			return false;
+	}
+
+	// Every symbol takes at least 6 bytes.
+	std::vector<AssemblerSymbol> symbols(std::min<uint64_t>(reader.ReadInteger(4), reader.data.size() / 6));
+	for (AssemblerSymbol& symbol : symbols)
+	{
+		symbol.address = static_cast<uint16_t>(reader.ReadInteger(2));
+		symbol.name = reader.ReadBytes(reader.ReadInteger(4));
+	}
+
+	// Every file takes at least 4 bytes.
+	std::vector<std::filesystem::path> files(std::min<uint64_t>(reader.ReadInteger(4), reader.data.size() / 4));
+	for (std::filesystem::path& file : files)
+	{
+		std::string_view path = reader.ReadBytes(reader.ReadInteger(4));
+		file = std::u8string_view(reinterpret_cast<const char8_t*>(path.data()), path.size());
+	}
+	if (!reader.isValid || !reader.data.empty())
+		return false;
+
+	// Mark the entry as recently used.
+	std::error_code error;
+	std::filesystem::last_write_time(entryPath, std::filesystem::file_time_type::clock::now(), error);
+
+	output = { AssemblerReturnCode_Success, 0, std::move(sections) };
+	output.symbols = std::move(symbols);
+	output.files = std::move(files);
+	return true;
+}
+
+void AssemblyCache::Store(uint64_t key, std::string_view source, const std::vector<AssemblerDependency>& dependencies, const AssemblerOutput& output)
+{
+	std::string entry;
+	entry.append(Magic, sizeof(Magic));
+	WriteInteger(entry, Version, 4);
+	WriteInteger(entry, key, 8);
+	WriteInteger(entry, source.size(), 8);
+	WriteInteger(entry, ContentHash::Hash(source, SourceHashSeed), 8);
+
+	WriteInteger(entry, dependencies.size(), 4);
+	for (const AssemblerDependency& dependency : dependencies)
+	{
+		std::u8string path = dependency.path.u8string();
+		WriteInteger(entry, dependency.contentHash, 8);
+		WriteInteger(entry, path.size(), 4);
+		entry.append(reinterpret_cast<const char*>(path.data()), path.size());
+	}
+
+	WriteInteger(entry, output.sections.size(), 4);
+	for (const AssemblerProgramSection& section : output.sections)
+	{
+		WriteInteger(entry, section.origin, 2);
+		WriteInteger(entry, section.assembly.size(), 4);
+		entry.append(reinterpret_cast<const char*>(section.assembly.data()), section.assembly.size());
+		std::span<const uint8_t> lineMap = section.lineMap.GetData();
+		WriteInteger(entry, lineMap.size(), 4);
+		entry.append(reinterpret_cast<const char*>(lineMap.data()), lineMap.size());
+	}
+
+	WriteInteger(entry, output.symbols.size(), 4);
+	for (const AssemblerSymbol& symbol : output.symbols)
+	{
+		WriteInteger(entry, symbol.address, 2);
+		WriteInteger(entry, symbol.name.size(), 4);
+		entry.append(symbol.name);
+	}
+
+	WriteInteger(entry, output.files.size(), 4);
+	for (const std::filesystem::path& file : output.files)
+	{
+		std::u8string path = file.u8string();
+		WriteInteger(entry, path.size(), 4);
+		entry.append(reinterpret_cast<const char*>(path.data()), path.size());
+	}
+	WriteInteger(entry, ContentHash::Hash(entry), 8);
+
+	// Write the whole entry somewhere else first, so that no process ever maps a partly written entry.
+	std::filesystem::path entryPath = GetEntryPath(key);
+	std::filesystem::path temporaryPath = entryPath;
+	temporaryPath += "." + std::to_string(temporaryNonce) + "." + std::to_string(temporaryCount++) + std::string(TemporaryExtension);
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		if (!file.write(entry.data(), static_cast<std::streamsize>(entry.size())))
+		{
+			file.close();
+			std::error_code error;
+			std::filesystem::remove(temporaryPath, error);
+			return;
+		}
+	}
+
+	// Renaming replaces the entry atomically. If another process has it open in a way that prevents
+	// replacing it, its entry is as good as this one.
+	std::error_code error;
+	std::filesystem::rename(temporaryPath, entryPath, error);
+	if (error)
+		std::filesystem::remove(temporaryPath, error);
+
+	Trim();
+}
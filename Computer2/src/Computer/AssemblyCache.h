@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Assembler.h"
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+// A cache of assembled programs on disk, which any number of processes can share.
+//
+// Entries are keyed by the hash of the source, its path, and the assembler's version, and are only a hit if the
+// source also has the size and the second, differently seeded, hash that the entry stores. Each entry also lists
+// every file the source included along with the hash of its contents, and is only a hit while all of them still
+// hash the same, so editing an included file, or anything it includes, is a miss. Every .define lives in the source
+// or its includes, so they are covered too. Only successful outputs are cached.
+//
+// Entries are written to a temporary file that is then renamed over the entry, so readers only ever see whole
+// entries, and they are read by mapping them. Hits refresh an entry's modification time, and the least recently
+// used entries are removed whenever storing one makes the cache larger than its maximum size.
+// Safe to use from multiple threads.
+class AssemblyCache
+{
+public:
+	static constexpr uint64_t DefaultMaxSize = 256ull << 20;
+	// Stored in every entry. Must change whenever the same source may assemble differently, or the format changes.
+	static constexpr uint32_t Version = 4;
+public:
+	// Creates directory if it doesn't exist. A cache whose directory can't be created never hits, and stores nothing.
+	AssemblyCache(const std::filesystem::path& directory, uint64_t maxSize = DefaultMaxSize);
+
+	// Like Assembler::Assemble(), but returns the cached output if there is one, and caches it otherwise.
+	AssemblerOutput Assemble(std::string_view source, const std::filesystem::path& sourcePath = {});
+	AssemblerOutput Assemble(std::string_view source, const std::filesystem::path& sourcePath, ThreadPool& threadPool);
+
+	// Removes the least recently used entries until the cache is at most three quarters of its maximum size,
+	// if it's larger than its maximum size.
+	void Trim();
+
+	uint64_t GetHitCount() const noexcept { return hitCount; }
+	uint64_t GetMissCount() const noexcept { return missCount; }
+private:
+	AssemblerOutput AssembleSource(std::string_view source, const std::filesystem::path& sourcePath, ThreadPool* threadPool);
+
+	uint64_t GetKey(std::string_view source, const std::filesystem::path& sourcePath) const;
+	std::filesystem::path GetEntryPath(uint64_t key) const;
+	// Returns false if there's no valid entry for key, or one of its dependencies changed.
+	bool Load(uint64_t key, std::string_view source, AssemblerOutput& output);
+	void Store(uint64_t key, std::string_view source, const std::vector<AssemblerDependency>& dependencies, const AssemblerOutput& output);
+private:
+	AssemblyCache(const AssemblyCache&) = delete;
+	AssemblyCache(AssemblyCache&&) = delete;
+	AssemblyCache& operator=(const AssemblyCache&) = delete;
+	AssemblyCache& operator=(AssemblyCache&&) = delete;
+private:
+	std::filesystem::path directory;
+	uint64_t maxSize = DefaultMaxSize;
+	bool isEnabled = false;
+	std::atomic<uint64_t> hitCount = 0;
+	std::atomic<uint64_t> missCount = 0;
+	// Make the names of temporary files unique across processes and threads.
+	uint64_t temporaryNonce = 0;
+	std::atomic<uint64_t> temporaryCount = 0;
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Locale independent character classification. Each query is a single table lookup,
+// and chars are converted to uint8_t first, so negative chars are classified safely.
+
+using CharacterClass = uint16_t;
+enum CharacterClass_ : CharacterClass
+{
+	CharacterClass_None               = 0,
+	CharacterClass_Blank              = 1 << 0,  // ' ' '\t'
+	CharacterClass_Whitespace         = 1 << 1,  // ' ' '\t' '\v' '\f' '\n' '\r'
+	CharacterClass_LineEnding         = 1 << 2,  // '\n' '\r'
+	CharacterClass_BinaryDigit        = 1 << 3,  // [01]
+	CharacterClass_DecimalDigit       = 1 << 4,  // [0-9]
+	CharacterClass_HexadecimalDigit   = 1 << 5,  // [0-9a-fA-F]
+	CharacterClass_Alpha              = 1 << 6,  // [a-zA-Z]
+	CharacterClass_IdentifierStart    = 1 << 7,  // [_a-zA-Z]
+	CharacterClass_IdentifierContinue = 1 << 8,  // [._a-zA-Z0-9]
+	CharacterClass_OperandDelimiter   = 1 << 9,  // ','
+	CharacterClass_Quote              = 1 << 10, // '"'
+	CharacterClass_Comment            = 1 << 11, // ';'
+};
+
+inline constexpr std::array<CharacterClass, 256> CharacterClassTable = []()
+{
+	std::array<CharacterClass, 256> classes{};
+	auto add = [&classes](char c, CharacterClass characterClass) { classes[static_cast<uint8_t>(c)] |= characterClass; };
+
+	for (char c : { ' ', '\t' })
+		add(c, CharacterClass_Blank);
+	for (char c : { ' ', '\t', '\v', '\f', '\n', '\r' })
+		add(c, CharacterClass_Whitespace);
+	for (char c : { '\n', '\r' })
+		add(c, CharacterClass_LineEnding);
+	for (char c : { '0', '1' })
+		add(c, CharacterClass_BinaryDigit);
+	for (char c = '0'; c <= '9'; c++)
+		add(c, CharacterClass_DecimalDigit | CharacterClass_HexadecimalDigit | CharacterClass_IdentifierContinue);
+	for (char c = 'a'; c <= 'z'; c++)
+	{
+		CharacterClass alpha = CharacterClass_Alpha | CharacterClass_IdentifierStart | CharacterClass_IdentifierContinue;
+		CharacterClass hex = c <= 'f' ? CharacterClass_HexadecimalDigit : CharacterClass_None;
+		add(c, alpha | hex);
+		add(static_cast<char>(c - 'a' + 'A'), alpha | hex);
+	}
+	add('_', CharacterClass_IdentifierStart | CharacterClass_IdentifierContinue);
+	add('.', CharacterClass_IdentifierContinue);
+	add(',', CharacterClass_OperandDelimiter);
+	add('"', CharacterClass_Quote);
+	add(';', CharacterClass_Comment);
+	return classes;
+}();
+
+inline constexpr std::array<char, 256> LowercaseTable = []()
+{
+	std::array<char, 256> lowercase{};
+	for (size_t i = 0; i < lowercase.size(); i++)
+		lowercase[i] = static_cast<char>(i);
+	for (char c = 'A'; c <= 'Z'; c++)
+		lowercase[static_cast<uint8_t>(c)] = static_cast<char>(c - 'A' + 'a');
+	return lowercase;
+}();
+
+// The value of a hexadecimal digit, or 0xFF for any other character.
+inline constexpr std::array<uint8_t, 256> DigitValueTable = []()
+{
+	std::array<uint8_t, 256> values{};
+	values.fill(0xFF);
+	for (char c = '0'; c <= '9'; c++)
+		values[static_cast<uint8_t>(c)] = static_cast<uint8_t>(c - '0');
+	for (char c = 'a'; c <= 'f'; c++)
+	{
+		values[static_cast<uint8_t>(c)] = static_cast<uint8_t>(c - 'a' + 10);
+		values[static_cast<uint8_t>(c - 'a' + 'A')] = static_cast<uint8_t>(c - 'a' + 10);
+	}
+	return values;
+}();
+
+// The character each escape sequence stands for, indexed by the character after the backslash, or -1 if it isn't one.
+inline constexpr std::array<int16_t, 256> EscapeTable = []()
+{
+	std::array<int16_t, 256> escapes{};
+	escapes.fill(-1);
+	escapes['0'] = '\0';
+	escapes['n'] = '\n';
+	escapes['r'] = '\r';
+	escapes['t'] = '\t';
+	escapes['\\'] = '\\';
+	escapes['"'] = '"';
+	escapes['\''] = '\'';
+	return escapes;
+}();
+
+constexpr CharacterClass GetCharacterClass(char c) noexcept
+{
+	return CharacterClassTable[static_cast<uint8_t>(c)];
+}
+
+constexpr bool HasCharacterClass(char c, CharacterClass characterClass) noexcept
+{
+	return (GetCharacterClass(c) & characterClass) != 0;
+}
+
+constexpr bool IsBlank(char c) noexcept { return HasCharacterClass(c, CharacterClass_Blank); }
+constexpr bool IsWhitespace(char c) noexcept { return HasCharacterClass(c, CharacterClass_Whitespace); }
+constexpr bool IsLineEnding(char c) noexcept { return HasCharacterClass(c, CharacterClass_LineEnding); }
+constexpr bool IsBinaryDigit(char c) noexcept { return HasCharacterClass(c, CharacterClass_BinaryDigit); }
+constexpr bool IsDecimalDigit(char c) noexcept { return HasCharacterClass(c, CharacterClass_DecimalDigit); }
+constexpr bool IsHexadecimalDigit(char c) noexcept { return HasCharacterClass(c, CharacterClass_HexadecimalDigit); }
+constexpr bool IsAlpha(char c) noexcept { return HasCharacterClass(c, CharacterClass_Alpha); }
+constexpr bool IsIdentifierStart(char c) noexcept { return HasCharacterClass(c, CharacterClass_IdentifierStart); }
+constexpr bool IsIdentifierContinue(char c) noexcept { return HasCharacterClass(c, CharacterClass_IdentifierContinue); }
+constexpr bool IsOperandDelimiter(char c) noexcept { return HasCharacterClass(c, CharacterClass_OperandDelimiter); }
+
+constexpr char ToLower(char c) noexcept
+{
+	return LowercaseTable[static_cast<uint8_t>(c)];
+}
+
+// Returns the value of a hexadecimal digit, or 0xFF if c is not one.
+constexpr uint8_t GetDigitValue(char c) noexcept
+{
+	return DigitValueTable[static_cast<uint8_t>(c)];
+}
+
+// Returns the character that c stands for after a backslash, or -1 if "\c" isn't an escape sequence.
+constexpr int16_t GetEscapedCharacter(char c) noexcept
+{
+	return EscapeTable[static_cast<uint8_t>(c)];
+}
@@ -0,0 +1,677 @@
+#pragma once
+
+#include "Assembler.h"
+#include "CharacterClass.h"
+#include "Expression.h"
+#include "InstructionEncoder.h"
+#include "Keywords.h"
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+template<size_t Size>
+struct CompileTimeAssemblerOutput
+{
+	AssemblerReturnCode returnCode = AssemblerReturnCode_Success;
+	size_t lineNumber = 0; // Only relevant if returnCode is not AssemblerReturnCode_Success.
+	std::array<uint8_t, Size> image{};
+
+	constexpr operator bool() const noexcept
+	{
+		return returnCode == AssemblerReturnCode_Success;
+	}
+};
+
+// Assembles programs in constant expressions, so that boot ROMs and test programs can be embedded as string
+// literals, never be assembled at run time, and fail the build if they don't assemble, e.g.
+//   static constexpr auto BootRom = CompileTimeAssembler::AssembleRom<256>(R"(
+//       ldi a, 1
+//       halt
+//   )");
+//
+// Assembles the same language as Assembler::Assemble(), except for what needs files or has to outlive the
+// call: .include and .macro are invalid directives. Like Assembler::AssembleImage(), sections may not overlap.
+// Compilers limit how much work a constant expression may do; a line costs GCC around 10k of its default 33M
+// operations, so larger programs need -fconstexpr-ops-limit, or /constexpr:steps with MSVC.
+class CompileTimeAssembler
+{
+public:
+	// Assembles source into an image of the Size bytes from address origin. Bytes that nothing is emitted to are 0,
+	// and emitting bytes outside of the image fails with AssemblerReturnCode_AddressOverflow.
+	template<size_t Size>
+	static constexpr CompileTimeAssemblerOutput<Size> Assemble(std::string_view source, uint16_t origin = 0)
+	{
+		static_assert(Size <= AssemblerImage::Size, "Images can't be larger than the address space.");
+
+		CompileTimeAssemblerOutput<Size> output;
+		if (origin + Size > AssemblerImage::Size)
+		{
+			output.returnCode = AssemblerReturnCode_AddressOverflow;
+			return output;
+		}
+
+		Context context(output.image, origin);
+		output.returnCode = context.Assemble(source);
+		output.lineNumber = context.lineNumber;
+		if (!output)
+			output.image = {};
+		return output;
+	}
+
+	// Like above, but fails to compile if source doesn't assemble.
+	template<size_t Size>
+	static consteval std::array<uint8_t, Size> AssembleRom(std::string_view source, uint16_t origin = 0)
+	{
+		CompileTimeAssemblerOutput<Size> output = Assemble<Size>(source, origin);
+		CheckSuccess(output.returnCode, output.lineNumber);
+		return output.image;
+	}
+private:
+	// Fails the build unless returnCode is success. Writing past the end of an array isn't a constant expression,
+	// and compilers show the index in their error, so the error shows which line failed to assemble. Whatever
+	// else fails, like an empty source, fails at the throw instead. Assemble() tells why.
+	static constexpr void CheckSuccess(AssemblerReturnCode returnCode, size_t lineNumber)
+	{
+		if (returnCode == AssemblerReturnCode_Success)
+			return;
+
+		[[maybe_unused]] uint8_t failedToAssembleLine[1]{};
+		failedToAssembleLine[lineNumber] = 1;
+		throw "The program failed to assemble.";
+	}
+
+	class Context
+	{
+	public:
+		constexpr Context(std::span<uint8_t> image, uint16_t origin)
+			: image(image), origin(origin), isWritten(image.size()) {}
+
+		constexpr AssemblerReturnCode Assemble(std::string_view source)
+		{
+			// Separate source code into lines while ignoring preceding whitespace, traling whitespace, and comments,
+			// like SourceScanner::SplitLines().
+			bool isEffectivelyEmpty = true;
+			lineNumber = 1;
+			for (size_t i = 0; i < source.size(); lineNumber++)
+			{
+				// Find the line's end and its comment in one pass, since every step counts against the compiler's limit.
+				size_t lineEnd = i;
+				size_t commentStart = std::string_view::npos;
+				for (; lineEnd < source.size() && !IsLineEnding(source[lineEnd]); lineEnd++)
+					if (source[lineEnd] == ';' && commentStart == std::string_view::npos)
+						commentStart = lineEnd;
+
+				size_t lineStart = i;
+				size_t contentEnd = commentStart != std::string_view::npos ? commentStart : lineEnd;
+				while (lineStart < contentEnd && IsWhitespace(source[lineStart]))
+					lineStart++;
+				while (contentEnd > lineStart && IsWhitespace(source[contentEnd - 1]))
+					contentEnd--;
+				std::string_view line = source.substr(lineStart, contentEnd - lineStart);
+
+				i = lineEnd + (lineEnd + 1 < source.size() && source[lineEnd] == '\r' && source[lineEnd + 1] == '\n' ? 2 : 1);
+				if (line.empty())
+					continue;
+
+				isEffectivelyEmpty = false;
+				if (AssemblerReturnCode returnCode = ProcessLine(line); returnCode != AssemblerReturnCode_Success)
+					return returnCode;
+			}
+
+			if (isEffectivelyEmpty)
+			{
+				lineNumber = 0;
+				return AssemblerReturnCode_EffectivelyEmptySource;
+			}
+			if (!conditionals.empty())
+			{
+				lineNumber = conditionals.back().lineNumber;
+				return AssemblerReturnCode_UnterminatedConditional;
+			}
+
+			// Whatever still waits uses a symbol that is never defined, which fails at the first line that does.
+			lineNumber = 0;
+			for (const Symbol& symbol : symbols)
+				for (uint32_t fixupIndex = symbol.firstFixup; fixupIndex != NoIndex; fixupIndex = fixups[fixupIndex].nextFixup)
+					if (lineNumber == 0 || fixups[fixupIndex].lineNumber < lineNumber)
+						lineNumber = fixups[fixupIndex].lineNumber;
+			if (lineNumber != 0)
+				return AssemblerReturnCode_UndefinedSymbol;
+
+			return AssemblerReturnCode_Success;
+		}
+	private:
+		static constexpr uint32_t NoIndex = 0xFFFFFFFF;
+
+		struct Symbol
+		{
+			std::string_view name;
+			int32_t value = 0;
+			// The operand of a .define, which is evaluated once something uses it.
+			std::string_view operand;
+			bool isLabel = false;
+			bool isString = false;
+			bool isEvaluated = false;
+			bool isEvaluating = false;
+			// Symbols are also added once something waits on them, and only defined later, if ever.
+			bool isDefined = false;
+			// The first fixup waiting on this symbol, see Fixup::nextFixup.
+			uint32_t firstFixup = NoIndex;
+		};
+
+		// An operand that used symbols that weren't defined yet. Like with Assembler::Assemble(), it waits on the first
+		// one it needs, and is evaluated again as soon as that one is defined, so that both fail on the same line.
+		struct Fixup
+		{
+			uint32_t address = 0;
+			uint8_t size = 0;
+			std::string_view operand;
+			size_t lineNumber = 0;
+			// The next fixup waiting on the same symbol.
+			uint32_t nextFixup = NoIndex;
+		};
+
+		struct Conditional
+		{
+			bool isBranchTaken = false;
+			bool hasElse = false;
+			size_t lineNumber = 0;
+		};
+	private:
+		constexpr AssemblerReturnCode ProcessLine(std::string_view line)
+		{
+			if (SkipLine(line))
+				return AssemblerReturnCode_Success;
+			if (line.ends_with(':'))
+				return DefineLabel(line);
+
+			tokens.clear();
+			if (AssemblerReturnCode returnCode = Tokenize(line, tokens); returnCode != AssemblerReturnCode_Success)
+				return returnCode;
+
+			std::string_view token0 = tokens.front();
+			std::span<const std::string_view> operands = std::span<const std::string_view>(tokens).subspan(1);
+			if (token0.front() != '.')
+				return EmitInstruction(MnemonicTable.Find(token0), operands);
+
+			Directive directive = DirectiveTable.Find(token0.substr(1));
+			switch (directive)
+			{
+				case Directive::Byte:
+				case Directive::Word:
+				{
+					if (operands.empty())
+						return AssemblerReturnCode_InvalidOperandCount;
+
+					for (std::string_view operand : operands)
+						if (AssemblerReturnCode returnCode = EmitData(operand, directive == Directive::Byte ? 1 : 2); returnCode != AssemblerReturnCode_Success)
+							return returnCode;
+					return AssemblerReturnCode_Success;
+				}
+				case Directive::Define:
+				{
+					if (operands.size() != 2)
+						return AssemblerReturnCode_InvalidOperandCount;
+					if (!Assembler::IsLabel(operands[0]))
+						return AssemblerReturnCode_InvalidOperand;
+					if (FindSymbol(operands[0]) != nullptr)
+						return AssemblerReturnCode_DuplicateDefine;
+
+					bool isString = IsStringOperand(operands[1]);
+					std::string decoded;
+					if (isString)
+						if (AssemblerReturnCode returnCode = DecodeStringOperand(operands[1], decoded); returnCode != AssemblerReturnCode_Success)
+							return returnCode;
+					return DefineSymbol({ .name = operands[0], .operand = operands[1], .isString = isString });
+				}
+				case Directive::If:
+				case Directive::Elif:
+				case Directive::Else:
+				case Directive::EndIf:
+					return ProcessConditional(directive, operands);
+				case Directive::Origin:
+				{
+					if (operands.size() != 1)
+						return AssemblerReturnCode_InvalidOperandCount;
+
+					// The origin must be known right away.
+					int32_t value = 0;
+					if (AssemblerReturnCode returnCode = Evaluate(operands.front(), value); returnCode != AssemblerReturnCode_Success)
+						return returnCode;
+					if (value < 0 || value >= static_cast<int32_t>(AssemblerImage::Size))
+						return AssemblerReturnCode_OperandOutOfRange;
+
+					address = static_cast<uint32_t>(value);
+					return AssemblerReturnCode_Success;
+				}
+				default:
+					// Including files and defining macros isn't possible in constant expressions.
+					return AssemblerReturnCode_InvalidDirective;
+			}
+		}
+
+		// Splits line into its first token and its comma separated operands, like TokenStream::Tokenize().
+		static constexpr AssemblerReturnCode Tokenize(std::string_view line, std::vector<std::string_view>& tokens)
+		{
+			size_t i = 0;
+			while (i < line.size() && !IsWhitespace(line[i]))
+				i++;
+			tokens.push_back(line.substr(0, i));
+
+			while (i < line.size())
+			{
+				do i++;
+				while (i < line.size() && IsWhitespace(line[i]));
+
+				size_t operandStart = i;
+				bool inQuote = false;
+				bool isEscaped = false;
+				for (; i < line.size(); i++)
+				{
+					char c = line[i];
+					if (inQuote)
+					{
+						if (c == '"' && !isEscaped)
+							inQuote = false;
+						else
+							isEscaped = c == '\\' && !isEscaped;
+					}
+					else if (c == '"')
+						inQuote = true;
+					else if (IsOperandDelimiter(c))
+						break;
+				}
+
+				if (inQuote || isEscaped)
+					return AssemblerReturnCode_InvalidStringLiteral;
+
+				size_t operandEnd = i;
+				while (operandEnd > operandStart && IsBlank(line[operandEnd - 1]))
+					operandEnd--;
+				if (operandEnd == operandStart)
+					return AssemblerReturnCode_InvalidOperand;
+				tokens.push_back(line.substr(operandStart, operandEnd - operandStart));
+			}
+
+			return AssemblerReturnCode_Success;
+		}
+
+		// Only branches of the innermost conditional end the skipped lines; nested blocks are skipped whole.
+		constexpr bool SkipLine(std::string_view line)
+		{
+			if (!isSkipping)
+				return false;
+
+			size_t nameEnd = 1;
+			while (nameEnd < line.size() && !IsWhitespace(line[nameEnd]))
+				nameEnd++;
+			switch (line.front() == '.' ? DirectiveTable.Find(line.substr(1, nameEnd - 1)) : Directive::None)
+			{
+				case Directive::If:
+					skippedDepth++;
+					return true;
+				case Directive::Elif:
+				case Directive::Else:
+					return skippedDepth != 0;
+				case Directive::EndIf:
+					if (skippedDepth == 0)
+						return false;
+					skippedDepth--;
+					return true;
+				default:
+					return true;
+			}
+		}
+
+		constexpr AssemblerReturnCode ProcessConditional(Directive directive, std::span<const std::string_view> operands)
+		{
+			bool hasCondition = directive == Directive::If || directive == Directive::Elif;
+			if (operands.size() != (hasCondition ? 1 : 0))
+				return AssemblerReturnCode_InvalidOperandCount;
+			if (directive != Directive::If && (conditionals.empty() || (directive != Directive::EndIf && conditionals.back().hasElse)))
+				return AssemblerReturnCode_UnmatchedConditional;
+
+			// Once a branch was assembled, the conditions of the others aren't even evaluated.
+			int32_t condition = 0;
+			if (directive == Directive::If || (directive == Directive::Elif && !conditionals.back().isBranchTaken))
+				if (AssemblerReturnCode returnCode = Evaluate(operands.front(), condition); returnCode != AssemblerReturnCode_Success)
+					return returnCode;
+
+			switch (directive)
+			{
+				case Directive::If:
+					conditionals.push_back({ condition != 0, false, lineNumber });
+					isSkipping = condition == 0;
+					break;
+				case Directive::Elif:
+					isSkipping = conditionals.back().isBranchTaken || condition == 0;
+					conditionals.back().isBranchTaken |= condition != 0;
+					break;
+				case Directive::Else:
+					conditionals.back().hasElse = true;
+					isSkipping = conditionals.back().isBranchTaken;
+					conditionals.back().isBranchTaken = true;
+					break;
+				default:
+					conditionals.pop_back();
+					isSkipping = false;
+					break;
+			}
+			return AssemblerReturnCode_Success;
+		}
+
+		constexpr AssemblerReturnCode DefineLabel(std::string_view line)
+		{
+			size_t lastSpace = line.find_last_of(" \t");
+			std::string_view name = line.substr(lastSpace + 1, line.size() - (lastSpace + 2));
+			if (!Assembler::IsLabel(name))
+				return AssemblerReturnCode_InvalidLabelDefinition;
+
+			// Every label is visible to the whole program, since there are no other files.
+			if (lastSpace != std::string_view::npos)
+			{
+				std::string_view visibility = line.substr(0, lastSpace);
+				if (visibility != "public" && visibility != "protected" && visibility != "private")
+					return AssemblerReturnCode_InvalidLabelDefinition;
+			}
+
+			if (FindSymbol(name) != nullptr)
+				return AssemblerReturnCode_DuplicateLabelDefinition;
+			if (address >= AssemblerImage::Size)
+				return AssemblerReturnCode_AddressOverflow;
+
+			return DefineSymbol({ .name = name, .value = static_cast<int32_t>(address), .operand = {}, .isLabel = true, .isEvaluated = true });
+		}
+
+		constexpr AssemblerReturnCode EmitInstruction(Mnemonic mnemonic, std::span<const std::string_view> operands)
+		{
+			EncodedInstruction instruction;
+			if (AssemblerReturnCode returnCode = InstructionEncoder::Encode(mnemonic, operands, instruction); returnCode != AssemblerReturnCode_Success)
+				return returnCode;
+			if (AssemblerReturnCode returnCode = EmitBytes({ instruction.info->opcode.data(), instruction.info->opcodeSize }); returnCode != AssemblerReturnCode_Success)
+				return returnCode;
+
+			if (instruction.info->immediateSize == 0)
+				return AssemblerReturnCode_Success;
+			if (IsStringOperand(instruction.immediate))
+				return AssemblerReturnCode_InvalidOperand;
+			return EmitData(instruction.immediate, instruction.info->immediateSize);
+		}
+
+		constexpr AssemblerReturnCode EmitData(std::string_view operand, uint8_t size)
+		{
+			if (IsStringOperand(operand))
+			{
+				// Strings are only allowed where bytes are expected.
+				if (size != 1)
+					return AssemblerReturnCode_InvalidStringLiteral;
+
+				std::string string;
+				if (AssemblerReturnCode returnCode = DecodeStringOperand(operand, string); returnCode != AssemblerReturnCode_Success)
+					return returnCode;
+				std::vector<uint8_t> bytes(string.begin(), string.end());
+				return EmitBytes(bytes);
+			}
+
+			// Operands that use symbols that aren't defined yet are emitted as 0, and patched once they are.
+			int32_t value = 0;
+			AssemblerReturnCode returnCode = Evaluate(operand, value);
+			if (returnCode == AssemblerReturnCode_UndefinedSymbol)
+			{
+				fixups.push_back({ address, size, operand, lineNumber });
+				Wait(static_cast<uint32_t>(fixups.size() - 1));
+				value = 0;
+			}
+			else if (returnCode != AssemblerReturnCode_Success)
+				return returnCode;
+			else if (!NumericLiteral::FitsOperandSize(value, size))
+				return AssemblerReturnCode_OperandOutOfRange;
+
+			// Words are little endian.
+			uint8_t bytes[2] = { static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8) };
+			return EmitBytes({ bytes, size });
+		}
+
+		constexpr AssemblerReturnCode EmitBytes(std::span<const uint8_t> bytes)
+		{
+			if (address + bytes.size() > AssemblerImage::Size)
+				return AssemblerReturnCode_AddressOverflow;
+			if (address < origin || address + bytes.size() > origin + image.size())
+				return AssemblerReturnCode_AddressOverflow;
+
+			for (uint8_t byte : bytes)
+			{
+				uint32_t offset = address++ - origin;
+				if (isWritten[offset])
+					return AssemblerReturnCode_OverlappingSections;
+				isWritten[offset] = true;
+				image[offset] = byte;
+			}
+			return AssemblerReturnCode_Success;
+		}
+
+		// Whether operand is a concatenation of string literals and string defines, e.g. "abc" Name "def".
+		constexpr bool IsStringOperand(std::string_view operand) const
+		{
+			if (operand.front() == '"')
+				return true;
+
+			size_t end = 0;
+			while (end < operand.size() && IsIdentifierContinue(operand[end]))
+				end++;
+			const Symbol* symbol = FindSymbol(operand.substr(0, end));
+			return symbol != nullptr && symbol->isString;
+		}
+
+		constexpr AssemblerReturnCode DecodeStringOperand(std::string_view operand, std::string& string) const
+		{
+			for (size_t i = 0; i < operand.size();)
+			{
+				if (IsBlank(operand[i]))
+				{
+					i++;
+					continue;
+				}
+
+				// Only string defines may be concatenated with string literals.
+				if (operand[i] != '"')
+				{
+					size_t end = i;
+					while (end < operand.size() && IsIdentifierContinue(operand[end]))
+						end++;
+					const Symbol* symbol = FindSymbol(operand.substr(i, end - i));
+					if (symbol == nullptr || !symbol->isString)
+						return AssemblerReturnCode_InvalidStringLiteral;
+					if (AssemblerReturnCode returnCode = DecodeStringOperand(symbol->operand, string); returnCode != AssemblerReturnCode_Success)
+						return returnCode;
+					i = end;
+					continue;
+				}
+
+				// The tokenizer already made sure every string literal is terminated.
+				for (i++; operand[i] != '"'; i++)
+				{
+					char c = operand[i];
+					if (c == '\\')
+					{
+						int16_t escaped = GetEscapedCharacter(operand[++i]);
+						if (escaped < 0)
+							return AssemblerReturnCode_InvalidStringLiteral;
+						c = static_cast<char>(escaped);
+					}
+					string.push_back(c);
+				}
+				i++;
+			}
+			return AssemblerReturnCode_Success;
+		}
+
+		constexpr AssemblerReturnCode Evaluate(std::string_view operand, int32_t& value)
+		{
+			Expression::EvaluateResult result = Expression::EvaluateText(operand, [this](std::string_view name, int32_t& value) { return Resolve(name, value); });
+			value = result.value;
+			return result.returnCode;
+		}
+
+		constexpr AssemblerReturnCode Resolve(std::string_view name, int32_t& value)
+		{
+			Symbol* symbol = FindSymbol(name);
+			if (symbol == nullptr)
+			{
+				blockingName = name;
+				return AssemblerReturnCode_UndefinedSymbol;
+			}
+			if (symbol->isString)
+				return AssemblerReturnCode_InvalidExpression;
+
+			// Defines are evaluated once they're first used, and only once they're defined in full.
+			if (!symbol->isEvaluated)
+			{
+				if (symbol->isEvaluating)
+					return AssemblerReturnCode_CircularDefine;
+
+				symbol->isEvaluating = true;
+				int32_t defineValue = 0;
+				AssemblerReturnCode returnCode = Evaluate(symbol->operand, defineValue);
+				symbol->isEvaluating = false;
+				if (returnCode != AssemblerReturnCode_Success)
+					return returnCode;
+
+				symbol->value = defineValue;
+				symbol->isEvaluated = true;
+			}
+
+			value = symbol->value;
+			return AssemblerReturnCode_Success;
+		}
+
+		// Defines symbol, whose name isn't defined yet, and patches whatever waited on it.
+		constexpr AssemblerReturnCode DefineSymbol(const Symbol& symbol)
+		{
+			Symbol& definedSymbol = symbols[InsertSymbol(symbol.name)];
+			uint32_t fixupIndex = definedSymbol.firstFixup;
+			definedSymbol = symbol;
+			definedSymbol.isDefined = true;
+
+			// Fixups that are still blocked by another symbol wait on that one instead.
+			while (fixupIndex != NoIndex)
+			{
+				uint32_t nextFixupIndex = fixups[fixupIndex].nextFixup;
+				if (AssemblerReturnCode returnCode = ResolveFixup(fixupIndex); returnCode != AssemblerReturnCode_Success)
+					return returnCode;
+				fixupIndex = nextFixupIndex;
+			}
+			return AssemblerReturnCode_Success;
+		}
+
+		// Patches the fixup if its operand can be evaluated, or makes it wait on the symbol it's blocked by.
+		constexpr AssemblerReturnCode ResolveFixup(uint32_t fixupIndex)
+		{
+			int32_t value = 0;
+			AssemblerReturnCode returnCode = Evaluate(fixups[fixupIndex].operand, value);
+			if (returnCode == AssemblerReturnCode_UndefinedSymbol)
+			{
+				Wait(fixupIndex);
+				return AssemblerReturnCode_Success;
+			}
+
+			const Fixup& fixup = fixups[fixupIndex];
+			if (returnCode == AssemblerReturnCode_Success && !NumericLiteral::FitsOperandSize(value, fixup.size))
+				returnCode = AssemblerReturnCode_OperandOutOfRange;
+			if (returnCode != AssemblerReturnCode_Success)
+			{
+				lineNumber = fixup.lineNumber;
+				return returnCode;
+			}
+
+			for (uint8_t i = 0; i < fixup.size; i++)
+				image[fixup.address - origin + i] = static_cast<uint8_t>(value >> (i * 8));
+			return AssemblerReturnCode_Success;
+		}
+
+		// Makes the fixup wait on the symbol that evaluating it last was blocked by.
+		constexpr void Wait(uint32_t fixupIndex)
+		{
+			Symbol& symbol = symbols[InsertSymbol(blockingName)];
+			fixups[fixupIndex].nextFixup = symbol.firstFixup;
+			symbol.firstFixup = fixupIndex;
+		}
+
+		// Returns the index of the symbol named name, which is added undefined if there isn't one yet.
+		constexpr uint32_t InsertSymbol(std::string_view name)
+		{
+			// Keep the index at most half full, so that probing stays short.
+			if ((symbols.size() + 1) * 2 > symbolIndex.size())
+			{
+				symbolIndex.assign(symbolIndex.empty() ? 64 : symbolIndex.size() * 2, NoIndex);
+				for (uint32_t i = 0; i < symbols.size(); i++)
+					symbolIndex[FindSlot(symbols[i].name)] = i;
+			}
+
+			size_t slot = FindSlot(name);
+			if (symbolIndex[slot] == NoIndex)
+			{
+				symbolIndex[slot] = static_cast<uint32_t>(symbols.size());
+				symbols.push_back({ .name = name, .operand = {} });
+			}
+			return symbolIndex[slot];
+		}
+
+		constexpr Symbol* FindSymbol(std::string_view name)
+		{
+			return const_cast<Symbol*>(std::as_const(*this).FindSymbol(name));
+		}
+
+		constexpr const Symbol* FindSymbol(std::string_view name) const
+		{
+			if (symbolIndex.empty())
+				return nullptr;
+			uint32_t index = symbolIndex[FindSlot(name)];
+			return index != NoIndex && symbols[index].isDefined ? &symbols[index] : nullptr;
+		}
+
+		// Returns the slot of the index that name is in, or the empty slot it would go in.
+		constexpr size_t FindSlot(std::string_view name) const
+		{
+			// 32-bit FNV-1a, probed linearly.
+			uint32_t hash = 2166136261u;
+			for (char c : name)
+				hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+
+			size_t mask = symbolIndex.size() - 1;
+			for (size_t slot = (hash ^ hash >> 15) & mask;; slot = (slot + 1) & mask)
+				if (symbolIndex[slot] == NoIndex || symbols[symbolIndex[slot]].name == name)
+					return slot;
+		}
+	public:
+		// The line currently being assembled, or the line an error was found on.
+		size_t lineNumber = 0;
+	private:
+		std::span<uint8_t> image;
+		uint32_t origin = 0;
+		std::vector<bool> isWritten;
+		uint32_t address = 0;
+		// Reused for every line, rather than allocated for each.
+		std::vector<std::string_view> tokens;
+		std::vector<Symbol> symbols;
+		// Open addressing over symbols, since programs may well have thousands of labels.
+		std::vector<uint32_t> symbolIndex;
+		std::vector<Fixup> fixups;
+		// The symbol that evaluating an operand was last blocked by, see Wait().
+		std::string_view blockingName;
+		std::vector<Conditional> conditionals;
+		bool isSkipping = false;
+		uint32_t skippedDepth = 0;
+	};
+private:
+	CompileTimeAssembler() = delete;
+	CompileTimeAssembler(const CompileTimeAssembler&) = delete;
+	CompileTimeAssembler(CompileTimeAssembler&&) = delete;
+	CompileTimeAssembler& operator=(const CompileTimeAssembler&) = delete;
+	CompileTimeAssembler& operator=(CompileTimeAssembler&&) = delete;
+	~CompileTimeAssembler() = delete;
+};
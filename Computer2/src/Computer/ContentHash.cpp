@@ -0,0 +1,61 @@
+#include "ContentHash.h"
+#include <bit>
+#include <cstring>
+
+static constexpr uint64_t Prime1 = 0x9E3779B185EBCA87ull;
+static constexpr uint64_t Prime2 = 0xC2B2AE3D27D4EB4Full;
+
+static uint64_t Load64(const char* bytes) noexcept
+{
+	uint64_t value = 0;
+	std::memcpy(&value, bytes, sizeof(value));
+
+	// Words are read as little endian on every platform, so that hashes match across them.
+	if constexpr (std::endian::native == std::endian::big)
+	{
+		uint64_t swapped = 0;
+		for (size_t i = 0; i < 8; i++)
+			swapped |= ((value >> (i * 8)) & 0xFF) << ((7 - i) * 8);
+		value = swapped;
+	}
+	return value;
+}
+
+static uint64_t Round(uint64_t hash, uint64_t word) noexcept
+{
+	return std::rotl(hash + word * Prime2, 31) * Prime1;
+}
+
+uint64_t ContentHash::Hash(std::string_view data, uint64_t seed) noexcept
+{
+	const char* bytes = data.data();
+	size_t size = data.size();
+
+	// Four independent lanes, so that the multiplies of consecutive words overlap.
+	uint64_t lanes[4] = { seed + Prime1 + Prime2, seed + Prime2, seed, seed - Prime1 };
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32)
+		for (size_t lane = 0; lane < 4; lane++)
+			lanes[lane] = Round(lanes[lane], Load64(bytes + i + lane * 8));
+
+	uint64_t hash = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18);
+	hash += size;
+	for (; i + 8 <= size; i += 8)
+		hash = Round(hash, Load64(bytes + i));
+
+	// The last few bytes are zero-padded to a whole word.
+	if (i < size)
+	{
+		char tail[8]{};
+		std::memcpy(tail, bytes + i, size - i);
+		hash = Round(hash, Load64(tail));
+	}
+
+	// Mix every bit into every other bit.
+	hash ^= hash >> 33;
+	hash *= Prime2;
+	hash ^= hash >> 29;
+	hash *= Prime1;
+	hash ^= hash >> 32;
+	return hash;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// A fast 64-bit hash of file contents and other large byte strings.
+// Unlike std::hash, its values are the same on every platform and in every process, so they can be stored on disk.
+// NOTE: not cryptographic; it only needs to tell apart files that were edited, not files crafted to collide.
+class ContentHash
+{
+public:
+	static uint64_t Hash(std::string_view data, uint64_t seed = 0) noexcept;
+private:
+	ContentHash() = delete;
+	ContentHash(const ContentHash&) = delete;
+	ContentHash(ContentHash&&) = delete;
+	ContentHash& operator=(const ContentHash&) = delete;
+	ContentHash& operator=(ContentHash&&) = delete;
+	~ContentHash() = delete;
+};
@@ -0,0 +1,216 @@
+#include "Disassembler.h"
+#include "InstructionSet.h"
+#include "Keywords.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+// The text of an instruction around its immediate, e.g. "sto [" and "], b". Both are copied whole, and the
+// output is only advanced by their sizes, so that copying them never branches on their length.
+struct InstructionText
+{
+	std::array<char, 16> prefix{};
+	uint8_t prefixSize = 0;
+	std::array<char, 4> suffix{};
+	uint8_t suffixSize = 0;
+};
+
+static consteval std::array<InstructionText, InstructionSet::InstructionCount> BuildInstructionTexts()
+{
+	std::array<InstructionText, InstructionSet::InstructionCount> texts{};
+	for (size_t i = 0; i < InstructionSet::InstructionCount; i++)
+	{
+		const InstructionInfo& instruction = InstructionTable.GetInstructions()[i];
+		InstructionText& text = texts[i];
+		bool isAfterImmediate = false;
+		auto append = [&](std::string_view string)
+		{
+			for (char c : string)
+			{
+				if (isAfterImmediate)
+					text.suffix[text.suffixSize++] = c;
+				else
+					text.prefix[text.prefixSize++] = c;
+			}
+		};
+
+		append(MnemonicTable.GetName(instruction.mnemonic));
+		for (size_t j = 0; j < instruction.operandCount; j++)
+		{
+			const OperandInfo& operand = instruction.operands[j];
+			append(j == 0 ? " " : ", ");
+			if (operand.isAddress)
+				append("[");
+
+			switch (operand.kind)
+			{
+				case OperandKind::R8:
+				case OperandKind::R16:
+					append(RegisterTable.GetName(operand.reg));
+					break;
+				case OperandKind::I8:
+				case OperandKind::I16:
+					isAfterImmediate = true;
+					break;
+				case OperandKind::Cond:
+					append(ConditionTable.GetName(operand.condition));
+					break;
+				default:
+					break;
+			}
+
+			if (operand.isAddress)
+				append("]");
+		}
+	}
+	return texts;
+}
+
+static constexpr std::array<InstructionText, InstructionSet::InstructionCount> InstructionTexts = BuildInstructionTexts();
+
+static constexpr std::array<std::array<char, 2>, 256> HexBytes = []()
+{
+	constexpr char Digits[] = "0123456789abcdef";
+	std::array<std::array<char, 2>, 256> hexBytes{};
+	for (size_t i = 0; i < hexBytes.size(); i++)
+		hexBytes[i] = { Digits[i >> 4], Digits[i & 0xF] };
+	return hexBytes;
+}();
+
+// The address and bytes columns, e.g. "8000  0f 00 17     ". The longest instructions take 4 bytes.
+static constexpr size_t ColumnsSize = 19;
+// The longest instruction, e.g. "call nz, 0x1234", and the columns and line ending around it.
+static constexpr size_t MaxLineSize = ColumnsSize + 15 + 1;
+// How far past the end of the text a whole InstructionText may be copied.
+static constexpr size_t Slack = sizeof(InstructionText::prefix);
+
+static char* WriteHexByte(char* out, uint8_t value) noexcept
+{
+	std::memcpy(out, HexBytes[value].data(), 2);
+	return out + 2;
+}
+
+static char* WriteColumns(char* out, uint32_t address, std::span<const uint8_t> bytes) noexcept
+{
+	WriteHexByte(out, static_cast<uint8_t>(address >> 8));
+	WriteHexByte(out + 2, static_cast<uint8_t>(address));
+	std::memset(out + 4, ' ', ColumnsSize - 4);
+	for (size_t i = 0; i < bytes.size(); i++)
+		WriteHexByte(out + 6 + i * 3, bytes[i]);
+	return out + ColumnsSize;
+}
+
+// Returns the first symbol at address, or nullptr if there isn't one.
+static const AssemblerSymbol* FindSymbol(std::span<const AssemblerSymbol> symbols, uint16_t address) noexcept
+{
+	auto symbol = std::ranges::lower_bound(symbols, address, {}, &AssemblerSymbol::address);
+	return symbol != symbols.end() && symbol->address == address ? &*symbol : nullptr;
+}
+
+// Writes instruction without its columns or line ending. Immediates that are the address of a symbol are written as its name.
+static char* WriteInstruction(char* out, const InstructionInfo& instruction, std::span<const uint8_t> bytes, std::span<const AssemblerSymbol> symbols) noexcept
+{
+	const InstructionText& text = InstructionTexts[&instruction - InstructionTable.GetInstructions().data()];
+	std::memcpy(out, text.prefix.data(), text.prefix.size());
+	out += text.prefixSize;
+
+	if (instruction.immediateSize != 0)
+	{
+		// Immediates are little endian.
+		uint16_t immediate = bytes[instruction.opcodeSize];
+		if (instruction.immediateSize == 2)
+			immediate |= static_cast<uint16_t>(bytes[instruction.opcodeSize + 1] << 8);
+
+		const AssemblerSymbol* symbol = instruction.immediateSize == 2 ? FindSymbol(symbols, immediate) : nullptr;
+		if (symbol != nullptr)
+		{
+			std::memcpy(out, symbol->name.data(), symbol->name.size());
+			out += symbol->name.size();
+		}
+		else
+		{
+			*out++ = '0';
+			*out++ = 'x';
+			if (instruction.immediateSize == 2)
+				out = WriteHexByte(out, static_cast<uint8_t>(immediate >> 8));
+			out = WriteHexByte(out, static_cast<uint8_t>(immediate));
+		}
+	}
+
+	std::memcpy(out, text.suffix.data(), text.suffix.size());
+	return out + text.suffixSize;
+}
+
+size_t Disassembler::GetMaxTextSize(size_t size, std::span<const AssemblerSymbol> symbols) noexcept
+{
+	// A line for every byte, a line for every label, and a label for every 16-bit operand, each of which
+	// takes at least 3 bytes.
+	size_t maxTextSize = size * MaxLineSize + Slack;
+	size_t maxNameSize = 0;
+	for (const AssemblerSymbol& symbol : symbols)
+	{
+		maxTextSize += symbol.name.size() + 2;
+		maxNameSize = std::max(maxNameSize, symbol.name.size());
+	}
+	return maxTextSize + (size / 3 + 1) * maxNameSize;
+}
+
+size_t Disassembler::Disassemble(std::span<const uint8_t> memory, uint16_t origin, std::span<const AssemblerSymbol> symbols, std::span<char> text) noexcept
+{
+	memory = memory.first(std::min(memory.size(), AssemblerImage::Size - origin));
+
+	// Labels are written as the address reaches them, so only the next one is tracked.
+	char* out = text.data();
+	auto nextSymbol = std::ranges::lower_bound(symbols, origin, {}, &AssemblerSymbol::address);
+	for (size_t offset = 0; offset < memory.size();)
+	{
+		uint32_t address = origin + static_cast<uint32_t>(offset);
+		for (; nextSymbol != symbols.end() && nextSymbol->address <= address; nextSymbol++)
+		{
+			std::memcpy(out, nextSymbol->name.data(), nextSymbol->name.size());
+			out += nextSymbol->name.size();
+			*out++ = ':';
+			*out++ = '\n';
+		}
+
+		// Instructions may not span a label.
+		uint32_t nextSymbolAddress = nextSymbol != symbols.end() ? nextSymbol->address : static_cast<uint32_t>(AssemblerImage::Size);
+		std::span<const uint8_t> bytes = memory.subspan(offset, std::min<size_t>(memory.size() - offset, nextSymbolAddress - address));
+		const InstructionInfo* instruction = InstructionTable.Decode(bytes);
+		if (instruction != nullptr && instruction->length <= bytes.size())
+		{
+			out = WriteColumns(out, address, bytes.first(instruction->length));
+			out = WriteInstruction(out, *instruction, bytes, symbols);
+			offset += instruction->length;
+		}
+		else
+		{
+			out = WriteColumns(out, address, bytes.first(1));
+			std::memcpy(out, ".byte 0x", 8);
+			out = WriteHexByte(out + 8, bytes[0]);
+			offset++;
+		}
+		*out++ = '\n';
+	}
+	return static_cast<size_t>(out - text.data());
+}
+
+void Disassembler::DisassembleBatch(std::span<DisassemblerJob> jobs, ThreadPool& threadPool)
+{
+	for (DisassemblerJob& job : jobs)
+		threadPool.Submit([&job]() { job.textSize = Disassemble(job.memory, job.origin, job.symbols, job.text); });
+	threadPool.Wait();
+}
+
+size_t Disassembler::Disassemble(std::span<const uint8_t> bytes, std::string& text)
+{
+	const InstructionInfo* instruction = InstructionTable.Decode(bytes);
+	if (instruction == nullptr || bytes.size() < instruction->length)
+		return 0;
+
+	char line[MaxLineSize + Slack];
+	size_t lineSize = static_cast<size_t>(WriteInstruction(line, *instruction, bytes, {}) - line);
+	text.append(line, lineSize);
+	return instruction->length;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Assembler.h"
+#include <cstdint>
+#include <span>
+#include <string>
+
+// Memory to disassemble, and where to write its text, see Disassembler::DisassembleBatch().
+struct DisassemblerJob
+{
+	std::span<const uint8_t> memory;
+	// The address of memory's first byte.
+	uint16_t origin = 0;
+	// Sorted by address, like AssemblerOutput::symbols.
+	std::span<const AssemblerSymbol> symbols;
+	// Must hold at least Disassembler::GetMaxTextSize(memory.size(), symbols) chars.
+	std::span<char> text;
+	// How many chars of text were written.
+	size_t textSize = 0;
+};
+
+// Turns machine code back into assembly, by decoding it with the same InstructionTable that the assembler encodes
+// with. Immediates are written in hexadecimal, e.g. "jmp nz, 0x8000", so that the text assembles back to the same bytes.
+//
+// Memory is disassembled into one line per instruction, after a line for every label at its address:
+//   Main:
+//   8000  0f 00 17     ldi b, 0x17
+//   8003  2b 00 80     jmp nz, Main
+// Addresses that a label is at replace the immediates of 16-bit operands. Bytes that aren't an instruction, or
+// whose instruction would span the address of a label, are written as .byte.
+//
+// Text is written to a buffer that the caller allocated up front, from a table of each instruction's text that
+// is generated at compile time, so nothing is allocated per instruction.
+class Disassembler
+{
+public:
+	// The most chars that disassembling size bytes with symbols can write.
+	static size_t GetMaxTextSize(size_t size, std::span<const AssemblerSymbol> symbols) noexcept;
+
+	// Disassembles memory, whose first byte is at address origin, into text, and returns how many chars it wrote.
+	// symbols must be sorted by address, and text must hold at least GetMaxTextSize() chars.
+	// Bytes past the end of the address space are ignored.
+	static size_t Disassemble(std::span<const uint8_t> memory, uint16_t origin, std::span<const AssemblerSymbol> symbols, std::span<char> text) noexcept;
+	// Disassembles every job, concurrently on threadPool.
+	// NOTE: waits for every task on threadPool, not only the ones this submits.
+	static void DisassembleBatch(std::span<DisassemblerJob> jobs, ThreadPool& threadPool);
+
+	// Appends the instruction that bytes start with to text, without its address and bytes, and returns its length.
+	// Returns 0, and appends nothing, if bytes don't start with a whole instruction.
+	static size_t Disassemble(std::span<const uint8_t> bytes, std::string& text);
+private:
+	Disassembler() = delete;
+	Disassembler(const Disassembler&) = delete;
+	Disassembler(Disassembler&&) = delete;
+	Disassembler& operator=(const Disassembler&) = delete;
+	Disassembler& operator=(Disassembler&&) = delete;
+	~Disassembler() = delete;
+};
@@ -0,0 +1,407 @@
+#include "Expression.h"
+#include "CharacterClass.h"
+#include "NumericLiteral.h"
+#include <array>
+
+static constexpr size_t MaxStackDepth = 64;
+
+static void Write32(std::pmr::vector<uint8_t>& bytecode, uint32_t value)
+{
+	bytecode.insert(bytecode.end(), {
+		static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8),
+		static_cast<uint8_t>(value >> 16), static_cast<uint8_t>(value >> 24) });
+}
+
+static uint32_t Read32(const uint8_t* bytes) noexcept
+{
+	return uint32_t(bytes[0]) | (uint32_t(bytes[1]) << 8) | (uint32_t(bytes[2]) << 16) | (uint32_t(bytes[3]) << 24);
+}
+
+// A top-down operator precedence (Pratt) parser.
+// Bytecode is emitted as soon as each operand is parsed. When every operand of an operator turns out to
+// be constant, their bytecode is truncated away again and replaced by a single PushConstant.
+// Operands that may be left out at run time aren't folded if that fails, so that only Evaluate() reports
+// the error, and only if the operand is actually used.
+class Expression::Parser
+{
+public:
+	Parser(std::string_view text, SymbolResolver& resolver, std::pmr::vector<uint8_t>& bytecode) noexcept
+		: text(text), resolver(resolver), bytecode(bytecode) {}
+
+	CompileResult Parse()
+	{
+		size_t start = bytecode.size();
+		Operand result;
+		AssemblerReturnCode returnCode = ParseExpression(Precedence::None, result);
+		if (returnCode == AssemblerReturnCode_Success && (SkipBlanks(), position != text.size()))
+			returnCode = AssemblerReturnCode_InvalidExpression;
+
+		if (returnCode != AssemblerReturnCode_Success || result.isConstant)
+			bytecode.resize(start);
+		return { returnCode, result.isConstant, result.value };
+	}
+private:
+	struct Operand
+	{
+		bool isConstant = false;
+		int32_t value = 0;
+		// Where this operand's bytecode starts.
+		size_t start = 0;
+	};
+private:
+	AssemblerReturnCode ParseExpression(Precedence minPrecedence, Operand& lhs)
+	{
+		if (AssemblerReturnCode returnCode = ParseUnary(lhs); returnCode != AssemblerReturnCode_Success)
+			return returnCode;
+
+		while (true)
+		{
+			SkipBlanks();
+			BinaryOperator op = PeekBinaryOperator(text.substr(position));
+			if (op.precedence == Precedence::None || op.precedence <= minPrecedence)
+				return AssemblerReturnCode_Success;
+			position += op.length;
+
+			if (op.opcode == Opcode::Select)
+			{
+				// The conditional operator is right associative, so its last operand may be another one.
+				Operand whenTrue, whenFalse;
+				if (AssemblerReturnCode returnCode = ParseOperand(Precedence::None, whenTrue, !lhs.isConstant || lhs.value == 0); returnCode != AssemblerReturnCode_Success)
+					return returnCode;
+				SkipBlanks();
+				if (position == text.size() || text[position] != ':')
+					return AssemblerReturnCode_InvalidExpression;
+				position++;
+				if (AssemblerReturnCode returnCode = ParseOperand(Precedence::None, whenFalse, !lhs.isConstant || lhs.value != 0); returnCode != AssemblerReturnCode_Success)
+					return returnCode;
+
+				FoldSelect(lhs, whenTrue, whenFalse);
+				continue;
+			}
+
+			// Logical operators only use rhs if lhs doesn't already decide the result.
+			bool mayBeLeftOut = (op.opcode == Opcode::LogicalAnd || op.opcode == Opcode::LogicalOr) &&
+				(!lhs.isConstant || (lhs.value != 0) == (op.opcode == Opcode::LogicalOr));
+			Operand rhs;
+			if (AssemblerReturnCode returnCode = ParseOperand(op.precedence, rhs, mayBeLeftOut); returnCode != AssemblerReturnCode_Success)
+				return returnCode;
+			if (AssemblerReturnCode returnCode = FoldBinary(op.opcode, lhs, rhs); returnCode != AssemblerReturnCode_Success)
+				return returnCode;
+		}
+	}
+
+	AssemblerReturnCode ParseOperand(Precedence minPrecedence, Operand& operand, bool mayBeLeftOut)
+	{
+		leftOutDepth += mayBeLeftOut;
+		AssemblerReturnCode returnCode = ParseExpression(minPrecedence, operand);
+		leftOutDepth -= mayBeLeftOut;
+		return returnCode;
+	}
+
+	AssemblerReturnCode ParseUnary(Operand& operand)
+	{
+		if (++depth > MaxNestingDepth)
+			return AssemblerReturnCode_InvalidExpression;
+		AssemblerReturnCode returnCode = ParsePrimary(operand);
+		depth--;
+		return returnCode;
+	}
+
+	AssemblerReturnCode ParsePrimary(Operand& operand)
+	{
+		SkipBlanks();
+		if (position == text.size())
+			return AssemblerReturnCode_InvalidExpression;
+
+		operand.start = bytecode.size();
+		char c = text[position];
+		switch (c)
+		{
+			case '(':
+			{
+				position++;
+				if (AssemblerReturnCode returnCode = ParseExpression(Precedence::None, operand); returnCode != AssemblerReturnCode_Success)
+					return returnCode;
+				SkipBlanks();
+				if (position == text.size() || text[position] != ')')
+					return AssemblerReturnCode_InvalidExpression;
+				position++;
+				return AssemblerReturnCode_Success;
+			}
+			case '+':
+			case '-':
+			case '~':
+			case '!':
+			{
+				position++;
+				if (AssemblerReturnCode returnCode = ParseUnary(operand); returnCode != AssemblerReturnCode_Success)
+					return returnCode;
+				if (c == '+')
+					return AssemblerReturnCode_Success;
+				return FoldUnary(c == '-' ? Opcode::Negate : c == '~' ? Opcode::Complement : Opcode::LogicalNot, operand);
+			}
+			case '\'':
+				return ParseCharacter(operand);
+		}
+
+		// Prefixed literals are only recognized where an operand is expected, so '%' is still modulo elsewhere.
+		if (IsDecimalDigit(c) || c == '$' || c == '%')
+		{
+			size_t end = position + 1;
+			while (end < text.size() && IsIdentifierContinue(text[end]))
+				end++;
+
+			uint32_t value = 0;
+			switch (NumericLiteral::Parse(text.substr(position, end - position), value))
+			{
+				case NumericLiteralResult::Success:  break;
+				case NumericLiteralResult::Overflow: return AssemblerReturnCode_OperandOutOfRange;
+				case NumericLiteralResult::Invalid:  return AssemblerReturnCode_InvalidExpression;
+			}
+			position = end;
+			EmitConstant(static_cast<int32_t>(value), operand);
+			return AssemblerReturnCode_Success;
+		}
+
+		if (IsIdentifierStart(c))
+		{
+			size_t end = position + 1;
+			while (end < text.size() && IsIdentifierContinue(text[end]))
+				end++;
+
+			std::string_view name = text.substr(position, end - position);
+			position = end;
+
+			int32_t value = 0;
+			uint32_t symbolIndex = NoSymbol;
+			AssemblerReturnCode returnCode = AssemblerReturnCode_Success;
+			if (resolver.Resolve(name, value, symbolIndex, returnCode))
+				EmitConstant(value, operand);
+			else if (returnCode == AssemblerReturnCode_Success)
+			{
+				bytecode.push_back(static_cast<uint8_t>(Opcode::PushSymbol));
+				Write32(bytecode, symbolIndex);
+				operand.isConstant = false;
+			}
+			return returnCode;
+		}
+
+		return AssemblerReturnCode_InvalidExpression;
+	}
+
+	// 'c', where c is any character other than a quote or a backslash, or one of the escapes strings accept.
+	AssemblerReturnCode ParseCharacter(Operand& operand)
+	{
+		std::string_view rest = text.substr(position);
+		size_t length = rest.size() >= 2 && rest[1] == '\\' ? 4 : 3;
+		if (rest.size() < length || rest[length - 1] != '\'' || rest[1] == '\'')
+			return AssemblerReturnCode_InvalidExpression;
+
+		int16_t c = rest[1];
+		if (length == 4 && (c = GetEscapedCharacter(rest[2])) < 0)
+			return AssemblerReturnCode_InvalidExpression;
+
+		position += length;
+		EmitConstant(static_cast<uint8_t>(c), operand);
+		return AssemblerReturnCode_Success;
+	}
+
+	void EmitConstant(int32_t value, Operand& operand)
+	{
+		bytecode.resize(operand.start);
+		bytecode.push_back(static_cast<uint8_t>(Opcode::PushConstant));
+		Write32(bytecode, static_cast<uint32_t>(value));
+		operand.isConstant = true;
+		operand.value = value;
+	}
+
+	AssemblerReturnCode FoldUnary(Opcode opcode, Operand& operand)
+	{
+		if (!operand.isConstant)
+		{
+			bytecode.push_back(static_cast<uint8_t>(opcode));
+			return AssemblerReturnCode_Success;
+		}
+
+		int32_t result = 0;
+		Apply(opcode, operand.value, 0, result);
+		EmitConstant(result, operand);
+		return AssemblerReturnCode_Success;
+	}
+
+	AssemblerReturnCode FoldBinary(Opcode opcode, Operand& lhs, const Operand& rhs)
+	{
+		// Logical operators short circuit, so "0 && Label" is constant even if Label isn't.
+		if (lhs.isConstant && ((opcode == Opcode::LogicalAnd && lhs.value == 0) || (opcode == Opcode::LogicalOr && lhs.value != 0)))
+		{
+			EmitConstant(opcode == Opcode::LogicalOr, lhs);
+			return AssemblerReturnCode_Success;
+		}
+
+		if (!lhs.isConstant || !rhs.isConstant)
+		{
+			bytecode.push_back(static_cast<uint8_t>(opcode));
+			lhs.isConstant = false;
+			return AssemblerReturnCode_Success;
+		}
+
+		int32_t result = 0;
+		if (AssemblerReturnCode returnCode = Apply(opcode, lhs.value, rhs.value, result); returnCode != AssemblerReturnCode_Success)
+		{
+			if (leftOutDepth == 0)
+				return returnCode;
+			bytecode.push_back(static_cast<uint8_t>(opcode));
+			lhs.isConstant = false;
+			return AssemblerReturnCode_Success;
+		}
+		EmitConstant(result, lhs);
+		return AssemblerReturnCode_Success;
+	}
+
+	void FoldSelect(Operand& condition, const Operand& whenTrue, const Operand& whenFalse)
+	{
+		if (!condition.isConstant)
+		{
+			bytecode.push_back(static_cast<uint8_t>(Opcode::Select));
+			return;
+		}
+
+		// Keep only the chosen operand's bytecode, moved to where the condition's was.
+		const Operand& chosen = condition.value != 0 ? whenTrue : whenFalse;
+		if (chosen.isConstant)
+		{
+			EmitConstant(chosen.value, condition);
+			return;
+		}
+
+		size_t chosenEnd = condition.value != 0 ? whenFalse.start : bytecode.size();
+		bytecode.erase(bytecode.begin() + chosenEnd, bytecode.end());
+		bytecode.erase(bytecode.begin() + condition.start, bytecode.begin() + chosen.start);
+		condition.isConstant = false;
+	}
+
+	void SkipBlanks() noexcept
+	{
+		while (position < text.size() && IsBlank(text[position]))
+			position++;
+	}
+private:
+	std::string_view text;
+	size_t position = 0;
+	uint32_t depth = 0;
+	// How many of the operands being parsed may be left out at run time.
+	uint32_t leftOutDepth = 0;
+	SymbolResolver& resolver;
+	std::pmr::vector<uint8_t>& bytecode;
+};
+
+Expression::CompileResult Expression::Compile(std::string_view text, SymbolResolver& resolver, std::pmr::vector<uint8_t>& bytecode)
+{
+	return Parser(text, resolver, bytecode).Parse();
+}
+
+Expression::EvaluateResult Expression::Evaluate(std::span<const uint8_t> bytecode, SymbolResolver& resolver)
+{
+	// An operand that fails keeps its error on the stack instead of returning it right away,
+	// since a short circuit or a conditional operator may still leave it out.
+	std::array<EvaluateResult, MaxStackDepth> stack;
+	size_t stackSize = 0;
+
+	for (size_t i = 0; i < bytecode.size();)
+	{
+		Opcode opcode = static_cast<Opcode>(bytecode[i++]);
+		switch (opcode)
+		{
+			case Opcode::PushConstant:
+			case Opcode::PushSymbol:
+			{
+				if (stackSize == stack.size())
+					return { AssemblerReturnCode_InvalidExpression };
+
+				uint32_t operand = Read32(&bytecode[i]);
+				i += 4;
+				EvaluateResult& result = stack[stackSize++];
+				result = {};
+				if (opcode == Opcode::PushConstant)
+					result.value = static_cast<int32_t>(operand);
+				else
+					result.returnCode = resolver.Evaluate(operand, result.value, result.blockingSymbolIndex);
+				break;
+			}
+			case Opcode::Negate:
+			case Opcode::Complement:
+			case Opcode::LogicalNot:
+			{
+				EvaluateResult& top = stack[stackSize - 1];
+				if (top.returnCode == AssemblerReturnCode_Success)
+					Apply(opcode, top.value, 0, top.value);
+				break;
+			}
+			case Opcode::Select:
+			{
+				stackSize -= 2;
+				EvaluateResult& condition = stack[stackSize - 1];
+				if (condition.returnCode == AssemblerReturnCode_Success)
+					condition = condition.value != 0 ? stack[stackSize] : stack[stackSize + 1];
+				break;
+			}
+			default:
+			{
+				stackSize--;
+				EvaluateResult& lhs = stack[stackSize - 1];
+				const EvaluateResult& rhs = stack[stackSize];
+				if (lhs.returnCode != AssemblerReturnCode_Success)
+					break;
+				if ((opcode == Opcode::LogicalAnd && lhs.value == 0) || (opcode == Opcode::LogicalOr && lhs.value != 0))
+					lhs.value = opcode == Opcode::LogicalOr;
+				else if (rhs.returnCode != AssemblerReturnCode_Success)
+					lhs = rhs;
+				else
+					lhs.returnCode = Apply(opcode, lhs.value, rhs.value, lhs.value);
+				break;
+			}
+		}
+	}
+
+	return stack[0];
+}
+
+bool Expression::IsValid(std::span<const uint8_t> bytecode, uint32_t symbolCount) noexcept
+{
+	// Track the stack depth the same way Evaluate() changes it.
+	size_t stackSize = 0;
+	for (size_t i = 0; i < bytecode.size();)
+	{
+		Opcode opcode = static_cast<Opcode>(bytecode[i++]);
+		switch (opcode)
+		{
+			case Opcode::PushConstant:
+			case Opcode::PushSymbol:
+				if (bytecode.size() - i < 4 || stackSize == MaxStackDepth)
+					return false;
+				if (opcode == Opcode::PushSymbol && Read32(&bytecode[i]) >= symbolCount)
+					return false;
+				i += 4;
+				stackSize++;
+				break;
+			case Opcode::Negate:
+			case Opcode::Complement:
+			case Opcode::LogicalNot:
+				if (stackSize < 1)
+					return false;
+				break;
+			case Opcode::Select:
+				if (stackSize < 3)
+					return false;
+				stackSize -= 2;
+				break;
+			default:
+				if (opcode > Opcode::Select || stackSize < 2)
+					return false;
+				stackSize--;
+				break;
+		}
+	}
+
+	return stackSize == 1;
+}
@@ -0,0 +1,442 @@
+#pragma once
+
+#include "Assembler.h"
+#include "CharacterClass.h"
+#include "NumericLiteral.h"
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Compiles constant expressions, like "15 + 49 - 7 * 4" or "(Table + 2) >> 8", into compact postfix bytecode.
+//
+// Every C operator is supported: unary + - ~ !, binary * / % + - << >> < <= > >= == != & ^ | && ||,
+// the conditional operator ?:, and parentheses. Operands are numeric literals, character literals like 'a',
+// and symbols. Values are 32-bit signed integers while being evaluated, and callers check that results fit
+// in the 8- or 16-bit operands they are used in.
+//
+// Subexpressions whose operands are all known while compiling are folded into a single constant, so an
+// expression only keeps bytecode for what depends on symbols that weren't resolvable yet.
+class Expression
+{
+public:
+	enum class Opcode : uint8_t
+	{
+		PushConstant, // followed by a 32-bit value
+		PushSymbol, // followed by a 32-bit symbol index
+
+		// Unary
+		Negate,
+		Complement,
+		LogicalNot,
+
+		// Binary
+		Multiply,
+		Divide,
+		Modulo,
+		Add,
+		Subtract,
+		ShiftLeft,
+		ShiftRight,
+		Less,
+		LessEqual,
+		Greater,
+		GreaterEqual,
+		Equal,
+		NotEqual,
+		BitwiseAnd,
+		BitwiseXor,
+		BitwiseOr,
+		LogicalAnd,
+		LogicalOr,
+
+		// Ternary
+		Select,
+	};
+
+	static constexpr uint32_t NoSymbol = ~uint32_t(0);
+
+	// Gives meaning to the names in an expression.
+	class SymbolResolver
+	{
+	public:
+		// Called while compiling. Either sets value and returns true if name's value is already known,
+		// or sets symbolIndex to something Evaluate() can later ask about and returns false.
+		// Returns an error by setting returnCode.
+		virtual bool Resolve(std::string_view name, int32_t& value, uint32_t& symbolIndex, AssemblerReturnCode& returnCode) = 0;
+
+		// Called while evaluating. Returns Success and sets value if symbolIndex's value is known,
+		// AssemblerReturnCode_UndefinedSymbol if it isn't known yet, or any other error.
+		virtual AssemblerReturnCode Evaluate(uint32_t symbolIndex, int32_t& value, uint32_t& blockingSymbolIndex) = 0;
+	protected:
+		~SymbolResolver() = default;
+	};
+
+	struct CompileResult
+	{
+		AssemblerReturnCode returnCode = AssemblerReturnCode_Success;
+		// If true, value is the result, and nothing was added to the bytecode.
+		bool isConstant = false;
+		int32_t value = 0;
+	};
+
+	struct EvaluateResult
+	{
+		AssemblerReturnCode returnCode = AssemblerReturnCode_Success;
+		int32_t value = 0;
+		// If returnCode is AssemblerReturnCode_UndefinedSymbol, the first symbol that isn't known yet.
+		uint32_t blockingSymbolIndex = NoSymbol;
+	};
+public:
+	// Compiles text, appending its bytecode to bytecode unless it folds into a constant.
+	static CompileResult Compile(std::string_view text, SymbolResolver& resolver, std::pmr::vector<uint8_t>& bytecode);
+
+	static EvaluateResult Evaluate(std::span<const uint8_t> bytecode, SymbolResolver& resolver);
+
+	// Evaluates text right away instead of compiling it, so that it can be used in constant expressions.
+	// resolve(name, value) either sets value and returns AssemblerReturnCode_Success, or returns an error.
+	// Like with Compile(), operands that a constant condition or a short circuit leaves out may use undefined
+	// symbols, and aren't checked for errors other than syntax errors.
+	template<typename Resolve>
+	static constexpr EvaluateResult EvaluateText(std::string_view text, Resolve&& resolve);
+
+	// Applies a unary or binary operator. rhs is ignored for unary operators.
+	static constexpr AssemblerReturnCode Apply(Opcode opcode, int32_t lhs, int32_t rhs, int32_t& result) noexcept
+	{
+		// Arithmetic wraps around instead of overflowing.
+		uint32_t a = static_cast<uint32_t>(lhs);
+		uint32_t b = static_cast<uint32_t>(rhs);
+		switch (opcode)
+		{
+			case Opcode::Negate:       result = static_cast<int32_t>(0u - a); break;
+			case Opcode::Complement:   result = ~lhs; break;
+			case Opcode::LogicalNot:   result = lhs == 0; break;
+			case Opcode::Multiply:     result = static_cast<int32_t>(a * b); break;
+			case Opcode::Divide:
+			case Opcode::Modulo:
+			{
+				if (rhs == 0)
+					return AssemblerReturnCode_DivisionByZero;
+				bool overflows = lhs == std::numeric_limits<int32_t>::min() && rhs == -1;
+				if (opcode == Opcode::Divide)
+					result = overflows ? lhs : lhs / rhs;
+				else
+					result = overflows ? 0 : lhs % rhs;
+				break;
+			}
+			case Opcode::Add:          result = static_cast<int32_t>(a + b); break;
+			case Opcode::Subtract:     result = static_cast<int32_t>(a - b); break;
+			// Shifting by a negative amount or by the width or more shifts every bit out.
+			case Opcode::ShiftLeft:    result = b < 32 ? static_cast<int32_t>(a << b) : 0; break;
+			case Opcode::ShiftRight:   result = lhs >> (b < 32 ? b : 31); break;
+			case Opcode::Less:         result = lhs < rhs; break;
+			case Opcode::LessEqual:    result = lhs <= rhs; break;
+			case Opcode::Greater:      result = lhs > rhs; break;
+			case Opcode::GreaterEqual: result = lhs >= rhs; break;
+			case Opcode::Equal:        result = lhs == rhs; break;
+			case Opcode::NotEqual:     result = lhs != rhs; break;
+			case Opcode::BitwiseAnd:   result = lhs & rhs; break;
+			case Opcode::BitwiseXor:   result = lhs ^ rhs; break;
+			case Opcode::BitwiseOr:    result = lhs | rhs; break;
+			case Opcode::LogicalAnd:   result = lhs != 0 && rhs != 0; break;
+			case Opcode::LogicalOr:    result = lhs != 0 || rhs != 0; break;
+			default: return AssemblerReturnCode_InvalidExpression;
+		}
+		return AssemblerReturnCode_Success;
+	}
+
+	// Whether bytecode is safe to evaluate, and only refers to symbols below symbolCount.
+	// Bytecode from Compile() always is; this is for bytecode that was read from a file.
+	static bool IsValid(std::span<const uint8_t> bytecode, uint32_t symbolCount) noexcept;
+
+	// Replaces the index of every symbol in bytecode with remap(index), e.g. to move bytecode to another symbol table.
+	template<typename Remap>
+	static void RemapSymbols(std::span<uint8_t> bytecode, Remap&& remap)
+	{
+		for (size_t i = 0; i < bytecode.size();)
+		{
+			Opcode opcode = static_cast<Opcode>(bytecode[i++]);
+			if (opcode != Opcode::PushConstant && opcode != Opcode::PushSymbol)
+				continue;
+
+			if (opcode == Opcode::PushSymbol)
+			{
+				uint32_t symbolIndex = bytecode[i] | bytecode[i + 1] << 8 | bytecode[i + 2] << 16 | static_cast<uint32_t>(bytecode[i + 3]) << 24;
+				symbolIndex = remap(symbolIndex);
+				for (size_t j = 0; j < 4; j++)
+					bytecode[i + j] = static_cast<uint8_t>(symbolIndex >> (j * 8));
+			}
+			i += 4;
+		}
+	}
+private:
+	// Deeper nesting than this is almost certainly a mistake, and would otherwise risk overflowing the stack.
+	static constexpr uint32_t MaxNestingDepth = 64;
+
+	// Binding power of each kind of operator, from loosest to tightest. Matches C.
+	enum class Precedence : uint8_t
+	{
+		None,
+		Conditional,
+		LogicalOr,
+		LogicalAnd,
+		BitwiseOr,
+		BitwiseXor,
+		BitwiseAnd,
+		Equality,
+		Relational,
+		Shift,
+		Additive,
+		Multiplicative,
+	};
+
+	struct BinaryOperator
+	{
+		Opcode opcode = Opcode::PushConstant;
+		Precedence precedence = Precedence::None;
+		uint8_t length = 0;
+	};
+
+	// Returns an operator with Precedence::None if text doesn't start with a binary operator.
+	// The conditional operator is returned as Opcode::Select.
+	static constexpr BinaryOperator PeekBinaryOperator(std::string_view text) noexcept
+	{
+		using enum Opcode;
+
+		char c0 = text.empty() ? '\0' : text[0];
+		char c1 = text.size() < 2 ? '\0' : text[1];
+		switch (c0)
+		{
+			case '*': return { Multiply, Precedence::Multiplicative, 1 };
+			case '/': return { Divide, Precedence::Multiplicative, 1 };
+			case '%': return { Modulo, Precedence::Multiplicative, 1 };
+			case '+': return { Add, Precedence::Additive, 1 };
+			case '-': return { Subtract, Precedence::Additive, 1 };
+			case '<':
+				if (c1 == '<') return { ShiftLeft, Precedence::Shift, 2 };
+				if (c1 == '=') return { LessEqual, Precedence::Relational, 2 };
+				return { Less, Precedence::Relational, 1 };
+			case '>':
+				if (c1 == '>') return { ShiftRight, Precedence::Shift, 2 };
+				if (c1 == '=') return { GreaterEqual, Precedence::Relational, 2 };
+				return { Greater, Precedence::Relational, 1 };
+			case '=':
+				if (c1 == '=') return { Equal, Precedence::Equality, 2 };
+				break;
+			case '!':
+				if (c1 == '=') return { NotEqual, Precedence::Equality, 2 };
+				break;
+			case '&':
+				if (c1 == '&') return { LogicalAnd, Precedence::LogicalAnd, 2 };
+				return { BitwiseAnd, Precedence::BitwiseAnd, 1 };
+			case '^': return { BitwiseXor, Precedence::BitwiseXor, 1 };
+			case '|':
+				if (c1 == '|') return { LogicalOr, Precedence::LogicalOr, 2 };
+				return { BitwiseOr, Precedence::BitwiseOr, 1 };
+			case '?': return { Select, Precedence::Conditional, 1 };
+		}
+		return {};
+	}
+private:
+	class Parser;
+	template<typename Resolve>
+	class TextEvaluator;
+private:
+	Expression() = delete;
+	Expression(const Expression&) = delete;
+	Expression(Expression&&) = delete;
+	Expression& operator=(const Expression&) = delete;
+	Expression& operator=(Expression&&) = delete;
+	~Expression() = delete;
+};
+
+// Evaluates as it parses, with the same grammar as Expression::Parser.
+template<typename Resolve>
+class Expression::TextEvaluator
+{
+public:
+	constexpr TextEvaluator(std::string_view text, Resolve& resolve) noexcept
+		: text(text), resolve(resolve) {}
+
+	constexpr EvaluateResult Evaluate()
+	{
+		EvaluateResult result;
+		result.returnCode = ParseExpression(Precedence::None, result.value);
+		if (result.returnCode == AssemblerReturnCode_Success && (SkipBlanks(), position != text.size()))
+			result.returnCode = AssemblerReturnCode_InvalidExpression;
+		return result;
+	}
+private:
+	constexpr AssemblerReturnCode ParseExpression(Precedence minPrecedence, int32_t& lhs)
+	{
+		if (AssemblerReturnCode returnCode = ParseUnary(lhs); returnCode != AssemblerReturnCode_Success)
+			return returnCode;
+
+		while (true)
+		{
+			SkipBlanks();
+			BinaryOperator op = PeekBinaryOperator(text.substr(position));
+			if (op.precedence == Precedence::None || op.precedence <= minPrecedence)
+				return AssemblerReturnCode_Success;
+			position += op.length;
+
+			if (op.opcode == Opcode::Select)
+			{
+				// The conditional operator is right associative, so its last operand may be another one.
+				bool condition = lhs != 0;
+				int32_t whenTrue = 0;
+				int32_t whenFalse = 0;
+				if (AssemblerReturnCode returnCode = ParseOperand(Precedence::None, whenTrue, !condition); returnCode != AssemblerReturnCode_Success)
+					return returnCode;
+				SkipBlanks();
+				if (position == text.size() || text[position] != ':')
+					return AssemblerReturnCode_InvalidExpression;
+				position++;
+				if (AssemblerReturnCode returnCode = ParseOperand(Precedence::None, whenFalse, condition); returnCode != AssemblerReturnCode_Success)
+					return returnCode;
+
+				lhs = condition ? whenTrue : whenFalse;
+				continue;
+			}
+
+			// Logical operators short circuit, so "0 && Label" is 0 even if Label isn't defined.
+			bool isShortCircuited = (op.opcode == Opcode::LogicalAnd && lhs == 0) || (op.opcode == Opcode::LogicalOr && lhs != 0);
+			int32_t rhs = 0;
+			if (AssemblerReturnCode returnCode = ParseOperand(op.precedence, rhs, isShortCircuited); returnCode != AssemblerReturnCode_Success)
+				return returnCode;
+
+			if (isShortCircuited)
+				lhs = op.opcode == Opcode::LogicalOr;
+			else if (AssemblerReturnCode returnCode = Apply(op.opcode, lhs, rhs, lhs); returnCode != AssemblerReturnCode_Success && leftOutDepth == 0)
+				return returnCode;
+		}
+	}
+
+	// Parses an operand whose value may be left out, in which case only its syntax is checked.
+	constexpr AssemblerReturnCode ParseOperand(Precedence minPrecedence, int32_t& value, bool isLeftOut)
+	{
+		leftOutDepth += isLeftOut;
+		AssemblerReturnCode returnCode = ParseExpression(minPrecedence, value);
+		leftOutDepth -= isLeftOut;
+		return returnCode;
+	}
+
+	constexpr AssemblerReturnCode ParseUnary(int32_t& value)
+	{
+		if (++depth > MaxNestingDepth)
+			return AssemblerReturnCode_InvalidExpression;
+		AssemblerReturnCode returnCode = ParsePrimary(value);
+		depth--;
+		return returnCode;
+	}
+
+	constexpr AssemblerReturnCode ParsePrimary(int32_t& value)
+	{
+		SkipBlanks();
+		if (position == text.size())
+			return AssemblerReturnCode_InvalidExpression;
+
+		char c = text[position];
+		switch (c)
+		{
+			case '(':
+			{
+				position++;
+				if (AssemblerReturnCode returnCode = ParseExpression(Precedence::None, value); returnCode != AssemblerReturnCode_Success)
+					return returnCode;
+				SkipBlanks();
+				if (position == text.size() || text[position] != ')')
+					return AssemblerReturnCode_InvalidExpression;
+				position++;
+				return AssemblerReturnCode_Success;
+			}
+			case '+':
+			case '-':
+			case '~':
+			case '!':
+			{
+				position++;
+				if (AssemblerReturnCode returnCode = ParseUnary(value); returnCode != AssemblerReturnCode_Success)
+					return returnCode;
+				if (c != '+')
+					Apply(c == '-' ? Opcode::Negate : c == '~' ? Opcode::Complement : Opcode::LogicalNot, value, 0, value);
+				return AssemblerReturnCode_Success;
+			}
+			case '\'':
+			{
+				// 'c', where c is any character other than a quote or a backslash, or one of the escapes strings accept.
+				std::string_view rest = text.substr(position);
+				size_t length = rest.size() >= 2 && rest[1] == '\\' ? 4 : 3;
+				if (rest.size() < length || rest[length - 1] != '\'' || rest[1] == '\'')
+					return AssemblerReturnCode_InvalidExpression;
+
+				int16_t character = rest[1];
+				if (length == 4 && (character = GetEscapedCharacter(rest[2])) < 0)
+					return AssemblerReturnCode_InvalidExpression;
+
+				position += length;
+				value = static_cast<uint8_t>(character);
+				return AssemblerReturnCode_Success;
+			}
+		}
+
+		// Prefixed literals are only recognized where an operand is expected, so '%' is still modulo elsewhere.
+		if (IsDecimalDigit(c) || c == '$' || c == '%')
+		{
+			size_t end = position + 1;
+			while (end < text.size() && IsIdentifierContinue(text[end]))
+				end++;
+
+			uint32_t literal = 0;
+			switch (NumericLiteral::Parse(text.substr(position, end - position), literal))
+			{
+				case NumericLiteralResult::Success:  break;
+				case NumericLiteralResult::Overflow: return AssemblerReturnCode_OperandOutOfRange;
+				case NumericLiteralResult::Invalid:  return AssemblerReturnCode_InvalidExpression;
+			}
+			position = end;
+			value = static_cast<int32_t>(literal);
+			return AssemblerReturnCode_Success;
+		}
+
+		if (IsIdentifierStart(c))
+		{
+			size_t end = position + 1;
+			while (end < text.size() && IsIdentifierContinue(text[end]))
+				end++;
+
+			std::string_view name = text.substr(position, end - position);
+			position = end;
+
+			value = 0;
+			AssemblerReturnCode returnCode = resolve(name, value);
+			if (returnCode == AssemblerReturnCode_UndefinedSymbol && leftOutDepth != 0)
+				return AssemblerReturnCode_Success;
+			return returnCode;
+		}
+
+		return AssemblerReturnCode_InvalidExpression;
+	}
+
+	constexpr void SkipBlanks() noexcept
+	{
+		while (position < text.size() && IsBlank(text[position]))
+			position++;
+	}
+private:
+	std::string_view text;
+	size_t position = 0;
+	uint32_t depth = 0;
+	// How many of the operands being parsed are left out, see EvaluateText().
+	uint32_t leftOutDepth = 0;
+	Resolve& resolve;
+};
+
+template<typename Resolve>
+constexpr Expression::EvaluateResult Expression::EvaluateText(std::string_view text, Resolve&& resolve)
+{
+	return TextEvaluator<std::remove_reference_t<Resolve>>(text, resolve).Evaluate();
+}
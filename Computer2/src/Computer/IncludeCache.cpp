@@ -0,0 +1,69 @@
+#include "IncludeCache.h"
+#include "ContentHash.h"
+#include "SourceScanner.h"
+
+std::mutex IncludeCache::mutex;
+std::unordered_map<std::string, std::shared_ptr<const IncludeCache::Entry>> IncludeCache::entries;
+
+std::shared_ptr<const IncludeCache::Entry> IncludeCache::Get(const std::filesystem::path& path)
+{
+	std::error_code error;
+	std::filesystem::path canonicalPath = std::filesystem::canonical(path, error);
+	if (error)
+		return nullptr;
+
+	// Hashing a file is much cheaper than tokenizing it, so the file is always checked for changes.
+	// Entries outlive the call, and tokens view the file's contents, so the file is read rather than mapped,
+	// which would crash the process if the file were truncated while an entry still views it.
+	SourceFile file(canonicalPath, false);
+	if (!file)
+		return nullptr;
+	uint64_t contentHash = ContentHash::Hash(file.GetSource());
+
+	std::string key = canonicalPath.string();
+	{
+		std::scoped_lock lock(mutex);
+		auto it = entries.find(key);
+		if (it != entries.end() && it->second->contentHash == contentHash)
+			return it->second;
+	}
+
+	// Tokenize without holding the lock, so that different files are tokenized concurrently.
+	std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+	entry->path = std::move(canonicalPath);
+	entry->contentHash = contentHash;
+	entry->file = std::move(file);
+	Tokenize(*entry);
+
+	// Another thread may have tokenized the same file in the meantime.
+	std::scoped_lock lock(mutex);
+	std::shared_ptr<const Entry>& cachedEntry = entries[key];
+	if (!cachedEntry || cachedEntry->contentHash != contentHash)
+		cachedEntry = std::move(entry);
+	return cachedEntry;
+}
+
+void IncludeCache::Clear()
+{
+	std::scoped_lock lock(mutex);
+	entries.clear();
+}
+
+void IncludeCache::Tokenize(Entry& entry)
+{
+	std::pmr::vector<SourceLine> lines;
+	SourceScanner::SplitLines(entry.file.GetSource(), lines);
+
+	TokenStream& tokenStream = entry.tokenStream;
+	tokenStream.lines.reserve(lines.size());
+	for (const SourceLine& line : lines)
+	{
+		if (AssemblerReturnCode returnCode = tokenStream.Append(line); returnCode != AssemblerReturnCode_Success)
+		{
+			tokenStream.lines.pop_back();
+			entry.returnCode = returnCode;
+			entry.lineNumber = line.number;
+			return;
+		}
+	}
+}
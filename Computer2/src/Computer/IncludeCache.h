@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Assembler.h"
+#include "SourceFile.h"
+#include "TokenStream.h"
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// A process-wide cache of tokenized include files, so that a header included from hundreds of files is only
+// tokenized once per process. Entries are keyed by canonical path, and are only reused while the file's
+// contents still hash the same, so edited files are tokenized again.
+// Safe to use from multiple threads.
+class IncludeCache
+{
+public:
+	struct Entry
+	{
+		std::filesystem::path path; // Canonical
+		// See ContentHash.
+		uint64_t contentHash = 0;
+		// Read rather than mapped, see SourceFile.
+		SourceFile file;
+		// NOTE: tokens are views of file's source.
+		TokenStream tokenStream;
+		// If tokenizing failed, why and where. The tokens before lineNumber are still valid.
+		AssemblerReturnCode returnCode = AssemblerReturnCode_Success;
+		size_t lineNumber = 0;
+	};
+public:
+	// Returns nullptr if path can't be opened.
+	static std::shared_ptr<const Entry> Get(const std::filesystem::path& path);
+
+	// Entries that are in use stay alive until they aren't.
+	static void Clear();
+private:
+	static void Tokenize(Entry& entry);
+private:
+	static std::mutex mutex;
+	static std::unordered_map<std::string, std::shared_ptr<const Entry>> entries;
+private:
+	IncludeCache() = delete;
+	IncludeCache(const IncludeCache&) = delete;
+	IncludeCache(IncludeCache&&) = delete;
+	IncludeCache& operator=(const IncludeCache&) = delete;
+	IncludeCache& operator=(IncludeCache&&) = delete;
+	~IncludeCache() = delete;
+};
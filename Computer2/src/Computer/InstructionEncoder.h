@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Assembler.h"
+#include "CharacterClass.h"
+#include "InstructionSet.h"
+#include "Keywords.h"
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+// An instruction of the InstructionTable, and the operand its immediate value comes from, if it has one.
+struct EncodedInstruction
+{
+	const InstructionInfo* info = nullptr;
+	std::string_view immediate;
+};
+
+// Encodes instructions from their mnemonic and operands, by finding the form of the mnemonic in the InstructionTable
+// that the operands match. Only checks what kind each operand is; evaluating the immediate is up to the caller, so
+// that this can be used both while assembling normally and in constant expressions, see CompileTimeAssembler.
+class InstructionEncoder
+{
+public:
+	static constexpr AssemblerReturnCode Encode(Mnemonic mnemonic, std::span<const std::string_view> operands, EncodedInstruction& instruction) noexcept
+	{
+		instruction = {};
+		if (mnemonic == Mnemonic::None)
+			return AssemblerReturnCode_InvalidMnemonic;
+		if (!InstructionTable.HasOperandCount(mnemonic, operands.size()))
+			return AssemblerReturnCode_InvalidOperandCount;
+
+		ParsedOperand parsed[2];
+		for (size_t i = 0; i < operands.size(); i++)
+			parsed[i] = ParseOperand(operands[i]);
+
+		// Moving a register to itself does nothing, which is what nop does.
+		if (mnemonic == Mnemonic::Mvr && parsed[0].key == parsed[1].key && IsRegister8(parsed[0].key))
+			mnemonic = Mnemonic::Nop, parsed[0] = parsed[1] = {};
+
+		// Conditions share names with registers and labels, e.g. c, so the first operand is only taken as one if
+		// nothing else matches.
+		instruction.info = InstructionTable.Find(mnemonic, parsed[0].key, parsed[1].key);
+		if (instruction.info == nullptr && !operands.empty())
+			if (Condition condition = ConditionTable.Find(operands[0]); condition != Condition::None)
+				instruction.info = InstructionTable.Find(mnemonic, InstructionSet::GetOperandKey({ .kind = OperandKind::Cond, .condition = condition }), parsed[1].key);
+		if (instruction.info == nullptr)
+			return AssemblerReturnCode_InvalidOperand;
+
+		for (size_t i = 0; i < operands.size(); i++)
+			if (instruction.info->operands[i].kind == OperandKind::I8 || instruction.info->operands[i].kind == OperandKind::I16)
+				instruction.immediate = parsed[i].immediate;
+		return AssemblerReturnCode_Success;
+	}
+private:
+	// The InstructionSet operand key of an operand, taking it as anything but a condition.
+	struct ParsedOperand
+	{
+		uint8_t key = 0;
+		// The operand, or the address in it, if it's an immediate.
+		std::string_view immediate;
+	};
+private:
+	static constexpr ParsedOperand ParseOperand(std::string_view operand) noexcept
+	{
+		OperandInfo info;
+		if (operand.size() >= 2 && operand.front() == '[' && operand.back() == ']')
+		{
+			info.isAddress = true;
+			operand = operand.substr(1, operand.size() - 2);
+			while (!operand.empty() && IsBlank(operand.front()))
+				operand.remove_prefix(1);
+			while (!operand.empty() && IsBlank(operand.back()))
+				operand.remove_suffix(1);
+		}
+
+		ParsedOperand parsed;
+		info.reg = RegisterTable.Find(operand);
+		if (info.reg != Register::None)
+			info.kind = OperandKind::R8;
+		else if (!operand.empty() && operand.front() != '[')
+		{
+			// Registers and memory operands can't be immediates. Whether the rest are valid expressions is up to the caller.
+			info.kind = OperandKind::I16;
+			parsed.immediate = operand;
+		}
+		parsed.key = info.kind != OperandKind::None ? InstructionSet::GetOperandKey(info) : InstructionSet::NoOperandKey;
+		return parsed;
+	}
+
+	static constexpr bool IsRegister8(uint8_t key) noexcept
+	{
+		return key == static_cast<uint8_t>(Register::A) || (key >= static_cast<uint8_t>(Register::B) && key <= static_cast<uint8_t>(Register::L));
+	}
+private:
+	InstructionEncoder() = delete;
+	InstructionEncoder(const InstructionEncoder&) = delete;
+	InstructionEncoder(InstructionEncoder&&) = delete;
+	InstructionEncoder& operator=(const InstructionEncoder&) = delete;
+	InstructionEncoder& operator=(InstructionEncoder&&) = delete;
+	~InstructionEncoder() = delete;
+};
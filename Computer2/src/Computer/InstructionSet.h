@@ -0,0 +1,337 @@
+#pragma once
+
+#include "Keywords.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <utility>
+
+// The bits of the flags register in docs/Architecture.txt, msb ---SPOCZ lsb.
+using Flags = uint8_t;
+enum Flags_ : Flags
+{
+	Flags_Z = 1 << 0, // Zero
+	Flags_C = 1 << 1, // Carry
+	Flags_O = 1 << 2, // Overflow
+	Flags_P = 1 << 3, // Parity
+	Flags_S = 1 << 4, // Sign
+	Flags_All = Flags_Z | Flags_C | Flags_O | Flags_P | Flags_S,
+};
+
+// The kinds of operands in docs/Architecture.txt.
+enum class OperandKind : uint8_t
+{
+	None,
+	R8,   // An 8-bit register.
+	R16,  // A 16-bit register, which is only ever an address.
+	I8,   // An 8-bit immediate value.
+	I16,  // A 16-bit immediate value.
+	Cond, // A branch condition.
+};
+
+struct OperandInfo
+{
+	OperandKind kind = OperandKind::None;
+	// Whether the operand is an address in brackets, i.e. [bc], [de], [hl], or [nn].
+	bool isAddress = false;
+	// The register an R8 or R16 operand must be.
+	Register reg = Register::None;
+	// The condition a Cond operand must be.
+	Condition condition = Condition::None;
+};
+
+// One row of the instruction set: an opcode, and the exact operands it is assembled from.
+struct InstructionInfo
+{
+	Mnemonic mnemonic = Mnemonic::None;
+	// Opcodes of the second table are InstructionSet::SecondTablePrefix followed by their index in it.
+	std::array<uint8_t, 2> opcode{};
+	uint8_t opcodeSize = 0;
+	std::array<OperandInfo, 2> operands{};
+	uint8_t operandCount = 0;
+	// The immediate follows the opcode, little endian. Its size is 0 if the instruction has none.
+	uint8_t immediateSize = 0;
+	// The opcode and the immediate.
+	uint8_t length = 0;
+	uint8_t cycles = 0;
+	// The flags it reads, like the carry of adc or the condition of a branch, and the flags it may change.
+	Flags flagsRead = 0;
+	Flags flagsWritten = 0;
+
+	constexpr std::span<const OperandInfo> GetOperands() const noexcept
+	{
+		return { operands.data(), operandCount };
+	}
+};
+
+// Every instruction of the opcode map in docs/Architecture.xlsx, built at compile time. The assembler's encoder
+// (InstructionEncoder), the disassembler, and anything executing machine code all look instructions up in it, so
+// they can't disagree about what an opcode means. Both directions are a single index into a table built from it:
+// Decode() by opcode, for disassembling and executing, and Find() by mnemonic and operands, for encoding.
+//
+// The docs don't give timings, so an instruction's cycles are its bus accesses: one per byte of it fetched, one
+// per byte sto and rcl store or recall, and two for the return address call pushes and ret pops.
+// Nor do they say which flags each instruction changes. Arithmetic is taken to change all of them, and bitwise
+// operations only those that describe the result, i.e. Z, P, and S, since claiming fewer changed flags is the safe
+// side for anything that decides which flags are still needed, like the assembler's optimizer.
+class InstructionSet
+{
+public:
+	static constexpr uint8_t SecondTablePrefix = 0x0F;
+	static constexpr size_t InstructionCount = 206;
+	static constexpr uint8_t NoOperandKey = 0xFF;
+public:
+	consteval InstructionSet()
+	{
+		firstTable.fill(NoInstruction);
+		secondTable.fill(NoInstruction);
+		encodeTable.fill(NoInstruction);
+
+		// Rows and columns of the opcode map list the registers in this order, with a before or after them.
+		constexpr Register Registers[] = { Register::B, Register::C, Register::D, Register::E, Register::H, Register::L };
+
+		Add(Mnemonic::Nop, { 0x00 }, {});
+		Add(Mnemonic::Halt, { 0x01 }, {});
+		Add(Mnemonic::Cpl, { 0xB8 }, {});
+		Add(Mnemonic::Neg, { 0xB9 }, {});
+
+		// ldi a, n is in the first table, and ldi b..l, n lead the second one.
+		Add(Mnemonic::Ldi, { 0x10 }, { Register8(Register::A), Immediate(OperandKind::I8) });
+		for (uint8_t i = 0; i < 6; i++)
+			Add(Mnemonic::Ldi, { SecondTablePrefix, i }, { Register8(Registers[i]), Immediate(OperandKind::I8) });
+
+		// The opcode map lists mvr a, c twice and mvr a, e nowhere. Its other rows and columns all use the order
+		// b, c, d, e, h, l, so this does too. Column n of the second table moves the nth register other than the
+		// destination to it.
+		for (uint8_t i = 0; i < 6; i++)
+		{
+			Add(Mnemonic::Mvr, { static_cast<uint8_t>((i + 2) << 4) }, { Register8(Register::A), Register8(Registers[i]) });
+			Add(Mnemonic::Mvr, { static_cast<uint8_t>(0x21 + i) }, { Register8(Registers[i]), Register8(Register::A) });
+		}
+		for (uint8_t destination = 0; destination < 6; destination++)
+		{
+			for (uint8_t source = 0; source < 6; source++)
+			{
+				if (source == destination)
+					continue;
+				uint8_t column = source < destination ? source + 1 : source;
+				Add(Mnemonic::Mvr, { SecondTablePrefix, static_cast<uint8_t>(column << 4 | destination) }, { Register8(Registers[destination]), Register8(Registers[source]) });
+			}
+		}
+
+		// Each takes an address of [nn], [bc], [de], or [hl], in that order.
+		const OperandInfo Addresses[] = { Immediate(OperandKind::I16, true), Address(Register::BC), Address(Register::DE), Address(Register::HL) };
+		for (Mnemonic mnemonic : { Mnemonic::Sto, Mnemonic::Rcl })
+		{
+			for (uint8_t i = 0; i < 4; i++)
+			{
+				uint8_t row = static_cast<uint8_t>((mnemonic == Mnemonic::Sto ? 0 : 4) + i);
+				Add(mnemonic, { static_cast<uint8_t>(0xB0 + row) }, { Addresses[i], Register8(Register::A) }, 1);
+				for (uint8_t j = 0; j < 6; j++)
+					Add(mnemonic, { SecondTablePrefix, static_cast<uint8_t>(j << 4 | (6 + row)) }, { Addresses[i], Register8(Registers[j]) }, 1);
+			}
+		}
+
+		// The 8 opcodes from each base take a, n, b, c, d, e, h, and l, in that order.
+		constexpr std::pair<Mnemonic, uint8_t> Arithmetic[] =
+		{
+			{ Mnemonic::Add, 0xC0 }, { Mnemonic::And, 0xC8 }, { Mnemonic::Adc, 0xD0 }, { Mnemonic::Xor, 0xD8 },
+			{ Mnemonic::Sub, 0xE0 }, { Mnemonic::Or, 0xE8 }, { Mnemonic::Sbc, 0xF0 }, { Mnemonic::Cmp, 0xF8 },
+		};
+		for (auto [mnemonic, base] : Arithmetic)
+		{
+			Add(mnemonic, { base }, { Register8(Register::A) });
+			Add(mnemonic, { static_cast<uint8_t>(base + 1) }, { Immediate(OperandKind::I8) });
+			for (uint8_t i = 0; i < 6; i++)
+				Add(mnemonic, { static_cast<uint8_t>(base + 2 + i) }, { Register8(Registers[i]) });
+		}
+
+		// Unconditional branches are at each base, followed by z, c, o, p, and s, and their complements are in the
+		// next column.
+		constexpr std::pair<Mnemonic, uint8_t> Branches[] = { { Mnemonic::Jmp, 0x1A }, { Mnemonic::Call, 0x3A }, { Mnemonic::Ret, 0x5A } };
+		for (auto [mnemonic, base] : Branches)
+		{
+			uint8_t stackAccesses = mnemonic == Mnemonic::Jmp ? 0 : 2;
+			Add(mnemonic, { base }, { Immediate(OperandKind::I16) }, stackAccesses);
+			for (uint8_t i = 1; i <= 10; i++)
+			{
+				uint8_t opcode = static_cast<uint8_t>(i <= 5 ? base + i : base + 0x10 + (i - 5));
+				Add(mnemonic, { opcode }, { ConditionOperand(static_cast<Condition>(i)), Immediate(OperandKind::I16) }, stackAccesses);
+			}
+		}
+
+		// Not a constant expression, so this fails the build if a row is missing.
+		if (instructionCount != InstructionCount)
+			throw "The instruction set doesn't have InstructionCount instructions.";
+	}
+
+	constexpr std::span<const InstructionInfo> GetInstructions() const noexcept
+	{
+		return instructions;
+	}
+
+	// Whether mnemonic has a form that takes operandCount operands.
+	constexpr bool HasOperandCount(Mnemonic mnemonic, size_t operandCount) const noexcept
+	{
+		return operandCount < 8 && (operandCounts[static_cast<size_t>(mnemonic)] >> operandCount & 1) != 0;
+	}
+
+	// Returns the form of mnemonic that takes operands with these keys, see GetOperandKey(), or nullptr if there isn't one.
+	constexpr const InstructionInfo* Find(Mnemonic mnemonic, uint8_t operandKey0, uint8_t operandKey1) const noexcept
+	{
+		if (operandKey0 >= OperandKeyCount || operandKey1 >= OperandKeyCount)
+			return nullptr;
+
+		uint8_t index = encodeTable[GetEncodeIndex(mnemonic, operandKey0, operandKey1)];
+		return index != NoInstruction ? &instructions[index] : nullptr;
+	}
+
+	// Forms are looked up by what their operands are, except for the value of immediates. Returns NoOperandKey for
+	// operands that no form takes, like [a].
+	static constexpr uint8_t GetOperandKey(const OperandInfo& operand) noexcept
+	{
+		switch (operand.kind)
+		{
+			case OperandKind::None:
+				return 0;
+			case OperandKind::R8:
+			case OperandKind::R16:
+				if (!operand.isAddress)
+					return static_cast<uint8_t>(operand.reg);
+				if (operand.reg >= Register::BC && operand.reg <= Register::HL)
+					return static_cast<uint8_t>(RegisterKeyCount + static_cast<uint8_t>(operand.reg) - static_cast<uint8_t>(Register::BC));
+				return NoOperandKey;
+			case OperandKind::I8:
+			case OperandKind::I16:
+				return operand.isAddress ? RegisterKeyCount + 4 : RegisterKeyCount + 3;
+			case OperandKind::Cond:
+				return static_cast<uint8_t>(RegisterKeyCount + 4 + static_cast<uint8_t>(operand.condition));
+		}
+		return NoOperandKey;
+	}
+
+	// Returns the instruction that bytes start with, or nullptr if they don't start with a valid opcode.
+	// Only the opcode has to be in bytes, not the immediate.
+	constexpr const InstructionInfo* Decode(std::span<const uint8_t> bytes) const noexcept
+	{
+		if (bytes.empty())
+			return nullptr;
+
+		uint8_t index = firstTable[bytes[0]];
+		if (bytes[0] == SecondTablePrefix)
+			index = bytes.size() > 1 ? secondTable[bytes[1]] : NoInstruction;
+		return index != NoInstruction ? &instructions[index] : nullptr;
+	}
+private:
+	static constexpr uint8_t NoInstruction = 0xFF;
+	static constexpr size_t MnemonicCount = static_cast<size_t>(Mnemonic::Ret) + 1;
+	// No operand, and every register. Then [bc], [de], [hl], n, [nn], and every condition.
+	static constexpr uint8_t RegisterKeyCount = static_cast<uint8_t>(Register::PC) + 1;
+	static constexpr uint8_t OperandKeyCount = RegisterKeyCount + 5 + static_cast<uint8_t>(Condition::NS);
+
+	static constexpr size_t GetEncodeIndex(Mnemonic mnemonic, uint8_t operandKey0, uint8_t operandKey1) noexcept
+	{
+		return (static_cast<size_t>(mnemonic) * OperandKeyCount + operandKey0) * OperandKeyCount + operandKey1;
+	}
+
+	static consteval OperandInfo Register8(Register reg)
+	{
+		return { .kind = OperandKind::R8, .reg = reg };
+	}
+
+	static consteval OperandInfo Address(Register reg)
+	{
+		return { .kind = OperandKind::R16, .isAddress = true, .reg = reg };
+	}
+
+	static consteval OperandInfo Immediate(OperandKind kind, bool isAddress = false)
+	{
+		return { .kind = kind, .isAddress = isAddress };
+	}
+
+	static consteval OperandInfo ConditionOperand(Condition condition)
+	{
+		return { .kind = OperandKind::Cond, .condition = condition };
+	}
+
+	static consteval void SetFlags(InstructionInfo& instruction)
+	{
+		switch (instruction.mnemonic)
+		{
+			case Mnemonic::Adc:
+			case Mnemonic::Sbc:
+				instruction.flagsRead = Flags_C;
+				instruction.flagsWritten = Flags_All;
+				break;
+			case Mnemonic::Add:
+			case Mnemonic::Sub:
+			case Mnemonic::Cmp:
+			case Mnemonic::Neg:
+				instruction.flagsWritten = Flags_All;
+				break;
+			case Mnemonic::And:
+			case Mnemonic::Xor:
+			case Mnemonic::Or:
+			case Mnemonic::Cpl:
+				instruction.flagsWritten = Flags_Z | Flags_P | Flags_S;
+				break;
+			case Mnemonic::Jmp:
+			case Mnemonic::Call:
+			case Mnemonic::Ret:
+			{
+				// nz, nc, and so on read the same flag as z, c, and so on.
+				Condition condition = instruction.operands[0].condition;
+				if (instruction.operands[0].kind == OperandKind::Cond)
+					instruction.flagsRead = static_cast<Flags>(1 << ((static_cast<uint8_t>(condition) - 1) % 5));
+				break;
+			}
+			default:
+				break;
+		}
+	}
+
+	consteval void Add(Mnemonic mnemonic, std::initializer_list<uint8_t> opcode, std::initializer_list<OperandInfo> operands, uint8_t dataAccesses = 0)
+	{
+		InstructionInfo& instruction = instructions[instructionCount];
+		instruction.mnemonic = mnemonic;
+		instruction.opcodeSize = static_cast<uint8_t>(opcode.size());
+		std::copy(opcode.begin(), opcode.end(), instruction.opcode.begin());
+		instruction.operandCount = static_cast<uint8_t>(operands.size());
+		std::copy(operands.begin(), operands.end(), instruction.operands.begin());
+
+		for (const OperandInfo& operand : operands)
+			if (operand.kind == OperandKind::I8 || operand.kind == OperandKind::I16)
+				instruction.immediateSize = operand.kind == OperandKind::I8 ? 1 : 2;
+		instruction.length = instruction.opcodeSize + instruction.immediateSize;
+		instruction.cycles = instruction.length + dataAccesses;
+		SetFlags(instruction);
+
+		// Every form must take different operands than the others of its mnemonic.
+		uint8_t& form = encodeTable[GetEncodeIndex(mnemonic, GetOperandKey(instruction.operands[0]), GetOperandKey(instruction.operands[1]))];
+		if (form != NoInstruction)
+			throw "Two forms of a mnemonic take the same operands.";
+		form = static_cast<uint8_t>(instructionCount);
+		operandCounts[static_cast<size_t>(mnemonic)] |= 1 << instruction.operandCount;
+
+		// Every opcode must mean exactly one instruction, and the prefix must not be one.
+		bool isSecondTable = instruction.opcodeSize == 2;
+		uint8_t& slot = isSecondTable ? secondTable[instruction.opcode[1]] : firstTable[instruction.opcode[0]];
+		if (slot != NoInstruction || (!isSecondTable && instruction.opcode[0] == SecondTablePrefix))
+			throw "Two instructions have the same opcode.";
+		slot = static_cast<uint8_t>(instructionCount++);
+	}
+private:
+	std::array<InstructionInfo, InstructionCount> instructions{};
+	size_t instructionCount = 0;
+	// Indices into instructions, by their first byte, or by their second byte for the second table.
+	std::array<uint8_t, 256> firstTable{};
+	std::array<uint8_t, 256> secondTable{};
+	// Indices into instructions, by mnemonic and operand keys.
+	std::array<uint8_t, MnemonicCount * OperandKeyCount * OperandKeyCount> encodeTable{};
+	// Bit n is set if the mnemonic has a form with n operands.
+	std::array<uint8_t, MnemonicCount> operandCounts{};
+};
+
+inline constexpr InstructionSet InstructionTable;
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <string_view>
+
+enum class Directive : uint8_t
+{
+	None,
+	Include,
+	Byte,
+	Word,
+	Macro,
+	EndMacro,
+	Define,
+	If,
+	Elif,
+	Else,
+	EndIf,
+	Origin,
+};
+
+enum class Mnemonic : uint8_t
+{
+	None,
+	Nop,
+	Halt,
+	Ldi,
+	Mvr,
+	Sto,
+	Rcl,
+	Add,
+	Adc,
+	Sub,
+	Sbc,
+	And,
+	Xor,
+	Or,
+	Cmp,
+	Cpl,
+	Neg,
+	Jmp,
+	Call,
+	Ret,
+};
+
+enum class Register : uint8_t
+{
+	None,
+	A,
+	F,
+	B,
+	C,
+	D,
+	E,
+	H,
+	L,
+	BC,
+	DE,
+	HL,
+	SP,
+	PC,
+};
+
+enum class Condition : uint8_t
+{
+	None,
+	Z,
+	C,
+	O,
+	P,
+	S,
+	NZ,
+	NC,
+	NO,
+	NP,
+	NS,
+};
+
+// A perfect hash table built at compile time from a fixed set of keywords.
+// Looking up a name costs one hash and one string compare.
+// T must be an enum whose zero value means "not a keyword".
+template<typename T, size_t KeywordCount>
+class KeywordTable
+{
+public:
+	struct Keyword
+	{
+		std::string_view name;
+		T value{};
+	};
+public:
+	consteval KeywordTable(const std::array<Keyword, KeywordCount>& keywords)
+	{
+		// Find a seed that maps every keyword to its own slot.
+		for (uint32_t seed = 0; seed < MaxSeed; seed++)
+		{
+			slots = {};
+			bool collided = false;
+			for (const Keyword& keyword : keywords)
+			{
+				Keyword& slot = slots[Hash(keyword.name, seed) & SlotMask];
+				if (!slot.name.empty())
+				{
+					collided = true;
+					break;
+				}
+				slot = keyword;
+			}
+
+			if (!collided)
+			{
+				this->seed = seed;
+				return;
+			}
+		}
+
+		// Not a constant expression, so this fails the build if no seed was found.
+		throw "No perfect hash seed found for this keyword set.";
+	}
+
+	// Returns the value of the keyword named name, or T{} if there isn't one.
+	constexpr T Find(std::string_view name) const noexcept
+	{
+		const Keyword& slot = slots[Hash(name, seed) & SlotMask];
+		return slot.name == name ? slot.value : T{};
+	}
+
+	// Returns the name of the keyword whose value is value, or an empty name if there isn't one.
+	constexpr std::string_view GetName(T value) const noexcept
+	{
+		for (const Keyword& slot : slots)
+			if (slot.value == value && !slot.name.empty())
+				return slot.name;
+		return {};
+	}
+private:
+	static constexpr size_t SlotCount = std::bit_ceil(KeywordCount * 2);
+	static constexpr size_t SlotMask = SlotCount - 1;
+	static constexpr uint32_t MaxSeed = 1 << 16;
+
+	// Seeded 32-bit FNV-1a with a final avalanche so the low bits depend on every character.
+	static constexpr uint32_t Hash(std::string_view name, uint32_t seed) noexcept
+	{
+		uint32_t hash = 2166136261u ^ seed;
+		for (char c : name)
+			hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+		return hash ^ (hash >> 15);
+	}
+private:
+	std::array<Keyword, SlotCount> slots{};
+	uint32_t seed = 0;
+};
+
+inline constexpr KeywordTable<Directive, 11> DirectiveTable({{
+	{ "include", Directive::Include },
+	{ "byte", Directive::Byte },
+	{ "word", Directive::Word },
+	{ "macro", Directive::Macro },
+	{ "endmacro", Directive::EndMacro },
+	{ "define", Directive::Define },
+	{ "if", Directive::If },
+	{ "elif", Directive::Elif },
+	{ "else", Directive::Else },
+	{ "endif", Directive::EndIf },
+	{ "origin", Directive::Origin },
+}});
+
+inline constexpr KeywordTable<Mnemonic, 19> MnemonicTable({{
+	{ "nop", Mnemonic::Nop },
+	{ "halt", Mnemonic::Halt },
+	{ "ldi", Mnemonic::Ldi },
+	{ "mvr", Mnemonic::Mvr },
+	{ "sto", Mnemonic::Sto },
+	{ "rcl", Mnemonic::Rcl },
+	{ "add", Mnemonic::Add },
+	{ "adc", Mnemonic::Adc },
+	{ "sub", Mnemonic::Sub },
+	{ "sbc", Mnemonic::Sbc },
+	{ "and", Mnemonic::And },
+	{ "xor", Mnemonic::Xor },
+	{ "or", Mnemonic::Or },
+	{ "cmp", Mnemonic::Cmp },
+	{ "cpl", Mnemonic::Cpl },
+	{ "neg", Mnemonic::Neg },
+	{ "jmp", Mnemonic::Jmp },
+	{ "call", Mnemonic::Call },
+	{ "ret", Mnemonic::Ret },
+}});
+
+inline constexpr KeywordTable<Register, 13> RegisterTable({{
+	{ "a", Register::A },
+	{ "f", Register::F },
+	{ "b", Register::B },
+	{ "c", Register::C },
+	{ "d", Register::D },
+	{ "e", Register::E },
+	{ "h", Register::H },
+	{ "l", Register::L },
+	{ "bc", Register::BC },
+	{ "de", Register::DE },
+	{ "hl", Register::HL },
+	{ "sp", Register::SP },
+	{ "pc", Register::PC },
+}});
+
+inline constexpr KeywordTable<Condition, 10> ConditionTable({{
+	{ "z", Condition::Z },
+	{ "c", Condition::C },
+	{ "o", Condition::O },
+	{ "p", Condition::P },
+	{ "s", Condition::S },
+	{ "nz", Condition::NZ },
+	{ "nc", Condition::NC },
+	{ "no", Condition::NO },
+	{ "np", Condition::NP },
+	{ "ns", Condition::NS },
+}});
@@ -0,0 +1,229 @@
+#include "Linker.h"
+#include "Expression.h"
+#include "NumericLiteral.h"
+#include "SymbolTable.h"
+#include <algorithm>
+
+static constexpr uint32_t AddressSpaceSize = 0x10000;
+
+struct AddressRange
+{
+	uint32_t begin = 0;
+	uint32_t end = 0;
+	size_t objectIndex = 0;
+};
+
+// Where an exported symbol is, by object and symbol index.
+struct ExportedSymbol
+{
+	uint32_t objectIndex = 0;
+	uint32_t symbolIndex = 0;
+};
+
+// Evaluates the symbols of the object currently being linked, once every section is placed.
+// Each symbol is only evaluated once, so a define that many relocations use isn't evaluated again for each of them.
+class LinkerResolver : public Expression::SymbolResolver
+{
+public:
+	LinkerResolver(std::span<const AssemblerObject> objects, std::span<const AssemblerProgramSection> sections,
+		std::span<const size_t> firstSections, const SymbolTable<ExportedSymbol>& exports)
+		: objects(objects), sections(sections), firstSections(firstSections), exports(exports)
+	{
+		// The values of object i start at firstValues[i].
+		for (const AssemblerObject& object : objects)
+		{
+			firstValues.push_back(values.size());
+			values.resize(values.size() + object.symbols.size());
+		}
+	}
+
+	// Bytecode is never compiled while linking.
+	bool Resolve(std::string_view, int32_t&, uint32_t&, AssemblerReturnCode& returnCode) override
+	{
+		returnCode = AssemblerReturnCode_InvalidExpression;
+		return false;
+	}
+
+	AssemblerReturnCode Evaluate(uint32_t symbolIndex, int32_t& value, uint32_t& blockingSymbolIndex) override
+	{
+		const AssemblerObject& object = objects[currentObject];
+		const AssemblerObject::Symbol& symbol = object.symbols[symbolIndex];
+		Value& symbolValue = values[firstValues[currentObject] + symbolIndex];
+		if (symbolValue.state == State::Evaluated)
+		{
+			value = symbolValue.value;
+			return AssemblerReturnCode_Success;
+		}
+		if (symbolValue.state == State::Evaluating)
+			return AssemblerReturnCode_CircularDefine;
+
+		switch (symbol.kind)
+		{
+			case AssemblerObject::SymbolKind::Absolute:
+				value = symbol.value;
+				break;
+			case AssemblerObject::SymbolKind::Relocatable:
+				value = static_cast<int32_t>(sections[firstSections[currentObject] + symbol.section].origin) + symbol.value;
+				break;
+			case AssemblerObject::SymbolKind::Expression:
+			{
+				symbolValue.state = State::Evaluating;
+				Expression::EvaluateResult result = Expression::Evaluate({ object.bytecode.data() + symbol.bytecodeOffset, symbol.bytecodeSize }, *this);
+				symbolValue.state = State::Unevaluated;
+				if (result.returnCode != AssemblerReturnCode_Success)
+				{
+					blockingSymbolIndex = result.blockingSymbolIndex;
+					return result.returnCode;
+				}
+				value = result.value;
+				break;
+			}
+			case AssemblerObject::SymbolKind::Import:
+			{
+				uint32_t exportIndex = exports.Find(symbol.name);
+				if (exportIndex == SymbolTable<ExportedSymbol>::InvalidIndex)
+				{
+					blockingSymbolIndex = symbolIndex;
+					return AssemblerReturnCode_UndefinedSymbol;
+				}
+
+				// Only labels are exported, so this never comes back to the object it started from.
+				const ExportedSymbol& exported = exports[exportIndex].value;
+				uint32_t importingObject = currentObject;
+				currentObject = exported.objectIndex;
+				AssemblerReturnCode returnCode = Evaluate(exported.symbolIndex, value, blockingSymbolIndex);
+				currentObject = importingObject;
+				if (returnCode != AssemblerReturnCode_Success)
+					return returnCode;
+				break;
+			}
+		}
+
+		symbolValue.state = State::Evaluated;
+		symbolValue.value = value;
+		return AssemblerReturnCode_Success;
+	}
+public:
+	uint32_t currentObject = 0;
+private:
+	enum class State : uint8_t
+	{
+		Unevaluated,
+		Evaluating,
+		Evaluated,
+	};
+
+	struct Value
+	{
+		State state = State::Unevaluated;
+		int32_t value = 0;
+	};
+private:
+	std::span<const AssemblerObject> objects;
+	std::span<const AssemblerProgramSection> sections;
+	std::span<const size_t> firstSections;
+	const SymbolTable<ExportedSymbol>& exports;
+	std::vector<Value> values;
+	std::vector<size_t> firstValues;
+};
+
+LinkerOutput Linker::Link(std::span<const AssemblerObject> objects, uint16_t relocatableOrigin)
+{
+	// Gather every export, which must have a unique name.
+	size_t symbolCount = 0;
+	for (const AssemblerObject& object : objects)
+		symbolCount += object.symbols.size();
+
+	SymbolTable<ExportedSymbol> exports;
+	exports.Reserve(symbolCount);
+	for (uint32_t objectIndex = 0; objectIndex < objects.size(); objectIndex++)
+	{
+		const AssemblerObject& object = objects[objectIndex];
+		for (uint32_t symbolIndex = 0; symbolIndex < object.symbols.size(); symbolIndex++)
+		{
+			const AssemblerObject::Symbol& symbol = object.symbols[symbolIndex];
+			if (!symbol.isExported)
+				continue;
+			if (symbol.kind != AssemblerObject::SymbolKind::Absolute && symbol.kind != AssemblerObject::SymbolKind::Relocatable)
+				return { AssemblerReturnCode_InvalidObject, 0, objectIndex };
+			if (!exports.Insert(symbol.name, { objectIndex, symbolIndex }).second)
+				return { AssemblerReturnCode_DuplicateLabelDefinition, 0, objectIndex };
+		}
+	}
+
+	// Copy every section, so that relocations can be applied to them. The sections of object i start at firstSections[i].
+	std::vector<AssemblerProgramSection> sections;
+	std::vector<size_t> firstSections;
+	std::vector<AddressRange> usedRanges;
+	for (size_t objectIndex = 0; objectIndex < objects.size(); objectIndex++)
+	{
+		firstSections.push_back(sections.size());
+		for (const AssemblerObject::Section& section : objects[objectIndex].sections)
+		{
+			sections.push_back(section);
+			if (!section.isRelocatable && !section.assembly.empty())
+				usedRanges.push_back({ section.origin, section.origin + static_cast<uint32_t>(section.assembly.size()), objectIndex });
+		}
+	}
+
+	// Absolute sections may not overlap each other.
+	std::sort(usedRanges.begin(), usedRanges.end(), [](const AddressRange& lhs, const AddressRange& rhs) { return lhs.begin < rhs.begin; });
+	for (size_t i = 1; i < usedRanges.size(); i++)
+		if (usedRanges[i].begin < usedRanges[i - 1].end)
+			return { AssemblerReturnCode_OverlappingSections, 0, std::max(usedRanges[i].objectIndex, usedRanges[i - 1].objectIndex) };
+
+	// Place each relocatable section in the first gap that fits it. Empty sections, which only hold labels,
+	// are placed right after the relocatable section before them instead, like they would be in one source.
+	uint32_t relocatableEnd = relocatableOrigin;
+	for (size_t objectIndex = 0; objectIndex < objects.size(); objectIndex++)
+	{
+		const std::vector<AssemblerObject::Section>& objectSections = objects[objectIndex].sections;
+		for (size_t sectionIndex = 0; sectionIndex < objectSections.size(); sectionIndex++)
+		{
+			if (!objectSections[sectionIndex].isRelocatable)
+				continue;
+
+			uint32_t size = static_cast<uint32_t>(objectSections[sectionIndex].assembly.size());
+			uint32_t origin = size != 0 ? relocatableOrigin : relocatableEnd;
+			auto gap = usedRanges.begin();
+			for (; gap != usedRanges.end() && origin + size > gap->begin; ++gap)
+				origin = std::max(origin, gap->end);
+			if (origin + size > AddressSpaceSize)
+				return { AssemblerReturnCode_AddressOverflow, 0, objectIndex };
+
+			sections[firstSections[objectIndex] + sectionIndex].origin = static_cast<uint16_t>(origin);
+			relocatableEnd = origin + size;
+			if (size != 0)
+				usedRanges.insert(gap, { origin, origin + size, objectIndex });
+		}
+	}
+
+	// Every section is placed, so every symbol can be evaluated now.
+	LinkerResolver resolver(objects, sections, firstSections, exports);
+	for (uint32_t objectIndex = 0; objectIndex < objects.size(); objectIndex++)
+	{
+		const AssemblerObject& object = objects[objectIndex];
+		resolver.currentObject = objectIndex;
+		for (const AssemblerObject::Relocation& relocation : object.relocations)
+		{
+			Expression::EvaluateResult result = Expression::Evaluate({ object.bytecode.data() + relocation.bytecodeOffset, relocation.bytecodeSize }, resolver);
+			if (result.returnCode == AssemblerReturnCode_Success && !NumericLiteral::FitsOperandSize(result.value, relocation.size))
+				result.returnCode = AssemblerReturnCode_OperandOutOfRange;
+			if (result.returnCode != AssemblerReturnCode_Success)
+				return { result.returnCode, relocation.lineNumber, objectIndex };
+
+			// Words are little endian.
+			std::vector<uint8_t>& assembly = sections[firstSections[objectIndex] + relocation.section].assembly;
+			assembly[relocation.offset] = static_cast<uint8_t>(result.value);
+			if (relocation.size == 2)
+				assembly[relocation.offset + 1] = static_cast<uint8_t>(result.value >> 8);
+		}
+	}
+
+	std::erase_if(sections, [](const AssemblerProgramSection& section) { return section.assembly.empty(); });
+	std::stable_sort(sections.begin(), sections.end(), [](const AssemblerProgramSection& lhs, const AssemblerProgramSection& rhs) { return lhs.origin < rhs.origin; });
+
+	LinkerOutput output;
+	output.sections = std::move(sections);
+	return output;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Assembler.h"
+#include "AssemblerObject.h"
+#include <span>
+
+struct LinkerOutput : AssemblerOutput
+{
+	// The object an error was found in. Only relevant if returnCode is not AssemblerReturnCode_Success.
+	size_t objectIndex = 0;
+
+	LinkerOutput() noexcept = default;
+	LinkerOutput(AssemblerReturnCode returnCode, size_t lineNumber = 0, size_t objectIndex = 0) noexcept
+		: AssemblerOutput(returnCode, lineNumber), objectIndex(objectIndex) {}
+};
+
+// Combines objects into one program.
+// Absolute sections stay where they are, and may not overlap. Relocatable sections are placed in object order,
+// each at the lowest address from relocatableOrigin on where it doesn't overlap anything else.
+// Every import must be exported by exactly one other object, and every relocation must fit its operand.
+class Linker
+{
+public:
+	static LinkerOutput Link(std::span<const AssemblerObject> objects, uint16_t relocatableOrigin = 0);
+private:
+	Linker() = delete;
+	Linker(const Linker&) = delete;
+	Linker(Linker&&) = delete;
+	Linker& operator=(const Linker&) = delete;
+	Linker& operator=(Linker&&) = delete;
+	~Linker() = delete;
+};
@@ -0,0 +1,227 @@
+#pragma once
+
+#include "CharacterClass.h"
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+// Validates and converts numeric literals in one pass over their digits.
+//
+// Supported forms:
+//   binary       0b1010  %1010  1010b
+//   decimal      1234
+//   hexadecimal  0x12ab  $12ab  012abh
+// Prefixes and suffixes are case insensitive. Suffixed literals must start with a decimal
+// digit, so that labels like "beach" or "cab" aren't mistaken for numbers.
+//
+// Runs of 8 digits are converted at once in a 64-bit word (SWAR).
+
+enum class NumericLiteralResult : uint8_t
+{
+	Success,
+	// The text isn't a numeric literal.
+	Invalid,
+	// The text is a numeric literal, but its value doesn't fit in 32 bits.
+	Overflow,
+};
+
+class NumericLiteral
+{
+public:
+	static constexpr NumericLiteralResult Parse(std::string_view text, uint32_t& value) noexcept
+	{
+		if (text.empty())
+			return NumericLiteralResult::Invalid;
+
+		char first = text.front();
+		if (first == '%')
+			return ParseDigits<2>(text.substr(1), value);
+		if (first == '$')
+			return ParseDigits<16>(text.substr(1), value);
+
+		// Every other form starts with a decimal digit.
+		if (!IsDecimalDigit(first))
+			return NumericLiteralResult::Invalid;
+
+		if (text.size() >= 3 && first == '0')
+		{
+			char prefix = ToLower(text[1]);
+			if (prefix == 'x')
+				return ParseDigits<16>(text.substr(2), value);
+
+			// "0b1h" is a hexadecimal literal, so only commit to the binary prefix if it works.
+			if (prefix == 'b')
+				if (NumericLiteralResult result = ParseDigits<2>(text.substr(2), value); result != NumericLiteralResult::Invalid)
+					return result;
+		}
+
+		switch (ToLower(text.back()))
+		{
+			case 'b': return ParseDigits<2>(text.substr(0, text.size() - 1), value);
+			case 'h': return ParseDigits<16>(text.substr(0, text.size() - 1), value);
+			default:  return ParseDigits<10>(text, value);
+		}
+	}
+
+	// Whether value can be encoded in an operand of size bytes, as either a signed or an unsigned integer.
+	// i.e. i8 operands accept [-128, 255] and i16 operands accept [-32768, 65535].
+	static constexpr bool FitsOperandSize(int64_t value, uint8_t size) noexcept
+	{
+		int64_t bits = size * 8;
+		return -(int64_t(1) << (bits - 1)) <= value && value < (int64_t(1) << bits);
+	}
+private:
+	// Loads 8 chars so that the first one is in the least significant byte.
+	static constexpr uint64_t Load8(const char* chars) noexcept
+	{
+		if (std::is_constant_evaluated() || std::endian::native != std::endian::little)
+		{
+			uint64_t word = 0;
+			for (size_t i = 0; i < 8; i++)
+				word |= uint64_t(static_cast<uint8_t>(chars[i])) << (i * 8);
+			return word;
+		}
+		else
+		{
+			uint64_t word;
+			std::memcpy(&word, chars, sizeof(word));
+			return word;
+		}
+	}
+
+	static constexpr uint64_t Repeat(uint8_t byte) noexcept
+	{
+		return 0x0101010101010101ull * byte;
+	}
+
+	// Returns the high bit of every byte of word that is at least n, for n in [1, 128].
+	// Only exact if no byte of word has its high bit set.
+	static constexpr uint64_t BytesAtLeast(uint64_t word, uint8_t n) noexcept
+	{
+		// Setting every high bit first means no byte borrows from the next one.
+		return ((word | Repeat(0x80)) - Repeat(n)) & Repeat(0x80);
+	}
+
+	// Returns the high bit of every byte of word that is in [low, high], for ASCII words.
+	static constexpr uint64_t BytesInRange(uint64_t word, char low, char high) noexcept
+	{
+		return BytesAtLeast(word, static_cast<uint8_t>(low)) & ~BytesAtLeast(word, static_cast<uint8_t>(high + 1));
+	}
+
+	static constexpr bool IsAscii(uint64_t word) noexcept
+	{
+		return (word & Repeat(0x80)) == 0;
+	}
+
+	static constexpr bool AreBinaryDigits(uint64_t word) noexcept
+	{
+		return IsAscii(word) && BytesInRange(word, '0', '1') == Repeat(0x80);
+	}
+
+	static constexpr bool AreDecimalDigits(uint64_t word) noexcept
+	{
+		return IsAscii(word) && BytesInRange(word, '0', '9') == Repeat(0x80);
+	}
+
+	static constexpr bool AreHexadecimalDigits(uint64_t word) noexcept
+	{
+		// Setting 0x20 lowercases letters without turning anything else into a lowercase hexadecimal letter.
+		return IsAscii(word) && (BytesInRange(word, '0', '9') | BytesInRange(word | Repeat(0x20), 'a', 'f')) == Repeat(0x80);
+	}
+
+	// The first digit is the most significant bit.
+	static constexpr uint32_t ConvertBinary8(uint64_t word) noexcept
+	{
+		word -= Repeat('0');
+		return static_cast<uint32_t>((word * 0x8040201008040201ull) >> 56);
+	}
+
+	static constexpr uint32_t ConvertDecimal8(uint64_t word) noexcept
+	{
+		word -= Repeat('0');
+		word = (word * 10 + (word >> 8)) & 0x00FF00FF00FF00FFull;
+		word = (word * 100 + (word >> 16)) & 0x0000FFFF0000FFFFull;
+		return static_cast<uint32_t>((word * 10000 + (word >> 32)) & 0xFFFFFFFFull);
+	}
+
+	static constexpr uint32_t ConvertHexadecimal8(uint64_t word) noexcept
+	{
+		// Letters have 0x40 set, so they get 9 added to their low nibble ('a' = 0x61 -> 1 + 9).
+		word = (word & Repeat(0x0F)) + ((word >> 6) & Repeat(0x01)) * 9;
+		// Pack pairs of nibbles into bytes, then pairs of bytes into 16-bit halves, and so on.
+		word = ((word & 0x000F000F000F000Full) << 4) | ((word >> 8) & 0x000F000F000F000Full);
+		word = ((word & 0x000000FF000000FFull) << 8) | ((word >> 16) & 0x000000FF000000FFull);
+		word = ((word & 0x000000000000FFFFull) << 16) | ((word >> 32) & 0x000000000000FFFFull);
+		return static_cast<uint32_t>(word);
+	}
+
+	template<uint8_t Base>
+	static constexpr NumericLiteralResult ParseDigits(std::string_view digits, uint32_t& value) noexcept
+	{
+		if (digits.empty())
+			return NumericLiteralResult::Invalid;
+
+		constexpr uint64_t ChunkScale = Base == 2 ? 1ull << 8 : Base == 16 ? 1ull << 32 : 100000000ull;
+		uint64_t result = 0;
+		bool overflowed = false;
+
+		size_t i = 0;
+		for (; i + 8 <= digits.size(); i += 8)
+		{
+			uint64_t word = Load8(digits.data() + i);
+			if constexpr (Base == 2)
+			{
+				if (!AreBinaryDigits(word))
+					return NumericLiteralResult::Invalid;
+				result = result * ChunkScale + ConvertBinary8(word);
+			}
+			else if constexpr (Base == 10)
+			{
+				if (!AreDecimalDigits(word))
+					return NumericLiteralResult::Invalid;
+				result = result * ChunkScale + ConvertDecimal8(word);
+			}
+			else
+			{
+				if (!AreHexadecimalDigits(word))
+					return NumericLiteralResult::Invalid;
+				result = result * ChunkScale + ConvertHexadecimal8(word);
+			}
+
+			// Keep validating the rest of the digits, but remember the value is too big.
+			if (result > 0xFFFFFFFFull)
+			{
+				overflowed = true;
+				result = 0;
+			}
+		}
+
+		for (; i < digits.size(); i++)
+		{
+			uint8_t digit = GetDigitValue(digits[i]);
+			if (digit >= Base)
+				return NumericLiteralResult::Invalid;
+			result = result * Base + digit;
+			if (result > 0xFFFFFFFFull)
+			{
+				overflowed = true;
+				result = 0;
+			}
+		}
+
+		if (overflowed)
+			return NumericLiteralResult::Overflow;
+
+		value = static_cast<uint32_t>(result);
+		return NumericLiteralResult::Success;
+	}
+private:
+	NumericLiteral() = delete;
+	NumericLiteral(const NumericLiteral&) = delete;
+	NumericLiteral(NumericLiteral&&) = delete;
+	NumericLiteral& operator=(const NumericLiteral&) = delete;
+	NumericLiteral& operator=(NumericLiteral&&) = delete;
+	~NumericLiteral() = delete;
+};
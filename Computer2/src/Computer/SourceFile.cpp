@@ -0,0 +1,218 @@
+#include "SourceFile.h"
+#include <utility>
+
+#if SYSTEM_WINDOWS
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <Windows.h>
+#else
+	#include <cerrno>
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+SourceFile::SourceFile(const std::filesystem::path& path, bool isMappingAllowed)
+{
+	Open(path, isMappingAllowed);
+}
+
+SourceFile::SourceFile(SourceFile&& sourceFile) noexcept
+{
+	Swap(sourceFile);
+}
+
+SourceFile& SourceFile::operator=(SourceFile&& sourceFile) noexcept
+{
+	if (this != &sourceFile)
+	{
+		Close();
+		Swap(sourceFile);
+	}
+	return *this;
+}
+
+SourceFile::~SourceFile()
+{
+	Close();
+}
+
+#if SYSTEM_WINDOWS
+
+bool SourceFile::Open(const std::filesystem::path& path, bool isMappingAllowed)
+{
+	Close();
+
+	bool isStdin = path == StdinPath;
+	HANDLE file = isStdin ? GetStdHandle(STD_INPUT_HANDLE) :
+		CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE || file == nullptr)
+		return false;
+
+	LARGE_INTEGER fileSize{};
+	bool isDisk = !isStdin && GetFileType(file) == FILE_TYPE_DISK && GetFileSizeEx(file, &fileSize);
+	if (isDisk && isMappingAllowed)
+	{
+		// Empty files can't be mapped, but they are still successfully opened.
+		if (fileSize.QuadPart == 0)
+			isOpen = true;
+		else if (HANDLE fileMapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr))
+		{
+			// The view keeps the file mapped after both handles are closed.
+			mapping = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(fileMapping);
+			if (mapping)
+			{
+				mappingSize = static_cast<size_t>(fileSize.QuadPart);
+				source = { static_cast<const char*>(mapping), mappingSize };
+				isOpen = true;
+			}
+		}
+	}
+
+	// Fall back to reading the whole file. A pipe whose writer closed it fails with ERROR_BROKEN_PIPE at its end;
+	// any other failure means the file can't be read, which isn't the same as it being empty.
+	if (!isOpen)
+	{
+		if (isDisk)
+			buffer.reserve(static_cast<size_t>(fileSize.QuadPart));
+
+		char chunk[64 * 1024];
+		DWORD bytesRead = 0;
+		bool isRead = true;
+		while (true)
+		{
+			if (!ReadFile(file, chunk, sizeof(chunk), &bytesRead, nullptr))
+			{
+				isRead = GetLastError() == ERROR_BROKEN_PIPE;
+				break;
+			}
+			if (bytesRead == 0)
+				break;
+			buffer.append(chunk, bytesRead);
+		}
+
+		if (isRead)
+		{
+			source = buffer;
+			isOpen = true;
+		}
+		else
+			buffer.clear();
+	}
+
+	if (!isStdin)
+		CloseHandle(file);
+	return isOpen;
+}
+
+void SourceFile::Close() noexcept
+{
+	if (mapping)
+		UnmapViewOfFile(mapping);
+	mapping = nullptr;
+	mappingSize = 0;
+	buffer.clear();
+	buffer.shrink_to_fit();
+	source = {};
+	isOpen = false;
+}
+
+#else // !SYSTEM_WINDOWS
+
+bool SourceFile::Open(const std::filesystem::path& path, bool isMappingAllowed)
+{
+	Close();
+
+	bool isStdin = path == StdinPath;
+	int file = isStdin ? STDIN_FILENO : open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (file < 0)
+		return false;
+
+	// Directories can be opened, but not read.
+	struct stat fileStat{};
+	bool isStat = fstat(file, &fileStat) == 0;
+	if (isStat && S_ISDIR(fileStat.st_mode))
+	{
+		close(file);
+		return false;
+	}
+
+	if (isStat && S_ISREG(fileStat.st_mode) && isMappingAllowed)
+	{
+		// Empty files can't be mapped, but they are still successfully opened.
+		if (fileStat.st_size == 0)
+			isOpen = true;
+		else if (void* view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0); view != MAP_FAILED)
+		{
+			madvise(view, static_cast<size_t>(fileStat.st_size), MADV_SEQUENTIAL);
+			mapping = view;
+			mappingSize = static_cast<size_t>(fileStat.st_size);
+			source = { static_cast<const char*>(mapping), mappingSize };
+			isOpen = true;
+		}
+	}
+
+	// Fall back to reading the whole file. A failed read means the file can't be read, which isn't the same as it
+	// being empty, unless a signal interrupted it.
+	if (!isOpen)
+	{
+		if (isStat && S_ISREG(fileStat.st_mode))
+			buffer.reserve(static_cast<size_t>(fileStat.st_size));
+
+		char chunk[64 * 1024];
+		ssize_t bytesRead = 0;
+		while ((bytesRead = read(file, chunk, sizeof(chunk))) != 0)
+		{
+			if (bytesRead < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+			buffer.append(chunk, static_cast<size_t>(bytesRead));
+		}
+
+		if (bytesRead == 0)
+		{
+			source = buffer;
+			isOpen = true;
+		}
+		else
+			buffer.clear();
+	}
+
+	if (!isStdin)
+		close(file);
+	return isOpen;
+}
+
+void SourceFile::Close() noexcept
+{
+	if (mapping)
+		munmap(mapping, mappingSize);
+	mapping = nullptr;
+	mappingSize = 0;
+	buffer.clear();
+	buffer.shrink_to_fit();
+	source = {};
+	isOpen = false;
+}
+
+#endif // SYSTEM_WINDOWS
+
+void SourceFile::Swap(SourceFile& sourceFile) noexcept
+{
+	std::swap(source, sourceFile.source);
+	std::swap(buffer, sourceFile.buffer);
+	std::swap(mapping, sourceFile.mapping);
+	std::swap(mappingSize, sourceFile.mappingSize);
+	std::swap(isOpen, sourceFile.isOpen);
+
+	// Short buffers live inside the std::string itself, so views of them don't survive a swap.
+	if (!mapping && isOpen)
+		source = buffer;
+	if (!sourceFile.mapping && sourceFile.isOpen)
+		sourceFile.source = sourceFile.buffer;
+}
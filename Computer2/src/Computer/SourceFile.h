@@ -0,0 +1,48 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+// Read-only access to the contents of a source file.
+// Regular files are memory-mapped, so GetSource() views the file's pages directly without copying them.
+// Anything that can't be mapped, like pipes and stdin, is read into an internal buffer instead.
+// NOTE: on POSIX systems, touching a page of a mapped file that another process truncated raises SIGBUS.
+// Files that stay open for long, especially in processes that must not crash, should be read instead.
+class SourceFile
+{
+public:
+	// The path used to read from stdin.
+	static constexpr std::string_view StdinPath = "-";
+public:
+	SourceFile() noexcept = default;
+	SourceFile(const std::filesystem::path& path, bool isMappingAllowed = true);
+	SourceFile(SourceFile&& sourceFile) noexcept;
+	SourceFile& operator=(SourceFile&& sourceFile) noexcept;
+	~SourceFile();
+
+	// Returns false if path can't be opened or read, e.g. if it's a directory.
+	// Unless isMappingAllowed, regular files are read into the internal buffer too.
+	bool Open(const std::filesystem::path& path, bool isMappingAllowed = true);
+	void Close() noexcept;
+
+	constexpr bool IsOpen() const noexcept { return isOpen; }
+	constexpr operator bool() const noexcept { return isOpen; }
+	constexpr bool IsMapped() const noexcept { return mapping != nullptr; }
+
+	// NOTE: the returned view is only valid until this file is closed, moved from, or destroyed.
+	constexpr std::string_view GetSource() const noexcept { return source; }
+private:
+	void Swap(SourceFile& sourceFile) noexcept;
+private:
+	SourceFile(const SourceFile&) = delete;
+	SourceFile& operator=(const SourceFile&) = delete;
+private:
+	std::string_view source;
+	// Only used when the file couldn't be mapped.
+	std::string buffer;
+	// The base address of the mapped view, or nullptr if the file isn't mapped.
+	void* mapping = nullptr;
+	size_t mappingSize = 0;
+	bool isOpen = false;
+};
@@ -0,0 +1,225 @@
+#include "SourceScanner.h"
+#include "CharacterClass.h"
+#include <bit>
+#include <cstring>
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+	#define SOURCE_SCANNER_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define SOURCE_SCANNER_SSE2 1
+#endif
+
+static_assert(SourceScanner::BlockSize == 64, "Block masks are stored in 64-bit integers.");
+
+SourceScanner::BlockMasks SourceScanner::ScanBlock(const char* block) noexcept
+{
+	BlockMasks masks;
+
+#if SOURCE_SCANNER_AVX2
+	for (size_t i = 0; i < BlockSize; i += 32)
+	{
+		__m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i));
+		auto matches = [bytes](char c) { return _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(c)); };
+		auto toMask = [](__m256i m) { return static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(m))); };
+
+		masks.lineEnding |= toMask(_mm256_or_si256(matches('\n'), matches('\r'))) << i;
+		masks.comment |= toMask(matches(';')) << i;
+		masks.space |= toMask(_mm256_or_si256(_mm256_or_si256(matches(' '), matches('\t')), _mm256_or_si256(matches('\v'), matches('\f')))) << i;
+	}
+#elif SOURCE_SCANNER_SSE2
+	for (size_t i = 0; i < BlockSize; i += 16)
+	{
+		__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+		auto matches = [bytes](char c) { return _mm_cmpeq_epi8(bytes, _mm_set1_epi8(c)); };
+		auto toMask = [](__m128i m) { return static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(m))); };
+
+		masks.lineEnding |= toMask(_mm_or_si128(matches('\n'), matches('\r'))) << i;
+		masks.comment |= toMask(matches(';')) << i;
+		masks.space |= toMask(_mm_or_si128(_mm_or_si128(matches(' '), matches('\t')), _mm_or_si128(matches('\v'), matches('\f')))) << i;
+	}
+#else
+	for (size_t i = 0; i < BlockSize; i++)
+	{
+		char c = block[i];
+		uint64_t bit = uint64_t(1) << i;
+		CharacterClass characterClass = GetCharacterClass(c);
+		if (characterClass & CharacterClass_LineEnding)
+			masks.lineEnding |= bit;
+		else if (characterClass & CharacterClass_Comment)
+			masks.comment |= bit;
+		else if (characterClass & CharacterClass_Whitespace)
+			masks.space |= bit;
+	}
+#endif
+
+	return masks;
+}
+
+size_t SourceScanner::SplitLines(std::string_view source, std::pmr::vector<SourceLine>& lines, size_t firstLineNumber)
+{
+	enum class State : uint8_t
+	{
+		// Skipping whitespace before the first character of a line.
+		LineStart,
+		// Looking for the end of a line's content.
+		InLine,
+		// Looking for the end of a comment.
+		InComment,
+	};
+
+	const char* data = source.data();
+	size_t size = source.size();
+
+	auto addLine = [&](size_t lineBegin, size_t lineEnd, size_t lineNumber)
+	{
+		// Remove trailing whitespace. lineBegin is never whitespace, so this stops there.
+		while (IsBlank(data[lineEnd - 1]))
+			lineEnd--;
+		lines.emplace_back(std::string_view(data + lineBegin, lineEnd - lineBegin), lineNumber);
+	};
+
+	State state = State::LineStart;
+	size_t lineNumber = firstLineNumber;
+	size_t lineBegin = 0;
+	size_t i = 0;
+
+	// The last block is copied here so that the scanner never reads past the end of source.
+	alignas(32) char tailBlock[BlockSize];
+
+	for (size_t blockBegin = 0; blockBegin < size; blockBegin += BlockSize)
+	{
+		const char* block = data + blockBegin;
+		size_t blockSize = size - blockBegin;
+		uint64_t validBytes = ~uint64_t(0);
+		if (blockSize < BlockSize)
+		{
+			std::memcpy(tailBlock, block, blockSize);
+			std::memset(tailBlock + blockSize, 0, BlockSize - blockSize);
+			block = tailBlock;
+			validBytes = (uint64_t(1) << blockSize) - 1;
+		}
+		else
+			blockSize = BlockSize;
+
+		BlockMasks masks = ScanBlock(block);
+		uint64_t nonSpace = ~masks.space & validBytes;
+		uint64_t lineEndingOrComment = masks.lineEnding | masks.comment;
+
+		size_t blockEnd = blockBegin + blockSize;
+		while (i < blockEnd)
+		{
+			uint64_t remaining = ~uint64_t(0) << (i - blockBegin);
+			uint64_t candidates = 0;
+			switch (state)
+			{
+				case State::LineStart:  candidates = nonSpace & remaining; break;
+				case State::InLine:     candidates = lineEndingOrComment & remaining; break;
+				case State::InComment:  candidates = masks.lineEnding & remaining; break;
+			}
+
+			// Nothing interesting is left in this block, so keep the current state for the next one.
+			if (candidates == 0)
+			{
+				i = blockEnd;
+				break;
+			}
+
+			i = blockBegin + std::countr_zero(candidates);
+			char c = data[i];
+
+			if (state == State::InLine)
+			{
+				// Let LineStart consume the line ending or comment.
+				addLine(lineBegin, i, lineNumber);
+				state = State::LineStart;
+			}
+			else if (IsLineEnding(c))
+			{
+				// A CRLF line ending counts as one line ending.
+				i += (c == '\r' && i + 1 < size && data[i + 1] == '\n') ? 2 : 1;
+				lineNumber++;
+				state = State::LineStart;
+			}
+			else if (state == State::LineStart)
+			{
+				if (c == ';')
+					state = State::InComment;
+				else
+				{
+					lineBegin = i;
+					state = State::InLine;
+				}
+				i++;
+			}
+		}
+	}
+
+	// The source may not end with a line ending.
+	if (state == State::InLine)
+		addLine(lineBegin, size, lineNumber);
+
+	return lineNumber;
+}
+
+size_t SourceScanner::FindLine(std::string_view source, size_t offset, std::span<const std::string_view> prefixes, size_t& lineNumber)
+{
+	const char* data = source.data();
+	size_t size = source.size();
+
+	// Like in SplitLines, but lines are only ever looked at up to their first non-blank character.
+	bool isLineStart = true;
+	size_t i = offset;
+	alignas(32) char tailBlock[BlockSize];
+
+	for (size_t blockBegin = offset; blockBegin < size; blockBegin += BlockSize)
+	{
+		const char* block = data + blockBegin;
+		size_t blockSize = size - blockBegin;
+		uint64_t validBytes = ~uint64_t(0);
+		if (blockSize < BlockSize)
+		{
+			std::memcpy(tailBlock, block, blockSize);
+			std::memset(tailBlock + blockSize, 0, BlockSize - blockSize);
+			block = tailBlock;
+			validBytes = (uint64_t(1) << blockSize) - 1;
+		}
+		else
+			blockSize = BlockSize;
+
+		BlockMasks masks = ScanBlock(block);
+		uint64_t nonSpace = ~masks.space & validBytes;
+
+		size_t blockEnd = blockBegin + blockSize;
+		while (i < blockEnd)
+		{
+			uint64_t remaining = ~uint64_t(0) << (i - blockBegin);
+			uint64_t candidates = (isLineStart ? nonSpace : masks.lineEnding) & remaining;
+			if (candidates == 0)
+			{
+				i = blockEnd;
+				break;
+			}
+
+			i = blockBegin + std::countr_zero(candidates);
+			char first = data[i];
+			if (isLineStart)
+				for (std::string_view prefix : prefixes)
+					if (first == prefix.front() && source.substr(i).starts_with(prefix))
+						return i;
+
+			if (IsLineEnding(first))
+			{
+				// A CRLF line ending counts as one line ending.
+				i += (first == '\r' && i + 1 < size && data[i + 1] == '\n') ? 2 : 1;
+				lineNumber++;
+				isLineStart = true;
+			}
+			else
+				isLineStart = false;
+		}
+	}
+
+	return size;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <string_view>
+#include <vector>
+
+struct SourceLine : std::string_view
+{
+	size_t number = 0;
+};
+
+class SourceScanner
+{
+public:
+	// Separates source into lines while ignoring preceding whitespace, trailing whitespace, and comments.
+	// Lines that are empty after that are not added. Line endings may be LF, CRLF, or CR, and may be mixed.
+	// Lines are numbered starting from firstLineNumber. Returns the number of the line after the last line ending.
+	static size_t SplitLines(std::string_view source, std::pmr::vector<SourceLine>& lines, size_t firstLineNumber = 1);
+
+	// Finds the first line that starts with one of prefixes after its leading whitespace, without splitting the lines
+	// before it, and returns the offset of the prefix, or the size of source if there's no such line. The search starts
+	// with the line that source[offset] is in, so offset must be at the start of a line, or after the last character
+	// of its content. lineNumber is incremented for every line ending that is passed.
+	static size_t FindLine(std::string_view source, size_t offset, std::span<const std::string_view> prefixes, size_t& lineNumber);
+public:
+	static constexpr size_t BlockSize = 64;
+
+	// One bit per byte of a block, the lsb being the first byte.
+	struct BlockMasks
+	{
+		uint64_t lineEnding = 0; // '\n' or '\r'
+		uint64_t comment = 0; // ';'
+		uint64_t space = 0; // ' ', '\t', '\v', or '\f'
+	};
+
+	// Classifies BlockSize bytes starting at block, 16 or 32 bytes at a time when SIMD is available.
+	static BlockMasks ScanBlock(const char* block) noexcept;
+private:
+	SourceScanner() = delete;
+	SourceScanner(const SourceScanner&) = delete;
+	SourceScanner(SourceScanner&&) = delete;
+	SourceScanner& operator=(const SourceScanner&) = delete;
+	SourceScanner& operator=(SourceScanner&&) = delete;
+	~SourceScanner() = delete;
+};
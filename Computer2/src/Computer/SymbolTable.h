@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// An open-addressing hash table from names to values.
+// Entries are stored densely in insertion order, so an entry's index never changes.
+// NOTE: the data each name points to must stay alive for as long as the table uses it.
+template<typename T>
+class SymbolTable
+{
+public:
+	using Index = uint32_t;
+	static constexpr Index InvalidIndex = ~Index(0);
+
+	struct Entry
+	{
+		std::string_view name;
+		T value{};
+	};
+public:
+	SymbolTable(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+		: entries(resource), slots(resource) {}
+
+	void Reserve(size_t count)
+	{
+		entries.reserve(count);
+		if (count * 2 > slots.size())
+			Rehash(count * 2);
+	}
+
+	// Returns the index of the entry named name, or InvalidIndex if there isn't one.
+	Index Find(std::string_view name) const noexcept
+	{
+		if (slots.empty())
+			return InvalidIndex;
+
+		uint32_t hash = Hash(name);
+		size_t mask = slots.size() - 1;
+		for (size_t i = hash & mask; ; i = (i + 1) & mask)
+		{
+			const Slot& slot = slots[i];
+			if (slot.index == InvalidIndex)
+				return InvalidIndex;
+			if (slot.hash == hash && entries[slot.index].name == name)
+				return slot.index;
+		}
+	}
+
+	// Adds an entry named name if there isn't one already.
+	// Returns the index of the entry named name and whether it was added.
+	std::pair<Index, bool> Insert(std::string_view name, const T& value = {})
+	{
+		// Keep the load factor at or below one half.
+		if ((entries.size() + 1) * 2 > slots.size())
+			Rehash(slots.empty() ? MinSlotCount : slots.size() * 2);
+
+		uint32_t hash = Hash(name);
+		size_t mask = slots.size() - 1;
+		for (size_t i = hash & mask; ; i = (i + 1) & mask)
+		{
+			Slot& slot = slots[i];
+			if (slot.index == InvalidIndex)
+			{
+				slot.hash = hash;
+				slot.index = static_cast<Index>(entries.size());
+				entries.emplace_back(name, value);
+				return { slot.index, true };
+			}
+			if (slot.hash == hash && entries[slot.index].name == name)
+				return { slot.index, false };
+		}
+	}
+
+	T* TryGet(std::string_view name) noexcept
+	{
+		Index index = Find(name);
+		return index != InvalidIndex ? &entries[index].value : nullptr;
+	}
+
+	const T* TryGet(std::string_view name) const noexcept
+	{
+		Index index = Find(name);
+		return index != InvalidIndex ? &entries[index].value : nullptr;
+	}
+
+	Entry& operator[](Index index) noexcept { return entries[index]; }
+	const Entry& operator[](Index index) const noexcept { return entries[index]; }
+
+	size_t Size() const noexcept { return entries.size(); }
+	bool Empty() const noexcept { return entries.empty(); }
+
+	void Clear() noexcept
+	{
+		entries.clear();
+		for (Slot& slot : slots)
+			slot.index = InvalidIndex;
+	}
+
+	auto begin() noexcept { return entries.begin(); }
+	auto end() noexcept { return entries.end(); }
+	auto begin() const noexcept { return entries.begin(); }
+	auto end() const noexcept { return entries.end(); }
+public:
+	// 32-bit FNV-1a.
+	static constexpr uint32_t Hash(std::string_view name) noexcept
+	{
+		uint32_t hash = 2166136261u;
+		for (char c : name)
+			hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+		return hash;
+	}
+private:
+	struct Slot
+	{
+		uint32_t hash = 0;
+		Index index = InvalidIndex;
+	};
+
+	static constexpr size_t MinSlotCount = 16;
+
+	void Rehash(size_t minSlotCount)
+	{
+		size_t slotCount = MinSlotCount;
+		while (slotCount < minSlotCount)
+			slotCount *= 2;
+
+		slots.assign(slotCount, Slot{});
+		size_t mask = slotCount - 1;
+		for (Index index = 0; index < entries.size(); index++)
+		{
+			uint32_t hash = Hash(entries[index].name);
+			size_t i = hash & mask;
+			while (slots[i].index != InvalidIndex)
+				i = (i + 1) & mask;
+			slots[i] = { hash, index };
+		}
+	}
+private:
+	std::pmr::vector<Entry> entries;
+	std::pmr::vector<Slot> slots;
+};
@@ -0,0 +1,120 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+// The pool and queue of the worker running on this thread, if any.
+static thread_local const ThreadPool* currentPool = nullptr;
+static thread_local size_t currentQueueIndex = 0;
+
+ThreadPool::ThreadPool(size_t threadCount)
+{
+	if (threadCount == 0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+	queues.reserve(threadCount + 1);
+	for (size_t i = 0; i < threadCount + 1; i++)
+		queues.push_back(std::make_unique<Queue>());
+
+	threads.reserve(threadCount);
+	for (size_t i = 0; i < threadCount; i++)
+		threads.emplace_back(&ThreadPool::Run, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	Wait();
+
+	{
+		std::scoped_lock lock(sleepMutex);
+		isStopping = true;
+	}
+	taskAvailable.notify_all();
+
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+void ThreadPool::Submit(Task task)
+{
+	// Threads that aren't workers of this pool share the last queue.
+	size_t queueIndex = currentPool == this ? currentQueueIndex : threads.size();
+	unfinishedTasks++;
+	queuedTasks++;
+	{
+		std::scoped_lock lock(queues[queueIndex]->mutex);
+		queues[queueIndex]->tasks.push_back(std::move(task));
+	}
+
+	// Taking the lock makes sure a worker that is about to sleep sees the new task.
+	{
+		std::scoped_lock lock(sleepMutex);
+	}
+	taskAvailable.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+	size_t queueIndex = currentPool == this ? currentQueueIndex : threads.size();
+	while (unfinishedTasks > 0)
+	{
+		if (TryRunTask(queueIndex))
+			continue;
+
+		std::unique_lock lock(sleepMutex);
+		allTasksFinished.wait(lock, [this]() { return unfinishedTasks == 0 || queuedTasks > 0; });
+	}
+}
+
+void ThreadPool::Run(size_t queueIndex)
+{
+	currentPool = this;
+	currentQueueIndex = queueIndex;
+
+	while (true)
+	{
+		if (TryRunTask(queueIndex))
+			continue;
+
+		std::unique_lock lock(sleepMutex);
+		taskAvailable.wait(lock, [this]() { return isStopping || queuedTasks > 0; });
+		if (isStopping)
+			return;
+	}
+}
+
+bool ThreadPool::TryRunTask(size_t queueIndex)
+{
+	Task task;
+	{
+		Queue& queue = *queues[queueIndex];
+		std::scoped_lock lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		}
+	}
+
+	for (size_t i = 1; !task && i < queues.size(); i++)
+	{
+		Queue& queue = *queues[(queueIndex + i) % queues.size()];
+		std::scoped_lock lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+	}
+
+	if (!task)
+		return false;
+
+	queuedTasks--;
+	task();
+
+	if (--unfinishedTasks == 0)
+	{
+		std::scoped_lock lock(sleepMutex);
+		allTasksFinished.notify_all();
+	}
+	return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A work-stealing thread pool.
+// Every worker has its own queue. Tasks submitted by a worker go to the back of its own queue, and each worker
+// runs its newest task first, so recursively submitted work stays on the thread that found it. Idle workers
+// steal the oldest task of another worker.
+class ThreadPool
+{
+public:
+	using Task = std::function<void()>;
+public:
+	// A threadCount of 0 uses one thread per hardware thread.
+	ThreadPool(size_t threadCount = 0);
+	// Waits for every task to finish first.
+	~ThreadPool();
+
+	// May be called from any thread, including from tasks.
+	void Submit(Task task);
+
+	// Waits until every submitted task, including the tasks they submit, has finished.
+	// The calling thread runs tasks too while it waits.
+	void Wait();
+
+	size_t GetThreadCount() const noexcept { return threads.size(); }
+private:
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+private:
+	void Run(size_t queueIndex);
+	// Runs one task, taken from the back of queueIndex's queue or stolen from the front of another one.
+	bool TryRunTask(size_t queueIndex);
+private:
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool(ThreadPool&&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	ThreadPool& operator=(ThreadPool&&) = delete;
+private:
+	// One queue per worker, plus one for every other thread.
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> threads;
+	std::atomic<size_t> queuedTasks = 0;
+	std::atomic<size_t> unfinishedTasks = 0;
+	std::mutex sleepMutex;
+	std::condition_variable taskAvailable;
+	std::condition_variable allTasksFinished;
+	bool isStopping = false;
+};
@@ -0,0 +1,77 @@
+#include "TokenStream.h"
+#include "CharacterClass.h"
+
+AssemblerReturnCode TokenStream::Append(const SourceLine& line)
+{
+	TokenizedLine& tokenizedLine = lines.emplace_back();
+	tokenizedLine.tokenOffset = static_cast<uint32_t>(tokens.size());
+	tokenizedLine.number = line.number;
+
+	// If the line could be a label definition, it's validated when the label is defined.
+	if (line.ends_with(':'))
+	{
+		tokenizedLine.isLabel = true;
+		tokens.push_back(line);
+	}
+	else if (AssemblerReturnCode returnCode = Tokenize(line); returnCode != AssemblerReturnCode_Success)
+		return returnCode;
+
+	tokenizedLine.tokenCount = static_cast<uint32_t>(tokens.size() - tokenizedLine.tokenOffset);
+	return AssemblerReturnCode_Success;
+}
+
+AssemblerReturnCode TokenStream::Tokenize(std::string_view line)
+{
+	size_t i = 0;
+
+	// Find the end of the first token.
+	while (i < line.size() && !IsWhitespace(line[i]))
+		i++;
+
+	tokens.push_back(line.substr(0, i));
+
+	// Find the rest of the tokens.
+	while (i < line.size())
+	{
+		// Find the start of the current token.
+		do i++;
+		while (i < line.size() && IsWhitespace(line[i]));
+
+		size_t operandStart = i;
+
+		// Find the end of the current token, accounting for string literals.
+		bool inQuote = false;
+		bool isEscaped = false;
+		for (; i < line.size(); i++)
+		{
+			char c = line[i];
+			if (inQuote)
+			{
+				if (c == '"' && !isEscaped)
+					inQuote = false;
+				else
+					isEscaped = c == '\\' && !isEscaped;
+			}
+			else if (c == '"')
+				inQuote = true;
+			else if (IsOperandDelimiter(c))
+				break;
+		}
+
+		if (inQuote || isEscaped)
+			return AssemblerReturnCode_InvalidStringLiteral;
+
+		// Remove whitespace between the operand and its delimiter.
+		size_t operandEnd = i;
+		while (operandEnd > operandStart && IsBlank(line[operandEnd - 1]))
+			operandEnd--;
+
+		size_t operandLength = operandEnd - operandStart;
+		if (operandLength == 0)
+			return AssemblerReturnCode_InvalidOperand;
+
+		tokens.push_back(line.substr(operandStart, operandLength));
+	}
+
+	return AssemblerReturnCode_Success;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Assembler.h"
+#include "SourceScanner.h"
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <string_view>
+#include <vector>
+
+struct TokenizedLine
+{
+	uint32_t tokenOffset = 0;
+	uint32_t tokenCount = 0;
+	size_t number = 0;
+	// Label definitions are stored as a single token holding the whole line.
+	bool isLabel = false;
+};
+
+// Every token of every line, stored contiguously. Each line refers to its tokens by offset and count.
+// NOTE: tokens are views of the source they were tokenized from.
+struct TokenStream
+{
+	std::pmr::vector<std::string_view> tokens;
+	std::pmr::vector<TokenizedLine> lines;
+
+	TokenStream(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+		: tokens(resource), lines(resource) {}
+
+	// Splits line into its first token and its comma separated operands, and appends it.
+	AssemblerReturnCode Append(const SourceLine& line);
+
+	std::span<const std::string_view> GetTokens(const TokenizedLine& line) const noexcept
+	{
+		return { tokens.data() + line.tokenOffset, line.tokenCount };
+	}
+
+	void Clear() noexcept
+	{
+		tokens.clear();
+		lines.clear();
+	}
+private:
+	AssemblerReturnCode Tokenize(std::string_view line);
+};
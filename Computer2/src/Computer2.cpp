@@ -1,5 +1,6 @@
 #include "Computer2.h"
 #include "Computer/Assembler.h"
+#include "Computer/SourceFile.h"
 
 Computer2::Computer2() : olc::PixelGameEngine()
 {
@@ -8,18 +9,9 @@ Computer2::Computer2() : olc::PixelGameEngine()
 
 bool Computer2::OnUserCreate()
 {
-	std::string testProgramSource;
-	{
-		std::ifstream testProgramFile("./test/test_program.asm");
-		if (testProgramFile.is_open())
-		{
-			std::stringstream testProgramStream;
-			testProgramStream << testProgramFile.rdbuf();
-			testProgramFile.close();
-			testProgramSource = testProgramStream.str();
-		}
-	}
-	Assembler::Assemble(testProgramSource);
+	const char* testProgramPath = "./test/test_program.asm";
+	SourceFile testProgramFile(testProgramPath);
+	Assembler::Assemble(testProgramFile.GetSource(), testProgramPath);
 
 	return true;
 }
@@ -0,0 +1,4 @@
+; Uses the constants from other_file.inc.
+
+protected Screen:
+	.word SCREEN, SCREEN + SCREEN_SIZE
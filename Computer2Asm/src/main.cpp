@@ -0,0 +1,384 @@
+// Assembles many sources at once, without the rest of Computer2, e.g. for a regression corpus:
+//   Computer2Asm [options] <source | @manifest>...
+// Sources are spread over every core, biggest first, and idle threads steal whatever is left, see ThreadPool.
+// Each source that assembles is written as a flat image of the whole address space, see Assembler::AssembleImage(),
+// and every failure is reported on stderr, in the order the sources were given.
+
+#include "Computer/Assembler.h"
+#include "Computer/SourceFile.h"
+#include "Computer/ThreadPool.h"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+static constexpr std::string_view ImageExtension = ".bin";
+// The buffer each thread assembles in, see Assemble().
+static constexpr size_t ArenaSize = 1 << 20;
+
+static constexpr std::string_view Usage =
+	"Usage: Computer2Asm [options] <source | @manifest>...\n"
+	"\n"
+	"Assembles every source into a 64 KiB image named after it, with the extension .bin.\n"
+	"A manifest lists one source per line, relative to the manifest. Lines starting with # are ignored.\n"
+	"\n"
+	"Options:\n"
+	"  -o, --output <directory>  Write images to directory, instead of next to their sources.\n"
+	"  -j, --jobs <count>        Assemble on count threads, instead of one per hardware thread.\n"
+	"  -O, --optimize            Run every pass of the peephole optimizer, and report what it deleted\n"
+	"                            in one line, or by pass with --stats.\n"
+	"  -q, --quiet               Only report failures.\n"
+	"      --stats               Report how long each phase of assembling took, which slows it down,\n"
+	"                            and what it allocated.\n"
+	"  -h, --help                Show this.\n";
+
+struct Options
+{
+	std::vector<std::filesystem::path> sources;
+	std::filesystem::path outputDirectory;
+	size_t threadCount = 0;
+	AssemblerPasses passes = 0;
+	bool isQuiet = false;
+	bool reportStats = false;
+};
+
+// What assembling one source did.
+struct Result
+{
+	std::filesystem::path source;
+	std::filesystem::path image;
+	uintmax_t sourceSize = 0;
+	AssemblerReturnCode returnCode = AssemblerReturnCode_Success;
+	size_t lineNumber = 0;
+	bool isWritten = false;
+	AssemblerStats stats;
+	std::array<AssemblerPassStats, AssemblerPass_Count> passStats{};
+};
+
+static std::string_view GetReturnCodeName(AssemblerReturnCode returnCode)
+{
+	switch (returnCode)
+	{
+		case AssemblerReturnCode_Success:                  return "success";
+		case AssemblerReturnCode_EffectivelyEmptySource:   return "effectively empty source";
+		case AssemblerReturnCode_EmptyLabelDefinition:     return "empty label definition";
+		case AssemblerReturnCode_InvalidLabelDefinition:   return "invalid label definition";
+		case AssemblerReturnCode_DuplicateLabelDefinition: return "duplicate label definition";
+		case AssemblerReturnCode_InvalidDirective:         return "invalid directive";
+		case AssemblerReturnCode_InvalidOperand:           return "invalid operand";
+		case AssemblerReturnCode_InvalidStringLiteral:     return "invalid string literal";
+		case AssemblerReturnCode_InvalidOperandCount:      return "invalid operand count";
+		case AssemblerReturnCode_OperandOutOfRange:        return "operand out of range";
+		case AssemblerReturnCode_UndefinedSymbol:          return "undefined symbol";
+		case AssemblerReturnCode_AddressOverflow:          return "address overflow";
+		case AssemblerReturnCode_InvalidExpression:        return "invalid expression";
+		case AssemblerReturnCode_DivisionByZero:           return "division by zero";
+		case AssemblerReturnCode_DuplicateDefine:          return "duplicate define";
+		case AssemblerReturnCode_CircularDefine:           return "circular define";
+		case AssemblerReturnCode_InvalidMacroDefinition:   return "invalid macro definition";
+		case AssemblerReturnCode_DuplicateMacroDefinition: return "duplicate macro definition";
+		case AssemblerReturnCode_UnterminatedMacro:        return "unterminated macro";
+		case AssemblerReturnCode_MacroNestingTooDeep:      return "macro nesting too deep";
+		case AssemblerReturnCode_IncludeNotFound:          return "include not found";
+		case AssemblerReturnCode_CircularInclude:          return "circular include";
+		case AssemblerReturnCode_InaccessibleLabel:        return "inaccessible label";
+		case AssemblerReturnCode_UnmatchedConditional:     return "unmatched conditional";
+		case AssemblerReturnCode_UnterminatedConditional:  return "unterminated conditional";
+		case AssemblerReturnCode_InvalidObject:            return "invalid object";
+		case AssemblerReturnCode_OverlappingSections:      return "overlapping sections";
+		case AssemblerReturnCode_SourceNotFound:           return "source not found";
+		case AssemblerReturnCode_ServiceUnavailable:       return "service unavailable";
+		case AssemblerReturnCode_InvalidRequest:           return "invalid request";
+		case AssemblerReturnCode_InvalidMnemonic:          return "invalid mnemonic";
+	}
+	return "unknown error";
+}
+
+static bool IsWarning(AssemblerReturnCode returnCode)
+{
+	return returnCode >= AssemblerReturnCode_EffectivelyEmptySource && returnCode < AssemblerReturnCode_EmptyLabelDefinition;
+}
+
+// Adds every source that the manifest at path lists. Returns false if it can't be read.
+static bool ReadManifest(const std::filesystem::path& path, std::vector<std::filesystem::path>& sources)
+{
+	SourceFile manifest(path);
+	if (!manifest)
+		return false;
+
+	std::string_view text = manifest.GetSource();
+	while (!text.empty())
+	{
+		size_t lineEnd = std::min(text.find_first_of("\r\n"), text.size());
+		std::string_view line = text.substr(0, lineEnd);
+		text.remove_prefix(std::min(lineEnd + 1, text.size()));
+
+		while (!line.empty() && (line.front() == ' ' || line.front() == '\t'))
+			line.remove_prefix(1);
+		while (!line.empty() && (line.back() == ' ' || line.back() == '\t'))
+			line.remove_suffix(1);
+		if (line.empty() || line.front() == '#')
+			continue;
+
+		std::filesystem::path source(std::u8string_view(reinterpret_cast<const char8_t*>(line.data()), line.size()));
+		sources.push_back(source.is_absolute() ? source : path.parent_path() / source);
+	}
+	return true;
+}
+
+// Returns false, after reporting why, if the arguments aren't valid.
+static bool ParseArguments(int argc, char** argv, Options& options, bool& showUsage)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string_view argument = argv[i];
+		auto getValue = [&](std::string_view& value)
+		{
+			if (i + 1 >= argc)
+			{
+				std::fprintf(stderr, "error: %s needs a value\n", argv[i]);
+				return false;
+			}
+			value = argv[++i];
+			return true;
+		};
+
+		std::string_view value;
+		if (argument == "-h" || argument == "--help")
+			showUsage = true;
+		else if (argument == "-o" || argument == "--output")
+		{
+			if (!getValue(value))
+				return false;
+			options.outputDirectory = value;
+		}
+		else if (argument == "-j" || argument == "--jobs")
+		{
+			if (!getValue(value))
+				return false;
+			auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), options.threadCount);
+			if (error != std::errc() || end != value.data() + value.size())
+			{
+				std::fprintf(stderr, "error: invalid thread count '%s'\n", argv[i]);
+				return false;
+			}
+		}
+		else if (argument == "-O" || argument == "--optimize")
+			options.passes = AllAssemblerPasses;
+		else if (argument == "-q" || argument == "--quiet")
+			options.isQuiet = true;
+		else if (argument == "--stats")
+			options.reportStats = true;
+		else if (argument.size() > 1 && argument.front() == '@')
+		{
+			std::filesystem::path manifest = argument.substr(1);
+			if (!ReadManifest(manifest, options.sources))
+			{
+				std::fprintf(stderr, "error: can't read manifest '%s'\n", manifest.string().c_str());
+				return false;
+			}
+		}
+		else if (argument.size() > 1 && argument.front() == '-')
+		{
+			std::fprintf(stderr, "error: unknown option '%s'\n", argv[i]);
+			return false;
+		}
+		else
+			options.sources.emplace_back(argument);
+	}
+	return true;
+}
+
+static void Assemble(Result& result, AssemblerPasses passes, bool reportStats)
+{
+	SourceFile sourceFile(result.source);
+	if (!sourceFile)
+	{
+		result.returnCode = AssemblerReturnCode_SourceNotFound;
+		return;
+	}
+	result.sourceSize = sourceFile.GetSource().size();
+
+	std::vector<uint8_t> memory(AssemblerImage::Size);
+	AssemblerImage image(std::span<uint8_t, AssemblerImage::Size>(memory.data(), AssemblerImage::Size));
+	// Every source a thread assembles reuses its buffer, so only sources that outgrow it go to the heap.
+	thread_local std::vector<std::byte> arenaBuffer(ArenaSize);
+	std::pmr::monotonic_buffer_resource arena(arenaBuffer.data(), arenaBuffer.size());
+	AssemblerOutput output = Assembler::AssembleImage(sourceFile.GetSource(), image, result.source, passes,
+		reportStats ? &result.stats : nullptr, &arena);
+	result.returnCode = output.returnCode;
+	result.lineNumber = output.lineNumber;
+	result.passStats = output.passStats;
+	if (!output)
+		return;
+
+	std::ofstream file(result.image, std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char*>(memory.data()), static_cast<std::streamsize>(memory.size()));
+	result.isWritten = static_cast<bool>(file);
+}
+
+static double ToMilliseconds(uint64_t nanoseconds)
+{
+	return static_cast<double>(nanoseconds) / 1e6;
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	bool showUsage = argc < 2;
+	if (!ParseArguments(argc, argv, options, showUsage))
+		return 2;
+	if (showUsage)
+	{
+		std::fputs(Usage.data(), stdout);
+		return 0;
+	}
+	if (options.sources.empty())
+	{
+		std::fputs("error: no sources\n", stderr);
+		return 2;
+	}
+
+	std::error_code error;
+	if (!options.outputDirectory.empty() && !std::filesystem::create_directories(options.outputDirectory, error) && error)
+	{
+		std::fprintf(stderr, "error: can't create output directory '%s'\n", options.outputDirectory.string().c_str());
+		return 2;
+	}
+
+	// Two sources written to the same image would overwrite each other.
+	std::vector<Result> results(options.sources.size());
+	std::unordered_set<std::string> images;
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		Result& result = results[i];
+		result.source = options.sources[i];
+		result.image = options.outputDirectory.empty() ? result.source : options.outputDirectory / result.source.filename();
+		result.image.replace_extension(ImageExtension);
+		if (!images.insert(std::filesystem::weakly_canonical(result.image, error).string()).second)
+		{
+			std::fprintf(stderr, "error: more than one source would be written to '%s'\n", result.image.string().c_str());
+			return 2;
+		}
+		// A source that can't be read fails on its own, and counts as empty.
+		result.sourceSize = std::filesystem::file_size(result.source, error);
+		if (error)
+			result.sourceSize = 0;
+	}
+
+	// Tasks are taken oldest first, so submitting the biggest sources first keeps one big source from being
+	// left for the end, while every other thread is idle.
+	std::vector<Result*> order(results.size());
+	for (size_t i = 0; i < results.size(); i++)
+		order[i] = &results[i];
+	std::ranges::stable_sort(order, std::ranges::greater(), &Result::sourceSize);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	ThreadPool threadPool(options.threadCount);
+	for (Result* result : order)
+		threadPool.Submit([result, &options]() { Assemble(*result, options.passes, options.reportStats); });
+	threadPool.Wait();
+	uint64_t wallNanoseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+	size_t writtenCount = 0;
+	size_t failedCount = 0;
+	uintmax_t sourceSize = 0;
+	AssemblerStats stats;
+	std::array<AssemblerPassStats, AssemblerPass_Count> passStats{};
+	for (const Result& result : results)
+	{
+		std::string source = result.source.string();
+		sourceSize += result.sourceSize;
+		writtenCount += result.isWritten ? 1 : 0;
+		for (size_t i = 0; i < AssemblerPhase_Count; i++)
+		{
+			stats.nanoseconds[i] += result.stats.nanoseconds[i];
+			stats.allocatedBytes[i] += result.stats.allocatedBytes[i];
+			stats.allocations[i] += result.stats.allocations[i];
+		}
+		for (size_t i = 0; i < passStats.size(); i++)
+		{
+			passStats[i].instructions += result.passStats[i].instructions;
+			passStats[i].bytes += result.passStats[i].bytes;
+			passStats[i].cycles += result.passStats[i].cycles;
+		}
+
+		if (result.returnCode == AssemblerReturnCode_Success && !result.isWritten)
+		{
+			std::fprintf(stderr, "%s: error: can't write image '%s'\n", source.c_str(), result.image.string().c_str());
+			failedCount++;
+		}
+		else if (IsWarning(result.returnCode))
+		{
+			if (!options.isQuiet)
+				std::fprintf(stderr, "%s: warning: %s\n", source.c_str(), GetReturnCodeName(result.returnCode).data());
+		}
+		else if (result.returnCode != AssemblerReturnCode_Success)
+		{
+			if (result.lineNumber != 0)
+				std::fprintf(stderr, "%s:%zu: error: %s\n", source.c_str(), result.lineNumber, GetReturnCodeName(result.returnCode).data());
+			else
+				std::fprintf(stderr, "%s: error: %s\n", source.c_str(), GetReturnCodeName(result.returnCode).data());
+			failedCount++;
+		}
+	}
+
+	if (!options.isQuiet)
+		std::printf("%zu assembled, %zu failed, in %.2f ms on %zu threads\n", writtenCount, failedCount,
+			ToMilliseconds(wallNanoseconds), threadPool.GetThreadCount());
+
+	constexpr const char* PassNames[AssemblerPass_Count] = { "self moves", "dead loads", "dead compares", "unreachable" };
+	if (options.passes != 0 && !options.isQuiet && !options.reportStats)
+	{
+		AssemblerPassStats total;
+		std::string byPass;
+		for (size_t i = 0; i < AssemblerPass_Count; i++)
+		{
+			total.instructions += passStats[i].instructions;
+			total.bytes += passStats[i].bytes;
+			total.cycles += passStats[i].cycles;
+			byPass += (i != 0 ? ", " : "") + std::string(PassNames[i]) + " " + std::to_string(passStats[i].instructions);
+		}
+		std::printf("optimized away %u instructions, %u bytes, %u cycles (%s)\n", total.instructions, total.bytes, total.cycles, byPass.c_str());
+	}
+
+	if (options.reportStats)
+	{
+		// Phases add up across threads, so they're shown as shares of the total, next to the wall time.
+		constexpr const char* PhaseNames[AssemblerPhase_Count] = { "split", "tokenize", "preprocess", "encode" };
+		uint64_t totalNanoseconds = 0;
+		for (uint64_t nanoseconds : stats.nanoseconds)
+			totalNanoseconds += nanoseconds;
+
+		uint64_t totalAllocatedBytes = 0;
+		uint64_t totalAllocations = 0;
+		for (size_t i = 0; i < AssemblerPhase_Count; i++)
+		{
+			totalAllocatedBytes += stats.allocatedBytes[i];
+			totalAllocations += stats.allocations[i];
+		}
+
+		std::printf("%-12s %12s %8s %14s %12s\n", "phase", "ms", "share", "bytes", "allocations");
+		for (size_t i = 0; i < AssemblerPhase_Count; i++)
+			std::printf("%-12s %12.3f %7.1f%% %14ju %12ju\n", PhaseNames[i], ToMilliseconds(stats.nanoseconds[i]),
+				totalNanoseconds != 0 ? 100.0 * static_cast<double>(stats.nanoseconds[i]) / static_cast<double>(totalNanoseconds) : 0.0,
+				static_cast<uintmax_t>(stats.allocatedBytes[i]), static_cast<uintmax_t>(stats.allocations[i]));
+		std::printf("%-12s %12.3f %8s %14ju %12ju\n", "total", ToMilliseconds(totalNanoseconds), "",
+			static_cast<uintmax_t>(totalAllocatedBytes), static_cast<uintmax_t>(totalAllocations));
+		std::printf("%ju source bytes, %.1f MB/s\n", sourceSize,
+			wallNanoseconds != 0 ? static_cast<double>(sourceSize) * 1e3 / static_cast<double>(wallNanoseconds) : 0.0);
+
+		if (options.passes != 0)
+			for (size_t i = 0; i < AssemblerPass_Count; i++)
+				std::printf("%-14s %u instructions, %u bytes, %u cycles\n", PassNames[i], passStats[i].instructions, passStats[i].bytes, passStats[i].cycles);
+	}
+	return failedCount != 0 ? 1 : 0;
+}
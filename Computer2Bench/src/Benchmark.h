@@ -0,0 +1,95 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+
+// A benchmark, which prints its own results, see main.cpp.
+struct Benchmark
+{
+	std::string_view name;
+	void (*function)() = nullptr;
+};
+
+class Benchmarks
+{
+public:
+	// Adds benchmark to the ones main() runs. Returns true, so it can initialize a static.
+	static bool Register(std::string_view name, void (*function)());
+	static void RunAll(std::string_view filter);
+private:
+	Benchmarks() = delete;
+	Benchmarks(const Benchmarks&) = delete;
+	Benchmarks(Benchmarks&&) = delete;
+	Benchmarks& operator=(const Benchmarks&) = delete;
+	Benchmarks& operator=(Benchmarks&&) = delete;
+	~Benchmarks() = delete;
+};
+
+#define BENCHMARK(name) \
+	static void name##Benchmark(); \
+	static const bool name##BenchmarkIsRegistered = Benchmarks::Register(#name, name##Benchmark); \
+	static void name##Benchmark()
+
+inline const void* volatile KeepAliveSink = nullptr;
+
+// Keeps the compiler from optimizing away the computation of value.
+template<typename T>
+inline void KeepAlive(const T& value)
+{
+	KeepAliveSink = &value;
+}
+
+// Runs function repetitions times, and returns the fastest run in nanoseconds. The best run is the one with the
+// least interference from the rest of the system, so it's the most repeatable.
+template<typename Function>
+uint64_t MeasureNanoseconds(Function&& function, size_t repetitions = 5)
+{
+	uint64_t best = UINT64_MAX;
+	for (size_t i = 0; i < repetitions; i++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		function();
+		uint64_t nanoseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+		if (nanoseconds < best)
+			best = nanoseconds;
+	}
+	return best;
+}
+
+// Passes allocations through to upstream, and counts them.
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+	size_t allocations = 0;
+	size_t allocatedBytes = 0;
+public:
+	CountingResource(std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+		: upstream(upstream) {}
+private:
+	void* do_allocate(size_t bytes, size_t alignment) override
+	{
+		allocations++;
+		allocatedBytes += bytes;
+		return upstream->allocate(bytes, alignment);
+	}
+
+	void do_deallocate(void* pointer, size_t bytes, size_t alignment) override
+	{
+		upstream->deallocate(pointer, bytes, alignment);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+		return this == &other;
+	}
+private:
+	std::pmr::memory_resource* upstream;
+};
+
+inline double ToMegabytesPerSecond(size_t bytes, uint64_t nanoseconds)
+{
+	return nanoseconds != 0 ? static_cast<double>(bytes) * 1e3 / static_cast<double>(nanoseconds) : 0.0;
+}
@@ -0,0 +1,95 @@
+#include "Benchmark.h"
+#include "Computer/CharacterClass.h"
+#include <cctype>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// What the tokenizer classifies most: identifiers, and the whitespace around operands.
+static std::vector<std::string> GenerateTokens(size_t count)
+{
+	std::vector<std::string> tokens(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		switch (i % 4)
+		{
+			case 0: tokens[i] = "  Label_" + std::to_string(i) + "\t"; break;
+			case 1: tokens[i] = "\tloop.inner" + std::to_string(i % 100) + " "; break;
+			case 2: tokens[i] = " 0x" + std::to_string(i % 10000) + "  "; break;
+			default: tokens[i] = "\t_Main "; break;
+		}
+	}
+	return tokens;
+}
+
+// Trims token, checks whether it's an identifier, and lowercases it, like mnemonics and labels are handled.
+template<bool UseTable>
+static size_t Classify(const std::vector<std::string>& tokens)
+{
+	size_t identifiers = 0;
+	size_t lowercaseSum = 0;
+	for (const std::string& token : tokens)
+	{
+		size_t begin = 0;
+		size_t end = token.size();
+		if constexpr (UseTable)
+		{
+			while (begin < end && IsWhitespace(token[begin]))
+				begin++;
+			while (end > begin && IsBlank(token[end - 1]))
+				end--;
+		}
+		else
+		{
+			while (begin < end && std::isspace(static_cast<unsigned char>(token[begin])))
+				begin++;
+			while (end > begin && std::isblank(static_cast<unsigned char>(token[end - 1])))
+				end--;
+		}
+		if (begin == end)
+			continue;
+
+		bool isIdentifier = true;
+		if constexpr (UseTable)
+		{
+			isIdentifier = IsIdentifierStart(token[begin]);
+			for (size_t i = begin + 1; i < end && isIdentifier; i++)
+				isIdentifier = IsIdentifierContinue(token[i]);
+			for (size_t i = begin; i < end; i++)
+				lowercaseSum += static_cast<uint8_t>(ToLower(token[i]));
+		}
+		else
+		{
+			unsigned char first = static_cast<unsigned char>(token[begin]);
+			isIdentifier = std::isalpha(first) || first == '_';
+			for (size_t i = begin + 1; i < end && isIdentifier; i++)
+			{
+				unsigned char c = static_cast<unsigned char>(token[i]);
+				isIdentifier = std::isalnum(c) || c == '_' || c == '.';
+			}
+			for (size_t i = begin; i < end; i++)
+				lowercaseSum += static_cast<uint8_t>(std::tolower(static_cast<unsigned char>(token[i])));
+		}
+		identifiers += isIdentifier ? 1 : 0;
+	}
+	return identifiers + lowercaseSum;
+}
+
+BENCHMARK(CharacterClass)
+{
+	std::vector<std::string> tokens = GenerateTokens(1'000'000);
+	size_t bytes = 0;
+	for (const std::string& token : tokens)
+		bytes += token.size();
+
+	size_t localeResult = 0;
+	size_t tableResult = 0;
+	uint64_t localeNanoseconds = MeasureNanoseconds([&]() { localeResult = Classify<false>(tokens); });
+	uint64_t tableNanoseconds = MeasureNanoseconds([&]() { tableResult = Classify<true>(tokens); });
+
+	std::printf("  %zu tokens, %zu bytes: trim, identifier check, and lowercase\n", tokens.size(), bytes);
+	std::printf("  %-24s %10.1f MB/s\n", "<cctype>", ToMegabytesPerSecond(bytes, localeNanoseconds));
+	std::printf("  %-24s %10.1f MB/s\n", "CharacterClassTable", ToMegabytesPerSecond(bytes, tableNanoseconds));
+	if (localeResult != tableResult)
+		std::printf("  results differ: %zu and %zu\n", localeResult, tableResult);
+}
@@ -0,0 +1,50 @@
+#include "Benchmark.h"
+#include "Computer/Assembler.h"
+#include <cstdio>
+#include <string>
+
+// activeLineCount lines that are assembled, with every block of them followed by a block that a false .if skips,
+// the way configuration headers disable most of what they contain.
+static std::string GenerateSource(size_t activeLineCount, size_t inactiveLineCount)
+{
+	constexpr size_t BlockCount = 100;
+
+	std::string source;
+	for (size_t block = 0; block < BlockCount; block++)
+	{
+		for (size_t i = 0; i < activeLineCount / BlockCount; i++)
+			source += "\tmvr a, b\n";
+
+		source += ".if DISABLED\n";
+		for (size_t i = 0; i < inactiveLineCount / BlockCount; i++)
+			source += (i & 1) != 0 ? "\tldi b, 17 + 6\n" : "\tsto [0x1234], a\n";
+		source += ".else\n\tnop\n.endif\n";
+	}
+	return ".define DISABLED, 0\n" + source;
+}
+
+BENCHMARK(Conditional)
+{
+	// The active lines stay the same, so assembling should cost about the same however many lines are skipped.
+	constexpr size_t ActiveLineCount = 20'000;
+
+	std::printf("  %-14s %12s %10s %14s %16s\n", "inactive lines", "source MB", "ms", "ns/active line", "skipped MB/s");
+	uint64_t baseNanoseconds = 0;
+	for (size_t inactiveLineCount : { 0, 20'000, 200'000, 2'000'000 })
+	{
+		std::string source = GenerateSource(ActiveLineCount, inactiveLineCount);
+		if (!Assembler::Assemble(source))
+		{
+			std::printf("  %-14zu failed to assemble\n", inactiveLineCount);
+			continue;
+		}
+
+		uint64_t nanoseconds = MeasureNanoseconds([&]() { KeepAlive(Assembler::Assemble(source)); });
+		if (inactiveLineCount == 0)
+			baseNanoseconds = nanoseconds;
+		size_t skippedBytes = source.size() - GenerateSource(ActiveLineCount, 0).size();
+		double skipped = inactiveLineCount != 0 && nanoseconds > baseNanoseconds ? ToMegabytesPerSecond(skippedBytes, nanoseconds - baseNanoseconds) : 0.0;
+		std::printf("  %-14zu %12.2f %10.2f %14.1f %16.0f\n", inactiveLineCount, static_cast<double>(source.size()) / 1e6,
+			static_cast<double>(nanoseconds) / 1e6, static_cast<double>(nanoseconds) / static_cast<double>(ActiveLineCount), skipped);
+	}
+}
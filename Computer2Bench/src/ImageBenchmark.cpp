@@ -0,0 +1,101 @@
+#include "Benchmark.h"
+#include "Computer/Assembler.h"
+#include "Computer/ThreadPool.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// A program that emits every byte of the address space, in sectionCount sections of the same size.
+static std::string GenerateSource(size_t sectionCount)
+{
+	size_t sectionSize = AssemblerImage::Size / sectionCount;
+	std::string source;
+	for (size_t section = 0; section < sectionCount; section++)
+	{
+		source += ".origin " + std::to_string(section * sectionSize) + "\n";
+		for (size_t i = 0; i < sectionSize; i += 8)
+			source += "\t.byte 1, 2, 3, 4, 5, 6, 7, 8\n";
+	}
+	return source;
+}
+
+// Loads an output into memory the way the emulator would without AssembleImage(): a copy per section.
+static void LoadSections(const AssemblerOutput& output, std::span<uint8_t> memory)
+{
+	for (const AssemblerProgramSection& section : output.sections)
+		std::copy(section.assembly.begin(), section.assembly.end(), memory.begin() + section.origin);
+}
+
+BENCHMARK(Image)
+{
+	std::vector<uint8_t> memory(AssemblerImage::Size);
+	AssemblerImage image(std::span<uint8_t, AssemblerImage::Size>(memory.data(), memory.size()));
+
+	std::printf("  %-9s %14s %12s %14s\n", "sections", "sections ms", "load us", "image ms");
+	for (size_t sectionCount : { 1, 16, 256, 4096 })
+	{
+		std::string source = GenerateSource(sectionCount);
+		AssemblerOutput output = Assembler::Assemble(source);
+		image.ClearWritten();
+		if (!output || !Assembler::AssembleImage(source, image))
+		{
+			std::printf("  %-9zu failed to assemble\n", sectionCount);
+			continue;
+		}
+
+		uint64_t sectionsNanoseconds = MeasureNanoseconds([&]()
+		{
+			AssemblerOutput sectionOutput = Assembler::Assemble(source);
+			LoadSections(sectionOutput, memory);
+			KeepAlive(sectionOutput);
+		});
+		uint64_t loadNanoseconds = MeasureNanoseconds([&]() { LoadSections(output, memory); KeepAlive(memory); });
+		uint64_t imageNanoseconds = MeasureNanoseconds([&]()
+		{
+			image.ClearWritten();
+			KeepAlive(Assembler::AssembleImage(source, image));
+		});
+		std::printf("  %-9zu %14.2f %12.1f %14.2f\n", sectionCount, static_cast<double>(sectionsNanoseconds) / 1e6,
+			static_cast<double>(loadNanoseconds) / 1e3, static_cast<double>(imageNanoseconds) / 1e6);
+	}
+}
+
+BENCHMARK(ImageBatch)
+{
+	// Like Computer2Asm, every program is assembled into an image of its own, one task per program.
+	constexpr size_t ProgramCount = 64;
+	std::string source = GenerateSource(16);
+	std::vector<std::vector<uint8_t>> memories(ProgramCount, std::vector<uint8_t>(AssemblerImage::Size));
+	auto assembleProgram = [&](size_t i)
+	{
+		AssemblerImage image(std::span<uint8_t, AssemblerImage::Size>(memories[i].data(), memories[i].size()));
+		return Assembler::AssembleImage(source, image);
+	};
+	if (!assembleProgram(0))
+	{
+		std::printf("  failed to assemble\n");
+		return;
+	}
+
+	uint64_t serialNanoseconds = MeasureNanoseconds([&]()
+	{
+		for (size_t i = 0; i < ProgramCount; i++)
+			KeepAlive(assembleProgram(i));
+	}, 3);
+
+	std::printf("  %-8s %10s %10s\n", "threads", "ms", "speedup");
+	std::printf("  %-8s %10.2f %10.2f\n", "serial", static_cast<double>(serialNanoseconds) / 1e6, 1.0);
+	for (size_t threadCount : { 1, 2, 4, 8 })
+	{
+		ThreadPool threadPool(threadCount);
+		uint64_t nanoseconds = MeasureNanoseconds([&]()
+		{
+			for (size_t i = 0; i < ProgramCount; i++)
+				threadPool.Submit([&, i]() { KeepAlive(assembleProgram(i)); });
+			threadPool.Wait();
+		}, 3);
+		std::printf("  %-8zu %10.2f %10.2f\n", threadCount, static_cast<double>(nanoseconds) / 1e6,
+			static_cast<double>(serialNanoseconds) / static_cast<double>(std::max<uint64_t>(nanoseconds, 1)));
+	}
+}
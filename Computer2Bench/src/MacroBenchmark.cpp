@@ -0,0 +1,65 @@
+#include "Benchmark.h"
+#include "Computer/Assembler.h"
+#include <cstdio>
+#include <string>
+
+// Macros Level1 to LevelDepth, where each level emits one instruction and invokes the level below it,
+// so invoking the top level expands into depth lines.
+static std::string GenerateMacros(size_t depth)
+{
+	std::string source = ".macro Level1, $a\n\tmvr a, $a\n.endmacro\n";
+	for (size_t level = 2; level <= depth; level++)
+	{
+		source += ".macro Level" + std::to_string(level) + ", $a\n";
+		source += "\tmvr a, $a\n";
+		source += "\tLevel" + std::to_string(level - 1) + " $a\n";
+		source += ".endmacro\n";
+	}
+	return source;
+}
+
+// The same program, with every macro expanded by hand.
+static std::string GenerateFlat(size_t depth, size_t invocationCount)
+{
+	std::string source;
+	for (size_t i = 0; i < invocationCount * depth; i++)
+		source += (i & 1) != 0 ? "\tmvr a, c\n" : "\tmvr a, b\n";
+	return source;
+}
+
+static std::string GenerateInvocations(size_t depth, size_t invocationCount)
+{
+	std::string source = GenerateMacros(depth);
+	std::string invocation = "\tLevel" + std::to_string(depth);
+	for (size_t i = 0; i < invocationCount; i++)
+		source += invocation + ((i & 1) != 0 ? " c\n" : " b\n");
+	return source;
+}
+
+BENCHMARK(Macro)
+{
+	// Every program expands into the same number of lines, so expanding costs the same per line however deep
+	// the macros nest. The address space limits how many lines a program can emit.
+	constexpr size_t LineCount = 30'000;
+
+	std::printf("  %-6s %12s %10s %10s %12s %12s\n", "depth", "invocations", "flat ms", "macro ms", "ns/line", "allocations");
+	for (size_t depth : { 1, 2, 8, 32, 63 })
+	{
+		size_t invocationCount = LineCount / depth;
+		std::string flat = GenerateFlat(depth, invocationCount);
+		std::string invocations = GenerateInvocations(depth, invocationCount);
+		if (!Assembler::Assemble(flat) || !Assembler::Assemble(invocations))
+		{
+			std::printf("  %-6zu failed to assemble\n", depth);
+			continue;
+		}
+
+		CountingResource resource;
+		KeepAlive(Assembler::Assemble(invocations, {}, 0, nullptr, &resource));
+		uint64_t flatNanoseconds = MeasureNanoseconds([&]() { KeepAlive(Assembler::Assemble(flat)); });
+		uint64_t macroNanoseconds = MeasureNanoseconds([&]() { KeepAlive(Assembler::Assemble(invocations)); });
+		size_t expandedLineCount = invocationCount * depth;
+		std::printf("  %-6zu %12zu %10.2f %10.2f %12.1f %12zu\n", depth, invocationCount, static_cast<double>(flatNanoseconds) / 1e6,
+			static_cast<double>(macroNanoseconds) / 1e6, static_cast<double>(macroNanoseconds) / static_cast<double>(expandedLineCount), resource.allocations);
+	}
+}
@@ -0,0 +1,104 @@
+#include "Benchmark.h"
+#include "Computer/NumericLiteral.h"
+#include <charconv>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+static std::vector<std::string> GenerateLiterals(size_t count)
+{
+	std::vector<std::string> literals(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t value = static_cast<uint32_t>(i * 2654435761u) & 0xFFFF;
+		char digits[33];
+		switch (i % 4)
+		{
+			case 0:
+				literals[i] = std::to_string(value);
+				break;
+			case 1:
+				literals[i] = "0x" + std::string(digits, std::to_chars(digits, digits + sizeof(digits), value, 16).ptr);
+				break;
+			case 2:
+				literals[i] = "$" + std::string(digits, std::to_chars(digits, digits + sizeof(digits), value & 0xFF, 16).ptr);
+				break;
+			default:
+				literals[i] = "0b" + std::string(digits, std::to_chars(digits, digits + sizeof(digits), value & 0xFF, 2).ptr);
+				break;
+		}
+	}
+	return literals;
+}
+
+// What NumericLiteral replaced: work out the form, check every digit, then convert the digits in a second pass.
+static bool ParseTwoPass(std::string_view text, uint32_t& value)
+{
+	int base = 10;
+	std::string_view digits = text;
+	if (text.starts_with("0x") || text.starts_with("0X"))
+	{
+		base = 16;
+		digits = text.substr(2);
+	}
+	else if (text.starts_with("0b") || text.starts_with("0B"))
+	{
+		base = 2;
+		digits = text.substr(2);
+	}
+	else if (text.starts_with('$'))
+	{
+		base = 16;
+		digits = text.substr(1);
+	}
+	else if (text.starts_with('%'))
+	{
+		base = 2;
+		digits = text.substr(1);
+	}
+
+	if (digits.empty())
+		return false;
+	for (char c : digits)
+	{
+		bool isDigit = base == 2 ? c == '0' || c == '1' : base == 10 ? '0' <= c && c <= '9' :
+			('0' <= c && c <= '9') || ('a' <= c && c <= 'f') || ('A' <= c && c <= 'F');
+		if (!isDigit)
+			return false;
+	}
+	return std::from_chars(digits.data(), digits.data() + digits.size(), value, base).ec == std::errc();
+}
+
+BENCHMARK(NumericLiteral)
+{
+	std::vector<std::string> literals = GenerateLiterals(1'000'000);
+
+	uint64_t twoPassSum = 0;
+	uint64_t sum = 0;
+	uint64_t twoPassNanoseconds = MeasureNanoseconds([&]()
+	{
+		twoPassSum = 0;
+		for (const std::string& literal : literals)
+		{
+			uint32_t value = 0;
+			if (ParseTwoPass(literal, value))
+				twoPassSum += value;
+		}
+	});
+	uint64_t nanoseconds = MeasureNanoseconds([&]()
+	{
+		sum = 0;
+		for (const std::string& literal : literals)
+		{
+			uint32_t value = 0;
+			if (NumericLiteral::Parse(literal, value) == NumericLiteralResult::Success)
+				sum += value;
+		}
+	});
+
+	std::printf("  %zu literals in binary, decimal, and hexadecimal\n", literals.size());
+	std::printf("  %-24s %10.1f ns/literal\n", "validate, then convert", static_cast<double>(twoPassNanoseconds) / static_cast<double>(literals.size()));
+	std::printf("  %-24s %10.1f ns/literal\n", "NumericLiteral::Parse", static_cast<double>(nanoseconds) / static_cast<double>(literals.size()));
+	if (twoPassSum != sum)
+		std::printf("  sums differ: %ju and %ju\n", static_cast<uintmax_t>(twoPassSum), static_cast<uintmax_t>(sum));
+}
@@ -0,0 +1,90 @@
+#include "Benchmark.h"
+#include "Computer/SourceScanner.h"
+#include <cctype>
+#include <cstdio>
+#include <string>
+
+// A generated source the way code generators write them: mostly instructions, with comments, labels, and blank lines.
+static std::string GenerateSource(size_t lineCount)
+{
+	std::string source;
+	for (size_t i = 0; i < lineCount; i++)
+	{
+		switch (i % 8)
+		{
+			case 0: source += "Label" + std::to_string(i) + ":\n"; break;
+			case 1: source += "\tldi b, 17 + 6 ; load the count\n"; break;
+			case 2: source += "\tadd b\n"; break;
+			case 3: source += "\n"; break;
+			case 4: source += "; a comment on a line of its own, as long as the ones generators write\n"; break;
+			case 5: source += "\tsto [0x1234], a   \n"; break;
+			case 6: source += "    jmp nz, Label0\r\n"; break;
+			default: source += "\t.byte 1, 2, 3, 4, 5, 6, 7, 8\n"; break;
+		}
+	}
+	return source;
+}
+
+// The loop SourceScanner replaced: one char at a time, through the C locale.
+static size_t SplitLinesScalar(std::string_view source, std::pmr::vector<SourceLine>& lines)
+{
+	size_t lineNumber = 1;
+	size_t i = 0;
+	while (i < source.size())
+	{
+		while (i < source.size() && std::isspace(static_cast<unsigned char>(source[i])))
+		{
+			if (source[i] == '\n' || (source[i] == '\r' && (i + 1 == source.size() || source[i + 1] != '\n')))
+				lineNumber++;
+			i++;
+		}
+
+		size_t lineBegin = i;
+		while (i < source.size() && source[i] != ';' && source[i] != '\n' && source[i] != '\r')
+			i++;
+		size_t lineEnd = i;
+		while (lineEnd > lineBegin && std::isblank(static_cast<unsigned char>(source[lineEnd - 1])))
+			lineEnd--;
+		if (lineEnd > lineBegin)
+		{
+			SourceLine& line = lines.emplace_back();
+			static_cast<std::string_view&>(line) = source.substr(lineBegin, lineEnd - lineBegin);
+			line.number = lineNumber;
+		}
+
+		while (i < source.size() && source[i] != '\n' && source[i] != '\r')
+			i++;
+	}
+	return lineNumber;
+}
+
+BENCHMARK(SplitLines)
+{
+	std::string source = GenerateSource(500'000);
+	std::pmr::vector<SourceLine> lines;
+	lines.reserve(500'000);
+
+	size_t scalarLineCount = 0;
+	uint64_t scalarNanoseconds = MeasureNanoseconds([&]()
+	{
+		lines.clear();
+		SplitLinesScalar(source, lines);
+		scalarLineCount = lines.size();
+		KeepAlive(lines);
+	});
+
+	size_t lineCount = 0;
+	uint64_t nanoseconds = MeasureNanoseconds([&]()
+	{
+		lines.clear();
+		SourceScanner::SplitLines(source, lines);
+		lineCount = lines.size();
+		KeepAlive(lines);
+	});
+
+	std::printf("  %zu bytes, %zu lines\n", source.size(), lineCount);
+	std::printf("  %-24s %10.1f MB/s\n", "scalar loop", ToMegabytesPerSecond(source.size(), scalarNanoseconds));
+	std::printf("  %-24s %10.1f MB/s\n", "SourceScanner", ToMegabytesPerSecond(source.size(), nanoseconds));
+	if (scalarLineCount != lineCount)
+		std::printf("  line counts differ: %zu and %zu\n", scalarLineCount, lineCount);
+}
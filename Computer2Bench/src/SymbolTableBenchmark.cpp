@@ -0,0 +1,63 @@
+#include "Benchmark.h"
+#include "Computer/Assembler.h"
+#include "Computer/SymbolTable.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// The duplicate check that SymbolTable replaced: every definition scans every label before it.
+static size_t InsertLinear(std::span<const std::string> names)
+{
+	std::vector<std::string_view> labels;
+	size_t duplicates = 0;
+	for (const std::string& name : names)
+	{
+		if (std::ranges::find(labels, name) != labels.end())
+			duplicates++;
+		else
+			labels.push_back(name);
+	}
+	return duplicates;
+}
+
+// Inserts every name, then looks every one up, like defining labels and then resolving the operands that use them.
+static size_t InsertAndFind(std::span<const std::string> names)
+{
+	SymbolTable<uint32_t> table;
+	for (const std::string& name : names)
+		table.Insert(name);
+	size_t found = 0;
+	for (const std::string& name : names)
+		found += table.Find(name) != SymbolTable<uint32_t>::InvalidIndex ? 1 : 0;
+	return found;
+}
+
+BENCHMARK(SymbolTable)
+{
+	// The linear scan is quadratic, so it's only run while that finishes in seconds.
+	constexpr size_t MaxLinearCount = 30'000;
+
+	std::printf("  %-10s %14s %14s %14s\n", "labels", "linear ns/op", "table ns/op", "assemble ms");
+	for (size_t count : { 1'000, 10'000, 100'000, 1'000'000 })
+	{
+		std::vector<std::string> names(count);
+		std::string source;
+		for (size_t i = 0; i < count; i++)
+		{
+			names[i] = "Label_" + std::to_string(i * 7919 % count);
+			source += names[i] + ":\n";
+		}
+
+		double linear = 0.0;
+		if (count <= MaxLinearCount)
+			linear = static_cast<double>(MeasureNanoseconds([&]() { KeepAlive(InsertLinear(names)); }, 1)) / static_cast<double>(count);
+		double table = static_cast<double>(MeasureNanoseconds([&]() { KeepAlive(InsertAndFind(names)); })) / static_cast<double>(count * 2);
+		uint64_t assembleNanoseconds = MeasureNanoseconds([&]() { KeepAlive(Assembler::Assemble(source)); }, 3);
+
+		if (count <= MaxLinearCount)
+			std::printf("  %-10zu %14.1f %14.1f %14.2f\n", count, linear, table, static_cast<double>(assembleNanoseconds) / 1e6);
+		else
+			std::printf("  %-10zu %14s %14.1f %14.2f\n", count, "-", table, static_cast<double>(assembleNanoseconds) / 1e6);
+	}
+}
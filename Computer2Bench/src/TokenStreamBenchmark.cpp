@@ -0,0 +1,71 @@
+#include "Benchmark.h"
+#include "Computer/SourceScanner.h"
+#include "Computer/TokenStream.h"
+#include <cstdio>
+#include <string>
+
+static std::string GenerateSource(size_t lineCount)
+{
+	std::string source;
+	for (size_t i = 0; i < lineCount; i++)
+	{
+		switch (i % 4)
+		{
+			case 0: source += "\tldi b, 17 + 6\n"; break;
+			case 1: source += "\tsto [0x1234], a\n"; break;
+			case 2: source += "\t.byte 1, 2, 3, 4\n"; break;
+			default: source += "\thalt\n"; break;
+		}
+	}
+	return source;
+}
+
+// Tokenizes every line, and stores its tokens the way TokenStream replaced: in a vector of their own, per line.
+static void TokenizePerLine(std::span<const SourceLine> lines, std::pmr::memory_resource* resource)
+{
+	TokenStream scratch;
+	std::pmr::vector<std::pmr::vector<std::string_view>> tokenizedLines(resource);
+	for (const SourceLine& line : lines)
+	{
+		scratch.Clear();
+		scratch.Append(line);
+		std::span<const std::string_view> tokens = scratch.GetTokens(scratch.lines.back());
+		tokenizedLines.emplace_back(tokens.begin(), tokens.end());
+	}
+	KeepAlive(tokenizedLines);
+}
+
+static void TokenizeStream(std::span<const SourceLine> lines, std::pmr::memory_resource* resource)
+{
+	// Like Assembler::Assemble(), every token lives in an arena for the whole call.
+	std::pmr::monotonic_buffer_resource arena(resource);
+	TokenStream tokenStream(&arena);
+	for (const SourceLine& line : lines)
+		tokenStream.Append(line);
+	KeepAlive(tokenStream);
+}
+
+BENCHMARK(TokenStream)
+{
+	// Allocations of the stream stay flat as lines grow, since the arena grows geometrically.
+	std::printf("  %-10s %-12s %12s %12s %10s\n", "lines", "layout", "allocations", "bytes", "ms");
+	for (size_t lineCount : { 1'000, 10'000, 100'000, 1'000'000 })
+	{
+		std::string source = GenerateSource(lineCount);
+		std::pmr::vector<SourceLine> lines;
+		SourceScanner::SplitLines(source, lines);
+
+		CountingResource perLineResource;
+		TokenizePerLine(lines, &perLineResource);
+		uint64_t perLineNanoseconds = MeasureNanoseconds([&]() { TokenizePerLine(lines, std::pmr::get_default_resource()); });
+
+		CountingResource streamResource;
+		TokenizeStream(lines, &streamResource);
+		uint64_t streamNanoseconds = MeasureNanoseconds([&]() { TokenizeStream(lines, std::pmr::get_default_resource()); });
+
+		std::printf("  %-10zu %-12s %12zu %12zu %10.2f\n", lineCount, "per line", perLineResource.allocations, perLineResource.allocatedBytes,
+			static_cast<double>(perLineNanoseconds) / 1e6);
+		std::printf("  %-10zu %-12s %12zu %12zu %10.2f\n", lineCount, "TokenStream", streamResource.allocations, streamResource.allocatedBytes,
+			static_cast<double>(streamNanoseconds) / 1e6);
+	}
+}
@@ -0,0 +1,42 @@
+// Measures the assembler's hot paths, each against what it replaced where that still makes sense to run:
+//   Computer2Bench [filter]
+// Only the benchmarks whose names contain filter are run. Build in Release or Dist, or the numbers mean little.
+
+#include "Benchmark.h"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+static std::vector<Benchmark>& GetBenchmarks()
+{
+	static std::vector<Benchmark> benchmarks;
+	return benchmarks;
+}
+
+bool Benchmarks::Register(std::string_view name, void (*function)())
+{
+	GetBenchmarks().push_back({ name, function });
+	return true;
+}
+
+void Benchmarks::RunAll(std::string_view filter)
+{
+	// Registration order depends on link order, so they're run by name instead.
+	std::vector<Benchmark>& benchmarks = GetBenchmarks();
+	std::ranges::sort(benchmarks, {}, &Benchmark::name);
+	for (const Benchmark& benchmark : benchmarks)
+	{
+		if (benchmark.name.find(filter) == std::string_view::npos)
+			continue;
+
+		std::printf("%.*s\n", static_cast<int>(benchmark.name.size()), benchmark.name.data());
+		benchmark.function();
+		std::printf("\n");
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Benchmarks::RunAll(argc > 1 ? argv[1] : "");
+	return 0;
+}
@@ -0,0 +1,48 @@
+project "Computer2Test"
+	kind "ConsoleApp"
+	language "C++"
+	cppdialect "C++20"
+	cdialect "C17"
+	staticruntime "On"
+
+	targetdir ("%{wks.location}/bin/" .. OutputDir .. "/%{prj.name}")
+	objdir ("%{wks.location}/bin-int/" .. OutputDir .. "/%{prj.name}")
+
+	files {
+		"src/**.h",
+		"src/**.cpp",
+
+		-- The tests exercise the assembler built from Computer2's sources, like Computer2Asm does.
+		"%{wks.location}/Computer2/src/Computer/**.h",
+		"%{wks.location}/Computer2/src/Computer/**.cpp",
+	}
+
+	includedirs {
+		-- Add any project source directories here.
+		"src",
+		"%{wks.location}/Computer2/src",
+	}
+
+	filter "system:windows"
+		systemversion "latest"
+		usestdpreproc "On"
+		buildoptions "/wd5105" -- Until Microsoft updates Windows 10 to not have terrible code (aka never), this must be here to prevent a warning.
+		defines "SYSTEM_WINDOWS"
+
+	filter "configurations:Debug"
+		runtime "Debug"
+		optimize "Debug"
+		symbols "Full"
+		defines "CONFIG_DEBUG"
+
+	filter "configurations:Release"
+		runtime "Release"
+		optimize "On"
+		symbols "On"
+		defines "CONFIG_RELEASE"
+
+	filter "configurations:Dist"
+		runtime "Release"
+		optimize "Full"
+		symbols "Off"
+		defines "CONFIG_DIST"
@@ -0,0 +1,143 @@
+#include "Test.h"
+#include "Computer/AssemblerService.h"
+#include <algorithm>
+#include <string>
+#include <thread>
+
+#if SYSTEM_WINDOWS
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <WinSock2.h>
+	#include <afunix.h>
+#else
+	#include <sys/socket.h>
+	#include <sys/un.h>
+	#include <unistd.h>
+#endif
+
+// Binds a socket to path, and closes it without removing its file, like a service that didn't stop cleanly.
+static void LeaveStaleSocket(const std::filesystem::path& path)
+{
+#if SYSTEM_WINDOWS
+	WSADATA data;
+	CHECK(WSAStartup(MAKEWORD(2, 2), &data) == 0);
+#endif
+
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	std::string pathString = path.string();
+	CHECK(pathString.size() < sizeof(address.sun_path));
+	std::copy_n(pathString.begin(), std::min(pathString.size(), sizeof(address.sun_path) - 1), address.sun_path);
+
+	auto socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	CHECK(bind(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0);
+#if SYSTEM_WINDOWS
+	closesocket(socket);
+	WSACleanup();
+#else
+	close(socket);
+#endif
+}
+
+// Runs a service on a socket in directory for as long as it lives.
+class RunningService
+{
+public:
+	RunningService(const TemporaryDirectory& directory)
+		: socketPath(directory.GetPath() / "service.sock"), service(socketPath, 2)
+	{
+		isStarted = service.Start();
+		CHECK(isStarted);
+		if (isStarted)
+			runner = std::thread([this]() { service.Run(); });
+	}
+
+	~RunningService()
+	{
+		service.Stop();
+		if (runner.joinable())
+			runner.join();
+	}
+
+	const std::filesystem::path& GetSocketPath() const noexcept { return socketPath; }
+private:
+	std::filesystem::path socketPath;
+	AssemblerService service;
+	bool isStarted = false;
+	std::thread runner;
+};
+
+TEST(ServiceReassemblesOnceABrokenIncludeIsFixed)
+{
+	TemporaryDirectory directory;
+	RunningService service(directory);
+	std::filesystem::path source = directory.Write("main.asm", "\t.include \"a.inc\"\n\thalt\n");
+
+	directory.Write("a.inc", "\tbogus\n");
+	AssemblerOutput output = AssemblerService::RequestFile(service.GetSocketPath(), source);
+	CHECK(output.returnCode == AssemblerReturnCode_InvalidMnemonic);
+
+	directory.Write("a.inc", "\tnop\n");
+	output = AssemblerService::RequestFile(service.GetSocketPath(), source);
+	CHECK(output);
+}
+
+TEST(ServiceReassemblesOnceAMissingIncludeIsCreated)
+{
+	TemporaryDirectory directory;
+	RunningService service(directory);
+	std::string_view text = "\t.include \"b.inc\"\n\thalt\n";
+	std::filesystem::path source = directory.Write("main.asm", text);
+
+	AssemblerOutput output = AssemblerService::Request(service.GetSocketPath(), text, source);
+	CHECK(output.returnCode == AssemblerReturnCode_IncludeNotFound);
+
+	directory.Write("b.inc", "\tnop\n");
+	output = AssemblerService::Request(service.GetSocketPath(), text, source);
+	CHECK(output);
+}
+
+TEST(ServiceLeavesOtherFilesAtItsSocketPath)
+{
+	TemporaryDirectory directory;
+	std::filesystem::path socketPath = directory.Write("service.sock", "not a socket");
+	{
+		AssemblerService service(socketPath);
+		CHECK(!service.Start());
+	}
+	CHECK(std::filesystem::is_regular_file(socketPath));
+}
+
+TEST(ServiceReplacesAStaleSocket)
+{
+	TemporaryDirectory directory;
+	std::filesystem::path socketPath = directory.GetPath() / "service.sock";
+	LeaveStaleSocket(socketPath);
+	CHECK(std::filesystem::is_socket(socketPath));
+	{
+		RunningService service(directory);
+		CHECK(AssemblerService::Request(service.GetSocketPath(), "\thalt\n"));
+	}
+	CHECK(!std::filesystem::exists(socketPath));
+}
+
+TEST(ServiceLeavesTheSocketOfAnotherService)
+{
+	TemporaryDirectory directory;
+	RunningService service(directory);
+	{
+		AssemblerService otherService(service.GetSocketPath());
+		CHECK(!otherService.Start());
+	}
+	CHECK(AssemblerService::Request(service.GetSocketPath(), "\thalt\n"));
+
+	// A socket file that replaced the service's own, after it was removed, stays once the service stops.
+	std::filesystem::path otherPath = directory.GetPath() / "other.sock";
+	{
+		AssemblerService startedService(otherPath);
+		CHECK(startedService.Start());
+		std::filesystem::remove(otherPath);
+		LeaveStaleSocket(otherPath);
+	}
+	CHECK(std::filesystem::is_socket(otherPath));
+}
@@ -0,0 +1,78 @@
+#include "Test.h"
+#include "RandomSource.h"
+#include "Computer/AssemblyCache.h"
+#include <algorithm>
+#include <string>
+
+// Everything the cache stores must come back the same, line maps included.
+static void CheckSameOutput(const AssemblerOutput& output, const AssemblerOutput& expected)
+{
+	CHECK(output.returnCode == expected.returnCode);
+	CHECK(output.sections.size() == expected.sections.size());
+	for (size_t i = 0; i < std::min(output.sections.size(), expected.sections.size()); i++)
+	{
+		const AssemblerProgramSection& section = output.sections[i];
+		const AssemblerProgramSection& expectedSection = expected.sections[i];
+		CHECK(section.origin == expectedSection.origin);
+		CHECK(section.assembly == expectedSection.assembly);
+		CHECK(std::ranges::equal(section.lineMap.GetData(), expectedSection.lineMap.GetData()));
+		CHECK(section.lineMap.GetEndAddress() == expectedSection.lineMap.GetEndAddress());
+	}
+
+	CHECK(output.symbols.size() == expected.symbols.size());
+	for (size_t i = 0; i < std::min(output.symbols.size(), expected.symbols.size()); i++)
+		CHECK(output.symbols[i].name == expected.symbols[i].name && output.symbols[i].address == expected.symbols[i].address);
+	CHECK(output.files == expected.files);
+}
+
+TEST(CacheLoadsWhatItStored)
+{
+	TemporaryDirectory directory;
+	AssemblyCache cache(directory.GetPath() / "cache");
+	std::mt19937 random(16);
+	for (size_t program = 0; program < 20; program++)
+	{
+		std::string source = RandomSource::Generate(random);
+		std::filesystem::path sourcePath = directory.Write("program" + std::to_string(program) + ".asm", source);
+		AssemblerOutput expected = Assembler::Assemble(source, sourcePath);
+		CHECK(expected);
+
+		CheckSameOutput(cache.Assemble(source, sourcePath), expected);
+		CheckSameOutput(cache.Assemble(source, sourcePath), expected);
+		CHECK(cache.GetMissCount() == program + 1);
+		CHECK(cache.GetHitCount() == program + 1);
+	}
+
+	// Another cache of the same directory, like one of another process, hits too.
+	AssemblyCache otherCache(directory.GetPath() / "cache");
+	std::string source = RandomSource::Generate(random);
+	cache.Assemble(source);
+	CheckSameOutput(otherCache.Assemble(source), Assembler::Assemble(source));
+	CHECK(otherCache.GetHitCount() == 1);
+}
+
+TEST(CacheMissesOnceAnIncludeChanges)
+{
+	TemporaryDirectory directory;
+	AssemblyCache cache(directory.GetPath() / "cache");
+	std::string_view source = "\t.include \"outer.inc\"\n\t.byte Value\n";
+	std::filesystem::path sourcePath = directory.Write("main.asm", source);
+	directory.Write("outer.inc", "\t.include \"inner.inc\"\n");
+	directory.Write("inner.inc", ".define Value, 1\n");
+
+	CHECK(cache.Assemble(source, sourcePath).sections.front().assembly == std::vector<uint8_t>{ 1 });
+	CHECK(cache.Assemble(source, sourcePath));
+	CHECK(cache.GetHitCount() == 1);
+
+	// Files that are only included by other includes count too.
+	directory.Write("inner.inc", ".define Value, 2\n");
+	AssemblerOutput output = cache.Assemble(source, sourcePath);
+	CHECK(cache.GetMissCount() == 2);
+	CHECK(output.sections.front().assembly == std::vector<uint8_t>{ 2 });
+	CheckSameOutput(output, Assembler::Assemble(source, sourcePath));
+
+	// An include that is gone misses, and fails like assembling without the cache does.
+	std::filesystem::remove(directory.GetPath() / "outer.inc");
+	CHECK(cache.Assemble(source, sourcePath).returnCode == AssemblerReturnCode_IncludeNotFound);
+	CHECK(cache.GetHitCount() == 1);
+}
@@ -0,0 +1,60 @@
+#include "Test.h"
+#include "RandomSource.h"
+#include "Computer/Assembler.h"
+#include "Computer/CompileTimeAssembler.h"
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <vector>
+
+static constexpr std::string_view RomSource = R"(
+.define Count, 3
+	ldi a, Count * 2
+Loop:
+	sub 1
+	jmp nz, Loop
+.if Count > 2
+	.word End
+.else
+	.byte 1
+.endif
+	.byte "hi", Count
+End:
+	halt
+)";
+
+// Assembled while compiling, which is what fails the build when the two assemblers stop agreeing on it.
+static constexpr std::array<uint8_t, 16> Rom = CompileTimeAssembler::AssembleRom<16>(RomSource);
+static_assert(Rom == std::array<uint8_t, 16>{ 0x10, 0x06, 0xE1, 0x01, 0x2B, 0x02, 0x00, 0x0C, 0x00, 0x68, 0x69, 0x03, 0x01 });
+
+TEST(RomMatchesAssembleImage)
+{
+	std::vector<uint8_t> memory(AssemblerImage::Size);
+	AssemblerImage image(std::span<uint8_t, AssemblerImage::Size>(memory.data(), memory.size()));
+	CHECK(Assembler::AssembleImage(RomSource, image));
+	CHECK(std::ranges::equal(Rom, std::span(memory).first(Rom.size())));
+}
+
+TEST(CompileTimeAssemblerMatchesAssembleImage)
+{
+	std::mt19937 random(19);
+	// Too large for the stack of some platforms.
+	auto output = std::make_unique<CompileTimeAssemblerOutput<AssemblerImage::Size>>();
+	for (size_t program = 0; program < 200; program++)
+	{
+		RandomSourceOptions options;
+		options.useMacros = false;
+		options.errorPercent = program % 4 == 0 ? 1 : 0;
+		std::string source = RandomSource::Generate(random, options);
+
+		std::vector<uint8_t> memory(AssemblerImage::Size);
+		AssemblerImage image(std::span<uint8_t, AssemblerImage::Size>(memory.data(), memory.size()));
+		AssemblerOutput expected = Assembler::AssembleImage(source, image);
+
+		*output = CompileTimeAssembler::Assemble<AssemblerImage::Size>(source);
+		CHECK(output->returnCode == expected.returnCode);
+		CHECK(output->lineNumber == expected.lineNumber);
+		if (*output && expected)
+			CHECK(std::ranges::equal(output->image, memory));
+	}
+}
@@ -0,0 +1,109 @@
+#include "Test.h"
+#include "RandomSource.h"
+#include "Computer/Disassembler.h"
+#include "Computer/ThreadPool.h"
+#include <algorithm>
+#include <vector>
+
+// The address and bytes columns in front of each instruction, e.g. "8000  0f 00 17     ".
+static constexpr size_t ColumnsSize = 19;
+
+// Disassembles memory into source that assembles, by leaving out the columns, and starting it at origin.
+static std::string Disassemble(std::span<const uint8_t> memory, uint16_t origin, std::span<const AssemblerSymbol> symbols)
+{
+	std::string text(Disassembler::GetMaxTextSize(memory.size(), symbols), '\0');
+	text.resize(Disassembler::Disassemble(memory, origin, symbols, text));
+
+	std::string source = ".origin " + std::to_string(origin) + "\n";
+	for (size_t start = 0; start < text.size();)
+	{
+		size_t end = text.find('\n', start);
+		std::string_view line = std::string_view(text).substr(start, end - start);
+		source += line.ends_with(':') ? line : line.substr(ColumnsSize);
+		source += "\n";
+		start = end + 1;
+	}
+	return source;
+}
+
+TEST(DisassemblyAssemblesBackToTheSameBytes)
+{
+	std::mt19937 random(21);
+	std::uniform_int_distribution<uint32_t> byte(0, 255);
+	for (size_t image = 0; image < 100; image++)
+	{
+		// Any bytes at all, whatever they decode to, including instructions that memory ends in the middle of.
+		uint16_t origin = static_cast<uint16_t>(std::uniform_int_distribution<uint32_t>(0, AssemblerImage::Size - 4096)(random));
+		std::vector<uint8_t> memory(4096);
+		for (uint8_t& value : memory)
+			value = static_cast<uint8_t>(byte(random));
+
+		AssemblerOutput output = Assembler::Assemble(Disassemble(memory, origin, {}));
+		CHECK(output);
+		CHECK(output.sections.size() == 1);
+		if (output.sections.size() == 1)
+		{
+			CHECK(output.sections.front().origin == origin);
+			CHECK(output.sections.front().assembly == memory);
+		}
+	}
+}
+
+TEST(DisassemblyWithLabelsAssemblesBackToTheSameProgram)
+{
+	std::mt19937 random(12);
+	for (size_t program = 0; program < 50; program++)
+	{
+		AssemblerOutput expected = Assembler::Assemble(RandomSource::Generate(random));
+		CHECK(expected);
+
+		// Labels that no section's bytes are at still have to be defined, for the operands that use them.
+		std::string source;
+		for (const AssemblerProgramSection& section : expected.sections)
+			source += Disassemble(section.assembly, section.origin, expected.symbols);
+		for (const AssemblerSymbol& symbol : expected.symbols)
+		{
+			auto isInSection = [&](const AssemblerProgramSection& section)
+			{
+				return symbol.address >= section.origin && symbol.address < section.origin + section.assembly.size();
+			};
+			if (std::ranges::none_of(expected.sections, isInSection))
+				source += ".origin " + std::to_string(symbol.address) + "\n" + symbol.name + ":\n";
+		}
+
+		AssemblerOutput output = Assembler::Assemble(source);
+		CHECK(output);
+		CHECK(output.sections.size() == expected.sections.size());
+		for (size_t i = 0; i < std::min(output.sections.size(), expected.sections.size()); i++)
+		{
+			CHECK(output.sections[i].origin == expected.sections[i].origin);
+			CHECK(output.sections[i].assembly == expected.sections[i].assembly);
+		}
+		CHECK(output.symbols.size() == expected.symbols.size());
+	}
+}
+
+TEST(BatchMatchesDisassemblingEachJob)
+{
+	std::mt19937 random(211);
+	ThreadPool threadPool;
+	std::vector<std::vector<uint8_t>> images(16, std::vector<uint8_t>(1024));
+	std::vector<std::string> texts(images.size());
+	std::vector<DisassemblerJob> jobs(images.size());
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		for (uint8_t& value : images[i])
+			value = static_cast<uint8_t>(random());
+		texts[i].resize(Disassembler::GetMaxTextSize(images[i].size(), {}));
+		jobs[i] = { images[i], static_cast<uint16_t>(i * 1024), {}, texts[i] };
+	}
+	Disassembler::DisassembleBatch(jobs, threadPool);
+
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		std::string text(texts[i].size(), '\0');
+		text.resize(Disassembler::Disassemble(images[i], jobs[i].origin, {}, text));
+		CHECK(jobs[i].textSize == text.size());
+		CHECK(std::string_view(texts[i]).substr(0, jobs[i].textSize) == text);
+	}
+}
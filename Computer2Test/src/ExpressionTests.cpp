@@ -0,0 +1,45 @@
+#include "Test.h"
+#include "Computer/Assembler.h"
+#include "Computer/CompileTimeAssembler.h"
+
+// Assembles source with both assemblers, which have to agree on the result.
+static AssemblerReturnCode AssembleBoth(std::string_view source, uint8_t& firstByte)
+{
+	AssemblerOutput output = Assembler::Assemble(source);
+	CompileTimeAssemblerOutput<16> compileTimeOutput = CompileTimeAssembler::Assemble<16>(source);
+	CHECK(output.returnCode == compileTimeOutput.returnCode);
+
+	firstByte = compileTimeOutput.image[0];
+	if (output && (output.sections.empty() || output.sections[0].assembly.empty() || output.sections[0].assembly[0] != firstByte))
+		Tests::Fail("Assemble() and CompileTimeAssembler agree on the first byte", __FILE__, __LINE__);
+	return output.returnCode;
+}
+
+TEST(LeftOutOperandsAreNotEvaluated)
+{
+	uint8_t value = 0xFF;
+	CHECK(AssembleBoth("\t.byte 0 && 1 / 0\n", value) == AssemblerReturnCode_Success && value == 0);
+	CHECK(AssembleBoth("\t.byte 1 || 1 / 0\n", value) == AssemblerReturnCode_Success && value == 1);
+	CHECK(AssembleBoth("\t.byte 1 ? 2 : 1 / 0\n", value) == AssemblerReturnCode_Success && value == 2);
+	CHECK(AssembleBoth("\t.byte 0 ? 1 % 0 : 3\n", value) == AssemblerReturnCode_Success && value == 3);
+	CHECK(AssembleBoth("\t.byte 0 && Undefined\n", value) == AssemblerReturnCode_Success && value == 0);
+	CHECK(AssembleBoth(".define X, 0\n.if X != 0 && 100 / X > 2\n\t.byte 1\n.else\n\t.byte 4\n.endif\n", value) == AssemblerReturnCode_Success && value == 4);
+}
+
+TEST(LeftOutOperandsAreNotEvaluatedAtRunTime)
+{
+	// Later isn't known while compiling, so these are evaluated once it's defined.
+	uint8_t value = 0xFF;
+	CHECK(AssembleBoth("Start:\n\t.byte Later ? 5 : 1 / Start\nLater:\n", value) == AssemblerReturnCode_Success && value == 5);
+	CHECK(AssembleBoth("Start:\n\t.byte Later || 1 / Start\nLater:\n", value) == AssemblerReturnCode_Success && value == 1);
+	CHECK(AssembleBoth("Start:\n\t.byte Later == 0 && 1 / Start\nLater:\n", value) == AssemblerReturnCode_Success && value == 0);
+}
+
+TEST(UsedOperandsAreStillEvaluated)
+{
+	uint8_t value = 0;
+	CHECK(AssembleBoth("\t.byte 1 && 1 / 0\n", value) == AssemblerReturnCode_DivisionByZero);
+	CHECK(AssembleBoth("\t.byte 0 ? 2 : 1 / 0\n", value) == AssemblerReturnCode_DivisionByZero);
+	CHECK(AssembleBoth("\t.byte 1 && Undefined\n", value) == AssemblerReturnCode_UndefinedSymbol);
+	CHECK(AssembleBoth("Start:\n\t.byte Later && 1 / Start\nLater:\n", value) == AssemblerReturnCode_DivisionByZero);
+}
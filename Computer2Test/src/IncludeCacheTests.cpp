@@ -0,0 +1,50 @@
+#include "Test.h"
+#include "Computer/Assembler.h"
+#include "Computer/IncludeCache.h"
+
+TEST(IncludeCacheEntriesSurviveTruncatedFiles)
+{
+	// Touching the pages of a mapped file past its new end would raise SIGBUS.
+	TemporaryDirectory directory;
+	std::string contents(64 * 1024, ' ');
+	contents += "Label:\n\thalt\n";
+	std::filesystem::path path = directory.Write("a.inc", contents);
+
+	std::shared_ptr<const IncludeCache::Entry> entry = IncludeCache::Get(path);
+	CHECK(entry != nullptr);
+	if (entry == nullptr)
+		return;
+	CHECK(!entry->file.IsMapped());
+
+	std::filesystem::resize_file(path, 0);
+	CHECK(entry->file.GetSource() == contents);
+	const TokenStream& tokenStream = entry->tokenStream;
+	CHECK(tokenStream.lines.size() == 2 && tokenStream.lines[0].isLabel && tokenStream.GetTokens(tokenStream.lines[0])[0] == "Label:");
+	CHECK(IncludeCache::Get(path) != entry);
+}
+
+TEST(IncludesFollowTheDefinesThatGuardThem)
+{
+	// Cached includes are only tokens, so flipping what guards an include, or what guards code in it, takes
+	// effect without the include changing.
+	TemporaryDirectory directory;
+	directory.Write("a.inc", ".if MODE == 2\n\t.byte 2\n.else\n\t.byte 3\n.endif\n");
+	directory.Write("b.inc", "\t.byte 4\n");
+	std::string source = ".define MODE, 1\n.if MODE\n\t.include \"a.inc\"\n.else\n\t.include \"b.inc\"\n.endif\n";
+	std::filesystem::path sourcePath = directory.Write("main.asm", source);
+
+	AssemblerSession session(sourcePath);
+	CHECK(session.Assemble(source));
+	for (std::string_view mode : { "2", "0", "1" })
+	{
+		std::vector<AssemblerPatch> patches;
+		const AssemblerOutput& output = session.Edit(1, 1, ".define MODE, " + std::string(mode), patches);
+		source.replace(source.find(',') + 2, 1, mode);
+		AssemblerOutput expected = Assembler::Assemble(source, sourcePath);
+		CHECK(output && expected);
+		CHECK(output.sections.size() == 1 && expected.sections.size() == 1);
+		if (output.sections.size() == 1 && expected.sections.size() == 1)
+			CHECK(output.sections[0].assembly == expected.sections[0].assembly);
+		CHECK(!patches.empty());
+	}
+}
@@ -0,0 +1,81 @@
+#include "Test.h"
+#include "Computer/Assembler.h"
+#include "Computer/AssemblerObject.h"
+#include "Computer/Linker.h"
+#include <algorithm>
+#include <vector>
+
+static AssemblerOutput AssembleFile(const TemporaryDirectory& directory, std::string_view source)
+{
+	return Assembler::Assemble(source, directory.Write("main.asm", source));
+}
+
+TEST(PrivateLabelsAreScopedToTheirFile)
+{
+	// Both files use Here before they define it, and each gets its own.
+	TemporaryDirectory directory;
+	directory.Write("a.inc", "\t.byte Here\nHere:\n\t.byte 0\n");
+	AssemblerOutput output = AssembleFile(directory, "\t.byte Here\n\t.include \"a.inc\"\nHere:\n\t.byte 0\n");
+	CHECK(output);
+	CHECK(output.sections.size() == 1);
+	if (output.sections.size() == 1)
+		CHECK(output.sections[0].assembly == std::vector<uint8_t>({ 3, 2, 0, 0 }));
+	CHECK(std::ranges::count(output.symbols, std::string("Here"), &AssemblerSymbol::name) == 2);
+}
+
+TEST(PrivateLabelsOfSiblingsDontConflict)
+{
+	TemporaryDirectory directory;
+	directory.Write("a.inc", "Loop:\n\t.byte Loop\n");
+	directory.Write("b.inc", "protected Loop:\n\t.byte Loop\n");
+	CHECK(AssembleFile(directory, "\t.include \"a.inc\", \"b.inc\"\n\t.byte Loop\n"));
+	CHECK(AssembleFile(directory, "\t.include \"a.inc\", \"a.inc\"\n"));
+}
+
+TEST(LabelsVisibleInTheSameFileConflict)
+{
+	TemporaryDirectory directory;
+	directory.Write("private.inc", "Value:\n");
+	directory.Write("protected.inc", "protected Value:\n");
+	directory.Write("public.inc", "public Value:\n");
+
+	AssemblerOutput output = AssembleFile(directory, "\t.include \"protected.inc\", \"protected.inc\"\n");
+	CHECK(output.returnCode == AssemblerReturnCode_DuplicateLabelDefinition);
+	output = AssembleFile(directory, "\t.include \"protected.inc\"\nValue:\n");
+	CHECK(output.returnCode == AssemblerReturnCode_DuplicateLabelDefinition);
+	CHECK(output.lineNumber == 2);
+	output = AssembleFile(directory, "\t.include \"private.inc\", \"public.inc\"\n");
+	CHECK(output.returnCode == AssemblerReturnCode_DuplicateLabelDefinition);
+	output = AssembleFile(directory, "\t.include \"private.inc\"\n.define Value, 1\n");
+	CHECK(output.returnCode == AssemblerReturnCode_DuplicateDefine);
+}
+
+TEST(PrivateLabelsStayInaccessible)
+{
+	TemporaryDirectory directory;
+	directory.Write("a.inc", "Value:\n");
+	AssemblerOutput output = AssembleFile(directory, "\t.include \"a.inc\"\n\t.byte Value\n");
+	CHECK(output.returnCode == AssemblerReturnCode_InaccessibleLabel);
+	CHECK(output.lineNumber == 2);
+	output = AssembleFile(directory, "\t.byte Value\n\t.include \"a.inc\"\n");
+	CHECK(output.returnCode == AssemblerReturnCode_InaccessibleLabel);
+	CHECK(output.lineNumber == 1);
+}
+
+TEST(PrivateLabelsAreScopedToTheirFileInObjects)
+{
+	// The labels are relocatable, so the linker resolves each use to the label of its own file.
+	TemporaryDirectory directory;
+	directory.Write("a.inc", "\t.byte Here\nHere:\n\t.byte 0\n");
+	AssemblerObject object;
+	std::string_view source = "\t.byte Here\n\t.include \"a.inc\"\nHere:\n\t.byte 0\n";
+	CHECK(Assembler::AssembleObject(source, object, directory.Write("main.asm", source)));
+	LinkerOutput output = Linker::Link({ &object, 1 }, 0x10);
+	CHECK(output);
+	CHECK(output.sections.size() == 1);
+	if (output.sections.size() == 1)
+		CHECK(output.sections[0].assembly == std::vector<uint8_t>({ 0x13, 0x12, 0, 0 }));
+
+	source = "\t.byte Here\n\t.include \"a.inc\"\n";
+	CHECK(Assembler::AssembleObject(source, object, directory.Write("main.asm", source)).returnCode == AssemblerReturnCode_InaccessibleLabel);
+}
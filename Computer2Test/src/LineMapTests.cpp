@@ -0,0 +1,98 @@
+#include "Test.h"
+#include "Computer/Assembler.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+// Checks that map finds the location of every byte that locations has one for, from origin on, and nothing else.
+static void CheckLocations(const AssemblerLineMap& map, uint32_t origin, const std::vector<AssemblerSourceLocation>& locations)
+{
+	AssemblerSourceLocation location;
+	CHECK(origin == 0 || !map.Find(origin - 1, location));
+	for (uint32_t i = 0; i < locations.size(); i++)
+		CHECK(map.Find(origin + i, location) && location == locations[i]);
+	CHECK(!map.Find(origin + static_cast<uint32_t>(locations.size()), location));
+}
+
+TEST(LineMapFindsTheLineOfEveryByte)
+{
+	std::mt19937 random(23);
+	auto pick = [&](uint32_t count) { return std::uniform_int_distribution<uint32_t>(0, count - 1)(random); };
+	for (size_t map = 0; map < 50; map++)
+	{
+		// Mostly the lines after each other, but also jumps back and forth, into other files, and bytes of no size.
+		AssemblerLineMap lineMap;
+		uint32_t origin = pick(0x10000);
+		std::vector<AssemblerSourceLocation> locations;
+		AssemblerSourceLocation location = { 0, 1 };
+		for (size_t i = 0, count = pick(2000); i < count; i++)
+		{
+			switch (pick(8))
+			{
+				case 0:
+					location = { pick(4) == 0 ? pick(20) : location.file, pick(100000) };
+					break;
+				case 1:
+					break;
+				default:
+					location.line++;
+					break;
+			}
+
+			uint32_t size = pick(5);
+			lineMap.Add(origin + static_cast<uint32_t>(locations.size()), size, location);
+			locations.insert(locations.end(), size, location);
+		}
+		CHECK(lineMap.IsEmpty() == locations.empty());
+		CheckLocations(lineMap, origin, locations);
+
+		// What's loaded from the data is the same map.
+		AssemblerLineMap loadedLineMap;
+		CHECK(loadedLineMap.Load(lineMap.GetData(), lineMap.GetEndAddress()));
+		CHECK(std::ranges::equal(loadedLineMap.GetData(), lineMap.GetData()));
+		CheckLocations(loadedLineMap, origin, locations);
+
+		// Rows can't start at or after the end.
+		if (!locations.empty())
+		{
+			CHECK(!loadedLineMap.Load(lineMap.GetData(), origin));
+			CHECK(loadedLineMap.IsEmpty());
+		}
+	}
+}
+
+TEST(LineMapTakesTwoBytesPerInstruction)
+{
+	AssemblerLineMap lineMap;
+	for (uint32_t line = 1; line <= 1000; line++)
+		lineMap.Add(line * 3, 3, { 0, line });
+	CHECK(lineMap.GetData().size() == 2000);
+}
+
+TEST(LineMapPointsIntoIncludesAndMacros)
+{
+	TemporaryDirectory directory;
+	std::string_view source =
+		"\t.macro Twice, $value\n"
+		"\t\t.byte $value\n"
+		"\t\t.byte $value\n"
+		"\t.endmacro\n"
+		"\tldi a, 1\n"
+		"\t.include \"data.inc\"\n"
+		"\tTwice 4\n"
+		"\thalt\n";
+	std::filesystem::path sourcePath = directory.Write("main.asm", source);
+	directory.Write("data.inc", "\t.byte 2, 3\n\n\thalt\n");
+
+	AssemblerOutput output = Assembler::Assemble(source, sourcePath);
+	CHECK(output);
+	CHECK(output.files.size() == 2 && output.files[1].filename() == "data.inc");
+	CHECK(output.sections.size() == 1);
+	if (!output || output.sections.size() != 1)
+		return;
+
+	// Bytes of the macro come from the line that invokes it, and bytes of the include from its own lines.
+	std::vector<AssemblerSourceLocation> locations = { { 0, 5 }, { 0, 5 }, { 1, 1 }, { 1, 1 }, { 1, 3 }, { 0, 7 }, { 0, 7 }, { 0, 8 } };
+	CHECK(output.sections.front().assembly.size() == locations.size());
+	CheckLocations(output.sections.front().lineMap, 0, locations);
+}
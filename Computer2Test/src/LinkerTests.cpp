@@ -0,0 +1,99 @@
+#include "Test.h"
+#include "RandomSource.h"
+#include "Computer/Linker.h"
+#include <algorithm>
+#include <array>
+#include <string>
+#include <vector>
+
+static constexpr std::array<std::string_view, 4> Prefixes = { "A", "B", "C", "D" };
+// The last object has no .origin, so the linker places it, which is here as long as nothing else is.
+static constexpr uint16_t RelocatableOrigin = 0xC000;
+
+static void CheckSameSections(std::span<const AssemblerProgramSection> sections, std::span<const AssemblerProgramSection> expectedSections)
+{
+	CHECK(sections.size() == expectedSections.size());
+	for (size_t i = 0; i < std::min(sections.size(), expectedSections.size()); i++)
+	{
+		CHECK(sections[i].origin == expectedSections[i].origin);
+		CHECK(sections[i].assembly == expectedSections[i].assembly);
+	}
+}
+
+// Generates a source for each object, with a section of its own, that uses a public label of the next one.
+static std::array<std::string, Prefixes.size()> GenerateSources(std::mt19937& random)
+{
+	std::array<std::string, Prefixes.size()> sources;
+	for (size_t i = 0; i < sources.size(); i++)
+	{
+		RandomSourceOptions options;
+		options.prefix = Prefixes[i];
+		options.firstOrigin = static_cast<uint16_t>(i * 0x4000);
+		options.sectionCount = 1;
+		std::string next(Prefixes[(i + 1) % Prefixes.size()]);
+		sources[i] = RandomSource::Generate(random, options);
+		sources[i] += "public " + std::string(Prefixes[i]) + "Entry:\n\tjmp " + next + "Entry\n\t.word " + next + "Entry + 1\n";
+	}
+	return sources;
+}
+
+TEST(LinkingMatchesAssemblingOneSource)
+{
+	std::mt19937 random(15);
+	for (size_t program = 0; program < 50; program++)
+	{
+		std::array<std::string, Prefixes.size()> sources = GenerateSources(random);
+		std::string source;
+		for (const std::string& objectSource : sources)
+			source += objectSource;
+		AssemblerOutput expected = Assembler::Assemble(source);
+		CHECK(expected);
+
+		// The last object's code comes before any .origin, without which its labels are relocatable.
+		std::string& relocatableSource = sources.back();
+		size_t originLine = relocatableSource.find(".origin " + std::to_string(RelocatableOrigin));
+		CHECK(originLine != std::string::npos);
+		if (originLine != std::string::npos)
+			relocatableSource.erase(originLine, relocatableSource.find('\n', originLine) - originLine);
+
+		std::vector<AssemblerObject> objects(sources.size());
+		for (size_t i = 0; i < sources.size(); i++)
+			CHECK(Assembler::AssembleObject(sources[i], objects[i]));
+		CHECK(objects.back().sections.front().isRelocatable);
+
+		LinkerOutput output = Linker::Link(objects, RelocatableOrigin);
+		CHECK(output);
+		CheckSameSections(output.sections, expected.sections);
+
+		// Objects that went through their binary format link the same, and are written the same again.
+		std::vector<AssemblerObject> loadedObjects(objects.size());
+		for (size_t i = 0; i < objects.size(); i++)
+		{
+			std::vector<uint8_t> data;
+			objects[i].Serialize(data);
+			CHECK(loadedObjects[i].Deserialize(data));
+
+			std::vector<uint8_t> loadedData;
+			loadedObjects[i].Serialize(loadedData);
+			CHECK(loadedData == data);
+		}
+		CheckSameSections(Linker::Link(loadedObjects, RelocatableOrigin).sections, expected.sections);
+	}
+}
+
+TEST(DamagedObjectsAreRejected)
+{
+	std::mt19937 random(51);
+	AssemblerObject object;
+	CHECK(Assembler::AssembleObject(GenerateSources(random).front(), object));
+	std::vector<uint8_t> data;
+	object.Serialize(data);
+
+	// Every prefix of an object is missing something.
+	for (size_t size = 0; size < data.size(); size += 1 + size / 16)
+	{
+		AssemblerObject loadedObject;
+		CHECK(!loadedObject.Deserialize({ data.data(), size }));
+		CHECK(loadedObject.sections.empty() && loadedObject.symbols.empty());
+	}
+}
@@ -0,0 +1,80 @@
+#include "Test.h"
+#include "Computer/Assembler.h"
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+// Counts what is allocated through it, and passes it on to upstream.
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+	explicit CountingResource(std::pmr::memory_resource* upstream)
+		: upstream(upstream) {}
+public:
+	size_t allocations = 0;
+	size_t allocatedBytes = 0;
+private:
+	void* do_allocate(size_t bytes, size_t alignment) override
+	{
+		allocations++;
+		allocatedBytes += bytes;
+		return upstream->allocate(bytes, alignment);
+	}
+
+	void do_deallocate(void* pointer, size_t bytes, size_t alignment) override
+	{
+		upstream->deallocate(pointer, bytes, alignment);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+		return this == &other;
+	}
+private:
+	std::pmr::memory_resource* upstream;
+};
+
+// Labels used before they're defined, defines, a macro, and strings, so that every kind of scratch space is used.
+static constexpr std::string_view Source =
+	".define Count, 3\n"
+	"\t.macro Store, $value\n"
+	"\t\tldi a, $value\n"
+	"\t\tsto [Data], a\n"
+	"\t.endmacro\n"
+	"Start:\n"
+	"\tStore Count * 2\n"
+	"\tjmp Start\n"
+	"Data:\n"
+	"\t.byte \"abc\", Count\n"
+	"\t.word Start, Data\n";
+
+TEST(ScratchSpaceComesFromTheCallersResource)
+{
+	AssemblerOutput expected = Assembler::Assemble(Source);
+	CHECK(expected);
+
+	// Without an upstream, anything that didn't fit in the buffer would throw, and the buffer is overwritten after
+	// each call, so the output can't point into it.
+	std::vector<std::byte> buffer(1 << 16);
+	std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+	for (size_t call = 0; call < 2; call++)
+	{
+		CountingResource resource(&arena);
+		AssemblerOutput output = Assembler::Assemble(Source, {}, 0, nullptr, &resource);
+		CHECK(resource.allocations != 0);
+		CHECK(resource.allocatedBytes <= buffer.size());
+
+		arena.release();
+		std::ranges::fill(buffer, std::byte{ 0xcd });
+		CHECK(output);
+		CHECK(output.sections.size() == expected.sections.size());
+		for (size_t i = 0; i < std::min(output.sections.size(), expected.sections.size()); i++)
+		{
+			// Sections hold plain vectors, which callers can take over.
+			std::vector<uint8_t> assembly = std::move(output.sections[i].assembly);
+			CHECK(output.sections[i].origin == expected.sections[i].origin);
+			CHECK(assembly == expected.sections[i].assembly);
+		}
+	}
+}
@@ -0,0 +1,38 @@
+#include "Test.h"
+#include "Computer/Assembler.h"
+
+static AssemblerOutput AssembleOptimized(std::string_view source)
+{
+	return Assembler::Assemble(source, {}, AllAssemblerPasses);
+}
+
+TEST(OptimizerKeepsInstructionsThatFail)
+{
+	// Each fails the same way with or without the optimizer, even though it would be deleted if it didn't.
+	for (std::string_view source : {
+		"\tldi a, Undefined\n\tldi a, 2\n\thalt\n",
+		"\tldi a, 300\n\tldi a, 2\n\thalt\n",
+		"\tldi a, \"x\"\n\tldi a, 2\n\thalt\n",
+		"\tldi a, 1 / 0\n\tldi a, 2\n\thalt\n",
+		"\thalt\n\tldi a, Undefined\n",
+	})
+	{
+		AssemblerOutput output = Assembler::Assemble(source);
+		AssemblerOutput optimizedOutput = AssembleOptimized(source);
+		CHECK(!output);
+		CHECK(optimizedOutput.returnCode == output.returnCode);
+		CHECK(optimizedOutput.lineNumber == output.lineNumber);
+	}
+}
+
+TEST(OptimizerDeletesDeadLoads)
+{
+	AssemblerOutput output = AssembleOptimized(".define One, 1\n\tldi a, One\n\tldi a, 2\n\thalt\n");
+	CHECK(output);
+	CHECK(output.passStats[AssemblerPass_DeadLoads].instructions == 1);
+
+	// A label further on can't be evaluated yet, so its load is kept, and still resolved.
+	output = AssembleOptimized("\tldi a, Later\n\tldi a, 2\n\thalt\nLater:\n");
+	CHECK(output);
+	CHECK(output.passStats[AssemblerPass_DeadLoads].instructions == 0);
+}
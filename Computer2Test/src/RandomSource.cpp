@@ -0,0 +1,228 @@
+#include "RandomSource.h"
+#include <array>
+#include <string_view>
+
+static constexpr std::array<std::string_view, 7> Registers = { "a", "b", "c", "d", "e", "h", "l" };
+static constexpr std::array<std::string_view, 3> AddressRegisters = { "bc", "de", "hl" };
+static constexpr std::array<std::string_view, 10> Conditions = { "z", "c", "o", "p", "s", "nz", "nc", "no", "np", "ns" };
+static constexpr std::array<std::string_view, 8> Arithmetic = { "add", "adc", "sub", "sbc", "and", "xor", "or", "cmp" };
+static constexpr size_t DefineCount = 4;
+
+class RandomSourceGenerator
+{
+public:
+	RandomSourceGenerator(std::mt19937& random, const RandomSourceOptions& options)
+		: random(random), options(options), labelCount(options.lineCount / 8 + 1) {}
+
+	std::string Generate()
+	{
+		for (size_t i = 0; i < DefineCount; i++)
+		{
+			// Later defines may use earlier ones, and stay small enough that twice any of them fits in a byte.
+			std::string value = std::to_string(Pick(25));
+			if (i != 0 && Chance(50))
+				value = GetDefine(Pick(i)) + " + " + value;
+			AddLine(".define " + GetDefine(i) + ", " + value);
+		}
+		AddLine(".define " + options.prefix + "Text, \"text\"");
+
+		if (options.useMacros)
+		{
+			AddLine("\t.macro " + options.prefix + "Load, $register, $value");
+			AddLine("\t\tldi $register, $value");
+			AddLine("\t\tcmp $register");
+			AddLine("\t.endmacro");
+		}
+
+		// Labels are spread evenly over the sections, and every one is defined outside of .if blocks.
+		uint32_t section = 0;
+		size_t nextLabel = 0;
+		size_t linesPerSection = options.lineCount / options.sectionCount + 1;
+		for (size_t line = 0; line < options.lineCount; line++)
+		{
+			if (line % linesPerSection == 0)
+			{
+				AddLine(".origin " + std::to_string(options.firstOrigin + 0x4000 * section));
+				section++;
+			}
+
+			if (nextLabel < labelCount && Pick(options.lineCount) < labelCount)
+			{
+				constexpr std::string_view Visibilities[] = { "", "protected ", "public " };
+				AddLine(std::string(Visibilities[Pick(3)]) + GetLabel(nextLabel++) + ":");
+				continue;
+			}
+
+			if (options.errorPercent != 0 && Pick(100) < options.errorPercent)
+			{
+				AddError();
+				continue;
+			}
+
+			if (Chance(5))
+			{
+				AddConditional();
+				continue;
+			}
+			AddStatement();
+		}
+
+		// Whatever labels weren't placed yet go at the end.
+		for (; nextLabel < labelCount; nextLabel++)
+			AddLine(GetLabel(nextLabel) + ":");
+		return std::move(source);
+	}
+private:
+	size_t Pick(size_t count) { return std::uniform_int_distribution<size_t>(0, count - 1)(random); }
+	bool Chance(uint32_t percent) { return Pick(100) < percent; }
+
+	template<size_t Count>
+	std::string_view Pick(const std::array<std::string_view, Count>& values) { return values[Pick(Count)]; }
+
+	std::string GetLabel(size_t index) const { return options.prefix + std::to_string(index); }
+	std::string GetDefine(size_t index) const { return options.prefix + "Value" + std::to_string(index); }
+
+	void AddLine(std::string_view line)
+	{
+		source += line;
+		if (Chance(10))
+			source += " ; comment, with \"quotes\"";
+		source += Chance(10) ? "\r\n" : "\n";
+		if (Chance(5))
+			source += "\n";
+	}
+
+	std::string GetByte()
+	{
+		switch (Pick(4))
+		{
+			case 0:
+				return std::to_string(Pick(256));
+			case 1:
+				return GetDefine(Pick(DefineCount));
+			case 2:
+				return GetDefine(Pick(DefineCount)) + " * 2 - " + std::to_string(Pick(10));
+			default:
+				return "0x" + std::to_string(Pick(10)) + "f";
+		}
+	}
+
+	std::string GetWord()
+	{
+		switch (Pick(3))
+		{
+			case 0:
+				return std::to_string(Pick(0x10000));
+			case 1:
+				return GetLabel(Pick(labelCount));
+			default:
+				return GetLabel(Pick(labelCount)) + " + " + GetDefine(Pick(DefineCount));
+		}
+	}
+
+	void AddStatement()
+	{
+		std::string line = "\t";
+		switch (Pick(options.useMacros ? 15 : 14))
+		{
+			case 0:
+				line += Chance(50) ? "nop" : (Chance(50) ? "cpl" : "neg");
+				break;
+			case 1:
+			case 2:
+				line += "ldi " + std::string(Pick(Registers)) + ", " + GetByte();
+				break;
+			case 3:
+				line += "mvr " + std::string(Pick(Registers)) + ", " + std::string(Pick(Registers));
+				break;
+			case 4:
+				line += std::string(Pick(Arithmetic)) + " " + (Chance(50) ? std::string(Pick(Registers)) : GetByte());
+				break;
+			case 5:
+			case 6:
+			{
+				constexpr std::string_view Branches[] = { "jmp ", "call ", "ret " };
+				line += std::string(Branches[Pick(3)]) + (Chance(50) ? std::string(Pick(Conditions)) + ", " : "") + GetWord();
+				break;
+			}
+			case 7:
+				line += std::string(Chance(50) ? "sto " : "rcl ") + "[" + GetWord() + "], " + std::string(Pick(Registers));
+				break;
+			case 8:
+				line += std::string(Chance(50) ? "sto " : "rcl ") + "[" + std::string(Pick(AddressRegisters)) + "], " + std::string(Pick(Registers));
+				break;
+			case 9:
+			case 10:
+			{
+				line += ".byte " + GetByte();
+				for (size_t i = Pick(4); i > 0; i--)
+					line += ", " + GetByte();
+				break;
+			}
+			case 11:
+				line += ".byte \"a, b: \\\"c\\\"\", " + options.prefix + "Text \" and more\", " + GetByte();
+				break;
+			case 12:
+			{
+				line += ".word " + GetWord();
+				for (size_t i = Pick(3); i > 0; i--)
+					line += ", " + GetWord();
+				break;
+			}
+			case 13:
+				line += "halt";
+				break;
+			default:
+				line += options.prefix + "Load " + std::string(Pick(Registers)) + ", " + GetByte();
+				break;
+		}
+		AddLine(line);
+	}
+
+	void AddConditional()
+	{
+		AddLine(".if " + GetDefine(Pick(DefineCount)) + " > " + std::to_string(Pick(60)));
+		for (size_t i = Pick(3) + 1; i > 0; i--)
+			AddStatement();
+		if (Chance(50))
+		{
+			AddLine(".elif " + GetDefine(Pick(DefineCount)) + " & 1");
+			AddStatement();
+		}
+		if (Chance(50))
+		{
+			AddLine(".else");
+			AddStatement();
+		}
+		AddLine(".endif");
+	}
+
+	void AddError()
+	{
+		switch (Pick(4))
+		{
+			case 0:
+				AddLine("\tldi a, " + options.prefix + "Missing");
+				break;
+			case 1:
+				AddLine("\t.byte 300");
+				break;
+			case 2:
+				AddLine("\tbogus a, b");
+				break;
+			default:
+				AddLine("\t.word " + GetLabel(Pick(labelCount)) + " / 0");
+				break;
+		}
+	}
+private:
+	std::mt19937& random;
+	const RandomSourceOptions& options;
+	size_t labelCount = 0;
+	std::string source;
+};
+
+std::string RandomSource::Generate(std::mt19937& random, const RandomSourceOptions& options)
+{
+	return RandomSourceGenerator(random, options).Generate();
+}
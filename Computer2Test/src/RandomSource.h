@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+
+struct RandomSourceOptions
+{
+	size_t lineCount = 100;
+	// Whether to use .macro, which CompileTimeAssembler doesn't have.
+	bool useMacros = true;
+	// How likely each line is to fail to assemble, like a use of a symbol that is never defined, in percent.
+	uint32_t errorPercent = 0;
+	// What the names of labels and defines start with, so that sources can be put together without conflicts.
+	std::string prefix = "Random";
+	// Sections are at multiples of 0x4000 from the first one, and only the first sectionCount are used.
+	uint16_t firstOrigin = 0;
+	uint32_t sectionCount = 4;
+};
+
+// Generates sources for tests that assemble the same program in two ways and compare what they get.
+// Sources use labels before and after they're defined, numeric and string defines, .if blocks, strings,
+// every kind of instruction operand, and several sections, which never overlap. Without errors, they assemble.
+class RandomSource
+{
+public:
+	static std::string Generate(std::mt19937& random, const RandomSourceOptions& options = {});
+private:
+	RandomSource() = delete;
+	RandomSource(const RandomSource&) = delete;
+	RandomSource(RandomSource&&) = delete;
+	RandomSource& operator=(const RandomSource&) = delete;
+	RandomSource& operator=(RandomSource&&) = delete;
+	~RandomSource() = delete;
+};
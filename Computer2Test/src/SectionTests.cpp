@@ -0,0 +1,35 @@
+#include "Test.h"
+#include "Computer/Assembler.h"
+#include "Computer/CompileTimeAssembler.h"
+#include <vector>
+
+TEST(OverlappingSectionsFailEverywhere)
+{
+	std::string_view source = ".origin 4\n\t.byte 1, 2\n.origin 0\n\t.byte 3, 4, 5, 6\n\t.byte 7\n";
+
+	AssemblerOutput output = Assembler::Assemble(source);
+	CHECK(output.returnCode == AssemblerReturnCode_OverlappingSections);
+	CHECK(output.lineNumber == 5);
+
+	std::vector<uint8_t> memory(AssemblerImage::Size);
+	AssemblerImage image(std::span<uint8_t, AssemblerImage::Size>(memory.data(), memory.size()));
+	output = Assembler::AssembleImage(source, image);
+	CHECK(output.returnCode == AssemblerReturnCode_OverlappingSections);
+	CHECK(output.lineNumber == 5);
+
+	CompileTimeAssemblerOutput<16> compileTimeOutput = CompileTimeAssembler::Assemble<16>(source);
+	CHECK(compileTimeOutput.returnCode == AssemblerReturnCode_OverlappingSections);
+	CHECK(compileTimeOutput.lineNumber == 5);
+
+	AssemblerSession session;
+	CHECK(session.Assemble(source).returnCode == AssemblerReturnCode_OverlappingSections);
+}
+
+TEST(AdjacentSectionsDontOverlap)
+{
+	std::string_view source = ".origin 4\n\t.byte 1, 2\n.origin 0\n\t.byte 3, 4, 5, 6\n.origin 6\n\t.byte 7\n";
+	AssemblerOutput output = Assembler::Assemble(source);
+	CHECK(output);
+	CHECK(output.sections.size() == 3);
+	CHECK(CompileTimeAssembler::Assemble<16>(source));
+}
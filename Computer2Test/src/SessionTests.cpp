@@ -0,0 +1,184 @@
+#include "Test.h"
+#include "RandomSource.h"
+#include "Computer/Assembler.h"
+#include <algorithm>
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+
+static constexpr std::array<std::string_view, 7> Registers = { "a", "b", "c", "d", "e", "h", "l" };
+static constexpr std::array<std::string_view, 3> Visibilities = { "", "protected ", "public " };
+
+static std::string JoinLines(const std::vector<std::string>& lines)
+{
+	std::string source;
+	for (const std::string& line : lines)
+		source += line + "\n";
+	return source;
+}
+
+// Labels at the same address may be listed in any order.
+static void CheckSameSymbols(std::vector<AssemblerSymbol> symbols, std::vector<AssemblerSymbol> expectedSymbols)
+{
+	auto isBefore = [](const AssemblerSymbol& a, const AssemblerSymbol& b) { return a.address != b.address ? a.address < b.address : a.name < b.name; };
+	std::ranges::sort(symbols, isBefore);
+	std::ranges::sort(expectedSymbols, isBefore);
+	CHECK(symbols.size() == expectedSymbols.size());
+	for (size_t i = 0; i < std::min(symbols.size(), expectedSymbols.size()); i++)
+		CHECK(symbols[i].name == expectedSymbols[i].name && symbols[i].address == expectedSymbols[i].address);
+}
+
+// Edits line the way someone typing would, mostly into a line of the same kind, which a session patches without
+// assembling everything again. Names may end up undefined or defined twice, which has to fail the same way.
+static std::string EditLine(std::string_view line, std::mt19937& random)
+{
+	auto pick = [&](size_t count) { return std::uniform_int_distribution<size_t>(0, count - 1)(random); };
+	auto getByte = [&]() { return pick(2) == 0 ? std::to_string(pick(256)) : "RandomValue" + std::to_string(pick(4)); };
+	auto getLabel = [&]() { return "Random" + std::to_string(pick(12)); };
+
+	line = line.substr(0, std::min(line.find(" ;"), line.size()));
+	size_t operandCount = static_cast<size_t>(std::ranges::count(line, ',')) + 1;
+	if (line.empty())
+		return std::string(Visibilities[pick(3)]) + (pick(2) == 0 ? getLabel() : "Unused" + std::to_string(pick(4))) + ":";
+	if (line.ends_with(':'))
+	{
+		// Labels of the source can be used wherever it is, whatever their visibility.
+		std::string_view name = line.substr(line.rfind(' ') + 1);
+		switch (pick(4))
+		{
+			case 0:
+				return "";
+			case 1:
+				return std::string(Visibilities[pick(3)]) + getLabel() + ":";
+			default:
+				return std::string(Visibilities[pick(3)]) + std::string(name);
+		}
+	}
+	if (line.starts_with(".define RandomValue"))
+		return ".define RandomValue" + std::to_string(pick(4)) + ", " + std::to_string(pick(25));
+	if (line.starts_with("\tldi "))
+		return "\tldi " + std::string(Registers[pick(Registers.size())]) + ", " + getByte();
+	if (line == "\tnop" || line == "\tcpl" || line == "\tneg")
+		return pick(2) == 0 ? "\tcpl" : "\tneg";
+	if (line.starts_with("\tjmp ") || line.starts_with("\tcall ") || line.starts_with("\tret "))
+		return std::string(line.substr(0, line.find(' ') + 1)) + (operandCount == 2 ? "nz, " : "") + getLabel();
+	if (line.starts_with("\t.byte ") && line.find('"') == std::string_view::npos)
+	{
+		std::string newLine = "\t.byte " + getByte();
+		for (size_t i = 1; i < operandCount; i++)
+			newLine += ", " + getByte();
+		return newLine;
+	}
+	if (line.starts_with("\t.word "))
+	{
+		std::string newLine = "\t.word " + getLabel();
+		for (size_t i = 1; i < operandCount; i++)
+			newLine += ", " + getLabel() + " + " + std::to_string(pick(3));
+		return newLine;
+	}
+	return pick(2) == 0 ? "\thalt" : "\tldi a, " + getByte();
+}
+
+// Makes a random edit to lines, and applies it to session too. Returns the output of the session.
+static const AssemblerOutput& EditSession(AssemblerSession& session, std::vector<std::string>& lines, std::mt19937& random,
+	std::vector<AssemblerPatch>& patches)
+{
+	auto pick = [&](size_t count) { return std::uniform_int_distribution<size_t>(0, count - 1)(random); };
+	size_t index = pick(lines.size());
+	switch (pick(10))
+	{
+		case 0:
+		{
+			// Lines that are inserted or removed move everything after them.
+			if (pick(2) == 0)
+			{
+				lines.erase(lines.begin() + static_cast<ptrdiff_t>(index));
+				return session.Edit(index + 1, 1, "", patches);
+			}
+			lines.insert(lines.begin() + static_cast<ptrdiff_t>(index), "\tnop");
+			return session.Edit(index + 1, 0, "\tnop\n", patches);
+		}
+		case 1:
+		{
+			// Moves a label to another line, as one edit of every line from one to the other.
+			size_t otherIndex = pick(lines.size());
+			std::swap(lines[index], lines[otherIndex]);
+			size_t first = std::min(index, otherIndex);
+			size_t last = std::max(index, otherIndex);
+			std::vector<std::string> editedLines(lines.begin() + static_cast<ptrdiff_t>(first), lines.begin() + static_cast<ptrdiff_t>(last + 1));
+			return session.Edit(first + 1, last + 1 - first, JoinLines(editedLines), patches);
+		}
+		default:
+			lines[index] = EditLine(lines[index], random);
+			return session.Edit(index + 1, 1, lines[index] + "\n", patches);
+	}
+}
+
+// Checks that the patches turned memory into the program that assembling lines from scratch gets.
+static void CheckSession(const AssemblerOutput& output, const std::vector<std::string>& lines, std::vector<uint8_t>& memory,
+	const std::vector<AssemblerPatch>& patches)
+{
+	for (const AssemblerPatch& patch : patches)
+		std::ranges::copy(patch.bytes, memory.begin() + patch.address);
+
+	std::vector<uint8_t> expectedMemory(AssemblerImage::Size);
+	AssemblerImage image(std::span<uint8_t, AssemblerImage::Size>(expectedMemory.data(), expectedMemory.size()));
+	std::string source = JoinLines(lines);
+	AssemblerOutput expected = Assembler::AssembleImage(source, image);
+	CHECK(output.returnCode == expected.returnCode);
+	CHECK(output.lineNumber == expected.lineNumber);
+	if (!expected)
+	{
+		CHECK(patches.empty());
+		return;
+	}
+
+	CHECK(memory == expectedMemory);
+	CheckSameSymbols(output.symbols, Assembler::Assemble(source).symbols);
+}
+
+TEST(SessionPatchesMatchAssemblingEverything)
+{
+	std::mt19937 random(13);
+	for (size_t program = 0; program < 20; program++)
+	{
+		RandomSourceOptions options;
+		options.lineCount = 80;
+		std::string source = RandomSource::Generate(random, options);
+		std::ranges::replace(source, '\r', ' ');
+
+		std::vector<std::string> lines;
+		for (size_t start = 0; start < source.size();)
+		{
+			size_t end = source.find('\n', start);
+			lines.emplace_back(source.substr(start, end - start));
+			start = end + 1;
+		}
+
+		AssemblerSession session;
+		CHECK(session.Assemble(JoinLines(lines)));
+
+		// The program the patches are applied to, which is the last one that assembled.
+		std::vector<uint8_t> memory(AssemblerImage::Size);
+		for (const AssemblerProgramSection& section : session.GetOutput().sections)
+			std::ranges::copy(section.assembly, memory.begin() + section.origin);
+
+		std::vector<AssemblerPatch> patches;
+		for (size_t edit = 0; edit < 100; edit++)
+		{
+			std::vector<std::string> previousLines = lines;
+			patches.clear();
+			const AssemblerOutput& output = EditSession(session, lines, random, patches);
+			CHECK(session.GetLineCount() == lines.size());
+			CheckSession(output, lines, memory, patches);
+			if (output)
+				continue;
+
+			// Edits that fail are undone, so that most edits are made to a program that assembles.
+			lines = std::move(previousLines);
+			patches.clear();
+			CheckSession(session.Edit(1, session.GetLineCount(), JoinLines(lines), patches), lines, memory, patches);
+		}
+	}
+}
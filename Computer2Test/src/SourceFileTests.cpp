@@ -0,0 +1,46 @@
+#include "Test.h"
+#include "Computer/Assembler.h"
+#include "Computer/SourceFile.h"
+
+TEST(SourceFileReadsRegularFiles)
+{
+	TemporaryDirectory directory;
+	SourceFile file(directory.Write("a.asm", "\thalt\n"));
+	CHECK(file);
+	CHECK(file.GetSource() == "\thalt\n");
+
+	SourceFile emptyFile(directory.Write("empty.asm", ""));
+	CHECK(emptyFile);
+	CHECK(emptyFile.GetSource().empty());
+}
+
+TEST(SourceFileCanBeReadInsteadOfMapped)
+{
+	TemporaryDirectory directory;
+	std::filesystem::path path = directory.Write("a.asm", "\thalt\n");
+	SourceFile mappedFile(path);
+	CHECK(mappedFile.IsMapped());
+
+	SourceFile file(path, false);
+	CHECK(file);
+	CHECK(!file.IsMapped());
+	CHECK(file.GetSource() == "\thalt\n");
+}
+
+TEST(SourceFileRejectsDirectories)
+{
+	TemporaryDirectory directory;
+	SourceFile file(directory.GetPath());
+	CHECK(!file);
+	CHECK(!SourceFile(directory.GetPath() / "missing.asm"));
+}
+
+TEST(IncludingADirectoryFails)
+{
+	TemporaryDirectory directory;
+	std::filesystem::create_directories(directory.GetPath() / "lib");
+	std::filesystem::path source = directory.Write("main.asm", ".include \"lib\"\n\thalt\n");
+	AssemblerOutput output = Assembler::Assemble("\t.include \"lib\"\n\thalt\n", source);
+	CHECK(output.returnCode == AssemblerReturnCode_IncludeNotFound);
+	CHECK(output.lineNumber == 1);
+}
@@ -0,0 +1,76 @@
+#include "Test.h"
+#include "RandomSource.h"
+#include "Computer/Assembler.h"
+#include <algorithm>
+#include <vector>
+
+static void CheckSameSections(std::span<const AssemblerProgramSection> sections, std::span<const AssemblerProgramSection> expectedSections)
+{
+	CHECK(sections.size() == expectedSections.size());
+	for (size_t i = 0; i < std::min(sections.size(), expectedSections.size()); i++)
+	{
+		CHECK(sections[i].origin == expectedSections[i].origin);
+		CHECK(sections[i].assembly == expectedSections[i].assembly);
+	}
+}
+
+// Feeds source to stream in chunks of random sizes, including ones that split CRLFs and string literals.
+static AssemblerOutput FeedInChunks(AssemblerStream& stream, std::string_view source, std::mt19937& random)
+{
+	std::uniform_int_distribution<size_t> chunkSize(1, 64);
+	for (size_t i = 0; i < source.size();)
+	{
+		size_t size = std::min(chunkSize(random), source.size() - i);
+		if (!stream.Feed(source.substr(i, size)))
+			break;
+		i += size;
+	}
+	return stream.Finish();
+}
+
+TEST(StreamMatchesAssemble)
+{
+	std::mt19937 random(7);
+	for (size_t program = 0; program < 200; program++)
+	{
+		RandomSourceOptions options;
+		options.errorPercent = program % 4 == 0 ? 1 : 0;
+		std::string source = RandomSource::Generate(random, options);
+		AssemblerOutput expected = Assembler::Assemble(source);
+
+		AssemblerStream stream;
+		AssemblerOutput output = FeedInChunks(stream, source, random);
+		CHECK(output.returnCode == expected.returnCode);
+		CHECK(output.lineNumber == expected.lineNumber);
+		if (!output || !expected)
+			continue;
+
+		CheckSameSections(output.sections, expected.sections);
+		CHECK(output.symbols.size() == expected.symbols.size());
+		for (size_t i = 0; i < std::min(output.symbols.size(), expected.symbols.size()); i++)
+			CHECK(output.symbols[i].name == expected.symbols[i].name && output.symbols[i].address == expected.symbols[i].address);
+	}
+}
+
+TEST(StreamSinkGetsEverySection)
+{
+	std::mt19937 random(17);
+	for (size_t program = 0; program < 50; program++)
+	{
+		std::string source = RandomSource::Generate(random);
+		AssemblerOutput expected = Assembler::Assemble(source);
+		CHECK(expected);
+
+		// Sections arrive once they're complete, which isn't necessarily in the order of the source.
+		std::vector<AssemblerProgramSection> sections;
+		AssemblerStream stream([&](AssemblerProgramSection&& section) { sections.push_back(std::move(section)); });
+		AssemblerOutput output = FeedInChunks(stream, source, random);
+		CHECK(output);
+		CHECK(output.sections.empty());
+
+		std::ranges::sort(sections, {}, &AssemblerProgramSection::origin);
+		std::vector<AssemblerProgramSection> expectedSections = std::move(expected.sections);
+		std::ranges::sort(expectedSections, {}, &AssemblerProgramSection::origin);
+		CheckSameSections(sections, expectedSections);
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string_view>
+
+// A test, which reports its failures through CHECK(), see main.cpp.
+struct Test
+{
+	std::string_view name;
+	void (*function)() = nullptr;
+};
+
+class Tests
+{
+public:
+	// Adds test to the ones main() runs. Returns true, so it can initialize a static.
+	static bool Register(std::string_view name, void (*function)());
+	// Runs every test whose name contains filter, and returns how many failed.
+	static size_t RunAll(std::string_view filter);
+
+	// Records a failed check of the test being run.
+	static void Fail(const char* expression, const char* file, int line);
+private:
+	Tests() = delete;
+	Tests(const Tests&) = delete;
+	Tests(Tests&&) = delete;
+	Tests& operator=(const Tests&) = delete;
+	Tests& operator=(Tests&&) = delete;
+	~Tests() = delete;
+};
+
+#define TEST(name) \
+	static void name##Test(); \
+	static const bool name##TestIsRegistered = Tests::Register(#name, name##Test); \
+	static void name##Test()
+
+// Records a failure, and carries on with the rest of the test, so one run shows every failure.
+#define CHECK(expression) \
+	do { if (!(expression)) Tests::Fail(#expression, __FILE__, __LINE__); } while (false)
+
+// A directory of its own in the temporary directory, removed with everything in it when this is destroyed.
+class TemporaryDirectory
+{
+public:
+	TemporaryDirectory();
+	~TemporaryDirectory();
+
+	// Writes contents to name in the directory, creating its parent directories, and returns its path.
+	std::filesystem::path Write(const std::filesystem::path& name, std::string_view contents) const;
+	const std::filesystem::path& GetPath() const noexcept { return path; }
+private:
+	TemporaryDirectory(const TemporaryDirectory&) = delete;
+	TemporaryDirectory& operator=(const TemporaryDirectory&) = delete;
+private:
+	std::filesystem::path path;
+};
@@ -0,0 +1,85 @@
+// Tests the assembler and the tools around it:
+//   Computer2Test [filter]
+// Only the tests whose names contain filter are run. Returns 1 if any check failed.
+
+#include "Test.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+static std::vector<Test>& GetTests()
+{
+	static std::vector<Test> tests;
+	return tests;
+}
+
+static size_t failedCheckCount = 0;
+
+bool Tests::Register(std::string_view name, void (*function)())
+{
+	GetTests().push_back({ name, function });
+	return true;
+}
+
+size_t Tests::RunAll(std::string_view filter)
+{
+	// Registration order depends on link order, so they're run by name instead.
+	std::vector<Test>& tests = GetTests();
+	std::ranges::sort(tests, {}, &Test::name);
+
+	size_t runCount = 0;
+	size_t failedCount = 0;
+	for (const Test& test : tests)
+	{
+		if (test.name.find(filter) == std::string_view::npos)
+			continue;
+
+		size_t failedChecksBefore = failedCheckCount;
+		test.function();
+		bool isFailed = failedCheckCount != failedChecksBefore;
+		std::printf("%s %.*s\n", isFailed ? "FAIL" : "ok  ", static_cast<int>(test.name.size()), test.name.data());
+		runCount++;
+		failedCount += isFailed ? 1 : 0;
+	}
+
+	std::printf("%zu tests, %zu failed\n", runCount, failedCount);
+	return failedCount;
+}
+
+void Tests::Fail(const char* expression, const char* file, int line)
+{
+	std::printf("  %s:%d: CHECK(%s) failed\n", file, line, expression);
+	failedCheckCount++;
+}
+
+TemporaryDirectory::TemporaryDirectory()
+{
+	// Tests may run in several processes at once, so the name includes the time as well as a counter.
+	static std::atomic<uint32_t> count = 0;
+	uint64_t time = static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+	path = std::filesystem::temp_directory_path() / ("Computer2Test-" + std::to_string(time) + "-" + std::to_string(count++));
+	std::filesystem::create_directories(path);
+}
+
+TemporaryDirectory::~TemporaryDirectory()
+{
+	std::error_code error;
+	std::filesystem::remove_all(path, error);
+}
+
+std::filesystem::path TemporaryDirectory::Write(const std::filesystem::path& name, std::string_view contents) const
+{
+	std::filesystem::path filePath = path / name;
+	std::filesystem::create_directories(filePath.parent_path());
+	std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+	file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+	return filePath;
+}
+
+int main(int argc, char** argv)
+{
+	return Tests::RunAll(argc > 1 ? argv[1] : "") != 0 ? 1 : 0;
+}
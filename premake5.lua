@@ -43,3 +43,6 @@ group ""
 
 -- Add any projects here with 'include "__PROJECT_NAME__"'
 include "Computer2"
+include "Computer2Asm"
+include "Computer2Bench"
+include "Computer2Test"